@@ -0,0 +1,176 @@
+// 任务系统的微基准：和最简单的线程池（一个加锁的共享队列）对比
+// 1. 细粒度的并行循环：100万个元素，每段1024个
+// 2. 大量很小的独立任务：10万个任务
+// 3. 有依赖的任务链：256条三个阶段的链，每条链的耗时不同；
+//    线程池没有依赖，只能每个阶段结束后等待所有任务，任务系统的每条链各自推进
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "JobSystem.h"
+
+using std::vector;
+
+// 最简单的线程池：所有线程从一个加锁的队列中取任务，用计数器等待一批任务完成
+class NaiveThreadPool {
+public:
+    explicit NaiveThreadPool(unsigned int workerCount) {
+        for (unsigned int i = 0; i < workerCount; i++)
+            this->threads.emplace_back([this]() { this->workerLoop(); });
+    }
+
+    ~NaiveThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->running = false;
+        }
+        this->wakeUp.notify_all();
+        for (std::thread& thread : this->threads)
+            thread.join();
+    }
+
+    void submit(std::function<void()> func) {
+        this->pending.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->jobs.push_back(std::move(func));
+        }
+        this->wakeUp.notify_one();
+    }
+
+    // 等待所有提交的任务完成
+    void waitAll() {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->done.wait(lock, [this]() { return this->pending == 0; });
+    }
+
+private:
+    vector<std::thread> threads;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable done;
+    std::atomic<int> pending{ 0 };
+    bool running = true;
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> func;
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->wakeUp.wait(lock, [this]() { return !this->jobs.empty() || !this->running; });
+                if (!this->running && this->jobs.empty())
+                    return;
+                func = std::move(this->jobs.front());
+                this->jobs.pop_front();
+            }
+            func();
+            if (this->pending.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->done.notify_all();
+            }
+        }
+    }
+};
+
+// 每种实现重复的次数，取最快的一次
+const int REPEAT = 10;
+
+static double measure(const std::function<void()>& func) {
+    double best = 1e30;
+    for (int r = 0; r < REPEAT; r++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        func();
+        auto end = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+// 模拟一段计算，iterations越大耗时越长
+static float work(size_t seed, int iterations) {
+    float value = (float)seed;
+    for (int i = 0; i < iterations; i++)
+        value = std::sqrt(value * 1.0001f + 1.0f);
+    return value;
+}
+
+int main() {
+    JobSystem& jobs = JobSystem::instance();
+    // 线程池的线程数和任务系统相同，再加上提交任务的线程
+    NaiveThreadPool pool(jobs.getWorkerCount());
+    printf("workers: %u (+ caller)\n", jobs.getWorkerCount());
+
+    // 1. 细粒度的并行循环
+    const size_t LOOP_COUNT = 1000000;
+    const size_t GRAIN = 1024;
+    vector<float> loopOutput(LOOP_COUNT);
+    auto loopBody = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            loopOutput[i] = work(i, 8);
+        };
+    double loopSerial = measure([&]() { loopBody(0, LOOP_COUNT); });
+    double loopPool = measure([&]() {
+        for (size_t begin = 0; begin < LOOP_COUNT; begin += GRAIN) {
+            size_t end = std::min(LOOP_COUNT, begin + GRAIN);
+            pool.submit([&, begin, end]() { loopBody(begin, end); });
+        }
+        pool.waitAll();
+        });
+    double loopJobs = measure([&]() { jobs.parallelFor(LOOP_COUNT, GRAIN, loopBody); });
+    printf("parallel for   serial %8.2f ms  pool %8.2f ms  jobs %8.2f ms\n", loopSerial, loopPool, loopJobs);
+
+    // 2. 大量很小的独立任务
+    const size_t TASK_COUNT = 100000;
+    vector<float> taskOutput(TASK_COUNT);
+    double tasksPool = measure([&]() {
+        for (size_t i = 0; i < TASK_COUNT; i++)
+            pool.submit([&, i]() { taskOutput[i] = work(i, 64); });
+        pool.waitAll();
+        });
+    double tasksJobs = measure([&]() {
+        vector<JobSystem::JobHandle> handles;
+        handles.reserve(TASK_COUNT);
+        for (size_t i = 0; i < TASK_COUNT; i++)
+            handles.push_back(jobs.schedule([&, i]() { taskOutput[i] = work(i, 64); }));
+        for (const JobSystem::JobHandle& handle : handles)
+            jobs.wait(handle);
+        });
+    printf("small tasks    pool %8.2f ms  jobs %8.2f ms\n", tasksPool, tasksJobs);
+
+    // 3. 有依赖的任务链，第i条链每个阶段的耗时按i错开，各阶段之间不平衡
+    const size_t CHAIN_COUNT = 256;
+    const int STAGES = 3;
+    vector<float> chainOutput(CHAIN_COUNT);
+    auto stageCost = [](size_t chain, int stage) { return 2000 + (int)((chain * 7919 + stage * 104729) % 64) * 500; };
+    double chainsPool = measure([&]() {
+        for (int stage = 0; stage < STAGES; stage++) {
+            for (size_t c = 0; c < CHAIN_COUNT; c++)
+                pool.submit([&, c, stage]() { chainOutput[c] = work((size_t)chainOutput[c] + c, stageCost(c, stage)); });
+            pool.waitAll();
+        }
+        });
+    double chainsJobs = measure([&]() {
+        vector<JobSystem::JobHandle> tails;
+        for (size_t c = 0; c < CHAIN_COUNT; c++) {
+            JobSystem::JobHandle previous;
+            for (int stage = 0; stage < STAGES; stage++) {
+                auto func = [&, c, stage]() { chainOutput[c] = work((size_t)chainOutput[c] + c, stageCost(c, stage)); };
+                previous = previous ? jobs.schedule(func, { previous }) : jobs.schedule(func);
+            }
+            tails.push_back(previous);
+        }
+        for (const JobSystem::JobHandle& tail : tails)
+            jobs.wait(tail);
+        });
+    printf("dependent jobs pool %8.2f ms  jobs %8.2f ms\n", chainsPool, chainsJobs);
+    return 0;
+}
@@ -0,0 +1,203 @@
+// 光照贴图后处理的微基准：1024 x 1024的光照贴图，由若干个矩形和三角形的图块组成，图块之间是无效纹素
+// 1. 接缝填充：原来的32遍单纹素扩张（和lmImageDilate相同的算法）、标量跳跃泛洪、SIMD + 多线程跳跃泛洪
+// 2. 平滑：原来的3x3逐纹素滤波（和lmImageSmooth相同的算法）、标量可分离滤波、SIMD + 多线程可分离滤波
+// 3. 求幂：std::pow逐元素、SIMD + 多线程的多项式近似
+// 4. 去噪：4次迭代的à-trous滤波，标量实现和SIMD + 多线程实现
+// 每项同时输出和参考结果的最大误差
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include "JobSystem.h"
+#include "LightmapImage.h"
+
+using std::vector;
+
+const int WIDTH = 1024;
+const int HEIGHT = 1024;
+// 每种实现重复的次数，取最快的一次
+const int REPEAT = 5;
+
+// 每次计算之前调用prepare恢复输入，prepare的时间不计入
+static double measure(const std::function<void()>& prepare, const std::function<void()>& func) {
+    double best = 1e30;
+    for (int r = 0; r < REPEAT; r++) {
+        prepare();
+        auto start = std::chrono::high_resolution_clock::now();
+        func();
+        auto end = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+static bool isValid(const float* texel) {
+    return texel[0] > 0.0f || texel[1] > 0.0f || texel[2] > 0.0f || texel[3] > 0.0f;
+}
+
+// 和lmImageDilate相同：无效纹素取上下左右有效纹素的平均
+static void referenceDilate(const float* image, float* out, int w, int h) {
+    const int dx[] = { -1, 0, 1, 0 };
+    const int dy[] = { 0, 1, 0, -1 };
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            const float* texel = image + (y * w + x) * 4;
+            float color[4] = { texel[0], texel[1], texel[2], texel[3] };
+            if (!isValid(texel)) {
+                int n = 0;
+                for (int d = 0; d < 4; d++) {
+                    int cx = x + dx[d], cy = y + dy[d];
+                    if (cx < 0 || cx >= w || cy < 0 || cy >= h || !isValid(image + (cy * w + cx) * 4))
+                        continue;
+                    for (int i = 0; i < 4; i++)
+                        color[i] += image[(cy * w + cx) * 4 + i];
+                    n++;
+                }
+                if (n)
+                    for (int i = 0; i < 4; i++)
+                        color[i] /= n;
+            }
+            memcpy(out + (y * w + x) * 4, color, sizeof(color));
+        }
+    }
+}
+
+// 和lmImageSmooth相同：3x3邻域内有效纹素的平均
+static void referenceSmooth(const float* image, float* out, int w, int h) {
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            float color[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            int n = 0;
+            for (int cy = std::max(0, y - 1); cy <= std::min(h - 1, y + 1); cy++) {
+                for (int cx = std::max(0, x - 1); cx <= std::min(w - 1, x + 1); cx++) {
+                    const float* texel = image + (cy * w + cx) * 4;
+                    if (!isValid(texel))
+                        continue;
+                    for (int i = 0; i < 4; i++)
+                        color[i] += texel[i];
+                    n++;
+                }
+            }
+            for (int i = 0; i < 4; i++)
+                out[(y * w + x) * 4 + i] = n ? color[i] / n : 0.0f;
+        }
+    }
+}
+
+static void referencePower(float* image, int w, int h, float exponent) {
+    for (size_t i = 0; i < (size_t)w * h * 4; i++)
+        if ((i & 3) != 3)
+            image[i] = std::pow(image[i], exponent);
+}
+
+static float maxDifference(const vector<float>& a, const vector<float>& b) {
+    float difference = 0.0f;
+    for (size_t i = 0; i < a.size(); i++)
+        difference = std::max(difference, std::fabs(a[i] - b[i]));
+    return difference;
+}
+
+static size_t validCount(const vector<float>& image) {
+    size_t count = 0;
+    for (size_t i = 0; i < image.size(); i += 4)
+        count += isValid(&image[i]) ? 1 : 0;
+    return count;
+}
+
+// 模拟展开后的图块：网格中的矩形和直角三角形，图块之间留出2到40个纹素的间隙
+static vector<float> createCharts() {
+    vector<float> image((size_t)WIDTH * HEIGHT * 4, 0.0f);
+    unsigned int state = 12345;
+    auto next = [&state]() { state = state * 1664525u + 1013904223u; return state >> 8; };
+    for (int cy = 0; cy < HEIGHT; cy += 128) {
+        for (int cx = 0; cx < WIDTH; cx += 128) {
+            int w = 40 + (int)(next() % 86), h = 40 + (int)(next() % 86);
+            bool triangle = next() % 2 == 0;
+            float r = 0.05f + (next() % 1000) / 400.0f, g = 0.05f + (next() % 1000) / 400.0f, b = 0.05f + (next() % 1000) / 400.0f;
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    if (triangle && x * h > (h - y) * w)
+                        continue;
+                    float* texel = &image[((size_t)(cy + y) * WIDTH + cx + x) * 4];
+                    // 带一点噪声，平滑才有意义
+                    float noise = 0.8f + (next() % 1000) / 2500.0f;
+                    texel[0] = r * noise;
+                    texel[1] = g * noise;
+                    texel[2] = b * noise;
+                    texel[3] = 1.0f;
+                }
+            }
+        }
+    }
+    return image;
+}
+
+// 和createCharts对应的引导缓冲：每个网格单元是一个图块，位置在z = 0的平面上，纹素边长为1
+static LightmapGuide createGuide(const vector<float>& image) {
+    LightmapGuide guide;
+    guide.reset(WIDTH, HEIGHT);
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            size_t i = (size_t)y * WIDTH + x;
+            if (!isValid(&image[i * 4]))
+                continue;
+            guide.positions[i * 3 + 0] = (float)x;
+            guide.positions[i * 3 + 1] = (float)y;
+            guide.normals[i * 3 + 2] = 1.0f;
+            guide.texelSizes[i] = 1.0f;
+            guide.charts[i] = (y / 128) * (WIDTH / 128) + x / 128;
+        }
+    }
+    return guide;
+}
+
+int main() {
+    JobSystem& jobs = JobSystem::instance();
+    printf("%d x %d, %s, workers: %u (+ caller)\n", WIDTH, HEIGHT, lightmapImageInstructionSet(), jobs.getWorkerCount());
+    const vector<float> charts = createCharts();
+    printf("valid texels: %zu\n", validCount(charts));
+
+    // 1. 接缝填充
+    vector<float> dilated, scalarFilled, filled, temp(charts.size());
+    double dilate = measure([&]() { dilated = charts; }, [&]() {
+        for (int i = 0; i < 16; i++) {
+            referenceDilate(dilated.data(), temp.data(), WIDTH, HEIGHT);
+            referenceDilate(temp.data(), dilated.data(), WIDTH, HEIGHT);
+        }
+        });
+    double fillScalar = measure([&]() { scalarFilled = charts; }, [&]() { lightmapSeamFillScalar(scalarFilled.data(), WIDTH, HEIGHT, 32); });
+    double fill = measure([&]() { filled = charts; }, [&]() { lightmapSeamFill(filled.data(), WIDTH, HEIGHT, 32); });
+    printf("seam fill  dilate x32 %8.2f ms  scalar %8.2f ms  simd+mt %8.2f ms  (valid %zu / %zu / %zu, simd vs scalar %g)\n",
+        dilate, fillScalar, fill, validCount(dilated), validCount(scalarFilled), validCount(filled), maxDifference(filled, scalarFilled));
+
+    // 2. 平滑
+    vector<float> referenceSmoothed(charts.size()), scalarSmoothed(charts.size()), smoothed(charts.size());
+    auto none = []() {};
+    double smoothReference = measure(none, [&]() { referenceSmooth(filled.data(), referenceSmoothed.data(), WIDTH, HEIGHT); });
+    double smoothScalar = measure(none, [&]() { lightmapSmoothScalar(filled.data(), scalarSmoothed.data(), WIDTH, HEIGHT); });
+    double smooth = measure(none, [&]() { lightmapSmooth(filled.data(), smoothed.data(), WIDTH, HEIGHT); });
+    printf("smooth     3x3 texel  %8.2f ms  scalar %8.2f ms  simd+mt %8.2f ms  (max error %g / %g)\n",
+        smoothReference, smoothScalar, smooth, maxDifference(scalarSmoothed, referenceSmoothed), maxDifference(smoothed, referenceSmoothed));
+
+    // 3. 求幂
+    vector<float> referencePowered, scalarPowered, powered;
+    double powerReference = measure([&]() { referencePowered = smoothed; }, [&]() { referencePower(referencePowered.data(), WIDTH, HEIGHT, 1.0f / 2.2f); });
+    double powerScalar = measure([&]() { scalarPowered = smoothed; }, [&]() { lightmapPowerScalar(scalarPowered.data(), WIDTH, HEIGHT, 1.0f / 2.2f); });
+    double power = measure([&]() { powered = smoothed; }, [&]() { lightmapPower(powered.data(), WIDTH, HEIGHT, 1.0f / 2.2f); });
+    printf("power      std::pow   %8.2f ms  scalar %8.2f ms  simd+mt %8.2f ms  (max error %g / %g)\n",
+        powerReference, powerScalar, power, maxDifference(scalarPowered, referencePowered), maxDifference(powered, referencePowered));
+
+    // 4. 去噪
+    const LightmapGuide guide = createGuide(charts);
+    LightmapDenoiseSettings settings;
+    vector<float> scalarDenoised, denoised;
+    double denoiseScalar = measure([&]() { scalarDenoised = charts; }, [&]() { lightmapDenoiseScalar(scalarDenoised.data(), guide, settings); });
+    double denoise = measure([&]() { denoised = charts; }, [&]() { lightmapDenoise(denoised.data(), guide, settings); });
+    printf("denoise    à-trous x%d         scalar %8.2f ms  simd+mt %8.2f ms  (simd vs scalar %g)\n",
+        settings.iterations, denoiseScalar, denoise, maxDifference(denoised, scalarDenoised));
+    return 0;
+}
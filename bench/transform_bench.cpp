@@ -0,0 +1,111 @@
+// 批量变换的微基准：对比逐个用glm计算、标量批量、SIMD批量和多线程批量的耗时
+// 分别测试1千、1万和10万个实例，输出每个实例的平均耗时（纳秒）和与glm结果的最大误差
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+#include "TransformBatch.h"
+#include "TransformStore.h"
+
+using std::vector;
+
+// 每种实现重复的次数，取最快的一次，减少调度和缓存冷启动的影响
+const int REPEAT = 20;
+
+/// @brief 重复执行REPEAT次，返回最快一次每个实例的耗时（纳秒）
+static double measure(size_t count, const std::function<void()>& func) {
+    double best = 1e30;
+    for (int r = 0; r < REPEAT; r++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        func();
+        auto end = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    return best / count;
+}
+
+static float maxDiff(const vector<glm::mat4>& a, const vector<glm::mat4>& b) {
+    float diff = 0.0f;
+    for (size_t i = 0; i < a.size(); i++)
+        for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 4; r++)
+                diff = std::max(diff, std::abs(a[i][c][r] - b[i][c][r]));
+    return diff;
+}
+
+static float maxDiff(const vector<AABB>& a, const vector<AABB>& b) {
+    float diff = 0.0f;
+    for (size_t i = 0; i < a.size(); i++)
+        for (int k = 0; k < 3; k++)
+            diff = std::max(diff, std::max(std::abs(a[i].min[k] - b[i].min[k]), std::abs(a[i].max[k] - b[i].max[k])));
+    return diff;
+}
+
+static void run(size_t count) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> scale(0.1f, 4.0f);
+
+    TransformSoA transforms;
+    vector<glm::vec3> positions, scales;
+    vector<glm::quat> rotations;
+    vector<AABB> localBounds(count);
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 p(position(rng), position(rng), position(rng));
+        glm::quat q = glm::normalize(glm::quat(unit(rng), unit(rng), unit(rng), unit(rng)));
+        glm::vec3 s(scale(rng), scale(rng), scale(rng));
+        positions.push_back(p);
+        rotations.push_back(q);
+        scales.push_back(s);
+        transforms.push_back(p, q, s);
+        glm::vec3 center(unit(rng), unit(rng), unit(rng));
+        glm::vec3 extent(scale(rng), scale(rng), scale(rng));
+        localBounds[i].expand(center - extent);
+        localBounds[i].expand(center + extent);
+    }
+
+    vector<glm::mat4> reference(count), matrices(count);
+    vector<AABB> referenceBounds(count), bounds(count);
+
+    double glmCompose = measure(count, [&]() {
+        for (size_t i = 0; i < count; i++)
+            reference[i] = TransformStore::compose(positions[i], rotations[i], scales[i]);
+        });
+    double scalarCompose = measure(count, [&]() { composeTRSScalar(transforms, 0, count, matrices.data()); });
+    float scalarComposeDiff = maxDiff(reference, matrices);
+    double batchCompose = measure(count, [&]() { composeTRSBatch(transforms, 0, count, matrices.data()); });
+    float batchComposeDiff = maxDiff(reference, matrices);
+    double parallelCompose = measure(count, [&]() { composeTRSParallel(transforms, 0, count, matrices.data()); });
+    float parallelComposeDiff = maxDiff(reference, matrices);
+
+    double glmBounds = measure(count, [&]() {
+        for (size_t i = 0; i < count; i++)
+            referenceBounds[i] = localBounds[i].transformed(reference[i]);
+        });
+    double scalarBounds = measure(count, [&]() { transformBoundsScalar(reference.data(), localBounds.data(), bounds.data(), count); });
+    float scalarBoundsDiff = maxDiff(referenceBounds, bounds);
+    double batchBounds = measure(count, [&]() { transformBoundsBatch(reference.data(), localBounds.data(), bounds.data(), count); });
+    float batchBoundsDiff = maxDiff(referenceBounds, bounds);
+    double parallelBounds = measure(count, [&]() { transformBoundsParallel(reference.data(), localBounds.data(), bounds.data(), count); });
+    float parallelBoundsDiff = maxDiff(referenceBounds, bounds);
+
+    printf("%zu instances\n", count);
+    printf("  compose  glm %7.2f ns  scalar %7.2f ns (%.2e)  batch %7.2f ns (%.2e)  parallel %7.2f ns (%.2e)\n",
+        glmCompose, scalarCompose, scalarComposeDiff, batchCompose, batchComposeDiff, parallelCompose, parallelComposeDiff);
+    printf("  bounds   glm %7.2f ns  scalar %7.2f ns (%.2e)  batch %7.2f ns (%.2e)  parallel %7.2f ns (%.2e)\n",
+        glmBounds, scalarBounds, scalarBoundsDiff, batchBounds, batchBoundsDiff, parallelBounds, parallelBoundsDiff);
+}
+
+int main() {
+    printf("instruction set: %s, parallel grain: %zu\n", transformBatchInstructionSet(), TRANSFORM_PARALLEL_GRAIN);
+    for (size_t count : { (size_t)1000, (size_t)10000, (size_t)100000 })
+        run(count);
+    return 0;
+}
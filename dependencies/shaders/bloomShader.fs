@@ -0,0 +1,38 @@
+#version 330 core
+// 泛光降采样：用4次双线性采样覆盖源图像4x4的区域
+out vec3 FragColor;
+
+in vec2 TexCoords;
+
+// 源图像（场景颜色或泛光的上一级）
+uniform sampler2D source;
+// 源图像一个纹素的大小
+uniform vec2 texelSize;
+// 是否是第一次降采样，第一次需要提取高亮部分
+uniform bool prefilter;
+// 泛光阈值
+uniform float threshold;
+// 阈值附近的过渡宽度
+uniform float knee;
+
+// 软阈值：亮度在 [threshold-knee, threshold+knee] 之间平滑过渡
+vec3 Prefilter(vec3 color) {
+    float brightness = max(color.r, max(color.g, color.b));
+    float soft = clamp(brightness - threshold + knee, 0.0, 2.0 * knee);
+    soft = soft * soft / (4.0 * knee + 1e-4);
+    float contribution = max(soft, brightness - threshold) / max(brightness, 1e-4);
+    return color * contribution;
+}
+
+void main() {
+    vec4 offset = texelSize.xyxy * vec4(-1.0, -1.0, 1.0, 1.0);
+    vec3 color = texture(source, TexCoords + offset.xy).rgb
+        + texture(source, TexCoords + offset.zy).rgb
+        + texture(source, TexCoords + offset.xw).rgb
+        + texture(source, TexCoords + offset.zw).rgb;
+    color *= 0.25;
+    if (prefilter) {
+        color = Prefilter(color);
+    }
+    FragColor = color;
+}
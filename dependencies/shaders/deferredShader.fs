@@ -0,0 +1,65 @@
+#version 330 core
+/// 输出
+// 输出颜色
+out vec4 FragColor;
+
+/// 输入
+// 纹理坐标
+in vec2 TexCoords;
+
+/// uniform
+// G-buffer：漫反射颜色和镜面反射强度
+uniform sampler2D gAlbedoSpec;
+// G-buffer：八面体编码的法线、反射光泽度和镜面反射颜色标志
+uniform sampler2D gNormalShininess;
+// G-buffer：深度
+uniform sampler2D gDepth;
+// 视图投影矩阵的逆矩阵，用来从深度重建世界坐标
+uniform mat4 inverseViewProjection;
+
+// 光照计算
+#include "lighting.glsl"
+
+// 把八面体编码的法线还原为单位向量
+vec3 DecodeOctahedron(vec2 e){
+    e=e*2.-1.;
+    vec3 n=vec3(e.xy,1.-abs(e.x)-abs(e.y));
+    float t=max(-n.z,0.);
+    n.x+=n.x>=0.?-t:t;
+    n.y+=n.y>=0.?-t:t;
+    return normalize(n);
+}
+
+void main()
+{
+    ivec2 coord=ivec2(gl_FragCoord.xy);
+    float sceneDepth=texelFetch(gDepth,coord,0).r;
+    // 没有被几何体覆盖的像素留给天空盒
+    if(sceneDepth>=1.)
+    discard;
+    
+    // 从深度重建世界坐标
+    vec4 ndc=vec4(TexCoords*2.-1.,sceneDepth*2.-1.,1.);
+    vec4 worldPos=inverseViewProjection*ndc;
+    vec3 fragPos=worldPos.xyz/worldPos.w;
+    
+    // 从G-buffer中获取表面属性
+    vec4 albedoSpec=texelFetch(gAlbedoSpec,coord,0);
+    vec4 normalShininess=texelFetch(gNormalShininess,coord,0);
+    Surface surface;
+    surface.albedo=albedoSpec.rgb;
+    surface.specular=normalShininess.a>.5?albedoSpec.rgb:vec3(albedoSpec.a);
+    surface.shininess=normalShininess.b*512.;
+    
+    vec3 norm=DecodeOctahedron(normalShininess.rg);
+    vec3 viewDir=normalize(viewPos-fragPos);
+    
+    // 计算所有方向光的贡献
+    vec3 result=vec3(0.);
+    for(int i=0;i<numDirectionalLights;i++)
+    result+=CalcDirLight(directionalLights[i],surface,norm,fragPos,viewDir);
+    // 计算所在簇中点光源的贡献
+    result+=CalcClusteredPointLights(surface,norm,fragPos,viewDir);
+    
+    FragColor=vec4(result,1.);
+}
@@ -4,6 +4,9 @@ layout (location = 0) in vec3 aPos;
 uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
 
+// 也用于摄像机视角的深度预渲染，需要和sceneShader.vs得到完全相同的深度
+invariant gl_Position;
+
 void main()
 {
     gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
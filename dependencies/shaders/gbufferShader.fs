@@ -0,0 +1,52 @@
+#version 330 core
+/// 输出：精简的G-buffer
+// rgb: 漫反射颜色，a: 镜面反射强度
+layout(location=0)out vec4 gAlbedoSpec;
+// rg: 八面体编码的法线，b: 反射光泽度/512，a: 镜面反射颜色是否直接使用漫反射颜色
+layout(location=1)out vec4 gNormalShininess;
+
+/// 输入
+// 纹理坐标
+in vec2 TexCoords;
+// 法线
+in vec3 Normal;
+// 片段位置
+in vec3 FragPos;
+// TBN矩阵
+in mat3 TBN;
+
+/// uniform
+// 材质
+#include "material.glsl"
+
+// 八面体编码的辅助函数，把下半球折叠到上半球外侧
+vec2 OctWrap(vec2 v){
+    return(1.-abs(v.yx))*vec2(v.x>=0.?1.:-1.,v.y>=0.?1.:-1.);
+}
+
+// 把单位法线编码成[0, 1]范围内的两个分量
+vec2 EncodeOctahedron(vec3 n){
+    n/=(abs(n.x)+abs(n.y)+abs(n.z));
+    n.xy=n.z>=0.?n.xy:OctWrap(n.xy);
+    return n.xy*.5+.5;
+}
+
+void main()
+{
+    vec3 norm=normalize(SampleNormal(Normal,TBN,TexCoords));
+    
+    gAlbedoSpec.rgb=texture(material0.diffuseMap,TexCoords).rgb;
+    if(material0.sampleSpecularMap){
+        // 镜面反射贴图一般是灰度图，只保存亮度
+        vec3 specular=texture(material0.specularMap,TexCoords).rgb;
+        gAlbedoSpec.a=dot(specular,vec3(.2126,.7152,.0722));
+        gNormalShininess.a=0.;
+    }
+    else{
+        // 和前向渲染一致，没有镜面反射贴图时镜面反射颜色使用漫反射颜色
+        gAlbedoSpec.a=1.;
+        gNormalShininess.a=1.;
+    }
+    gNormalShininess.rg=EncodeOctahedron(norm);
+    gNormalShininess.b=material0.shininess/512.;
+}
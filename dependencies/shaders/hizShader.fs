@@ -0,0 +1,33 @@
+#version 330 core
+// 生成层级深度（Hi-Z）：每个纹素保存上一级对应区域的最大深度（最远的深度）
+layout (location = 0) out float maxDepth;
+
+// 第0级时是场景深度贴图，之后是只暴露了上一级的层级深度纹理
+uniform sampler2D depthMap;
+// 是否是第0级（直接复制场景深度）
+uniform bool firstLevel;
+// 上一级的尺寸
+uniform ivec2 previousSize;
+
+void main() {
+    ivec2 coord = ivec2(gl_FragCoord.xy);
+    if (firstLevel) {
+        maxDepth = texelFetch(depthMap, coord, 0).r;
+        return;
+    }
+
+    // 上一级的尺寸是奇数时，这一级最后一行/列要多覆盖一个纹素，否则会漏掉边缘的深度
+    ivec2 size = max(previousSize / 2, ivec2(1));
+    ivec2 extent = ivec2(2);
+    if ((previousSize.x & 1) != 0 && coord.x == size.x - 1) extent.x = 3;
+    if ((previousSize.y & 1) != 0 && coord.y == size.y - 1) extent.y = 3;
+
+    float depth = 0.0;
+    for (int y = 0; y < extent.y; y++) {
+        for (int x = 0; x < extent.x; x++) {
+            ivec2 p = min(coord * 2 + ivec2(x, y), previousSize - 1);
+            depth = max(depth, texelFetch(depthMap, p, 0).r);
+        }
+    }
+    maxDepth = depth;
+}
@@ -0,0 +1,33 @@
+// 光照探针的公共代码：二阶球谐表示的辐照度，给不能使用光照贴图的动态物体提供间接光照
+// 由sceneShader.fs通过#include引用，纹理的布局见LightProbeGrid.h
+
+// 是否使用光照探针
+uniform bool useLightProbes;
+// 探针的3D纹理，z方向依次放7组系数：前4个系数的R、G、B，中间4个系数的R、G、B，第9个系数
+uniform sampler3D lightProbes;
+// 把世界坐标变换到一组系数内的纹理坐标：uvw = fragPos * lightProbeScale + lightProbeBias
+uniform vec3 lightProbeScale;
+uniform vec3 lightProbeBias;
+// 网格在z方向上的探针数
+uniform float lightProbeDepth;
+
+// 三线性插值探针的球谐系数，再按法线求值，返回辐照度（除以π），和光照贴图中的值相同
+vec3 SampleLightProbes(vec3 fragPos,vec3 normal){
+    vec3 uvw=fragPos*lightProbeScale+lightProbeBias;
+    // 在一组内把z坐标夹在第一个和最后一个探针之间，过滤时不会混入相邻的组；x和y由CLAMP_TO_EDGE处理
+    float z=clamp(uvw.z,.5/lightProbeDepth,1.-.5/lightProbeDepth)/7.;
+    vec4 r0=texture(lightProbes,vec3(uvw.xy,z));
+    vec4 g0=texture(lightProbes,vec3(uvw.xy,z+1./7.));
+    vec4 b0=texture(lightProbes,vec3(uvw.xy,z+2./7.));
+    vec4 r1=texture(lightProbes,vec3(uvw.xy,z+3./7.));
+    vec4 g1=texture(lightProbes,vec3(uvw.xy,z+4./7.));
+    vec4 b1=texture(lightProbes,vec3(uvw.xy,z+5./7.));
+    vec3 c8=texture(lightProbes,vec3(uvw.xy,z+6./7.)).rgb;
+
+    // 基函数的常数已经乘进系数，这里只剩多项式
+    vec4 basis0=vec4(1.,normal.y,normal.z,normal.x);
+    vec4 basis1=vec4(normal.x*normal.y,normal.y*normal.z,3.*normal.z*normal.z-1.,normal.x*normal.z);
+    float basis2=normal.x*normal.x-normal.y*normal.y;
+    vec3 irradiance=vec3(dot(r0,basis0)+dot(r1,basis1),dot(g0,basis0)+dot(g1,basis1),dot(b0,basis0)+dot(b1,basis1))+c8*basis2;
+    return max(irradiance,vec3(0.));
+}
@@ -0,0 +1,39 @@
+// 材质的公共代码，由sceneShader.fs和gbufferShader.fs通过#include引用
+
+// 材质结构体
+struct Material{
+    // 环境光系数
+    vec3 ambient;
+    // 漫反射系数
+    vec3 diffuse;
+    // 镜面反射系数
+    vec3 specular;
+    // 漫反射贴图
+    sampler2D diffuseMap;
+    // 是否使用法线贴图
+    bool sampleNormalMap;
+    // 法线贴图（凹凸贴图）
+    sampler2D normalMap;
+    // 是否使用镜面反射贴图
+    bool sampleSpecularMap;
+    // 镜面反射贴图
+    sampler2D specularMap;
+    // 反射光泽度
+    float shininess;
+    
+};
+// 材质
+uniform Material material0;
+
+// 获取片段的法线，如果材质有法线贴图则从法线贴图采样并变换到世界空间
+vec3 SampleNormal(vec3 normal,mat3 TBN,vec2 texCoords){
+    vec3 sampledNormal=normal;
+    // 判断是否进行法线贴图
+    if(material0.sampleNormalMap){
+        // 从法线贴图采样法线
+        vec3 normalMap=texture(material0.normalMap,texCoords).rgb;
+        sampledNormal=normalize(normalMap*2.-1.);
+        sampledNormal=normalize(TBN*sampledNormal);
+    }
+    return sampledNormal;
+}
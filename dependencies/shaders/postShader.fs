@@ -0,0 +1,49 @@
+#version 330 core
+// 合并的后处理：泛光合成、曝光、色调映射和sRGB转换在一次全屏绘制中完成
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// HDR场景颜色（线性空间）
+uniform sampler2D sceneColor;
+// 泛光mip链
+uniform sampler2D bloomMap;
+// 是否开启泛光
+uniform bool bloom;
+// 泛光的级数
+uniform int bloomLevels;
+// 泛光强度
+uniform float bloomIntensity;
+// 曝光
+uniform float exposure;
+
+// ACES电影色调映射的近似（Krzysztof Narkowicz）
+vec3 ToneMapACES(vec3 color) {
+    const float a = 2.51;
+    const float b = 0.03;
+    const float c = 2.43;
+    const float d = 0.59;
+    const float e = 0.14;
+    return clamp((color * (a * color + b)) / (color * (c * color + d) + e), 0.0, 1.0);
+}
+
+// 线性空间转换到sRGB空间
+vec3 LinearToSRGB(vec3 color) {
+    vec3 low = color * 12.92;
+    vec3 high = 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055;
+    return mix(low, high, step(vec3(0.0031308), color));
+}
+
+void main() {
+    vec3 color = texelFetch(sceneColor, ivec2(gl_FragCoord.xy), 0).rgb;
+    if (bloom) {
+        // 把每一级的泛光叠加起来，级数越低范围越小
+        vec3 bloomColor = vec3(0.0);
+        for (int i = 0; i < bloomLevels; i++) {
+            bloomColor += textureLod(bloomMap, TexCoords, float(i)).rgb;
+        }
+        color += bloomColor * bloomIntensity;
+    }
+    color = ToneMapACES(color * exposure);
+    FragColor = vec4(LinearToSRGB(color), 1.0);
+}
@@ -10,12 +10,16 @@ layout(location=2)in vec3 aNormal;
 layout(location=3)in vec3 aTangent;
 // 副切线
 layout(location=4)in vec3 aBitangent;
+// 光照贴图坐标
+layout(location=5)in vec2 aLightmapTexCoords;
 
 /// 输出
 // 法线
 out vec3 Normal;
 // 纹理坐标
 out vec2 TexCoords;
+// 光照贴图坐标
+out vec2 LightmapTexCoords;
 // 片段位置
 out vec3 FragPos;
 // 切线空间
@@ -26,20 +30,23 @@ out mat3 TBN;
 /// uniform
 // 模型矩阵
 uniform mat4 model;
-// 视图矩阵
-uniform mat4 view;
-// 投影矩阵
-uniform mat4 projection;
+// 视图投影矩阵（projection * view在CPU上预先相乘）
+uniform mat4 viewProjection;
 // 光空间矩阵
 // uniform mat4 lightSpaceMatrix;
 
+// 深度预渲染和主渲染阶段必须得到完全相同的深度，才能在主渲染阶段使用GL_EQUAL深度测试
+// 所以这里和directionLightShadowShader.vs使用相同的表达式，并声明为invariant
+invariant gl_Position;
+
 void main()
 {
-    gl_Position=projection*view*model*vec4(aPos,1.);
+    gl_Position=viewProjection*model*vec4(aPos,1.);
     
     Normal=mat3(transpose(inverse(model)))*aNormal;
     FragPos=vec3(model*vec4(aPos,1.));
     TexCoords=vec2(aTexCoords.x,aTexCoords.y);
+    LightmapTexCoords=aLightmapTexCoords;
     
     // 计算TBN矩阵
     vec3 T=normalize(vec3(model*vec4(aTangent,0.)));
@@ -1,21 +1,163 @@
-#include "utils/WindowFactory.h"
+#include "utils/windowFactory.h"
+#include "utils/headlessWindowFactory.h"
 #include "utils/Scene.h"
 #include "utils/SkyBox.h"
+#include "utils/Benchmark.h"
+#include "utils/Profiler.h"
+#include "utils/RenderStats.h"
+#include "utils/GpuResource.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+// 命令行参数
+struct Options {
+    // 是否使用无窗口的离屏渲染
+    bool headless = false;
+    // 渲染的宽度和高度
+    unsigned int width = GLFWWindowFactory::SCR_WIDTH;
+    unsigned int height = GLFWWindowFactory::SCR_HEIGHT;
+    // 离屏渲染的帧数
+    unsigned int frames = 1;
+    // 离屏渲染时最后一帧保存的路径
+    std::string output = "headless.png";
+    // 基准测试配置文件，为空时不运行基准测试
+    std::string benchmark;
+    // 录制摄像机路径的输出文件，为空时不录制
+    std::string record;
+    // 性能分析trace的输出文件，为空时不导出
+    std::string trace;
+    // 是否在单独的线程上更新，关闭时更新和渲染串行执行，用于对比
+    bool pipelined = true;
+    // 用CPU烘焙光照贴图的输出图片，不为空时只烘焙，不创建窗口
+    std::string bakeCpu;
+};
+
+// 解析命令行参数：--headless --size 1920x1080 --frames 300 --output frame.png --benchmark config/benchmark.yaml --record path.yaml --trace trace.json --no-pipeline --bake-cpu result.tga
+static Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--headless") == 0) {
+            options.headless = true;
+        }
+        else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            unsigned int width = 0, height = 0;
+            if (sscanf(argv[++i], "%ux%u", &width, &height) == 2 && width > 0 && height > 0) {
+                options.width = width;
+                options.height = height;
+            }
+            else {
+                cout << "Invalid size: " << argv[i] << endl;
+            }
+        }
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            options.frames = (unsigned int)std::stoul(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            options.output = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+            options.benchmark = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            options.record = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            options.trace = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--no-pipeline") == 0) {
+            options.pipelined = false;
+        }
+        else if (std::strcmp(argv[i], "--bake-cpu") == 0 && i + 1 < argc) {
+            options.bakeCpu = argv[++i];
+        }
+        else {
+            cout << "Unknown option: " << argv[i] << endl;
+        }
+    }
+    return options;
+}
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+    // 在没有显卡的机器上烘焙光照贴图，不需要opengl上下文
+    if (!options.bakeCpu.empty())
+        return Scene::bakeLightMapOffline(options.bakeCpu) ? 0 : -1;
 
-int main() {
     // 创建一个窗口Factory对象
-    GLFWWindowFactory myWindow(800, 600, "地球仪");
-    // 创建一个地球仪模型对象
-    Scene tellurion(&myWindow);
-    // 创建一个天空盒对象
-    SkyBox skyBox(&myWindow);
-
-    // 运行窗口，传入一个lambda表达式，用于自定义渲染逻辑
-    myWindow.run([&]() {
-        // 绘制地球仪
-        tellurion.draw();
-        // 绘制天空盒
-        skyBox.draw();
-        });
+    std::unique_ptr<WindowFactory> myWindow;
+    if (options.headless) {
+#ifdef TELLURION_HEADLESS
+        myWindow.reset(new HeadlessWindowFactory(options.width, options.height, options.frames, options.output));
+#else
+        cout << "Headless rendering is not available, rebuild with -DTELLURION_HEADLESS=ON" << endl;
+        return -1;
+#endif
+    }
+    else {
+        myWindow.reset(new GLFWWindowFactory(options.width, options.height, "地球仪"));
+    }
+
+    // 场景和天空盒在这个作用域结束时析构，释放所有显存资源，之后还没有释放的就是泄漏
+    {
+        // 创建一个地球仪模型对象
+        Scene tellurion(myWindow.get());
+        // 创建一个天空盒对象
+        SkyBox skyBox(myWindow.get());
+        // 输出加载完成后的常驻显存
+        GpuMemoryLedger::instance().printReport();
+
+        // 基准测试：回放录制的路径并统计帧时间
+        std::unique_ptr<Benchmark> benchmark;
+        if (!options.benchmark.empty())
+            benchmark.reset(new Benchmark(options.benchmark, myWindow.get(), &tellurion));
+        // 录制摄像机路径
+        std::unique_ptr<CameraPathRecorder> recorder;
+        if (!options.record.empty())
+            recorder.reset(new CameraPathRecorder(options.record, myWindow.get(), &tellurion));
+        // 导出trace时从第一帧开始统计
+        Profiler& profiler = Profiler::instance();
+        if (!options.trace.empty()) {
+            profiler.setTraceOutput(options.trace);
+            myWindow->profiler = true;
+        }
+
+        myWindow->setPipelined(options.pipelined);
+        // 更新线程：为下一帧计算模型矩阵、视锥体剔除和绘制顺序，和opengl线程并行执行
+        auto update = [&](FramePacket& packet) {
+            tellurion.update(packet);
+        };
+        // opengl线程：按数据包渲染这一帧
+        auto render = [&](const FramePacket& packet) {
+            profiler.setEnabled(myWindow->profiler);
+            profiler.beginFrame();
+            RenderStats::beginFrame();
+            if (benchmark)
+                benchmark->beginFrame();
+            // 绘制地球仪
+            tellurion.draw(packet);
+            // 绘制天空盒
+            skyBox.draw();
+            // 输出到屏幕
+            tellurion.present();
+            if (benchmark)
+                benchmark->endFrame();
+            if (recorder)
+                recorder->sample(packet);
+            RenderStats::endFrame();
+            profiler.endFrame();
+        };
+        // 运行窗口
+        myWindow->run(update, render);
+
+        if (benchmark)
+            benchmark->writeReport();
+        if (recorder)
+            recorder->save();
+        profiler.writeTrace();
+    }
+    if (GpuMemoryLedger::instance().reportLeaks() == 0)
+        cout << "no gpu resources leaked" << endl;
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,316 @@
+#include "Benchmark.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include "yaml-cpp/yaml.h"
+
+// 从yaml节点读取三维向量
+static glm::vec3 readVec3(const YAML::Node& node) {
+    return glm::vec3(node["x"].as<float>(), node["y"].as<float>(), node["z"].as<float>());
+}
+
+// 转义JSON字符串
+static std::string escapeJson(const std::string& text) {
+    std::string result;
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            result += '\\';
+        if ((unsigned char)c >= 0x20)
+            result += c;
+    }
+    return result;
+}
+
+Benchmark::Benchmark(const std::string& fileName, WindowFactory* window, Scene* scene) : window(window), scene(scene) {
+    load(fileName);
+    if (this->warmupFrames >= this->frames) {
+        std::cerr << "Warning: benchmark warmupFrames >= frames, no frame will be measured" << std::endl;
+    }
+
+    // 按固定时间步长渲染固定帧数
+    this->window->setFixedTimestep(this->timestep, this->frames);
+    // 摄像机在更新线程上按帧的时间沿路径移动
+    this->window->setCameraController([this](float time) { applyCameraPath(time); });
+
+    this->cpuTimes.assign(this->frames, -1.0);
+    this->gpuTimes.assign(this->frames, -1.0);
+    glGenQueries(QUERY_COUNT, this->queries);
+    for (unsigned int i = 0; i < QUERY_COUNT; i++)
+        this->queryFrames[i] = -1;
+}
+
+void Benchmark::load(const std::string& fileName) {
+    try {
+        YAML::Node config = YAML::LoadFile(fileName);
+        if (config["frames"])
+            this->frames = config["frames"].as<unsigned int>();
+        if (config["warmupFrames"])
+            this->warmupFrames = config["warmupFrames"].as<unsigned int>();
+        if (config["timestep"])
+            this->timestep = config["timestep"].as<float>();
+        if (config["output"])
+            this->outputPath = config["output"].as<std::string>();
+
+        // 渲染设置，保证对比的两次运行使用相同的渲染路径
+        if (YAML::Node settings = config["settings"]) {
+            if (settings["blinn"])
+                WindowFactory::blinn = settings["blinn"].as<bool>();
+            if (settings["deferred"])
+                WindowFactory::deferred = settings["deferred"].as<bool>();
+            if (settings["depthPrepass"])
+                WindowFactory::depthPrepass = settings["depthPrepass"].as<bool>();
+            if (settings["occlusionCulling"])
+                WindowFactory::occlusionCulling = settings["occlusionCulling"].as<bool>();
+            if (settings["bloom"])
+                WindowFactory::bloom = settings["bloom"].as<bool>();
+        }
+
+        if (YAML::Node path = config["cameraPath"]) {
+            for (size_t i = 0; i < path.size(); ++i) {
+                CameraKeyframe keyframe;
+                keyframe.time = path[i]["time"].as<float>();
+                keyframe.position = readVec3(path[i]["position"]);
+                keyframe.target = readVec3(path[i]["target"]);
+                this->cameraPath.push_back(keyframe);
+            }
+        }
+        if (YAML::Node path = config["lightPath"]) {
+            for (size_t i = 0; i < path.size(); ++i) {
+                LightKeyframe keyframe;
+                keyframe.time = path[i]["time"].as<float>();
+                keyframe.direction = readVec3(path[i]["direction"]);
+                this->lightPath.push_back(keyframe);
+            }
+        }
+    } catch (const YAML::BadFile& e) {
+        std::cerr << "Error: Unable to open file " << fileName << std::endl;
+    } catch (const YAML::Exception& e) {
+        std::cerr << "Error: Parsing failed: " << e.what() << std::endl;
+    }
+
+    // 关键帧按时间排序，插值时只需要顺序查找
+    std::sort(this->cameraPath.begin(), this->cameraPath.end(), [](const CameraKeyframe& a, const CameraKeyframe& b) { return a.time < b.time; });
+    std::sort(this->lightPath.begin(), this->lightPath.end(), [](const LightKeyframe& a, const LightKeyframe& b) { return a.time < b.time; });
+}
+
+void Benchmark::applyCameraPath(float time) {
+    if (this->cameraPath.empty())
+        return;
+
+    // 找到time所在的区间并线性插值，超出路径范围时停在两端
+    glm::vec3 position = this->cameraPath.back().position;
+    glm::vec3 target = this->cameraPath.back().target;
+    if (time <= this->cameraPath.front().time) {
+        position = this->cameraPath.front().position;
+        target = this->cameraPath.front().target;
+    }
+    else {
+        for (size_t i = 0; i + 1 < this->cameraPath.size(); i++) {
+            const CameraKeyframe& a = this->cameraPath[i];
+            const CameraKeyframe& b = this->cameraPath[i + 1];
+            if (time < b.time) {
+                float t = (time - a.time) / std::max(b.time - a.time, 1e-6f);
+                position = glm::mix(a.position, b.position, t);
+                target = glm::mix(a.target, b.target, t);
+                break;
+            }
+        }
+    }
+
+    // 摄像机总是保持水平（没有滚转），路径中不能出现竖直向上或向下看的关键帧
+    Camera& camera = WindowFactory::camera;
+    camera.Position = position;
+    camera.Front = glm::normalize(target - position);
+    camera.Right = glm::normalize(glm::cross(camera.Front, glm::vec3(0.0f, 1.0f, 0.0f)));
+    camera.Up = glm::normalize(glm::cross(camera.Right, camera.Front));
+}
+
+void Benchmark::applyLightPath(float time) {
+    if (this->lightPath.empty() || this->scene->directionalLights.empty())
+        return;
+
+    glm::vec3 direction = this->lightPath.back().direction;
+    if (time <= this->lightPath.front().time) {
+        direction = this->lightPath.front().direction;
+    }
+    else {
+        for (size_t i = 0; i + 1 < this->lightPath.size(); i++) {
+            const LightKeyframe& a = this->lightPath[i];
+            const LightKeyframe& b = this->lightPath[i + 1];
+            if (time < b.time) {
+                float t = (time - a.time) / std::max(b.time - a.time, 1e-6f);
+                direction = glm::mix(a.direction, b.direction, t);
+                break;
+            }
+        }
+    }
+    this->scene->directionalLights[0].direction = direction;
+}
+
+void Benchmark::beginFrame() {
+    unsigned int frame = this->window->getFrameIndex();
+    if (frame == 0)
+        this->benchmarkStart = std::chrono::steady_clock::now();
+
+    // 摄像机已经由更新线程按路径设置好了，这里只设置光源
+    applyLightPath(this->window->getTime());
+
+    // 环形缓冲中最老的查询是QUERY_COUNT帧之前的，这时结果一般已经准备好了
+    unsigned int slot = frame % QUERY_COUNT;
+    collectQuery(slot, false);
+    // 仍然没有结果就放弃那一帧的GPU时间，宁可少一个样本也不等待GPU
+    this->queryFrames[slot] = (int)frame;
+    glBeginQuery(GL_TIME_ELAPSED, this->queries[slot]);
+
+    this->frameStart = std::chrono::steady_clock::now();
+}
+
+void Benchmark::endFrame() {
+    std::chrono::duration<double, std::milli> cpuTime = std::chrono::steady_clock::now() - this->frameStart;
+    glEndQuery(GL_TIME_ELAPSED);
+
+    unsigned int frame = this->window->getFrameIndex();
+    if (frame < this->cpuTimes.size())
+        this->cpuTimes[frame] = cpuTime.count();
+}
+
+void Benchmark::collectQuery(unsigned int slot, bool wait) {
+    if (this->queryFrames[slot] < 0)
+        return;
+    GLint available = 0;
+    if (!wait) {
+        glGetQueryObjectiv(this->queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+    }
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(this->queries[slot], GL_QUERY_RESULT, &elapsed);
+    if ((size_t)this->queryFrames[slot] < this->gpuTimes.size())
+        this->gpuTimes[this->queryFrames[slot]] = elapsed / 1.0e6;
+    this->queryFrames[slot] = -1;
+}
+
+Benchmark::Statistics Benchmark::computeStatistics(const vector<double>& times) const {
+    vector<double> samples;
+    for (size_t i = this->warmupFrames; i < times.size(); i++) {
+        if (times[i] >= 0.0)
+            samples.push_back(times[i]);
+    }
+    Statistics statistics;
+    if (samples.empty())
+        return statistics;
+
+    std::sort(samples.begin(), samples.end());
+    // 最近秩法计算百分位数
+    auto percentile = [&](double p) {
+        size_t rank = (size_t)std::ceil(p / 100.0 * samples.size());
+        return samples[std::min(std::max(rank, (size_t)1), samples.size()) - 1];
+        };
+    double sum = 0.0;
+    for (double sample : samples)
+        sum += sample;
+    statistics.mean = sum / samples.size();
+    statistics.min = samples.front();
+    statistics.max = samples.back();
+    statistics.p50 = percentile(50.0);
+    statistics.p95 = percentile(95.0);
+    statistics.p99 = percentile(99.0);
+    return statistics;
+}
+
+void Benchmark::writeReport() {
+    // 测试已经结束，可以等待剩下的查询
+    for (unsigned int i = 0; i < QUERY_COUNT; i++)
+        collectQuery(i, true);
+    std::chrono::duration<double> wallTime = std::chrono::steady_clock::now() - this->benchmarkStart;
+
+    Statistics cpu = computeStatistics(this->cpuTimes);
+    Statistics gpu = computeStatistics(this->gpuTimes);
+    size_t gpuSamples = std::count_if(this->gpuTimes.begin() + std::min<size_t>(this->warmupFrames, this->gpuTimes.size()),
+        this->gpuTimes.end(), [](double t) { return t >= 0.0; });
+
+    std::ofstream file(this->outputPath);
+    if (!file) {
+        std::cerr << "Error: Unable to write " << this->outputPath << std::endl;
+        return;
+    }
+    auto writeStatistics = [&](const char* name, const Statistics& s) {
+        file << "  \"" << name << "\": { \"mean\": " << s.mean << ", \"min\": " << s.min << ", \"max\": " << s.max
+            << ", \"p50\": " << s.p50 << ", \"p95\": " << s.p95 << ", \"p99\": " << s.p99 << " },\n";
+        };
+    file << std::fixed << std::setprecision(4);
+    file << "{\n";
+    file << "  \"renderer\": \"" << escapeJson((const char*)glGetString(GL_RENDERER)) << "\",\n";
+    file << "  \"version\": \"" << escapeJson((const char*)glGetString(GL_VERSION)) << "\",\n";
+    file << "  \"width\": " << this->window->getWidth() << ",\n";
+    file << "  \"height\": " << this->window->getHeight() << ",\n";
+    file << "  \"frames\": " << this->frames << ",\n";
+    file << "  \"warmupFrames\": " << this->warmupFrames << ",\n";
+    file << "  \"timestep\": " << this->timestep << ",\n";
+    file << "  \"settings\": { \"blinn\": " << (WindowFactory::blinn ? "true" : "false")
+        << ", \"deferred\": " << (WindowFactory::deferred ? "true" : "false")
+        << ", \"depthPrepass\": " << (WindowFactory::depthPrepass ? "true" : "false")
+        << ", \"occlusionCulling\": " << (WindowFactory::occlusionCulling ? "true" : "false")
+        << ", \"bloom\": " << (WindowFactory::bloom ? "true" : "false") << " },\n";
+    writeStatistics("cpuMs", cpu);
+    writeStatistics("gpuMs", gpu);
+    file << "  \"gpuSamples\": " << gpuSamples << ",\n";
+    file << "  \"wallTimeSeconds\": " << wallTime.count() << "\n";
+    file << "}\n";
+
+    std::cout << std::fixed << std::setprecision(3)
+        << "benchmark: cpu p50/p95/p99 = " << cpu.p50 << "/" << cpu.p95 << "/" << cpu.p99 << " ms, "
+        << "gpu p50/p95/p99 = " << gpu.p50 << "/" << gpu.p95 << "/" << gpu.p99 << " ms, "
+        << "saved " << this->outputPath << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+}
+
+CameraPathRecorder::CameraPathRecorder(const std::string& fileName, WindowFactory* window, Scene* scene)
+    : fileName(fileName), window(window), scene(scene) {
+}
+
+void CameraPathRecorder::sample(const FramePacket& packet) {
+    float time = packet.input.time;
+    if (this->startTime < 0.0f) {
+        this->startTime = time;
+    }
+    else if (time - this->lastSampleTime < SAMPLE_INTERVAL) {
+        return;
+    }
+    this->lastSampleTime = time;
+
+    this->times.push_back(time - this->startTime);
+    this->positions.push_back(packet.cameraPosition);
+    // 看向的点取摄像机前方10个单位
+    this->targets.push_back(packet.cameraPosition + packet.cameraFront * 10.0f);
+    this->lightDirections.push_back(this->scene->directionalLights.empty() ? glm::vec3(0.0f, -1.0f, 0.0f) : this->scene->directionalLights[0].direction);
+}
+
+void CameraPathRecorder::save() {
+    std::ofstream file(this->fileName);
+    if (!file) {
+        std::cerr << "Error: Unable to write " << this->fileName << std::endl;
+        return;
+    }
+    auto writeVec3 = [&](const glm::vec3& v) {
+        file << "{ x: " << v.x << ", y: " << v.y << ", z: " << v.z << " }";
+        };
+    file << "# 录制的摄像机路径和光源路径，可以直接复制到基准测试配置中\n";
+    file << "cameraPath:\n";
+    for (size_t i = 0; i < this->times.size(); i++) {
+        file << "  - time: " << this->times[i] << "\n    position: ";
+        writeVec3(this->positions[i]);
+        file << "\n    target: ";
+        writeVec3(this->targets[i]);
+        file << "\n";
+    }
+    file << "lightPath:\n";
+    for (size_t i = 0; i < this->times.size(); i++) {
+        file << "  - time: " << this->times[i] << "\n    direction: ";
+        writeVec3(this->lightDirections[i]);
+        file << "\n";
+    }
+    std::cout << "Saved camera path " << this->fileName << " (" << this->times.size() << " keyframes)" << std::endl;
+}
@@ -0,0 +1,137 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// 定义了基准测试相关的类
+// Benchmark按固定时间步长回放录制好的摄像机路径和光源路径，渲染固定帧数，
+// 统计CPU和GPU帧时间的百分位数并输出为JSON，保证不同构建、不同机器之间的结果可以直接比较
+// CameraPathRecorder在交互运行时录制摄像机和光源路径，生成的文件可以直接作为基准测试的路径
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "windowFactory.h"
+#include "Scene.h"
+
+using std::vector;
+
+class Benchmark {
+public:
+    /// @brief 构造函数，加载基准测试配置
+    /// @param fileName 配置文件
+    /// @param window 窗口，基准测试会把它切换到固定时间步长模式
+    /// @param scene 场景，用于控制光源
+    Benchmark(const std::string& fileName, WindowFactory* window, Scene* scene);
+
+    /// @brief 一帧开始时调用：根据时间设置光源，开始计时，摄像机由更新线程按路径设置
+    void beginFrame();
+
+    /// @brief 一帧结束时调用：结束计时
+    void endFrame();
+
+    /// @brief 读取剩余的GPU计时结果，把统计结果写入JSON文件并输出到控制台
+    void writeReport();
+
+private:
+    // 摄像机路径的关键帧
+    struct CameraKeyframe {
+        float time;
+        glm::vec3 position;
+        // 摄像机看向的点
+        glm::vec3 target;
+    };
+    // 光源路径的关键帧（控制第一个定向光的方向）
+    struct LightKeyframe {
+        float time;
+        glm::vec3 direction;
+    };
+    // 帧时间的统计结果（毫秒）
+    struct Statistics {
+        double mean = 0.0;
+        double min = 0.0;
+        double max = 0.0;
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+    };
+
+    // GPU计时查询的环形缓冲大小，读取几帧之前的结果，不会阻塞
+    static const unsigned int QUERY_COUNT = 4;
+
+    WindowFactory* window;
+    Scene* scene;
+
+    // 渲染的帧数（包括预热帧）
+    unsigned int frames = 600;
+    // 不计入统计的预热帧数（着色器编译、纹理上传等只在开始时发生的开销）
+    unsigned int warmupFrames = 60;
+    // 固定时间步长（秒）
+    float timestep = 1.0f / 60.0f;
+    // 结果输出路径
+    std::string outputPath = "benchmark.json";
+    vector<CameraKeyframe> cameraPath;
+    vector<LightKeyframe> lightPath;
+
+    // 每帧的CPU时间（毫秒），下标是帧序号
+    vector<double> cpuTimes;
+    // 每帧的GPU时间（毫秒），下标是帧序号，负数表示没有读到结果
+    vector<double> gpuTimes;
+    // 当前帧开始的CPU时间
+    std::chrono::steady_clock::time_point frameStart;
+    // 整个测试开始的时间
+    std::chrono::steady_clock::time_point benchmarkStart;
+
+    // GL_TIME_ELAPSED查询对象
+    GLuint queries[QUERY_COUNT] = {};
+    // 每个查询对应的帧序号，-1表示空闲
+    int queryFrames[QUERY_COUNT];
+
+    /// @brief 加载配置文件
+    void load(const std::string& fileName);
+    /// @brief 根据时间插值摄像机路径并设置摄像机
+    void applyCameraPath(float time);
+    /// @brief 根据时间插值光源路径并设置光源
+    void applyLightPath(float time);
+    /// @brief 读取查询结果
+    /// @param slot 查询的下标
+    /// @param wait 是否等待结果，为false时结果没准备好就直接返回
+    void collectQuery(unsigned int slot, bool wait);
+    /// @brief 计算统计结果，忽略预热帧和没有结果的帧
+    Statistics computeStatistics(const vector<double>& times) const;
+};
+
+class CameraPathRecorder {
+public:
+    /// @brief 构造函数
+    /// @param fileName 录制结果保存的文件
+    /// @param window 窗口
+    /// @param scene 场景，用于读取光源
+    CameraPathRecorder(const std::string& fileName, WindowFactory* window, Scene* scene);
+
+    /// @brief 每帧调用，每隔固定的时间记录一个关键帧
+    /// @param packet 这一帧的数据包，摄像机从数据包中读取
+    void sample(const FramePacket& packet);
+
+    /// @brief 保存录制的路径，格式和基准测试配置中的路径相同
+    void save();
+
+private:
+    // 记录关键帧的时间间隔（秒）
+    static constexpr float SAMPLE_INTERVAL = 0.25f;
+
+    std::string fileName;
+    WindowFactory* window;
+    Scene* scene;
+    // 开始录制的时间
+    float startTime = -1.0f;
+    // 上一次记录的时间
+    float lastSampleTime = 0.0f;
+    // 录制的关键帧：时间、摄像机位置、摄像机看向的点、光源方向
+    vector<float> times;
+    vector<glm::vec3> positions;
+    vector<glm::vec3> targets;
+    vector<glm::vec3> lightDirections;
+};
+
+#endif // BENCHMARK_H
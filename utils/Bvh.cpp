@@ -0,0 +1,527 @@
+#include "Bvh.h"
+#include <algorithm>
+#include <cstring>
+
+// 和其他SIMD代码相同，SSE2在所有x64编译器上都可用
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BVH_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+// 包围盒的表面积，SAH用它估计光线穿过节点的概率
+static float surfaceArea(const AABB& box) {
+    glm::vec3 extent = box.max - box.min;
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+static void merge(AABB& box, const AABB& other) {
+    box.min = glm::min(box.min, other.min);
+    box.max = glm::max(box.max, other.max);
+}
+
+void Bvh::build(const void* positions, size_t stride, size_t vertexCount, const unsigned int* indices, size_t indexCount) {
+    this->nodes.clear();
+    this->triangles.clear();
+    this->bounds = AABB();
+    size_t triangleCount = indexCount / 3;
+    this->normals.assign(triangleCount, glm::vec3(0.0f));
+
+    vector<Triangle> triangles;
+    vector<BuildPrimitive> primitives;
+    triangles.reserve(triangleCount);
+    primitives.reserve(triangleCount);
+    const unsigned char* base = (const unsigned char*)positions;
+    for (size_t i = 0; i < triangleCount; i++) {
+        unsigned int a = indices[i * 3], b = indices[i * 3 + 1], c = indices[i * 3 + 2];
+        if (a >= vertexCount || b >= vertexCount || c >= vertexCount)
+            continue;
+        const float* pa = (const float*)(base + a * stride);
+        const float* pb = (const float*)(base + b * stride);
+        const float* pc = (const float*)(base + c * stride);
+        glm::vec3 v0(pa[0], pa[1], pa[2]), v1(pb[0], pb[1], pb[2]), v2(pc[0], pc[1], pc[2]);
+        glm::vec3 edge1 = v1 - v0, edge2 = v2 - v0;
+
+        Triangle triangle;
+        for (int k = 0; k < 3; k++) {
+            triangle.v0[k] = v0[k];
+            triangle.edge1[k] = edge1[k];
+            triangle.edge2[k] = edge2[k];
+        }
+        triangle.index = (int32_t)i;
+        triangles.push_back(triangle);
+        this->normals[i] = glm::cross(edge1, edge2);
+
+        BuildPrimitive primitive;
+        primitive.bounds.expand(v0);
+        primitive.bounds.expand(v1);
+        primitive.bounds.expand(v2);
+        primitive.centroid = (primitive.bounds.min + primitive.bounds.max) * 0.5f;
+        primitives.push_back(primitive);
+        merge(this->bounds, primitive.bounds);
+    }
+    if (triangles.empty())
+        return;
+
+    // 划分时只移动三角形的下标，最后按下标的顺序重新排列三角形，叶子中的三角形连续存放
+    vector<uint32_t> order(triangles.size());
+    for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+        order[i] = i;
+    // 二叉树的节点数不超过三角形数的两倍
+    this->nodes.reserve(triangles.size() * 2);
+    Node root;
+    root.first = 0;
+    root.count = (uint32_t)triangles.size();
+    this->nodes.push_back(root);
+    this->subdivide(0, primitives, order, 1);
+
+    this->triangles.resize(triangles.size());
+    for (size_t i = 0; i < order.size(); i++)
+        this->triangles[i] = triangles[order[i]];
+    this->nodes.shrink_to_fit();
+}
+
+void Bvh::subdivide(uint32_t nodeIndex, vector<BuildPrimitive>& primitives, vector<uint32_t>& order, int depth) {
+    uint32_t first = this->nodes[nodeIndex].first;
+    uint32_t count = this->nodes[nodeIndex].count;
+    AABB nodeBounds, centroidBounds;
+    for (uint32_t i = first; i < first + count; i++) {
+        merge(nodeBounds, primitives[order[i]].bounds);
+        centroidBounds.expand(primitives[order[i]].centroid);
+    }
+    for (int k = 0; k < 3; k++) {
+        this->nodes[nodeIndex].boundsMin[k] = nodeBounds.min[k];
+        this->nodes[nodeIndex].boundsMax[k] = nodeBounds.max[k];
+    }
+    if (count <= 2 || depth >= MAX_DEPTH)
+        return;
+
+    // 在三个轴上分箱，找到SAH开销最小的划分
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    int bestSplit = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        float low = centroidBounds.min[axis], high = centroidBounds.max[axis];
+        if (high <= low)
+            continue;
+        float scale = BIN_COUNT / (high - low);
+        AABB binBounds[BIN_COUNT];
+        uint32_t binCounts[BIN_COUNT] = {};
+        for (uint32_t i = first; i < first + count; i++) {
+            const BuildPrimitive& primitive = primitives[order[i]];
+            int bin = std::min(BIN_COUNT - 1, (int)((primitive.centroid[axis] - low) * scale));
+            binCounts[bin]++;
+            merge(binBounds[bin], primitive.bounds);
+        }
+        // 从左往右累加得到每个划分左侧的面积和数量，再从右往左计算开销
+        float leftArea[BIN_COUNT - 1];
+        uint32_t leftCount[BIN_COUNT - 1];
+        AABB accumulated;
+        uint32_t accumulatedCount = 0;
+        for (int i = 0; i < BIN_COUNT - 1; i++) {
+            if (binCounts[i] > 0)
+                merge(accumulated, binBounds[i]);
+            accumulatedCount += binCounts[i];
+            leftArea[i] = accumulatedCount > 0 ? surfaceArea(accumulated) : 0.0f;
+            leftCount[i] = accumulatedCount;
+        }
+        accumulated = AABB();
+        accumulatedCount = 0;
+        for (int i = BIN_COUNT - 1; i > 0; i--) {
+            if (binCounts[i] > 0)
+                merge(accumulated, binBounds[i]);
+            accumulatedCount += binCounts[i];
+            if (leftCount[i - 1] == 0 || accumulatedCount == 0)
+                continue;
+            float cost = leftArea[i - 1] * leftCount[i - 1] + surfaceArea(accumulated) * accumulatedCount;
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i;
+            }
+        }
+    }
+
+    uint32_t middle;
+    float parentArea = surfaceArea(nodeBounds);
+    float splitCost = TRAVERSAL_COST + INTERSECTION_COST * bestCost / std::max(parentArea, FLT_MIN);
+    float leafCost = INTERSECTION_COST * count;
+    if (bestAxis >= 0 && (splitCost < leafCost || count > MAX_LEAF_SIZE)) {
+        float low = centroidBounds.min[bestAxis];
+        float scale = BIN_COUNT / (centroidBounds.max[bestAxis] - low);
+        uint32_t* split = std::partition(order.data() + first, order.data() + first + count, [&](uint32_t i) {
+            return std::min(BIN_COUNT - 1, (int)((primitives[i].centroid[bestAxis] - low) * scale)) < bestSplit;
+            });
+        middle = (uint32_t)(split - order.data());
+    }
+    else if (count > MAX_LEAF_SIZE) {
+        // 所有中心重合，没法按位置划分，对半分开
+        middle = first + count / 2;
+    }
+    else {
+        return;
+    }
+
+    uint32_t left = (uint32_t)this->nodes.size();
+    Node child;
+    child.first = first;
+    child.count = middle - first;
+    this->nodes.push_back(child);
+    child.first = middle;
+    child.count = first + count - middle;
+    this->nodes.push_back(child);
+    this->nodes[nodeIndex].first = left;
+    this->nodes[nodeIndex].count = 0;
+    this->subdivide(left, primitives, order, depth + 1);
+    this->subdivide(left + 1, primitives, order, depth + 1);
+}
+
+glm::vec3 Bvh::getNormal(int32_t triangle) const {
+    return this->normals[triangle];
+}
+
+#ifdef BVH_USE_SSE
+namespace {
+// 光线包的SSE形式，方向的倒数用于和包围盒求交
+struct PacketSSE {
+    __m128 originX, originY, originZ;
+    __m128 directionX, directionY, directionZ;
+    __m128 inverseX, inverseY, inverseZ;
+    __m128 tMax;
+
+    explicit PacketSSE(const RayPacket& packet) {
+        const __m128 one = _mm_set1_ps(1.0f);
+        this->originX = _mm_load_ps(packet.originX);
+        this->originY = _mm_load_ps(packet.originY);
+        this->originZ = _mm_load_ps(packet.originZ);
+        this->directionX = _mm_load_ps(packet.directionX);
+        this->directionY = _mm_load_ps(packet.directionY);
+        this->directionZ = _mm_load_ps(packet.directionZ);
+        this->inverseX = _mm_div_ps(one, this->directionX);
+        this->inverseY = _mm_div_ps(one, this->directionY);
+        this->inverseZ = _mm_div_ps(one, this->directionZ);
+        this->tMax = _mm_load_ps(packet.tMax);
+    }
+};
+
+inline __m128 select(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// 4条光线和一个包围盒求交，返回相交的光线的掩码，entry是相交的光线中最近的进入距离
+template <typename NodeT>
+inline int intersectBox(const PacketSSE& packet, const NodeT& node, float& entry) {
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin[0]), packet.originX), packet.inverseX);
+    __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax[0]), packet.originX), packet.inverseX);
+    __m128 tNear = _mm_min_ps(t1, t2);
+    __m128 tFar = _mm_max_ps(t1, t2);
+    t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin[1]), packet.originY), packet.inverseY);
+    t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax[1]), packet.originY), packet.inverseY);
+    tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+    tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+    t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin[2]), packet.originZ), packet.inverseZ);
+    t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax[2]), packet.originZ), packet.inverseZ);
+    tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+    tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+    tNear = _mm_max_ps(tNear, _mm_setzero_ps());
+    __m128 hit = _mm_and_ps(_mm_cmple_ps(tNear, tFar), _mm_cmple_ps(tNear, packet.tMax));
+    int mask = _mm_movemask_ps(hit);
+    if (mask) {
+        // 没有相交的光线换成最大值，再求4个数中的最小值
+        __m128 nearest = select(hit, tNear, _mm_set1_ps(FLT_MAX));
+        nearest = _mm_min_ps(nearest, _mm_shuffle_ps(nearest, nearest, _MM_SHUFFLE(2, 3, 0, 1)));
+        nearest = _mm_min_ps(nearest, _mm_shuffle_ps(nearest, nearest, _MM_SHUFFLE(1, 0, 3, 2)));
+        entry = _mm_cvtss_f32(nearest);
+    }
+    return mask;
+}
+
+// 4条光线和一个三角形求交（Möller-Trumbore），返回在(0, tMax)范围内相交的掩码
+template <typename TriangleT>
+inline __m128 intersectTriangle(const PacketSSE& packet, const TriangleT& triangle, __m128& t, __m128& u, __m128& v) {
+    const __m128 edge1X = _mm_set1_ps(triangle.edge1[0]), edge1Y = _mm_set1_ps(triangle.edge1[1]), edge1Z = _mm_set1_ps(triangle.edge1[2]);
+    const __m128 edge2X = _mm_set1_ps(triangle.edge2[0]), edge2Y = _mm_set1_ps(triangle.edge2[1]), edge2Z = _mm_set1_ps(triangle.edge2[2]);
+    // p = d x e2
+    __m128 pX = _mm_sub_ps(_mm_mul_ps(packet.directionY, edge2Z), _mm_mul_ps(packet.directionZ, edge2Y));
+    __m128 pY = _mm_sub_ps(_mm_mul_ps(packet.directionZ, edge2X), _mm_mul_ps(packet.directionX, edge2Z));
+    __m128 pZ = _mm_sub_ps(_mm_mul_ps(packet.directionX, edge2Y), _mm_mul_ps(packet.directionY, edge2X));
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1X, pX), _mm_mul_ps(edge1Y, pY)), _mm_mul_ps(edge1Z, pZ));
+    // 行列式为0时倒数是无穷大，之后的比较都不成立
+    __m128 inverseDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+    // s = o - v0
+    __m128 sX = _mm_sub_ps(packet.originX, _mm_set1_ps(triangle.v0[0]));
+    __m128 sY = _mm_sub_ps(packet.originY, _mm_set1_ps(triangle.v0[1]));
+    __m128 sZ = _mm_sub_ps(packet.originZ, _mm_set1_ps(triangle.v0[2]));
+    u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sX, pX), _mm_mul_ps(sY, pY)), _mm_mul_ps(sZ, pZ)), inverseDet);
+    // q = s x e1
+    __m128 qX = _mm_sub_ps(_mm_mul_ps(sY, edge1Z), _mm_mul_ps(sZ, edge1Y));
+    __m128 qY = _mm_sub_ps(_mm_mul_ps(sZ, edge1X), _mm_mul_ps(sX, edge1Z));
+    __m128 qZ = _mm_sub_ps(_mm_mul_ps(sX, edge1Y), _mm_mul_ps(sY, edge1X));
+    v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(packet.directionX, qX), _mm_mul_ps(packet.directionY, qY)), _mm_mul_ps(packet.directionZ, qZ)), inverseDet);
+    t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge2X, qX), _mm_mul_ps(edge2Y, qY)), _mm_mul_ps(edge2Z, qZ)), inverseDet);
+
+    const __m128 zero = _mm_setzero_ps();
+    __m128 mask = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, zero));
+    return _mm_and_ps(mask, _mm_cmplt_ps(t, packet.tMax));
+}
+}
+#endif
+
+void Bvh::intersect(const RayPacket& packet, PacketHit& hit) const {
+#ifdef BVH_USE_SSE
+    PacketSSE rays(packet);
+    __m128i triangleIndex = _mm_set1_epi32(-1);
+    __m128 hitU = _mm_setzero_ps(), hitV = _mm_setzero_ps();
+    float entry;
+    if (!this->nodes.empty() && intersectBox(rays, this->nodes[0], entry)) {
+        uint32_t stack[MAX_DEPTH + 1];
+        int stackSize = 0;
+        uint32_t nodeIndex = 0;
+        while (true) {
+            const Node& node = this->nodes[nodeIndex];
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    __m128 t, u, v;
+                    __m128 mask = intersectTriangle(rays, this->triangles[i], t, u, v);
+                    if (_mm_movemask_ps(mask)) {
+                        rays.tMax = select(mask, t, rays.tMax);
+                        hitU = select(mask, u, hitU);
+                        hitV = select(mask, v, hitV);
+                        __m128i intMask = _mm_castps_si128(mask);
+                        triangleIndex = _mm_or_si128(_mm_and_si128(intMask, _mm_set1_epi32(this->triangles[i].index)), _mm_andnot_si128(intMask, triangleIndex));
+                    }
+                }
+            }
+            else {
+                // 两个子节点都相交时先进入近的，远的压栈
+                float leftEntry, rightEntry;
+                int leftMask = intersectBox(rays, this->nodes[node.first], leftEntry);
+                int rightMask = intersectBox(rays, this->nodes[node.first + 1], rightEntry);
+                if (leftMask && rightMask) {
+                    bool leftFirst = leftEntry <= rightEntry;
+                    stack[stackSize++] = leftFirst ? node.first + 1 : node.first;
+                    nodeIndex = leftFirst ? node.first : node.first + 1;
+                    continue;
+                }
+                if (leftMask || rightMask) {
+                    nodeIndex = leftMask ? node.first : node.first + 1;
+                    continue;
+                }
+            }
+            // 出栈时重新测试，找到更近的交点后很多节点已经不需要访问了
+            bool found = false;
+            while (stackSize > 0) {
+                nodeIndex = stack[--stackSize];
+                if (intersectBox(rays, this->nodes[nodeIndex], entry)) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found)
+                break;
+        }
+    }
+    _mm_store_ps(hit.t, rays.tMax);
+    _mm_store_si128((__m128i*)hit.triangle, triangleIndex);
+    _mm_store_ps(hit.u, hitU);
+    _mm_store_ps(hit.v, hitV);
+#else
+    this->intersectScalar(packet, hit);
+#endif
+}
+
+unsigned int Bvh::occluded(const RayPacket& packet) const {
+#ifdef BVH_USE_SSE
+    PacketSSE rays(packet);
+    // 只有tMax大于0的光线参与测试，全部被遮挡时提前结束
+    const int activeMask = _mm_movemask_ps(_mm_cmpgt_ps(rays.tMax, _mm_setzero_ps()));
+    int occludedMask = 0;
+    float entry;
+    if (activeMask == 0 || this->nodes.empty() || !intersectBox(rays, this->nodes[0], entry))
+        return 0;
+    uint32_t stack[MAX_DEPTH + 1];
+    int stackSize = 0;
+    uint32_t nodeIndex = 0;
+    while (true) {
+        const Node& node = this->nodes[nodeIndex];
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                __m128 t, u, v;
+                __m128 mask = intersectTriangle(rays, this->triangles[i], t, u, v);
+                int hitMask = _mm_movemask_ps(mask);
+                if (hitMask) {
+                    occludedMask |= hitMask;
+                    if (occludedMask == activeMask)
+                        return (unsigned int)occludedMask;
+                    // 被遮挡的光线不再参与求交
+                    rays.tMax = select(mask, _mm_set1_ps(-1.0f), rays.tMax);
+                }
+            }
+        }
+        else {
+            float leftEntry, rightEntry;
+            int leftMask = intersectBox(rays, this->nodes[node.first], leftEntry);
+            int rightMask = intersectBox(rays, this->nodes[node.first + 1], rightEntry);
+            if (leftMask && rightMask) {
+                bool leftFirst = leftEntry <= rightEntry;
+                stack[stackSize++] = leftFirst ? node.first + 1 : node.first;
+                nodeIndex = leftFirst ? node.first : node.first + 1;
+                continue;
+            }
+            if (leftMask || rightMask) {
+                nodeIndex = leftMask ? node.first : node.first + 1;
+                continue;
+            }
+        }
+        bool found = false;
+        while (stackSize > 0) {
+            nodeIndex = stack[--stackSize];
+            if (intersectBox(rays, this->nodes[nodeIndex], entry)) {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            break;
+    }
+    return (unsigned int)occludedMask;
+#else
+    return this->occludedScalar(packet);
+#endif
+}
+
+namespace {
+// 一条光线的标量形式
+struct ScalarRay {
+    float origin[3];
+    float direction[3];
+    float inverse[3];
+    float tMax;
+
+    ScalarRay(const RayPacket& packet, int i) {
+        this->origin[0] = packet.originX[i];
+        this->origin[1] = packet.originY[i];
+        this->origin[2] = packet.originZ[i];
+        this->direction[0] = packet.directionX[i];
+        this->direction[1] = packet.directionY[i];
+        this->direction[2] = packet.directionZ[i];
+        for (int k = 0; k < 3; k++)
+            this->inverse[k] = 1.0f / this->direction[k];
+        this->tMax = packet.tMax[i];
+    }
+};
+
+template <typename NodeT>
+inline bool intersectBoxScalar(const ScalarRay& ray, const NodeT& node, float& entry) {
+    float tNear = 0.0f, tFar = ray.tMax;
+    for (int k = 0; k < 3; k++) {
+        float t1 = (node.boundsMin[k] - ray.origin[k]) * ray.inverse[k];
+        float t2 = (node.boundsMax[k] - ray.origin[k]) * ray.inverse[k];
+        tNear = std::max(tNear, std::min(t1, t2));
+        tFar = std::min(tFar, std::max(t1, t2));
+    }
+    entry = tNear;
+    return tNear <= tFar;
+}
+
+template <typename TriangleT>
+inline bool intersectTriangleScalar(const ScalarRay& ray, const TriangleT& triangle, float& t, float& u, float& v) {
+    const float* d = ray.direction;
+    const float* e1 = triangle.edge1;
+    const float* e2 = triangle.edge2;
+    float p[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+    float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if (det == 0.0f)
+        return false;
+    float inverseDet = 1.0f / det;
+    float s[3] = { ray.origin[0] - triangle.v0[0], ray.origin[1] - triangle.v0[1], ray.origin[2] - triangle.v0[2] };
+    u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverseDet;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+    float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+    v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inverseDet;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+    t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverseDet;
+    return t > 0.0f && t < ray.tMax;
+}
+}
+
+void Bvh::intersectScalar(const RayPacket& packet, PacketHit& hit) const {
+    for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+        ScalarRay ray(packet, lane);
+        hit.triangle[lane] = -1;
+        hit.u[lane] = 0.0f;
+        hit.v[lane] = 0.0f;
+        float entry;
+        if (ray.tMax > 0.0f && !this->nodes.empty() && intersectBoxScalar(ray, this->nodes[0], entry)) {
+            uint32_t stack[MAX_DEPTH + 1];
+            int stackSize = 0;
+            stack[stackSize++] = 0;
+            while (stackSize > 0) {
+                const Node& node = this->nodes[stack[--stackSize]];
+                if (!intersectBoxScalar(ray, node, entry))
+                    continue;
+                if (node.count > 0) {
+                    for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                        float t, u, v;
+                        if (intersectTriangleScalar(ray, this->triangles[i], t, u, v)) {
+                            ray.tMax = t;
+                            hit.triangle[lane] = this->triangles[i].index;
+                            hit.u[lane] = u;
+                            hit.v[lane] = v;
+                        }
+                    }
+                }
+                else {
+                    float leftEntry, rightEntry;
+                    bool leftHit = intersectBoxScalar(ray, this->nodes[node.first], leftEntry);
+                    bool rightHit = intersectBoxScalar(ray, this->nodes[node.first + 1], rightEntry);
+                    // 近的子节点后压栈，先出栈
+                    bool leftFirst = leftEntry <= rightEntry;
+                    if (leftHit && rightHit) {
+                        stack[stackSize++] = leftFirst ? node.first + 1 : node.first;
+                        stack[stackSize++] = leftFirst ? node.first : node.first + 1;
+                    }
+                    else if (leftHit || rightHit) {
+                        stack[stackSize++] = leftHit ? node.first : node.first + 1;
+                    }
+                }
+            }
+        }
+        hit.t[lane] = ray.tMax;
+    }
+}
+
+unsigned int Bvh::occludedScalar(const RayPacket& packet) const {
+    unsigned int occludedMask = 0;
+    for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+        ScalarRay ray(packet, lane);
+        float entry;
+        if (ray.tMax <= 0.0f || this->nodes.empty() || !intersectBoxScalar(ray, this->nodes[0], entry))
+            continue;
+        uint32_t stack[MAX_DEPTH + 1];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        bool blocked = false;
+        while (stackSize > 0 && !blocked) {
+            const Node& node = this->nodes[stack[--stackSize]];
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count && !blocked; i++) {
+                    float t, u, v;
+                    blocked = intersectTriangleScalar(ray, this->triangles[i], t, u, v);
+                }
+            }
+            else {
+                if (intersectBoxScalar(ray, this->nodes[node.first], entry))
+                    stack[stackSize++] = node.first;
+                if (intersectBoxScalar(ray, this->nodes[node.first + 1], entry))
+                    stack[stackSize++] = node.first + 1;
+            }
+        }
+        if (blocked)
+            occludedMask |= 1u << lane;
+    }
+    return occludedMask;
+}
@@ -0,0 +1,121 @@
+#ifndef BVH_H
+#define BVH_H
+
+// 定义了三角形的层次包围盒（BVH），用于CPU上的光线追踪
+// 构建时在每个节点上按分箱的表面积启发式（SAH）选择划分，节点展平成数组，两个子节点相邻存放
+// 光线以4条为一个包遍历：一次测试4条光线和节点包围盒、4条光线和一个三角形，
+// 编译器没有开启SSE时退回逐条光线的标量实现
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Culling.h"
+
+using std::vector;
+
+// 一个光线包中的光线数
+const int RAY_PACKET_SIZE = 4;
+
+// 4条光线的包，按分量分别存放，tMax小于0的光线不参与求交
+struct alignas(16) RayPacket {
+    float originX[RAY_PACKET_SIZE], originY[RAY_PACKET_SIZE], originZ[RAY_PACKET_SIZE];
+    float directionX[RAY_PACKET_SIZE], directionY[RAY_PACKET_SIZE], directionZ[RAY_PACKET_SIZE];
+    float tMax[RAY_PACKET_SIZE];
+
+    /// @brief 设置第i条光线
+    void set(int i, const glm::vec3& origin, const glm::vec3& direction, float tMax) {
+        this->originX[i] = origin.x;
+        this->originY[i] = origin.y;
+        this->originZ[i] = origin.z;
+        this->directionX[i] = direction.x;
+        this->directionY[i] = direction.y;
+        this->directionZ[i] = direction.z;
+        this->tMax[i] = tMax;
+    }
+    /// @brief 停用第i条光线
+    void disable(int i) {
+        this->set(i, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), -1.0f);
+    }
+};
+
+// 光线包的最近交点
+struct alignas(16) PacketHit {
+    float t[RAY_PACKET_SIZE];
+    // 相交的三角形在构建时的下标，没有相交时是-1
+    int32_t triangle[RAY_PACKET_SIZE];
+    // 交点的重心坐标，交点 = (1 - u - v) * v0 + u * v1 + v * v2
+    float u[RAY_PACKET_SIZE], v[RAY_PACKET_SIZE];
+};
+
+class Bvh {
+public:
+    /// @brief 构建层次包围盒，三角形的顶点按下标顺序是v0、v1、v2
+    /// @param positions 第一个顶点位置（3个float）的地址
+    /// @param stride 相邻两个顶点的字节距离
+    /// @param vertexCount 顶点数，超出范围的下标所在的三角形会被跳过
+    /// @param indices 三角形的顶点下标
+    /// @param indexCount 下标数
+    void build(const void* positions, size_t stride, size_t vertexCount, const unsigned int* indices, size_t indexCount);
+
+    /// @brief 求光线包的最近交点
+    void intersect(const RayPacket& packet, PacketHit& hit) const;
+
+    /// @brief 测试光线包在(0, tMax)范围内是否被遮挡，找到任意交点即停止
+    /// @return 第i位表示第i条光线被遮挡
+    unsigned int occluded(const RayPacket& packet) const;
+
+    /// @brief 场景的包围盒
+    const AABB& getBounds() const { return this->bounds; }
+    /// @brief 三角形数（不包括被跳过的三角形）
+    size_t getTriangleCount() const { return this->triangles.size(); }
+    /// @brief 节点数
+    size_t getNodeCount() const { return this->nodes.size(); }
+    /// @brief 三角形的几何法线（没有归一化），方向由顶点的环绕顺序决定
+    glm::vec3 getNormal(int32_t triangle) const;
+
+private:
+    // 展平的节点，叶子的count大于0，first是第一个三角形；内部节点的count为0，first是左子节点，右子节点紧跟在后面
+    struct Node {
+        float boundsMin[3];
+        uint32_t first;
+        float boundsMax[3];
+        uint32_t count;
+    };
+    // 预先计算好求交用的顶点和两条边
+    struct Triangle {
+        float v0[3];
+        float edge1[3];
+        float edge2[3];
+        // 构建时的下标，排序后用来报告相交的三角形
+        int32_t index;
+    };
+    // 构建时每个三角形的包围盒和中心
+    struct BuildPrimitive {
+        AABB bounds;
+        glm::vec3 centroid;
+    };
+
+    // SAH划分的分箱数
+    static const int BIN_COUNT = 16;
+    // 叶子最多包含的三角形数，超过时即使SAH认为不划分更好也继续划分
+    static const uint32_t MAX_LEAF_SIZE = 8;
+    // 遍历栈的深度，构建时超过这个深度的节点直接作为叶子
+    static const int MAX_DEPTH = 64;
+    // SAH中遍历一个节点和测试一个三角形的相对开销
+    static constexpr float TRAVERSAL_COST = 1.0f;
+    static constexpr float INTERSECTION_COST = 1.0f;
+
+    vector<Node> nodes;
+    vector<Triangle> triangles;
+    // 按构建时的下标存放的几何法线
+    vector<glm::vec3> normals;
+    AABB bounds;
+
+    /// @brief 递归划分节点
+    void subdivide(uint32_t nodeIndex, vector<BuildPrimitive>& primitives, vector<uint32_t>& order, int depth);
+    /// @brief 逐条光线的标量实现，也用于没有SSE的编译器
+    void intersectScalar(const RayPacket& packet, PacketHit& hit) const;
+    unsigned int occludedScalar(const RayPacket& packet) const;
+};
+
+#endif // BVH_H
@@ -0,0 +1,386 @@
+#include "CpuLightmapBaker.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "JobSystem.h"
+
+namespace {
+const float PI = 3.14159265358979f;
+
+// PCG哈希，用于给每个纹素一个独立的随机数序列
+inline uint32_t pcgHash(uint32_t value) {
+    uint32_t state = value * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// [0, 1)范围内的随机数
+inline float nextRandom(uint32_t& state) {
+    state = pcgHash(state);
+    return (float)(state >> 8) * (1.0f / 16777216.0f);
+}
+
+// 以法线为z轴的余弦加权半球方向，切线空间用Duff等人的无分支方法构建
+glm::vec3 sampleCosineHemisphere(const glm::vec3& normal, uint32_t& state) {
+    float u1 = nextRandom(state), u2 = nextRandom(state);
+    float r = std::sqrt(u1);
+    float phi = 2.0f * PI * u2;
+    float x = r * std::cos(phi), y = r * std::sin(phi), z = std::sqrt(std::max(0.0f, 1.0f - u1));
+
+    float sign = std::copysign(1.0f, normal.z);
+    float a = -1.0f / (sign + normal.z);
+    float b = normal.x * normal.y * a;
+    glm::vec3 tangent(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+    glm::vec3 bitangent(b, sign + normal.y * normal.y * a, -normal.y);
+    return tangent * x + bitangent * y + normal * z;
+}
+}
+
+void CpuLightmapBaker::setLights(const vector<DirectionalLight>& directionalLights, const vector<PointLight>& pointLights) {
+    this->directionalLights = directionalLights;
+    this->pointLights = pointLights;
+}
+
+float CpuLightmapBaker::getProgress() const {
+    return this->totalRows > 0 ? (float)this->finishedRows / this->totalRows : 0.0f;
+}
+
+bool CpuLightmapBaker::bake(const vector<vertex_t>& vertices, const vector<unsigned int>& indices, int width, int height, float* output) {
+    memset(output, 0, (size_t)width * height * 4 * sizeof(float));
+    this->setScene(vertices, indices, height);
+    if (vertices.empty() || indices.empty())
+        return true;
+    LightmapRegion region;
+    region.width = width;
+    region.height = height;
+    return this->bakeObject(vertices, indices, width, height, output, region, 0);
+}
+
+void CpuLightmapBaker::setScene(const vector<vertex_t>& vertices, const vector<unsigned int>& indices, int totalRows) {
+    this->finishedRows = 0;
+    this->totalRows = totalRows;
+    // atomic不能复制，只能重新构造
+    this->rowFinished = vector<std::atomic<char>>(std::max(totalRows, 0));
+    for (std::atomic<char>& finished : this->rowFinished)
+        finished = 0;
+    // 场景任务还在队列中时就可能被取消，这时不用再建立层级包围盒
+    if (this->cancelled || vertices.empty() || indices.empty())
+        return;
+
+    this->bvh.build(vertices.data()->p, sizeof(vertex_t), vertices.size(), indices.data(), indices.size());
+    glm::vec3 extent = this->bvh.getBounds().max - this->bvh.getBounds().min;
+    this->rayOffset = std::max(1e-4f * std::max(std::max(extent.x, extent.y), extent.z), 1e-5f);
+    printf("cpu lightmap: %zu triangles, %zu bvh nodes\n", this->bvh.getTriangleCount(), this->bvh.getNodeCount());
+}
+
+vector<char> CpuLightmapBaker::getFinishedRows() const {
+    vector<char> rows(this->rowFinished.size());
+    for (size_t i = 0; i < rows.size(); i++)
+        rows[i] = this->rowFinished[i].load(std::memory_order_acquire);
+    return rows;
+}
+
+void CpuLightmapBaker::restoreFinishedRows(const vector<char>& rows) {
+    if (rows.size() != this->rowFinished.size())
+        return;
+    int finished = 0;
+    for (size_t i = 0; i < rows.size(); i++) {
+        this->rowFinished[i] = rows[i] ? 1 : 0;
+        finished += rows[i] ? 1 : 0;
+    }
+    this->finishedRows = finished;
+}
+
+void CpuLightmapBaker::copyFinishedRows(const float* lightmap, int width, int height, const vector<LightmapRegion>& regions, const vector<char>& finishedRows, vector<float>& out) {
+    out.assign((size_t)width * height * 4, 0.0f);
+    size_t firstRow = 0;
+    for (const LightmapRegion& region : regions) {
+        // 和rasterize一样裁掉区域超出光照贴图的部分，行的序号从裁剪后的第一行开始
+        int minX = std::max(0, region.x), maxX = std::min(width, region.x + region.width);
+        int minY = std::max(0, region.y), maxY = std::min(height, region.y + region.height);
+        for (int y = minY; y < maxY && minX < maxX; y++) {
+            size_t row = firstRow + (y - minY);
+            if (row >= finishedRows.size() || !finishedRows[row])
+                continue;
+            size_t offset = ((size_t)y * width + minX) * 4;
+            memcpy(out.data() + offset, lightmap + offset, (size_t)(maxX - minX) * 4 * sizeof(float));
+        }
+        firstRow += region.height;
+    }
+}
+
+bool CpuLightmapBaker::bakeObject(const vector<vertex_t>& vertices, const vector<unsigned int>& indices, int width, int height, float* output, const LightmapRegion& region, size_t firstRow) {
+    vector<vector<TexelSample>> rows = this->rasterize(vertices, indices, width, height, region);
+
+    JobSystem::instance().parallelFor(rows.size(), ROW_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; y++) {
+            if (this->cancelled)
+                return;
+            // 从断点继续时跳过已经完成的行，输出中已经是它的结果
+            std::atomic<char>* finished = firstRow + y < this->rowFinished.size() ? &this->rowFinished[firstRow + y] : nullptr;
+            if (finished && finished->load(std::memory_order_relaxed))
+                continue;
+            const vector<TexelSample>& row = rows[y];
+            // 同一行相邻的4个纹素一起计算直接光照，阴影光线的起点和方向都很接近
+            for (size_t i = 0; i < row.size(); i += RAY_PACKET_SIZE) {
+                glm::vec3 positions[RAY_PACKET_SIZE], normals[RAY_PACKET_SIZE], direct[RAY_PACKET_SIZE];
+                unsigned int activeMask = 0;
+                for (int lane = 0; lane < RAY_PACKET_SIZE && i + lane < row.size(); lane++) {
+                    positions[lane] = row[i + lane].position;
+                    normals[lane] = row[i + lane].normal;
+                    activeMask |= 1u << lane;
+                }
+                this->directLighting(positions, normals, activeMask, direct);
+                for (int lane = 0; lane < RAY_PACKET_SIZE && i + lane < row.size(); lane++) {
+                    const TexelSample& sample = row[i + lane];
+                    uint32_t state = pcgHash(sample.texel ^ pcgHash(this->settings.seed));
+                    glm::vec3 irradiance = direct[lane] + this->traceHemisphere(sample, state);
+                    float* texel = output + (size_t)sample.texel * 4;
+                    texel[0] = irradiance.x;
+                    texel[1] = irradiance.y;
+                    texel[2] = irradiance.z;
+                    texel[3] = 1.0f;
+                }
+            }
+            // 先写入结果再设置标志，读取标志的线程能看到这一行的结果
+            if (finished)
+                finished->store(1, std::memory_order_release);
+            this->finishedRows++;
+        }
+        });
+    return !this->cancelled;
+}
+
+vector<vector<CpuLightmapBaker::TexelSample>> CpuLightmapBaker::rasterize(const vector<vertex_t>& vertices, const vector<unsigned int>& indices, int width, int height, const LightmapRegion& region) const {
+    // 只光栅化区域内的纹素，区域超出光照贴图的部分被裁掉
+    int regionMinX = std::max(0, region.x), regionMaxX = std::min(width, region.x + region.width) - 1;
+    int regionMinY = std::max(0, region.y), regionMaxY = std::min(height, region.y + region.height) - 1;
+    if (regionMaxX < regionMinX || regionMaxY < regionMinY)
+        return vector<vector<TexelSample>>();
+    int regionWidth = regionMaxX - regionMinX + 1, regionHeight = regionMaxY - regionMinY + 1;
+    vector<TexelSample> texels((size_t)regionWidth * regionHeight);
+    vector<bool> covered((size_t)regionWidth * regionHeight, false);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        if (a >= vertices.size() || b >= vertices.size() || c >= vertices.size())
+            continue;
+        const vertex_t* v[3] = { &vertices[a], &vertices[b], &vertices[c] };
+        glm::vec3 p[3];
+        glm::vec2 uv[3];
+        for (int k = 0; k < 3; k++) {
+            p[k] = glm::vec3(v[k]->p[0], v[k]->p[1], v[k]->p[2]);
+            uv[k] = glm::vec2(v[k]->lm[0] * width, v[k]->lm[1] * height);
+        }
+        glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        float normalLength = glm::length(normal);
+        float area = (uv[1].x - uv[0].x) * (uv[2].y - uv[0].y) - (uv[2].x - uv[0].x) * (uv[1].y - uv[0].y);
+        if (normalLength == 0.0f || area == 0.0f)
+            continue;
+        normal = normal / normalLength;
+
+        // 纹素中心在三角形内（用重心坐标判断）就采样，细长的三角形漏掉的纹素由扩张填充
+        int minX = std::max(regionMinX, (int)std::floor(std::min(std::min(uv[0].x, uv[1].x), uv[2].x)));
+        int maxX = std::min(regionMaxX, (int)std::ceil(std::max(std::max(uv[0].x, uv[1].x), uv[2].x)));
+        int minY = std::max(regionMinY, (int)std::floor(std::min(std::min(uv[0].y, uv[1].y), uv[2].y)));
+        int maxY = std::min(regionMaxY, (int)std::ceil(std::max(std::max(uv[0].y, uv[1].y), uv[2].y)));
+        float inverseArea = 1.0f / area;
+        for (int y = minY; y <= maxY; y++) {
+            for (int x = minX; x <= maxX; x++) {
+                glm::vec2 center(x + 0.5f, y + 0.5f);
+                float w1 = ((center.x - uv[0].x) * (uv[2].y - uv[0].y) - (uv[2].x - uv[0].x) * (center.y - uv[0].y)) * inverseArea;
+                float w2 = ((uv[1].x - uv[0].x) * (center.y - uv[0].y) - (center.x - uv[0].x) * (uv[1].y - uv[0].y)) * inverseArea;
+                float w0 = 1.0f - w1 - w2;
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                    continue;
+                size_t local = (size_t)(y - regionMinY) * regionWidth + (x - regionMinX);
+                texels[local].position = p[0] * w0 + p[1] * w1 + p[2] * w2;
+                texels[local].normal = normal;
+                texels[local].texel = (uint32_t)((size_t)y * width + x);
+                covered[local] = true;
+            }
+        }
+    }
+
+    vector<vector<TexelSample>> rows(regionHeight);
+    for (int y = 0; y < regionHeight; y++) {
+        for (int x = 0; x < regionWidth; x++) {
+            size_t local = (size_t)y * regionWidth + x;
+            if (covered[local])
+                rows[y].push_back(texels[local]);
+        }
+    }
+    return rows;
+}
+
+void CpuLightmapBaker::directLighting(const glm::vec3 positions[RAY_PACKET_SIZE], const glm::vec3 normals[RAY_PACKET_SIZE], unsigned int activeMask, glm::vec3 out[RAY_PACKET_SIZE]) const {
+    for (int lane = 0; lane < RAY_PACKET_SIZE; lane++)
+        out[lane] = glm::vec3(0.0f);
+    RayPacket packet;
+    float cosine[RAY_PACKET_SIZE];
+    float attenuation[RAY_PACKET_SIZE];
+
+    for (const DirectionalLight& light : this->directionalLights) {
+        glm::vec3 toLight = -glm::normalize(light.direction);
+        unsigned int litMask = 0;
+        for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+            cosine[lane] = (activeMask & (1u << lane)) ? glm::dot(normals[lane], toLight) : 0.0f;
+            if (cosine[lane] > 0.0f) {
+                packet.set(lane, positions[lane] + normals[lane] * this->rayOffset, toLight, FLT_MAX);
+                litMask |= 1u << lane;
+            }
+            else {
+                packet.disable(lane);
+            }
+        }
+        if (litMask == 0)
+            continue;
+        litMask &= ~this->bvh.occluded(packet);
+        for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+            if (litMask & (1u << lane))
+                out[lane] += light.radiance * cosine[lane];
+        }
+    }
+
+    for (const PointLight& light : this->pointLights) {
+        unsigned int litMask = 0;
+        for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+            packet.disable(lane);
+            if (!(activeMask & (1u << lane)))
+                continue;
+            glm::vec3 origin = positions[lane] + normals[lane] * this->rayOffset;
+            glm::vec3 toLight = light.position - origin;
+            float distance = glm::length(toLight);
+            if (distance <= this->rayOffset)
+                continue;
+            toLight = toLight / distance;
+            cosine[lane] = glm::dot(normals[lane], toLight);
+            if (cosine[lane] <= 0.0f)
+                continue;
+            attenuation[lane] = 1.0f / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+            // 点光源可能在某个模型内部（比如灯泡），阴影光线在到达光源之前停下
+            packet.set(lane, origin, toLight, distance - this->rayOffset);
+            litMask |= 1u << lane;
+        }
+        if (litMask == 0)
+            continue;
+        litMask &= ~this->bvh.occluded(packet);
+        for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+            if (litMask & (1u << lane))
+                out[lane] += light.radiance * (cosine[lane] * attenuation[lane]);
+        }
+    }
+}
+
+glm::vec3 CpuLightmapBaker::traceHemisphere(const TexelSample& sample, uint32_t& state) const {
+    const unsigned int packetCount = std::max(1u, (this->settings.samples + RAY_PACKET_SIZE - 1) / RAY_PACKET_SIZE);
+    glm::vec3 total(0.0f);
+    RayPacket packet;
+    glm::vec3 radiance[RAY_PACKET_SIZE];
+
+    for (unsigned int p = 0; p < packetCount; p++) {
+        // 一个包里的4条光线从同一个纹素出发，遍历时访问的节点大部分相同
+        glm::vec3 origin = sample.position + sample.normal * this->rayOffset;
+        for (int lane = 0; lane < RAY_PACKET_SIZE; lane++)
+            packet.set(lane, origin, sampleCosineHemisphere(sample.normal, state), FLT_MAX);
+        this->tracePaths(packet, state, radiance, nullptr);
+        for (int lane = 0; lane < RAY_PACKET_SIZE; lane++)
+            total += radiance[lane];
+    }
+    return total / (float)(packetCount * RAY_PACKET_SIZE);
+}
+
+void CpuLightmapBaker::tracePaths(RayPacket& packet, uint32_t& state, glm::vec3 radiance[RAY_PACKET_SIZE], unsigned int* backfaceMask) const {
+    PacketHit hit;
+    glm::vec3 throughput[RAY_PACKET_SIZE];
+    glm::vec3 hitPositions[RAY_PACKET_SIZE], hitNormals[RAY_PACKET_SIZE], direct[RAY_PACKET_SIZE];
+    for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+        radiance[lane] = glm::vec3(0.0f);
+        throughput[lane] = glm::vec3(1.0f);
+    }
+    if (backfaceMask)
+        *backfaceMask = 0;
+
+    unsigned int activeMask = (1u << RAY_PACKET_SIZE) - 1;
+    // 第0次是起点发出的光线，之后每次反弹发出一条新的光线
+    for (unsigned int bounce = 0; bounce <= this->settings.bounces && activeMask; bounce++) {
+        this->bvh.intersect(packet, hit);
+        unsigned int hitMask = 0;
+        for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+            if (!(activeMask & (1u << lane)))
+                continue;
+            if (hit.triangle[lane] < 0) {
+                // 没有击中，看到天空
+                radiance[lane] += throughput[lane] * this->settings.skyColor;
+                continue;
+            }
+            glm::vec3 direction(packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]);
+            glm::vec3 rayOrigin(packet.originX[lane], packet.originY[lane], packet.originZ[lane]);
+            hitPositions[lane] = rayOrigin + direction * hit.t[lane];
+            // 三角形是双面的，法线朝向光线来的一侧
+            glm::vec3 normal = glm::normalize(this->bvh.getNormal(hit.triangle[lane]));
+            bool backface = glm::dot(normal, direction) > 0.0f;
+            hitNormals[lane] = backface ? -normal : normal;
+            if (backfaceMask && bounce == 0 && backface)
+                *backfaceMask |= 1u << lane;
+            hitMask |= 1u << lane;
+        }
+        activeMask = hitMask;
+        if (!hitMask)
+            break;
+
+        this->directLighting(hitPositions, hitNormals, hitMask, direct);
+        for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+            if (!(hitMask & (1u << lane))) {
+                packet.disable(lane);
+                continue;
+            }
+            throughput[lane] *= this->settings.albedo;
+            radiance[lane] += throughput[lane] * direct[lane];
+            packet.set(lane, hitPositions[lane] + hitNormals[lane] * this->rayOffset, sampleCosineHemisphere(hitNormals[lane], state), FLT_MAX);
+        }
+    }
+}
+
+bool CpuLightmapBaker::bakeProbes(const vector<glm::vec3>& positions, unsigned int samples, vector<LightProbe>& out) {
+    out.assign(positions.size(), LightProbe());
+    const unsigned int packetCount = std::max(1u, (samples + RAY_PACKET_SIZE - 1) / RAY_PACKET_SIZE);
+    const unsigned int rayCount = packetCount * RAY_PACKET_SIZE;
+    // 所有探针使用相同的球面斐波那契方向，比随机方向分布得更均匀，投影到球谐的误差更小
+    vector<glm::vec3> directions(rayCount);
+    const float goldenAngle = PI * (3.0f - std::sqrt(5.0f));
+    for (unsigned int i = 0; i < rayCount; i++) {
+        float z = 1.0f - (2.0f * i + 1.0f) / rayCount;
+        float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        float phi = goldenAngle * i;
+        directions[i] = glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+    // 每个方向代表的立体角
+    const float weight = 4.0f * PI / rayCount;
+
+    JobSystem::instance().parallelFor(positions.size(), PROBE_GRAIN, [&](size_t begin, size_t end) {
+        RayPacket packet;
+        glm::vec3 radiance[RAY_PACKET_SIZE];
+        for (size_t i = begin; i < end; i++) {
+            if (this->cancelled)
+                return;
+            // 反弹方向的随机数只由种子和探针下标决定
+            uint32_t state = pcgHash((uint32_t)i ^ pcgHash(this->settings.seed + 1));
+            LightProbe& probe = out[i];
+            unsigned int backfaces = 0;
+            for (unsigned int p = 0; p < packetCount; p++) {
+                // 探针在空中，不需要偏移起点
+                for (int lane = 0; lane < RAY_PACKET_SIZE; lane++)
+                    packet.set(lane, positions[i], directions[p * RAY_PACKET_SIZE + lane], FLT_MAX);
+                unsigned int backfaceMask;
+                this->tracePaths(packet, state, radiance, &backfaceMask);
+                for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+                    probe.add(directions[p * RAY_PACKET_SIZE + lane], radiance[lane], weight);
+                    backfaces += (backfaceMask >> lane) & 1u;
+                }
+            }
+            probe.backfaceRatio = (float)backfaces / rayCount;
+        }
+        });
+    return !this->cancelled;
+}
@@ -0,0 +1,150 @@
+#ifndef CPU_LIGHTMAP_BAKER_H
+#define CPU_LIGHTMAP_BAKER_H
+
+// 定义了CPU上的路径追踪光照贴图烘焙器，和lightmapper使用相同的vertex_t和索引数据，结果也写成相同格式的光照贴图
+// 1. 在光照贴图的纹理空间光栅化三角形，得到每个纹素中心的位置和几何法线
+// 2. 在任务系统上按行并行，每个纹素计算方向光和点光源的直接光照（带阴影光线），
+//    再从纹素发出余弦加权的半球光线，按光线包在层次包围盒中求交，在交点上继续计算直接光照和反弹
+// 3. 同一个场景也可以烘焙光照探针：从探针向整个球面发出光线，用同样的路径追踪得到入射辐射度，投影到二阶球谐
+// 不调用opengl，可以在没有显卡的构建机器上烘焙
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "Bvh.h"
+#include "LightmapAtlas.h"
+#include "LightProbeGrid.h"
+
+using std::vector;
+
+class CpuLightmapBaker {
+public:
+    // 方向光，radiance是漫反射系数乘以光的颜色
+    struct DirectionalLight {
+        // 光的方向（从光源指向场景）
+        glm::vec3 direction;
+        glm::vec3 radiance;
+    };
+    // 点光源，衰减和着色器中的相同
+    struct PointLight {
+        glm::vec3 position;
+        glm::vec3 radiance;
+        float constant;
+        float linear;
+        float quadratic;
+    };
+    // 烘焙参数
+    struct Settings {
+        // 每个纹素的半球采样数，向上取整到光线包大小的倍数
+        unsigned int samples = 64;
+        // 间接光的反弹次数，0表示半球光线只取交点上的直接光照
+        unsigned int bounces = 2;
+        // 没有击中任何几何体的光线看到的颜色，和GPU烘焙器的环境光颜色相同
+        glm::vec3 skyColor = glm::vec3(1.0f);
+        // 表面的漫反射率，vertex_t不带材质，所有表面使用相同的值
+        float albedo = 0.8f;
+        // 随机数种子，每个纹素的随机数只由种子和纹素位置决定，结果和线程调度无关
+        unsigned int seed = 1;
+    };
+
+    CpuLightmapBaker() = default;
+    explicit CpuLightmapBaker(const Settings& settings) : settings(settings) {}
+
+    /// @brief 获取烘焙参数
+    const Settings& getSettings() const { return this->settings; }
+
+    /// @brief 设置参与烘焙的光源，光源的环境光项由间接光照代替，不参与烘焙
+    void setLights(const vector<DirectionalLight>& directionalLights, const vector<PointLight>& pointLights);
+
+    /// @brief 烘焙光照贴图，阻塞直到完成，内部在任务系统上并行，可以在任意线程上调用
+    /// 三角形覆盖的纹素写入辐照度，alpha为1；没有覆盖的纹素保持为0，由之后的扩张填充
+    /// @param vertices 顶点数据，使用其中的光照贴图坐标lm
+    /// @param indices 索引数据，超出顶点范围的三角形会被跳过
+    /// @param width 光照贴图宽度
+    /// @param height 光照贴图高度
+    /// @param output 输出的光照贴图，width x height x 4个float
+    /// @return 被取消时返回false
+    bool bake(const vector<vertex_t>& vertices, const vector<unsigned int>& indices, int width, int height, float* output);
+
+    /// @brief 设置参与求交的场景几何体（世界空间）并建立层级包围盒，之后可以用bakeObject分别烘焙各个物体
+    /// @param totalRows 之后要烘焙的总行数，用于计算进度
+    void setScene(const vector<vertex_t>& vertices, const vector<unsigned int>& indices, int totalRows);
+
+    /// @brief 烘焙一个物体，只写入它在光照贴图中的区域，阻塞直到完成
+    /// 不同区域的物体可以在不同的任务中同时烘焙，必须在setScene之后调用
+    /// @param vertices 物体的顶点数据（世界空间），使用其中的光照贴图坐标lm
+    /// @param indices 物体的索引数据
+    /// @param region 物体在光照贴图中的区域，区域外的纹素不会被写入
+    /// @param firstRow 物体的第一行在所有要烘焙的行中的序号，用于记录哪些行已经完成，已经完成的行会被跳过
+    /// @return 被取消时返回false
+    bool bakeObject(const vector<vertex_t>& vertices, const vector<unsigned int>& indices, int width, int height, float* output, const LightmapRegion& region, size_t firstRow);
+
+    /// @brief 烘焙光照探针，按探针在任务系统上并行，阻塞直到完成，必须在setScene之后调用
+    /// @param positions 探针的世界空间位置
+    /// @param samples 每个探针的光线数，向上取整到光线包大小的倍数
+    /// @param out 每个探针的球谐系数和击中背面的比例
+    /// @return 被取消时返回false
+    bool bakeProbes(const vector<glm::vec3>& positions, unsigned int samples, vector<LightProbe>& out);
+
+    /// @brief 获取每一行是否已经完成，烘焙中也可以在其他线程上调用（标志为真的行已经写入了输出）
+    vector<char> getFinishedRows() const;
+    /// @brief 从断点恢复已经完成的行，在setScene之后、bakeObject之前调用，行数不同时忽略
+    void restoreFinishedRows(const vector<char>& rows);
+    /// @brief 只复制已经完成的行，烘焙中也可以在其他线程上调用，其余的纹素为0
+    /// 完成的行不会再被写入，复制时和工作线程没有竞争；先用getFinishedRows读取标志，复制的行和标志一致
+    /// @param lightmap 正在写入的光照贴图，width x height个RGBA float
+    /// @param regions 各物体的区域，按烘焙的顺序，行的序号和bakeObject的firstRow相同
+    /// @param finishedRows getFinishedRows的结果
+    /// @param out 输出，大小和光照贴图相同
+    static void copyFinishedRows(const float* lightmap, int width, int height, const vector<LightmapRegion>& regions, const vector<char>& finishedRows, vector<float>& out);
+
+    /// @brief 获取烘焙的进度（0到1），可以在其他线程上调用
+    float getProgress() const;
+    /// @brief 取消正在进行的烘焙，已经开始的行会完成，可以在其他线程上调用
+    /// 取消之后不能恢复，setScene也不会清除，每次烘焙使用新的烘焙器
+    void cancel() { this->cancelled = true; }
+    /// @brief 是否已经被取消
+    bool isCancelled() const { return this->cancelled; }
+
+private:
+    // 每个任务烘焙的行数
+    static const size_t ROW_GRAIN = 2;
+    // 每个任务烘焙的探针数
+    static const size_t PROBE_GRAIN = 4;
+
+    Settings settings;
+    vector<DirectionalLight> directionalLights;
+    vector<PointLight> pointLights;
+    Bvh bvh;
+    // 光线起点沿法线的偏移，按场景大小缩放，避免和起点所在的三角形相交
+    float rayOffset = 0.0f;
+    std::atomic<int> finishedRows{ 0 };
+    std::atomic<int> totalRows{ 0 };
+    // 每一行是否已经完成，行的结果写入输出之后才设置
+    vector<std::atomic<char>> rowFinished;
+    std::atomic<bool> cancelled{ false };
+
+    // 光栅化得到的纹素采样点
+    struct TexelSample {
+        glm::vec3 position;
+        glm::vec3 normal;
+        // 纹素在光照贴图中的下标
+        uint32_t texel;
+    };
+
+    /// @brief 在纹理空间光栅化三角形，返回区域中每一行被覆盖的纹素，每个纹素只保留最后一个覆盖它的三角形
+    vector<vector<TexelSample>> rasterize(const vector<vertex_t>& vertices, const vector<unsigned int>& indices, int width, int height, const LightmapRegion& region) const;
+    /// @brief 计算最多4个表面点上的直接光照（不乘漫反射率），每个光源发出一个阴影光线包
+    /// @param activeMask 第i位表示第i个点有效
+    void directLighting(const glm::vec3 positions[RAY_PACKET_SIZE], const glm::vec3 normals[RAY_PACKET_SIZE], unsigned int activeMask, glm::vec3 out[RAY_PACKET_SIZE]) const;
+    /// @brief 从一个纹素发出余弦加权的半球光线，返回平均的入射辐射度
+    /// @param state 纹素的随机数状态
+    glm::vec3 traceHemisphere(const TexelSample& sample, uint32_t& state) const;
+    /// @brief 追踪一个光线包的路径，返回每条光线带回的辐射度（天空，或者交点上的直接光照加上之后的反弹）
+    /// @param packet 设置好起点和方向的光线包，追踪时被修改
+    /// @param backfaceMask 不为空时输出第一次就击中三角形背面的光线
+    void tracePaths(RayPacket& packet, uint32_t& state, glm::vec3 radiance[RAY_PACKET_SIZE], unsigned int* backfaceMask) const;
+};
+
+#endif // CPU_LIGHTMAP_BAKER_H
@@ -0,0 +1,77 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+// 定义了视锥体剔除用到的包围盒和视锥体
+
+#include <glm/glm.hpp>
+#include <cfloat>
+
+// 轴对齐包围盒
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    // 包围盒是否有效（至少包含一个点）
+    bool valid() const {
+        return min.x <= max.x && min.y <= max.y && min.z <= max.z;
+    }
+
+    // 扩展包围盒使其包含一个点
+    void expand(const glm::vec3& p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    // 获取包围盒的第i个角点（i的三个二进制位分别选择x/y/z的最小或最大值）
+    glm::vec3 corner(int i) const {
+        return glm::vec3((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+    }
+
+    // 变换后重新计算的轴对齐包围盒
+    AABB transformed(const glm::mat4& m) const {
+        AABB result;
+        for (int i = 0; i < 8; i++) {
+            result.expand(glm::vec3(m * glm::vec4(corner(i), 1.0f)));
+        }
+        return result;
+    }
+};
+
+// 视锥体，由视图投影矩阵提取的6个平面组成，平面法线指向视锥体内部
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // 从视图投影矩阵中提取视锥体平面（Gribb-Hartmann方法）
+    static Frustum fromMatrix(const glm::mat4& m) {
+        // glm是列主序，第i行为 (m[0][i], m[1][i], m[2][i], m[3][i])
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        Frustum frustum;
+        frustum.planes[0] = row3 + row0; // 左
+        frustum.planes[1] = row3 - row0; // 右
+        frustum.planes[2] = row3 + row1; // 下
+        frustum.planes[3] = row3 - row1; // 上
+        frustum.planes[4] = row3 + row2; // 近
+        frustum.planes[5] = row3 - row2; // 远
+        return frustum;
+    }
+
+    // 包围盒是否和视锥体相交（保守测试，可能把少量视锥体外的包围盒判断为相交）
+    bool intersects(const AABB& box) const {
+        for (int i = 0; i < 6; i++) {
+            const glm::vec4& plane = planes[i];
+            // 取沿平面法线方向最远的角点，如果它都在平面外侧，整个包围盒就在视锥体外
+            glm::vec3 p(plane.x >= 0.0f ? box.max.x : box.min.x,
+                plane.y >= 0.0f ? box.max.y : box.min.y,
+                plane.z >= 0.0f ? box.max.z : box.min.z);
+            if (plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif // CULLING_H
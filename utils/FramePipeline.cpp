@@ -0,0 +1,77 @@
+#include "FramePipeline.h"
+#include <cassert>
+#include <chrono>
+
+FramePipeline::FramePipeline(std::function<void(FramePacket&)> updateFunc, bool threaded)
+    : updateFunc(std::move(updateFunc)), threaded(threaded) {
+    for (unsigned int i = 0; i < PACKET_COUNT; i++)
+        this->freePackets.push_back(&this->packets[i]);
+    if (this->threaded) {
+        this->running = true;
+        this->worker = std::thread([this]() { workerLoop(); });
+    }
+}
+
+FramePipeline::~FramePipeline() {
+    if (this->worker.joinable()) {
+        this->running = false;
+        this->worker.join();
+    }
+}
+
+void FramePipeline::submit(const FrameInput& input) {
+    // 正在使用的数据包在acquire时才归还，这里一定还有一个空闲的
+    assert(!this->freePackets.empty());
+    FramePacket* packet = this->freePackets.back();
+    this->freePackets.pop_back();
+    packet->input = input;
+
+    if (!this->threaded) {
+        update(*packet);
+        this->ready.push(packet);
+        return;
+    }
+    // 队列容量和数据包数量相同，不会满
+    this->pending.push(packet);
+}
+
+const FramePacket& FramePipeline::acquire() {
+    // 上一帧的数据包已经提交完了，可以交给更新线程复用
+    if (this->current)
+        this->freePackets.push_back(this->current);
+
+    FramePacket* packet = nullptr;
+    unsigned int spins = 0;
+    while (!this->ready.pop(packet))
+        backoff(spins);
+    this->current = packet;
+    return *packet;
+}
+
+void FramePipeline::workerLoop() {
+    unsigned int spins = 0;
+    while (this->running.load(std::memory_order_relaxed)) {
+        FramePacket* packet = nullptr;
+        if (!this->pending.pop(packet)) {
+            backoff(spins);
+            continue;
+        }
+        spins = 0;
+        update(*packet);
+        this->ready.push(packet);
+    }
+}
+
+void FramePipeline::update(FramePacket& packet) {
+    auto start = std::chrono::steady_clock::now();
+    this->updateFunc(packet);
+    packet.updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void FramePipeline::backoff(unsigned int& spins) {
+    // 更新一帧通常不到一毫秒，先让出时间片；垂直同步时要等十几毫秒，这时改为休眠
+    if (++spins < 64)
+        std::this_thread::yield();
+    else
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
@@ -0,0 +1,107 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+// 定义了帧流水线：更新线程和opengl线程并行
+// opengl线程在提交第N帧之前采集第N+1帧的输入交给更新线程，更新线程积分摄像机、计算模型矩阵、
+// 做视锥体剔除和排序，生成只读的帧数据包；opengl线程提交完第N帧再取出第N+1帧的数据包
+// 一共只有两个数据包循环使用，更新线程最多领先一帧，输入到画面的延迟也最多多一帧
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "Culling.h"
+#include "SpscQueue.h"
+
+using std::vector;
+
+// 一帧的输入，由opengl线程在帧开始之前采集
+struct FrameInput {
+    // 帧序号
+    unsigned int frameIndex = 0;
+    // 这一帧的时间（秒），固定时间步长模式下按帧序号计算
+    float time = 0.0f;
+    // 按下的摄像机移动键，第i位对应Camera_Movement中的第i个值
+    unsigned int movement = 0;
+    // 上一帧以来累计的鼠标移动
+    glm::vec2 mouseOffset = glm::vec2(0.0f);
+    // 上一帧以来累计的滚轮滚动
+    float scrollOffset = 0.0f;
+};
+
+// 帧数据包：由更新线程生成，opengl线程只读
+// 数据包循环使用，vector的容量会保留下来，稳定运行时不会再分配内存
+struct FramePacket {
+    FrameInput input;
+    // 这一帧执行的固定步长模拟步数
+    unsigned int simulationSteps = 0;
+    // 渲染时刻在上一个和当前模拟状态之间的插值系数
+    float simulationAlpha = 0.0f;
+    // 摄像机
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 projection = glm::mat4(1.0f);
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    // 每个模型的模型矩阵，下标和场景中的模型相同
+    vector<glm::mat4> modelMatrices;
+    // 每个模型在世界空间的包围盒
+    vector<AABB> worldBounds;
+    // 每个模型是否在视锥体内，遮挡剔除依赖opengl线程上的层级深度，在opengl线程上再做
+    vector<char> frustumVisible;
+    // 被视锥体剔除的模型数
+    int frustumCulled = 0;
+    // 绘制顺序（模型的下标，按到摄像机的距离从近到远排列）
+    vector<size_t> drawOrder;
+    // 生成这个数据包花费的CPU时间（毫秒）
+    double updateMs = 0.0;
+};
+
+class FramePipeline {
+public:
+    /// @brief 构造函数
+    /// @param updateFunc 生成数据包的函数，在更新线程上执行，不能调用opengl
+    /// @param threaded 是否使用单独的更新线程，为false时在opengl线程上串行执行，用于对比
+    FramePipeline(std::function<void(FramePacket&)> updateFunc, bool threaded);
+    ~FramePipeline();
+
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    /// @brief opengl线程：提交一帧的输入，更新线程开始生成这一帧的数据包
+    /// 在途的数据包最多两个：正在提交的一帧和正在生成的一帧
+    void submit(const FrameInput& input);
+
+    /// @brief opengl线程：取出最早提交的一帧的数据包，还没生成完时等待
+    /// 返回的数据包在下一次调用acquire之前有效，之后会被更新线程复用
+    const FramePacket& acquire();
+
+private:
+    // 数据包的数量，决定了更新线程最多领先几帧
+    static const unsigned int PACKET_COUNT = 2;
+
+    std::function<void(FramePacket&)> updateFunc;
+    bool threaded;
+    FramePacket packets[PACKET_COUNT];
+    // opengl线程交给更新线程的数据包（只填写了输入）
+    SpscQueue<FramePacket*, PACKET_COUNT> pending;
+    // 更新线程生成完交给opengl线程的数据包
+    SpscQueue<FramePacket*, PACKET_COUNT> ready;
+    // 空闲的数据包，只在opengl线程上访问
+    vector<FramePacket*> freePackets;
+    // opengl线程正在使用的数据包
+    FramePacket* current = nullptr;
+
+    std::atomic<bool> running{ false };
+    std::thread worker;
+
+    /// @brief 更新线程的循环
+    void workerLoop();
+    /// @brief 生成一个数据包并统计耗时
+    void update(FramePacket& packet);
+    /// @brief 队列暂时为空时的等待：先让出时间片，等待较久时短暂休眠，避免空转占满一个核心
+    static void backoff(unsigned int& spins);
+};
+
+#endif // FRAME_PIPELINE_H
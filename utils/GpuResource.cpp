@@ -0,0 +1,151 @@
+#include "GpuResource.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+GpuMemoryLedger& GpuMemoryLedger::instance() {
+    static GpuMemoryLedger ledger;
+    return ledger;
+}
+
+void GpuMemoryLedger::track(GpuResourceType type, GLuint id, const std::string& category, const std::string& owner) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    Entry& entry = this->entries[std::make_pair(type, id)];
+    entry.category = category;
+    entry.owner = owner;
+    entry.bytes = 0;
+    entry.format = GL_NONE;
+}
+
+void GpuMemoryLedger::setSize(GpuResourceType type, GLuint id, size_t bytes, GLenum format) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto found = this->entries.find(std::make_pair(type, id));
+    if (found == this->entries.end())
+        return;
+    found->second.bytes = bytes;
+    found->second.format = format;
+}
+
+void GpuMemoryLedger::release(GpuResourceType type, GLuint id) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->entries.erase(std::make_pair(type, id));
+}
+
+size_t GpuMemoryLedger::residentBytes() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    size_t total = 0;
+    for (const auto& item : this->entries)
+        total += item.second.bytes;
+    return total;
+}
+
+size_t GpuMemoryLedger::residentBytes(const std::string& category) const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    size_t total = 0;
+    for (const auto& item : this->entries) {
+        if (item.second.category == category)
+            total += item.second.bytes;
+    }
+    return total;
+}
+
+void GpuMemoryLedger::printReport() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    // 按类别汇总
+    std::map<std::string, std::pair<size_t, size_t>> categories;
+    size_t total = 0;
+    for (const auto& item : this->entries) {
+        auto& category = categories[item.second.category];
+        category.first++;
+        category.second += item.second.bytes;
+        total += item.second.bytes;
+    }
+    // 按占用从大到小输出
+    std::vector<std::pair<std::string, std::pair<size_t, size_t>>> sorted(categories.begin(), categories.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second.second > b.second.second; });
+    printf("---- gpu memory ----\n");
+    for (const auto& category : sorted) {
+        printf("%-20s %5zu objects %10.2f MB\n", category.first.c_str(), category.second.first, category.second.second / (1024.0 * 1024.0));
+    }
+    printf("%-20s %5zu objects %10.2f MB\n", "total", this->entries.size(), total / (1024.0 * 1024.0));
+    fflush(stdout);
+}
+
+size_t GpuMemoryLedger::reportLeaks() const {
+    static const char* typeNames[] = { "texture", "buffer", "framebuffer", "renderbuffer", "vertex array" };
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (const auto& item : this->entries) {
+        const Entry& entry = item.second;
+        printf("gpu leak: %s %u (%s, owner %s, %zu bytes)\n", typeNames[(int)item.first.first], item.first.second,
+            entry.category.c_str(), entry.owner.c_str(), entry.bytes);
+    }
+    fflush(stdout);
+    return this->entries.size();
+}
+
+size_t GpuMemoryLedger::bytesPerPixel(GLenum internalFormat) {
+    switch (internalFormat) {
+    case GL_R8:
+    case GL_RED:
+        return 1;
+    case GL_RG8:
+    case GL_R16F:
+        return 2;
+    case GL_RGB8:
+    case GL_SRGB8:
+    case GL_RGB:
+    case GL_DEPTH_COMPONENT24:
+        return 3;
+    case GL_RGBA8:
+    case GL_SRGB8_ALPHA8:
+    case GL_RGBA:
+    case GL_RGB10_A2:
+    case GL_R11F_G11F_B10F:
+    case GL_RGB9_E5:
+    case GL_RG16F:
+    case GL_R32F:
+    case GL_R32UI:
+    case GL_DEPTH_COMPONENT:
+    case GL_DEPTH_COMPONENT32F:
+    case GL_DEPTH24_STENCIL8:
+        return 4;
+    case GL_RGB16F:
+        return 6;
+    case GL_RGBA16F:
+    case GL_RG32F:
+    case GL_RG32UI:
+        return 8;
+    case GL_RGB32F:
+        return 12;
+    case GL_RGBA32F:
+        return 16;
+    default:
+        return 4;
+    }
+}
+
+size_t GpuMemoryLedger::textureBytes(GLenum internalFormat, size_t width, size_t height, size_t layers, bool mipmaps) {
+    size_t bytes = bytesPerPixel(internalFormat) * width * height * layers;
+    // 完整的mip链是基础层级的4/3
+    return mipmaps ? bytes * 4 / 3 : bytes;
+}
+
+void gpuResourceCreate(GpuResourceType type, GLuint* id) {
+    switch (type) {
+    case GpuResourceType::Texture: glGenTextures(1, id); break;
+    case GpuResourceType::Buffer: glGenBuffers(1, id); break;
+    case GpuResourceType::Framebuffer: glGenFramebuffers(1, id); break;
+    case GpuResourceType::Renderbuffer: glGenRenderbuffers(1, id); break;
+    case GpuResourceType::VertexArray: glGenVertexArrays(1, id); break;
+    }
+}
+
+void gpuResourceDelete(GpuResourceType type, GLuint id) {
+    switch (type) {
+    case GpuResourceType::Texture: glDeleteTextures(1, &id); break;
+    case GpuResourceType::Buffer: glDeleteBuffers(1, &id); break;
+    case GpuResourceType::Framebuffer: glDeleteFramebuffers(1, &id); break;
+    case GpuResourceType::Renderbuffer: glDeleteRenderbuffers(1, &id); break;
+    case GpuResourceType::VertexArray: glDeleteVertexArrays(1, &id); break;
+    }
+}
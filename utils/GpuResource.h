@@ -0,0 +1,145 @@
+#ifndef GPU_RESOURCE_H
+#define GPU_RESOURCE_H
+
+// 定义了显存资源的RAII封装和显存账本
+// 所有纹理、缓冲、帧缓冲、渲染缓冲和VAO都通过GpuHandle创建，创建时登记到GpuMemoryLedger，析构时自动删除并注销
+// 账本按类别统计常驻显存，用来根据显存预算选择阴影贴图和光照贴图的分辨率；程序退出时还没有注销的资源就是泄漏
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+// 资源类型
+enum class GpuResourceType {
+    Texture,
+    Buffer,
+    Framebuffer,
+    Renderbuffer,
+    VertexArray
+};
+
+class GpuMemoryLedger {
+public:
+    /// @brief 获取全局的显存账本
+    static GpuMemoryLedger& instance();
+
+    /// @brief 登记一个新创建的资源
+    /// @param type 资源类型
+    /// @param id opengl对象名
+    /// @param category 类别，例如shadow map、render target，显存报告按类别汇总
+    /// @param owner 拥有者，泄漏报告中用于定位资源
+    void track(GpuResourceType type, GLuint id, const std::string& category, const std::string& owner);
+
+    /// @brief 更新资源占用的显存大小，重新分配存储时再次调用即可
+    /// @param bytes 字节数
+    /// @param format 内部格式，缓冲等没有格式的资源传GL_NONE
+    void setSize(GpuResourceType type, GLuint id, size_t bytes, GLenum format);
+
+    /// @brief 注销一个即将删除的资源
+    void release(GpuResourceType type, GLuint id);
+
+    /// @brief 获取所有资源占用的显存（字节）
+    size_t residentBytes() const;
+    /// @brief 获取一个类别的资源占用的显存（字节）
+    size_t residentBytes(const std::string& category) const;
+
+    /// @brief 按类别输出常驻显存
+    void printReport() const;
+
+    /// @brief 输出所有还没有注销的资源，在所有拥有资源的对象析构之后调用
+    /// @return 泄漏的资源数
+    size_t reportLeaks() const;
+
+    /// @brief 计算纹理占用的显存
+    /// @param internalFormat 内部格式
+    /// @param width 宽度
+    /// @param height 高度
+    /// @param layers 层数，立方体贴图是6
+    /// @param mipmaps 是否有完整的mip链（大约多占用1/3）
+    static size_t textureBytes(GLenum internalFormat, size_t width, size_t height, size_t layers = 1, bool mipmaps = false);
+
+private:
+    // 一个资源的登记信息
+    struct Entry {
+        std::string category;
+        std::string owner;
+        size_t bytes = 0;
+        GLenum format = GL_NONE;
+    };
+
+    GpuMemoryLedger() = default;
+
+    mutable std::mutex mutex;
+    std::map<std::pair<GpuResourceType, GLuint>, Entry> entries;
+
+    /// @brief 每个像素的字节数，压缩格式和未知格式按4字节估计
+    static size_t bytesPerPixel(GLenum internalFormat);
+};
+
+/// @brief 创建opengl对象
+void gpuResourceCreate(GpuResourceType type, GLuint* id);
+/// @brief 删除opengl对象
+void gpuResourceDelete(GpuResourceType type, GLuint id);
+
+// 一个opengl对象的所有权，只能移动不能复制，析构时删除对象并从账本注销
+template <GpuResourceType Type>
+class GpuHandle {
+public:
+    GpuHandle() = default;
+    ~GpuHandle() { destroy(); }
+
+    GpuHandle(const GpuHandle&) = delete;
+    GpuHandle& operator=(const GpuHandle&) = delete;
+
+    GpuHandle(GpuHandle&& other) noexcept : handle(other.handle) {
+        other.handle = 0;
+    }
+    GpuHandle& operator=(GpuHandle&& other) noexcept {
+        if (this != &other) {
+            destroy();
+            this->handle = other.handle;
+            other.handle = 0;
+        }
+        return *this;
+    }
+
+    /// @brief 创建opengl对象并登记到账本，已经创建过时先删除旧的对象
+    /// @param category 类别
+    /// @param owner 拥有者
+    void create(const std::string& category, const std::string& owner) {
+        destroy();
+        gpuResourceCreate(Type, &this->handle);
+        GpuMemoryLedger::instance().track(Type, this->handle, category, owner);
+    }
+
+    /// @brief 删除opengl对象
+    void destroy() {
+        if (this->handle != 0) {
+            GpuMemoryLedger::instance().release(Type, this->handle);
+            gpuResourceDelete(Type, this->handle);
+            this->handle = 0;
+        }
+    }
+
+    /// @brief 分配存储之后记录占用的显存
+    void setSize(size_t bytes, GLenum format = GL_NONE) const {
+        GpuMemoryLedger::instance().setSize(Type, this->handle, bytes, format);
+    }
+
+    GLuint id() const { return this->handle; }
+    operator GLuint() const { return this->handle; }
+
+private:
+    GLuint handle = 0;
+};
+
+using GLTexture = GpuHandle<GpuResourceType::Texture>;
+using GLBuffer = GpuHandle<GpuResourceType::Buffer>;
+using GLFramebuffer = GpuHandle<GpuResourceType::Framebuffer>;
+using GLRenderbuffer = GpuHandle<GpuResourceType::Renderbuffer>;
+using GLVertexArray = GpuHandle<GpuResourceType::VertexArray>;
+
+#endif // GPU_RESOURCE_H
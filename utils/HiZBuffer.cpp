@@ -0,0 +1,176 @@
+#include "HiZBuffer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "RenderStats.h"
+
+HiZBuffer::~HiZBuffer() {
+    for (unsigned int i = 0; i < READBACK_COUNT; i++) {
+        if (this->readbackFences[i] != 0)
+            glDeleteSync(this->readbackFences[i]);
+    }
+}
+
+void HiZBuffer::setup(unsigned int width, unsigned int height) {
+    this->shader = Shader("shaders/hizShader.vs", "shaders/hizShader.fs");
+
+    // 计算每一级的尺寸，一直到1x1
+    this->levelSizes.clear();
+    glm::ivec2 size(width, height);
+    this->levelSizes.push_back(size);
+    while (size.x > 1 || size.y > 1) {
+        size = glm::max(size / 2, glm::ivec2(1));
+        this->levelSizes.push_back(size);
+    }
+    // 选择第一个宽度不超过MAX_READBACK_WIDTH的层级做回读
+    this->readbackLevel = 0;
+    while (this->levelSizes[this->readbackLevel].x > (int)MAX_READBACK_WIDTH && this->readbackLevel + 1 < this->levelSizes.size())
+        this->readbackLevel++;
+
+    // 层级深度纹理，每一级都需要单独分配
+    this->hiZMap.create("hi-z", "HiZBuffer");
+    glBindTexture(GL_TEXTURE_2D, this->hiZMap);
+    for (unsigned int level = 0; level < this->levelSizes.size(); level++) {
+        glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, this->levelSizes[level].x, this->levelSizes[level].y, 0, GL_RED, GL_FLOAT, NULL);
+    }
+    this->hiZMap.setSize(GpuMemoryLedger::textureBytes(GL_R32F, width, height, 1, true), GL_R32F);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)this->levelSizes.size() - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    this->hiZFBO.create("hi-z", "HiZBuffer");
+
+    // 回读缓冲
+    glm::ivec2 readbackSize = this->levelSizes[this->readbackLevel];
+    for (unsigned int i = 0; i < READBACK_COUNT; i++) {
+        this->readbackPBOs[i].create("hi-z", "HiZBuffer");
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, this->readbackPBOs[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, readbackSize.x * readbackSize.y * sizeof(float), NULL, GL_STREAM_READ);
+        this->readbackPBOs[i].setSize(readbackSize.x * readbackSize.y * sizeof(float));
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    this->depthData.assign(readbackSize.x * readbackSize.y, 1.0f);
+}
+
+void HiZBuffer::build(unsigned int depthMap, const glm::mat4& viewProjection, const std::function<void()>& renderQuad) {
+    // 先取走已经完成的回读，空出回读缓冲
+    collectReadbacks();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, this->hiZFBO);
+    STATS_COUNT(framebufferBinds, 1);
+    glDisable(GL_DEPTH_TEST);
+    this->shader.use();
+    this->shader.setInt("depthMap", 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    // 第0级：直接复制场景深度
+    glBindTexture(GL_TEXTURE_2D, depthMap);
+    STATS_COUNT(textureBinds, 1);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->hiZMap, 0);
+    glViewport(0, 0, this->levelSizes[0].x, this->levelSizes[0].y);
+    this->shader.setBool("firstLevel", true);
+    renderQuad();
+
+    // 之后每一级取上一级2x2区域的最大值
+    // 读写同一张纹理的不同层级，通过限制BASE/MAX_LEVEL保证采样的只有上一级，避免反馈循环
+    this->shader.setBool("firstLevel", false);
+    glBindTexture(GL_TEXTURE_2D, this->hiZMap);
+    STATS_COUNT(textureBinds, 1);
+    for (unsigned int level = 1; level < this->levelSizes.size(); level++) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->hiZMap, level);
+        glViewport(0, 0, this->levelSizes[level].x, this->levelSizes[level].y);
+        this->shader.setIVec2("previousSize", this->levelSizes[level - 1]);
+        renderQuad();
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)this->levelSizes.size() - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glEnable(GL_DEPTH_TEST);
+
+    // 把回读层级异步复制到空闲的像素缓冲，所有缓冲都在等待GPU时跳过这一帧的回读
+    unsigned int slot = this->nextReadback;
+    if (this->readbackFences[slot] == 0) {
+        glm::ivec2 readbackSize = this->levelSizes[this->readbackLevel];
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->hiZMap, this->readbackLevel);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, this->readbackPBOs[slot]);
+        glReadPixels(0, 0, readbackSize.x, readbackSize.y, GL_RED, GL_FLOAT, (void*)0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        this->readbackFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        this->readbackMatrices[slot] = viewProjection;
+        this->nextReadback = (slot + 1) % READBACK_COUNT;
+    }
+}
+
+void HiZBuffer::collectReadbacks() {
+    // 按提交顺序检查，保证留下的是最新完成的数据
+    for (unsigned int i = 0; i < READBACK_COUNT; i++) {
+        unsigned int slot = (this->nextReadback + i) % READBACK_COUNT;
+        if (this->readbackFences[slot] == 0)
+            continue;
+        // 超时为0，只查询状态不等待
+        GLenum status = glClientWaitSync(this->readbackFences[slot], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            continue;
+        glDeleteSync(this->readbackFences[slot]);
+        this->readbackFences[slot] = 0;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, this->readbackPBOs[slot]);
+        void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, this->depthData.size() * sizeof(float), GL_MAP_READ_BIT);
+        if (data) {
+            std::memcpy(this->depthData.data(), data, this->depthData.size() * sizeof(float));
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            this->depthViewProjection = this->readbackMatrices[slot];
+            this->hasDepthData = true;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+}
+
+bool HiZBuffer::isOccluded(const AABB& worldBox) const {
+    if (!this->hasDepthData)
+        return false;
+
+    // 用生成深度时的视图投影矩阵把包围盒投影到屏幕
+    glm::vec2 ndcMin(FLT_MAX), ndcMax(-FLT_MAX);
+    float nearestDepth = FLT_MAX;
+    for (int i = 0; i < 8; i++) {
+        glm::vec4 clip = this->depthViewProjection * glm::vec4(worldBox.corner(i), 1.0f);
+        // 有角点在近平面后面，投影结果不可靠，保守地认为可见
+        if (clip.w <= 0.0f)
+            return false;
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        ndcMin = glm::min(ndcMin, glm::vec2(ndc));
+        ndcMax = glm::max(ndcMax, glm::vec2(ndc));
+        nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+    }
+
+    // 先换算成第0级的像素，再换算到回读层级的纹素
+    // 尺寸为奇数时每一级的最后一行/列会多覆盖一个像素，所以这里要把越界的纹素夹到最后一个
+    const glm::ivec2& baseSize = this->levelSizes[0];
+    const glm::ivec2& size = this->levelSizes[this->readbackLevel];
+    glm::vec2 uvMin = glm::clamp(ndcMin * 0.5f + 0.5f, glm::vec2(0.0f), glm::vec2(1.0f));
+    glm::vec2 uvMax = glm::clamp(ndcMax * 0.5f + 0.5f, glm::vec2(0.0f), glm::vec2(1.0f));
+    glm::ivec2 pixelMin = glm::min(glm::ivec2(uvMin * glm::vec2(baseSize)), baseSize - 1);
+    glm::ivec2 pixelMax = glm::min(glm::ivec2(uvMax * glm::vec2(baseSize)), baseSize - 1);
+    glm::ivec2 texelMin = glm::min(glm::ivec2(pixelMin.x >> this->readbackLevel, pixelMin.y >> this->readbackLevel), size - 1);
+    glm::ivec2 texelMax = glm::min(glm::ivec2(pixelMax.x >> this->readbackLevel, pixelMax.y >> this->readbackLevel), size - 1);
+
+    // 覆盖区域内最远的深度
+    float farthestDepth = 0.0f;
+    for (int y = texelMin.y; y <= texelMax.y; y++) {
+        for (int x = texelMin.x; x <= texelMax.x; x++) {
+            farthestDepth = std::max(farthestDepth, this->depthData[y * size.x + x]);
+        }
+        // 已经有没被遮挡的纹素就不用继续了
+        if (farthestDepth >= nearestDepth)
+            return false;
+    }
+    return nearestDepth > farthestDepth;
+}
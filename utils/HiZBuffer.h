@@ -0,0 +1,78 @@
+#ifndef HIZ_BUFFER_H
+#define HIZ_BUFFER_H
+
+// 定义了HiZBuffer类，实现基于层级深度（Hierarchical-Z）的遮挡剔除
+// 从场景深度生成逐级取最大值的mip链，把其中一个很小的层级异步回读到CPU，
+// 下一帧用它测试物体的包围盒：包围盒最近的深度都比覆盖区域内最远的深度还远，说明被完全遮挡
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <functional>
+#include <vector>
+#include "shader.h"
+#include "Culling.h"
+#include "GpuResource.h"
+
+using std::vector;
+
+class HiZBuffer {
+public:
+    HiZBuffer() {}
+    // 删除还没有完成的回读栅栏，纹理和缓冲由RAII对象释放
+    ~HiZBuffer();
+
+    /// @brief 创建层级深度纹理和回读缓冲，需要在opengl上下文初始化之后调用
+    /// @param width 场景深度的宽度
+    /// @param height 场景深度的高度
+    void setup(unsigned int width, unsigned int height);
+
+    /// @brief 从场景深度生成层级深度，并发起异步回读
+    /// 调用后绑定的帧缓冲和视口会被改变，调用者需要自己恢复
+    /// @param depthMap 场景深度贴图
+    /// @param viewProjection 渲染这份深度时使用的视图投影矩阵
+    /// @param renderQuad 绘制全屏四边形的函数
+    void build(unsigned int depthMap, const glm::mat4& viewProjection, const std::function<void()>& renderQuad);
+
+    /// @brief 判断世界空间的包围盒是否被完全遮挡
+    /// 使用的是最近一次回读完成的层级深度（通常是上一帧的），没有可用数据时总是返回false
+    /// @param worldBox 世界空间的包围盒
+    bool isOccluded(const AABB& worldBox) const;
+
+private:
+    // 回读的层级不超过这个宽度，保证回读的数据量很小
+    static const unsigned int MAX_READBACK_WIDTH = 64;
+    // 回读缓冲的数量
+    static const unsigned int READBACK_COUNT = 2;
+
+    // 层级深度着色器
+    Shader shader;
+    // 层级深度纹理（R32F，每一级保存上一级2x2区域的最大深度）
+    GLTexture hiZMap;
+    // 渲染到层级深度纹理的帧缓冲
+    GLFramebuffer hiZFBO;
+    // 每一级的尺寸
+    vector<glm::ivec2> levelSizes;
+    // 回读的层级
+    unsigned int readbackLevel = 0;
+
+    // 像素缓冲对象，用于异步回读
+    GLBuffer readbackPBOs[READBACK_COUNT];
+    // 每个像素缓冲对应的栅栏，为0表示空闲
+    GLsync readbackFences[READBACK_COUNT] = {};
+    // 每个像素缓冲对应的视图投影矩阵
+    glm::mat4 readbackMatrices[READBACK_COUNT];
+    // 下一个使用的像素缓冲
+    unsigned int nextReadback = 0;
+
+    // 最近一次回读完成的深度数据
+    vector<float> depthData;
+    // 这份深度数据对应的视图投影矩阵
+    glm::mat4 depthViewProjection = glm::mat4(1.0f);
+    // 是否有可用的深度数据
+    bool hasDepthData = false;
+
+    /// @brief 检查之前发起的回读是否完成，完成的话把数据复制出来，不会等待GPU
+    void collectReadbacks();
+};
+
+#endif // HIZ_BUFFER_H
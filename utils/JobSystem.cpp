@@ -0,0 +1,231 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <cstdio>
+
+// 当前线程是第几个工作线程，不是工作线程时为-1
+static thread_local int currentWorker = -1;
+
+// 没有任务时先空转的次数，任务通常一个接一个地提交，马上休眠会增加唤醒的延迟
+static const int SPIN_COUNT = 64;
+
+JobSystem& JobSystem::instance() {
+    // 调用者的线程在parallelFor中也会执行任务，工作线程比核心数少一个；至少一个工作线程，
+    // 保证从不等待的线程提交的任务也能执行
+    static JobSystem jobSystem(std::max(2u, std::thread::hardware_concurrency()) - 1);
+    return jobSystem;
+}
+
+JobSystem::JobSystem(unsigned int workerCount) {
+    for (unsigned int i = 0; i <= workerCount; i++)
+        this->queues.emplace_back(new WorkQueue());
+    for (unsigned int i = 0; i < workerCount; i++)
+        this->threads.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem() {
+    this->running = false;
+    {
+        std::lock_guard<std::mutex> lock(this->sleepMutex);
+    }
+    this->wakeUp.notify_all();
+    for (std::thread& thread : this->threads)
+        thread.join();
+}
+
+JobSystem::JobHandle JobSystem::schedule(std::function<void()> func, const vector<JobHandle>& dependencies) {
+    JobHandle job = std::make_shared<Job>();
+    job->func = std::move(func);
+    job->pendingDependencies = (int)dependencies.size() + 1;
+    int finishedDependencies = 0;
+    for (const JobHandle& dependency : dependencies) {
+        // 加锁检查，依赖不会在登记之后、检查之前完成
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (dependency->finished)
+            finishedDependencies++;
+        else
+            dependency->dependents.push_back(job);
+    }
+    // 最后减去提交时持有的1，之前完成的依赖不会提前把任务放入队列
+    if (job->pendingDependencies.fetch_sub(finishedDependencies + 1) == finishedDependencies + 1)
+        this->push(job);
+    return job;
+}
+
+void JobSystem::wait(const JobHandle& job) {
+    // 工作线程必须帮忙执行任务，否则所有工作线程都在等待时没有线程执行任务
+    if (currentWorker >= 0) {
+        while (!job->finished) {
+            if (!this->runOne())
+                std::this_thread::yield();
+        }
+        return;
+    }
+    // 其他线程取到的任务可能是一整块烘焙，会卡住这一帧，只休眠等待
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finishedCondition.wait(lock, [&job]() { return job->finished.load(); });
+}
+
+void JobSystem::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& func) {
+    grain = std::max<size_t>(grain, 1);
+    if (count <= grain) {
+        func(0, count);
+        return;
+    }
+    // 不为每一段单独创建任务：提交几个取段的任务，每个任务不断领取下一段直到领完
+    // 空闲的工作线程会窃取这些任务，执行快的线程自然领到更多的段
+    struct State {
+        std::function<void(size_t, size_t)> func;
+        size_t count;
+        size_t grain;
+        size_t chunks;
+        std::atomic<size_t> nextChunk{ 0 };
+        std::atomic<size_t> finishedChunks{ 0 };
+        // 保护error，最后一段完成时通过allFinished通知调用者
+        std::mutex mutex;
+        std::condition_variable allFinished;
+        std::exception_ptr error;
+    };
+    std::shared_ptr<State> state = std::make_shared<State>();
+    state->func = func;
+    state->count = count;
+    state->grain = grain;
+    state->chunks = (count + grain - 1) / grain;
+    auto work = [state]() {
+        size_t chunk;
+        while ((chunk = state->nextChunk.fetch_add(1)) < state->chunks) {
+            size_t begin = chunk * state->grain;
+            try {
+                state->func(begin, std::min(state->count, begin + state->grain));
+            }
+            catch (...) {
+                // 只保留第一个异常，这一段仍然算作完成，调用者不会永远等下去
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (!state->error)
+                    state->error = std::current_exception();
+            }
+            if (state->finishedChunks.fetch_add(1) + 1 == state->chunks) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->allFinished.notify_all();
+            }
+        }
+        };
+    size_t helpers = std::min<size_t>(state->chunks - 1, this->threads.size());
+    for (size_t i = 0; i < helpers; i++)
+        this->schedule(work);
+    work();
+    // 剩下的段已经被其他线程领走了；工作线程等待时帮忙执行其他任务，其他线程只休眠等待，和wait相同
+    if (currentWorker >= 0) {
+        while (state->finishedChunks < state->chunks) {
+            if (!this->runOne())
+                std::this_thread::yield();
+        }
+    }
+    else {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->allFinished.wait(lock, [&state]() { return state->finishedChunks == state->chunks; });
+    }
+    if (state->error)
+        std::rethrow_exception(state->error);
+}
+
+void JobSystem::push(JobHandle job) {
+    WorkQueue& queue = *this->queues[currentWorker >= 0 ? currentWorker : this->queues.size() - 1];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    this->queuedCount.fetch_add(1);
+    // 工作线程休眠前先增加sleepingCount再检查queuedCount，这里先增加queuedCount再检查sleepingCount，
+    // 两边至少有一边能看到对方，不会丢失唤醒
+    if (this->sleepingCount > 0) {
+        {
+            std::lock_guard<std::mutex> lock(this->sleepMutex);
+        }
+        this->wakeUp.notify_one();
+    }
+}
+
+JobSystem::JobHandle JobSystem::pop() {
+    size_t queueCount = this->queues.size();
+    // 工作线程先从自己队列的尾部取
+    if (currentWorker >= 0) {
+        WorkQueue& own = *this->queues[currentWorker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            JobHandle job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            return job;
+        }
+    }
+    // 从其他队列的头部窃取，从不同的位置开始，避免所有线程都去抢同一个队列
+    size_t start = currentWorker >= 0 ? currentWorker + 1 : queueCount - 1;
+    for (size_t i = 0; i < queueCount; i++) {
+        WorkQueue& victim = *this->queues[(start + i) % queueCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            JobHandle job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+bool JobSystem::runOne() {
+    if (this->queuedCount == 0)
+        return false;
+    JobHandle job = this->pop();
+    if (!job)
+        return false;
+    this->queuedCount.fetch_sub(1);
+    this->execute(job);
+    return true;
+}
+
+void JobSystem::execute(const JobHandle& job) {
+    // 异常不能离开工作线程，否则会调用std::terminate；任务仍然算作完成，等待者和后续任务照常继续
+    std::exception_ptr error;
+    try {
+        job->func();
+    }
+    catch (const std::exception& e) {
+        error = std::current_exception();
+        fprintf(stderr, "Error: job failed: %s\n", e.what());
+    }
+    catch (...) {
+        error = std::current_exception();
+        fprintf(stderr, "Error: job failed with an unknown exception\n");
+    }
+    vector<JobHandle> dependents;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->error = error;
+        job->finished = true;
+        dependents.swap(job->dependents);
+    }
+    job->finishedCondition.notify_all();
+    for (JobHandle& dependent : dependents) {
+        if (dependent->pendingDependencies.fetch_sub(1) == 1)
+            this->push(std::move(dependent));
+    }
+}
+
+void JobSystem::workerLoop(unsigned int index) {
+    currentWorker = (int)index;
+    int spins = 0;
+    while (this->running) {
+        if (this->runOne()) {
+            spins = 0;
+            continue;
+        }
+        if (++spins < SPIN_COUNT) {
+            std::this_thread::yield();
+            continue;
+        }
+        spins = 0;
+        std::unique_lock<std::mutex> lock(this->sleepMutex);
+        this->sleepingCount.fetch_add(1);
+        this->wakeUp.wait(lock, [this]() { return this->queuedCount > 0 || !this->running; });
+        this->sleepingCount.fetch_sub(1);
+    }
+}
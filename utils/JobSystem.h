@@ -0,0 +1,103 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+// 定义了任务系统：固定数量的工作线程，每个工作线程有自己的双端队列
+// 工作线程从自己队列的尾部取最新的任务（缓存还是热的），自己的队列空了再从其他队列的头部窃取最早的任务
+// 不是工作线程的线程（opengl线程、更新线程）提交的任务放在一个共享的队列里，等待时只参与自己的parallelFor，
+// 不从队列中取任务，不会在一帧中途执行一整块烘焙任务
+// 任务抛出的异常记录在任务中，不会结束工作线程
+// 任务可以依赖其他任务，所有依赖都完成后才会进入队列
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::vector;
+
+class JobSystem {
+public:
+    struct Job;
+    // 任务句柄，用于等待任务完成或者作为其他任务的依赖
+    using JobHandle = std::shared_ptr<Job>;
+
+    struct Job {
+        std::function<void()> func;
+        // 还没有完成的依赖数，加上提交时持有的1，减到0时进入队列
+        std::atomic<int> pendingDependencies{ 1 };
+        std::atomic<bool> finished{ false };
+        // 任务抛出的异常，没有时为空，finished为true之后才能读取
+        std::exception_ptr error;
+        // 保护finished的设置和dependents
+        std::mutex mutex;
+        // 任务完成时通知不是工作线程的等待者
+        std::condition_variable finishedCondition;
+        // 依赖这个任务的任务
+        vector<JobHandle> dependents;
+    };
+
+    /// @brief 获取全局的任务系统，第一次调用时创建工作线程
+    static JobSystem& instance();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    /// @brief 提交一个任务
+    /// @param func 任务函数，可以在任意线程上执行，不能调用opengl
+    /// @param dependencies 依赖的任务，全部完成后才会执行
+    /// @return 任务句柄
+    JobHandle schedule(std::function<void()> func, const vector<JobHandle>& dependencies = {});
+
+    /// @brief 等待任务完成，工作线程等待时执行其他任务，其他线程休眠等待
+    /// 任务抛出异常时也会返回，异常记录在job->error中
+    void wait(const JobHandle& job);
+
+    /// @brief 把[0, count)分成长度为grain的段并行执行func(begin, end)，返回时所有段都已完成
+    /// 当前线程也参与执行；count不超过grain时直接在当前线程上执行，没有任何调度开销
+    /// func抛出异常时其余的段照常执行，全部结束后在当前线程上重新抛出第一个异常
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& func);
+
+    /// @brief 获取工作线程数（不包括调用者的线程）
+    unsigned int getWorkerCount() const { return (unsigned int)this->threads.size(); }
+
+private:
+    // 一个线程的任务队列，所有者从尾部取，其他线程从头部窃取
+    // 任务的粒度远大于加锁的开销，用互斥锁保护就足够了
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<JobHandle> jobs;
+    };
+
+    // 0到工作线程数-1是工作线程的队列，最后一个是其他线程共享的队列
+    vector<std::unique_ptr<WorkQueue>> queues;
+    vector<std::thread> threads;
+    std::atomic<bool> running{ true };
+    // 所有队列中的任务数，工作线程没有任务时据此休眠
+    std::atomic<int> queuedCount{ 0 };
+    std::atomic<int> sleepingCount{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+
+    explicit JobSystem(unsigned int workerCount);
+    ~JobSystem();
+
+    /// @brief 把依赖都已完成的任务放入当前线程的队列
+    void push(JobHandle job);
+    /// @brief 从当前线程的队列中取一个任务，没有时从其他队列窃取
+    JobHandle pop();
+    /// @brief 取出并执行一个任务
+    /// @return 没有可执行的任务时返回false
+    bool runOne();
+    /// @brief 执行任务并记录抛出的异常，然后把所有依赖都已完成的后续任务放入队列
+    void execute(const JobHandle& job);
+    /// @brief 工作线程的循环
+    void workerLoop(unsigned int index);
+};
+
+#endif // JOB_SYSTEM_H
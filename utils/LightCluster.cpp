@@ -0,0 +1,253 @@
+#include "LightCluster.h"
+#include <algorithm>
+#include <cmath>
+#include "RenderStats.h"
+
+// x64下SSE2总是可用的，其他平台退回标量实现
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHT_CLUSTER_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+// 候选光源补齐用的坐标，保证补齐的光源不会和任何簇相交
+static const float PADDING_POSITION = 1e18f;
+
+void LightCluster::setup() {
+    // 点光源数据
+    this->lightDataBuffer.create("light cluster", "LightCluster");
+    this->lightDataTexture.create("light cluster", "LightCluster");
+    // 每个簇的偏移和数量
+    this->clusterGridBuffer.create("light cluster", "LightCluster");
+    this->clusterGridTexture.create("light cluster", "LightCluster");
+    // 光源索引列表
+    this->lightIndexBuffer.create("light cluster", "LightCluster");
+    this->lightIndexTexture.create("light cluster", "LightCluster");
+
+    this->clusterGrid.assign(NUM_CLUSTERS * 2, 0);
+    // 先上传空数据，保证着色器采样的缓冲纹理总是有效的
+    setLights(this->lights);
+    glBindBuffer(GL_TEXTURE_BUFFER, this->clusterGridBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, this->clusterGrid.size() * sizeof(GLuint), this->clusterGrid.data(), GL_STREAM_DRAW);
+    this->clusterGridBuffer.setSize(this->clusterGrid.size() * sizeof(GLuint));
+    glBindTexture(GL_TEXTURE_BUFFER, this->clusterGridTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, this->clusterGridBuffer);
+
+    GLuint emptyIndex = 0;
+    glBindBuffer(GL_TEXTURE_BUFFER, this->lightIndexBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(GLuint), &emptyIndex, GL_STREAM_DRAW);
+    this->lightIndexBuffer.setSize(sizeof(GLuint));
+    glBindTexture(GL_TEXTURE_BUFFER, this->lightIndexTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, this->lightIndexBuffer);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightCluster::setLights(const vector<GpuPointLight>& lights) {
+    this->lights = lights;
+
+    // 缓冲纹理不能为空，没有光源时上传一个占位光源
+    GpuPointLight placeholder = {};
+    const void* data = this->lights.empty() ? (const void*)&placeholder : (const void*)this->lights.data();
+    size_t size = std::max<size_t>(this->lights.size(), 1) * sizeof(GpuPointLight);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, this->lightDataBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STATIC_DRAW);
+    this->lightDataBuffer.setSize(size);
+    glBindTexture(GL_TEXTURE_BUFFER, this->lightDataTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, this->lightDataBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    // 预分配视图空间SoA数据
+    this->viewX.resize(this->lights.size());
+    this->viewY.resize(this->lights.size());
+    this->viewZ.resize(this->lights.size());
+    this->radius.resize(this->lights.size());
+}
+
+float LightCluster::computeRadius(float constant, float linear, float quadratic, float maxIntensity) {
+    // 解方程 constant + linear * d + quadratic * d^2 = maxIntensity * 256 / 5
+    float target = maxIntensity * (256.0f / 5.0f);
+    if (quadratic > 0.0f) {
+        float discriminant = linear * linear - 4.0f * quadratic * (constant - target);
+        if (discriminant <= 0.0f)
+            return 0.0f;
+        return (-linear + std::sqrt(discriminant)) / (2.0f * quadratic);
+    }
+    if (linear > 0.0f)
+        return std::max((target - constant) / linear, 0.0f);
+    // 没有衰减的光源会影响整个场景
+    return 1e4f;
+}
+
+void LightCluster::buildClusterAABBs(float tanHalfFovY, float aspect, float zNear, float zFar) {
+    this->clusterAABBs.resize(NUM_CLUSTERS);
+    float tanHalfFovX = tanHalfFovY * aspect;
+    for (unsigned int z = 0; z < GRID_Z; z++) {
+        // 指数划分深度切片，近处的切片更薄
+        float sliceNear = zNear * std::pow(zFar / zNear, (float)z / GRID_Z);
+        float sliceFar = zNear * std::pow(zFar / zNear, (float)(z + 1) / GRID_Z);
+        for (unsigned int y = 0; y < GRID_Y; y++) {
+            float ndcY0 = (float)y / GRID_Y * 2.0f - 1.0f;
+            float ndcY1 = (float)(y + 1) / GRID_Y * 2.0f - 1.0f;
+            for (unsigned int x = 0; x < GRID_X; x++) {
+                float ndcX0 = (float)x / GRID_X * 2.0f - 1.0f;
+                float ndcX1 = (float)(x + 1) / GRID_X * 2.0f - 1.0f;
+
+                // froxel的8个角点在视图空间中的x/y坐标取决于深度，取近远两个平面上的极值
+                float xs[4] = {
+                    ndcX0 * tanHalfFovX * sliceNear, ndcX1 * tanHalfFovX * sliceNear,
+                    ndcX0 * tanHalfFovX * sliceFar, ndcX1 * tanHalfFovX * sliceFar
+                };
+                float ys[4] = {
+                    ndcY0 * tanHalfFovY * sliceNear, ndcY1 * tanHalfFovY * sliceNear,
+                    ndcY0 * tanHalfFovY * sliceFar, ndcY1 * tanHalfFovY * sliceFar
+                };
+
+                ClusterAABB& aabb = this->clusterAABBs[x + GRID_X * (y + GRID_Y * z)];
+                aabb.min = glm::vec3(*std::min_element(xs, xs + 4), *std::min_element(ys, ys + 4), -sliceFar);
+                aabb.max = glm::vec3(*std::max_element(xs, xs + 4), *std::max_element(ys, ys + 4), -sliceNear);
+            }
+        }
+    }
+
+    this->cachedTanHalfFovY = tanHalfFovY;
+    this->cachedAspect = aspect;
+    this->cachedNear = zNear;
+    this->cachedFar = zFar;
+    this->sliceScale = GRID_Z / std::log(zFar / zNear);
+    this->sliceBias = GRID_Z * std::log(zNear) / std::log(zFar / zNear);
+}
+
+void LightCluster::update(const glm::mat4& view, const glm::mat4& projection, unsigned int screenWidth, unsigned int screenHeight) {
+    // 从透视投影矩阵中还原投影参数
+    float tanHalfFovY = 1.0f / projection[1][1];
+    float aspect = projection[1][1] / projection[0][0];
+    float zNear = projection[3][2] / (projection[2][2] - 1.0f);
+    float zFar = projection[3][2] / (projection[2][2] + 1.0f);
+    // 投影参数变化时（比如滚轮缩放）才需要重新计算簇的包围盒
+    if (this->clusterAABBs.empty()
+        || std::abs(tanHalfFovY - this->cachedTanHalfFovY) > 1e-6f
+        || std::abs(aspect - this->cachedAspect) > 1e-6f
+        || std::abs(zNear - this->cachedNear) > 1e-6f
+        || std::abs(zFar - this->cachedFar) > 1e-3f) {
+        buildClusterAABBs(tanHalfFovY, aspect, zNear, zFar);
+    }
+    this->tileSize = glm::vec2((float)screenWidth / GRID_X, (float)screenHeight / GRID_Y);
+
+    // 把点光源变换到视图空间
+    for (size_t i = 0; i < this->lights.size(); i++) {
+        glm::vec4 p = view * glm::vec4(glm::vec3(this->lights[i].positionRadius), 1.0f);
+        this->viewX[i] = p.x;
+        this->viewY[i] = p.y;
+        this->viewZ[i] = p.z;
+        this->radius[i] = this->lights[i].positionRadius.w;
+    }
+
+    this->lightIndices.clear();
+    for (unsigned int z = 0; z < GRID_Z; z++) {
+        // 先按深度切片粗筛一遍，只有和该切片相交的光源才需要逐簇测试
+        const ClusterAABB& sliceAABB = this->clusterAABBs[GRID_X * GRID_Y * z];
+        this->candX.clear();
+        this->candY.clear();
+        this->candZ.clear();
+        this->candR.clear();
+        this->candIndex.clear();
+        for (size_t i = 0; i < this->lights.size(); i++) {
+            if (this->viewZ[i] - this->radius[i] <= sliceAABB.max.z && this->viewZ[i] + this->radius[i] >= sliceAABB.min.z) {
+                this->candX.push_back(this->viewX[i]);
+                this->candY.push_back(this->viewY[i]);
+                this->candZ.push_back(this->viewZ[i]);
+                this->candR.push_back(this->radius[i]);
+                this->candIndex.push_back((GLuint)i);
+            }
+        }
+        unsigned int candidateCount = (unsigned int)this->candIndex.size();
+        // 补齐到4的倍数，补齐的光源放在无穷远处
+        while (this->candX.size() % 4 != 0) {
+            this->candX.push_back(PADDING_POSITION);
+            this->candY.push_back(PADDING_POSITION);
+            this->candZ.push_back(PADDING_POSITION);
+            this->candR.push_back(0.0f);
+            this->candIndex.push_back(0);
+        }
+        cullSlice(z, candidateCount);
+    }
+
+    // 上传簇网格和光源索引列表（每帧重新分配缓冲，避免和上一帧的绘制同步）
+    glBindBuffer(GL_TEXTURE_BUFFER, this->clusterGridBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, this->clusterGrid.size() * sizeof(GLuint), this->clusterGrid.data(), GL_STREAM_DRAW);
+    GLuint emptyIndex = 0;
+    const GLuint* indexData = this->lightIndices.empty() ? &emptyIndex : this->lightIndices.data();
+    glBindBuffer(GL_TEXTURE_BUFFER, this->lightIndexBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(this->lightIndices.size(), 1) * sizeof(GLuint), indexData, GL_STREAM_DRAW);
+    this->lightIndexBuffer.setSize(std::max<size_t>(this->lightIndices.size(), 1) * sizeof(GLuint));
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightCluster::cullSlice(unsigned int z, unsigned int candidateCount) {
+    for (unsigned int y = 0; y < GRID_Y; y++) {
+        for (unsigned int x = 0; x < GRID_X; x++) {
+            unsigned int clusterIndex = x + GRID_X * (y + GRID_Y * z);
+            const ClusterAABB& aabb = this->clusterAABBs[clusterIndex];
+            GLuint offset = (GLuint)this->lightIndices.size();
+
+            if (candidateCount > 0) {
+#ifdef LIGHT_CLUSTER_USE_SSE
+                // 一次测试4个光源：计算球心到包围盒的最近距离平方，和半径平方比较
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 minX = _mm_set1_ps(aabb.min.x), maxX = _mm_set1_ps(aabb.max.x);
+                const __m128 minY = _mm_set1_ps(aabb.min.y), maxY = _mm_set1_ps(aabb.max.y);
+                const __m128 minZ = _mm_set1_ps(aabb.min.z), maxZ = _mm_set1_ps(aabb.max.z);
+                for (size_t i = 0; i < this->candX.size(); i += 4) {
+                    __m128 px = _mm_loadu_ps(&this->candX[i]);
+                    __m128 py = _mm_loadu_ps(&this->candY[i]);
+                    __m128 pz = _mm_loadu_ps(&this->candZ[i]);
+                    __m128 r = _mm_loadu_ps(&this->candR[i]);
+                    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, px), _mm_sub_ps(px, maxX)), zero);
+                    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minY, py), _mm_sub_ps(py, maxY)), zero);
+                    __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minZ, pz), _mm_sub_ps(pz, maxZ)), zero);
+                    __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    int mask = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_mul_ps(r, r)));
+                    for (int lane = 0; lane < 4; lane++) {
+                        if (mask & (1 << lane))
+                            this->lightIndices.push_back(this->candIndex[i + lane]);
+                    }
+                }
+#else
+                for (size_t i = 0; i < candidateCount; i++) {
+                    float dx = std::max(std::max(aabb.min.x - this->candX[i], this->candX[i] - aabb.max.x), 0.0f);
+                    float dy = std::max(std::max(aabb.min.y - this->candY[i], this->candY[i] - aabb.max.y), 0.0f);
+                    float dz = std::max(std::max(aabb.min.z - this->candZ[i], this->candZ[i] - aabb.max.z), 0.0f);
+                    if (dx * dx + dy * dy + dz * dz <= this->candR[i] * this->candR[i])
+                        this->lightIndices.push_back(this->candIndex[i]);
+                }
+#endif
+            }
+
+            this->clusterGrid[clusterIndex * 2] = offset;
+            this->clusterGrid[clusterIndex * 2 + 1] = (GLuint)this->lightIndices.size() - offset;
+        }
+    }
+}
+
+void LightCluster::bind(Shader& shader) {
+    glActiveTexture(GL_TEXTURE0 + LIGHT_DATA_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, this->lightDataTexture);
+    STATS_COUNT(textureBinds, 1);
+    glActiveTexture(GL_TEXTURE0 + CLUSTER_GRID_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, this->clusterGridTexture);
+    STATS_COUNT(textureBinds, 1);
+    glActiveTexture(GL_TEXTURE0 + LIGHT_INDEX_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, this->lightIndexTexture);
+    STATS_COUNT(textureBinds, 1);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader.setInt("pointLightData", LIGHT_DATA_UNIT);
+    shader.setInt("clusterGrid", CLUSTER_GRID_UNIT);
+    shader.setInt("clusterLightIndices", LIGHT_INDEX_UNIT);
+    shader.setVec2("clusterTileSize", this->tileSize);
+    shader.setFloat("clusterScale", this->sliceScale);
+    shader.setFloat("clusterBias", this->sliceBias);
+}
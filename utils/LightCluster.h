@@ -0,0 +1,117 @@
+#ifndef LIGHT_CLUSTER_H
+#define LIGHT_CLUSTER_H
+
+// 定义了LightCluster类，实现分簇前向渲染（clustered forward）的点光源剔除
+// 以摄像机视锥体划分froxel网格（屏幕空间的tile + 指数分布的深度切片），
+// 在CPU上用SIMD把点光源分配到各个簇中，再通过缓冲纹理（TBO）上传给片段着色器，
+// 片段着色器只需要遍历自己所在簇的点光源
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "shader.h"
+#include "GpuResource.h"
+
+using std::vector;
+
+class LightCluster {
+public:
+    // 上传到GPU的点光源数据，每个光源占4个RGBA32F纹素
+    struct GpuPointLight {
+        // xyz: 世界坐标，w: 影响半径
+        glm::vec4 positionRadius;
+        // rgb: 环境光（已乘光源颜色），a: 常数衰减项
+        glm::vec4 ambientConstant;
+        // rgb: 漫反射（已乘光源颜色），a: 一次衰减项
+        glm::vec4 diffuseLinear;
+        // rgb: 镜面反射（已乘光源颜色），a: 二次衰减项
+        glm::vec4 specularQuadratic;
+    };
+
+    // 簇网格在屏幕x方向上的划分数
+    static const unsigned int GRID_X = 16;
+    // 簇网格在屏幕y方向上的划分数
+    static const unsigned int GRID_Y = 9;
+    // 簇网格在深度方向上的切片数
+    static const unsigned int GRID_Z = 24;
+    // 簇的总数
+    static const unsigned int NUM_CLUSTERS = GRID_X * GRID_Y * GRID_Z;
+    // 点光源数据缓冲纹理使用的纹理单元（放在高位，避免和网格的材质/阴影贴图冲突）
+    static const unsigned int LIGHT_DATA_UNIT = 13;
+    // 簇网格缓冲纹理使用的纹理单元
+    static const unsigned int CLUSTER_GRID_UNIT = 14;
+    // 光源索引列表缓冲纹理使用的纹理单元
+    static const unsigned int LIGHT_INDEX_UNIT = 15;
+
+    LightCluster() {}
+
+    /// @brief 创建缓冲纹理，需要在opengl上下文初始化之后调用
+    void setup();
+
+    /// @brief 设置点光源数据并上传到GPU（光源变化时调用）
+    /// @param lights 点光源数据
+    void setLights(const vector<GpuPointLight>& lights);
+
+    /// @brief 根据摄像机重新划分簇并剔除点光源，每帧调用一次
+    /// @param view 视图矩阵
+    /// @param projection 透视投影矩阵
+    /// @param screenWidth 屏幕宽度
+    /// @param screenHeight 屏幕高度
+    void update(const glm::mat4& view, const glm::mat4& projection, unsigned int screenWidth, unsigned int screenHeight);
+
+    /// @brief 绑定缓冲纹理并设置着色器中的簇相关uniform变量
+    /// @param shader 使用分簇光照的着色器
+    void bind(Shader& shader);
+
+    /// @brief 根据衰减系数计算点光源的影响半径（亮度衰减到1/256以下视为没有贡献）
+    static float computeRadius(float constant, float linear, float quadratic, float maxIntensity);
+
+    // 点光源数量
+    unsigned int getLightCount() const { return (unsigned int)lights.size(); }
+    // 上一次剔除后所有簇的光源索引总数
+    unsigned int getIndexCount() const { return (unsigned int)lightIndices.size(); }
+
+private:
+    // 视图空间中的包围盒
+    struct ClusterAABB {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    // 点光源数据
+    vector<GpuPointLight> lights;
+    // 每个簇在视图空间的包围盒（只在投影参数变化时重新计算）
+    vector<ClusterAABB> clusterAABBs;
+    // 每个簇在索引列表中的偏移和数量
+    vector<GLuint> clusterGrid;
+    // 所有簇的光源索引，按簇依次排列
+    vector<GLuint> lightIndices;
+
+    // 视图空间中点光源的SoA数据，供SIMD剔除使用
+    vector<float> viewX, viewY, viewZ, radius;
+    // 某个深度切片的候选光源（SoA，长度补齐到4的倍数）
+    vector<float> candX, candY, candZ, candR;
+    vector<GLuint> candIndex;
+
+    // 生成簇包围盒时使用的投影参数
+    float cachedTanHalfFovY = 0.0f;
+    float cachedAspect = 0.0f;
+    float cachedNear = 0.0f;
+    float cachedFar = 0.0f;
+    // 深度切片计算公式：slice = log(z) * sliceScale - sliceBias
+    float sliceScale = 0.0f;
+    float sliceBias = 0.0f;
+    // 每个tile的像素大小
+    glm::vec2 tileSize = glm::vec2(1.0f);
+
+    // 缓冲对象和对应的缓冲纹理
+    GLBuffer lightDataBuffer, clusterGridBuffer, lightIndexBuffer;
+    GLTexture lightDataTexture, clusterGridTexture, lightIndexTexture;
+
+    /// @brief 根据投影参数重新计算所有簇的包围盒
+    void buildClusterAABBs(float tanHalfFovY, float aspect, float zNear, float zFar);
+    /// @brief 对一个深度切片内的所有簇做光源剔除
+    void cullSlice(unsigned int z, unsigned int candidateCount);
+};
+
+#endif // LIGHT_CLUSTER_H
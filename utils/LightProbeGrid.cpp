@@ -0,0 +1,288 @@
+#include "LightProbeGrid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+// 基函数的常数的平方乘以余弦卷积的系数（0阶1，1阶2/3，2阶1/4），投影时乘进系数，着色器只计算多项式
+const float SH_FACTORS[9] = {
+    0.0795775f,                         // 1/(4π)
+    0.1591549f, 0.1591549f, 0.1591549f, // 3/(4π) * 2/3
+    0.2984155f, 0.2984155f,             // 15/(4π) * 1/4
+    0.0248680f,                         // 5/(16π) * 1/4
+    0.2984155f,                         // 15/(4π) * 1/4
+    0.0746039f                          // 15/(16π) * 1/4
+};
+
+// 方向上的基函数多项式
+void shPolynomials(const glm::vec3& d, float out[9]) {
+    out[0] = 1.0f;
+    out[1] = d.y;
+    out[2] = d.z;
+    out[3] = d.x;
+    out[4] = d.x * d.y;
+    out[5] = d.y * d.z;
+    out[6] = 3.0f * d.z * d.z - 1.0f;
+    out[7] = d.x * d.z;
+    out[8] = d.x * d.x - d.y * d.y;
+}
+
+// 文件头，后面是所有探针
+struct ProbeHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sceneHash;
+    uint64_t settingsHash;
+    int32_t size[3];
+    float origin[3];
+    float spacing[3];
+    uint32_t reserved;
+};
+
+const char PROBE_MAGIC[4] = { 'T', 'L', 'P', 'B' };
+}
+
+LightProbe::LightProbe() : backfaceRatio(0.0f) {
+    for (glm::vec3& coefficient : this->sh)
+        coefficient = glm::vec3(0.0f);
+}
+
+void LightProbe::add(const glm::vec3& direction, const glm::vec3& radiance, float weight) {
+    float basis[9];
+    shPolynomials(direction, basis);
+    for (int i = 0; i < 9; i++)
+        this->sh[i] += radiance * (basis[i] * SH_FACTORS[i] * weight);
+}
+
+glm::vec3 LightProbe::evaluate(const glm::vec3& normal) const {
+    float basis[9];
+    shPolynomials(normal, basis);
+    glm::vec3 irradiance(0.0f);
+    for (int i = 0; i < 9; i++)
+        irradiance += this->sh[i] * basis[i];
+    // 二阶球谐在亮度变化剧烈的方向上可能是负数
+    return glm::max(irradiance, glm::vec3(0.0f));
+}
+
+void LightProbeGrid::setup(const AABB& bounds, int resolution) {
+    this->probes.clear();
+    this->size = glm::ivec3(0);
+    if (!bounds.valid() || resolution < 2)
+        return;
+    glm::vec3 extent = bounds.max - bounds.min;
+    float longest = std::max(std::max(extent.x, extent.y), extent.z);
+    float step = longest > 0.0f ? longest / (resolution - 1) : 1.0f;
+    int counts[3];
+    for (int axis = 0; axis < 3; axis++) {
+        counts[axis] = std::max(2, (int)std::ceil(extent[axis] / step - 1e-3f) + 1);
+        // 探针在这个轴上居中，最短的轴上也至少有两层，三线性插值才有意义
+        float span = step * (counts[axis] - 1);
+        this->origin[axis] = (bounds.min[axis] + bounds.max[axis] - span) * 0.5f;
+        this->spacing[axis] = step;
+    }
+    this->size = glm::ivec3(counts[0], counts[1], counts[2]);
+}
+
+glm::vec3 LightProbeGrid::getPosition(size_t index) const {
+    size_t x = index % this->size.x;
+    size_t y = index / this->size.x % this->size.y;
+    size_t z = index / ((size_t)this->size.x * this->size.y);
+    return this->origin + this->spacing * glm::vec3((float)x, (float)y, (float)z);
+}
+
+vector<glm::vec3> LightProbeGrid::getPositions() const {
+    vector<glm::vec3> positions(this->getCount());
+    for (size_t i = 0; i < positions.size(); i++)
+        positions[i] = this->getPosition(i);
+    return positions;
+}
+
+bool LightProbeGrid::setProbes(vector<LightProbe> probes) {
+    if (probes.size() != this->getCount() || probes.empty())
+        return false;
+    this->probes.swap(probes);
+    return true;
+}
+
+size_t LightProbeGrid::fixInvalid(float backfaceThreshold) {
+    vector<char> valid(this->probes.size());
+    size_t invalidCount = 0;
+    for (size_t i = 0; i < this->probes.size(); i++) {
+        valid[i] = this->probes[i].backfaceRatio <= backfaceThreshold;
+        invalidCount += valid[i] ? 0 : 1;
+    }
+    if (invalidCount == this->probes.size())
+        return 0;
+
+    // 每一遍只填充至少有一个有效邻居的探针，填充的结果下一遍才能作为邻居，从外向内一层层推进
+    size_t fixed = 0;
+    vector<size_t> layer;
+    while (fixed < invalidCount) {
+        layer.clear();
+        for (int z = 0; z < this->size.z; z++) {
+            for (int y = 0; y < this->size.y; y++) {
+                for (int x = 0; x < this->size.x; x++) {
+                    size_t i = this->index(x, y, z);
+                    if (valid[i])
+                        continue;
+                    LightProbe average;
+                    int neighbors = 0;
+                    const int offsets[6][3] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+                    for (const int* offset : offsets) {
+                        int nx = x + offset[0], ny = y + offset[1], nz = z + offset[2];
+                        if (nx < 0 || ny < 0 || nz < 0 || nx >= this->size.x || ny >= this->size.y || nz >= this->size.z)
+                            continue;
+                        size_t neighbor = this->index(nx, ny, nz);
+                        if (!valid[neighbor])
+                            continue;
+                        for (int k = 0; k < 9; k++)
+                            average.sh[k] += this->probes[neighbor].sh[k];
+                        neighbors++;
+                    }
+                    if (neighbors == 0)
+                        continue;
+                    for (int k = 0; k < 9; k++)
+                        average.sh[k] /= (float)neighbors;
+                    average.backfaceRatio = this->probes[i].backfaceRatio;
+                    this->probes[i] = average;
+                    layer.push_back(i);
+                }
+            }
+        }
+        for (size_t i : layer)
+            valid[i] = 1;
+        fixed += layer.size();
+    }
+    return fixed;
+}
+
+glm::vec3 LightProbeGrid::sample(const glm::vec3& position, const glm::vec3& normal) const {
+    if (this->probes.empty())
+        return glm::vec3(0.0f);
+    int base[3];
+    float fraction[3];
+    for (int axis = 0; axis < 3; axis++) {
+        float coordinate = std::min(std::max((position[axis] - this->origin[axis]) / this->spacing[axis], 0.0f), (float)(this->size[axis] - 1));
+        base[axis] = std::min((int)coordinate, this->size[axis] - 2);
+        fraction[axis] = coordinate - base[axis];
+    }
+    // 系数是线性的，先插值系数再求值，和着色器中三线性过滤后求值相同
+    LightProbe probe;
+    for (int corner = 0; corner < 8; corner++) {
+        int x = base[0] + (corner & 1), y = base[1] + ((corner >> 1) & 1), z = base[2] + ((corner >> 2) & 1);
+        float weight = ((corner & 1) ? fraction[0] : 1.0f - fraction[0])
+            * (((corner >> 1) & 1) ? fraction[1] : 1.0f - fraction[1])
+            * (((corner >> 2) & 1) ? fraction[2] : 1.0f - fraction[2]);
+        const LightProbe& source = this->probes[this->index(x, y, z)];
+        for (int k = 0; k < 9; k++)
+            probe.sh[k] += source.sh[k] * weight;
+    }
+    return probe.evaluate(normal);
+}
+
+void LightProbeGrid::packTexels(vector<float>& out) const {
+    size_t count = this->getCount();
+    out.assign(count * TEXTURE_BLOCKS * 4, 0.0f);
+    for (size_t i = 0; i < this->probes.size(); i++) {
+        const LightProbe& probe = this->probes[i];
+        // 每组和整个网格一样大，组内的布局和探针的下标相同
+        float* block[TEXTURE_BLOCKS];
+        for (int b = 0; b < TEXTURE_BLOCKS; b++)
+            block[b] = out.data() + ((size_t)b * count + i) * 4;
+        for (int channel = 0; channel < 3; channel++) {
+            for (int k = 0; k < 4; k++) {
+                block[channel][k] = probe.sh[k][channel];
+                block[3 + channel][k] = probe.sh[4 + k][channel];
+            }
+            block[6][channel] = probe.sh[8][channel];
+        }
+    }
+}
+
+glm::vec3 LightProbeGrid::getTextureScale() const {
+    glm::vec3 scale;
+    for (int axis = 0; axis < 3; axis++)
+        scale[axis] = 1.0f / (this->spacing[axis] * this->size[axis]);
+    return scale;
+}
+
+glm::vec3 LightProbeGrid::getTextureBias() const {
+    // 探针在纹素中心
+    glm::vec3 bias;
+    for (int axis = 0; axis < 3; axis++)
+        bias[axis] = (0.5f - this->origin[axis] / this->spacing[axis]) / this->size[axis];
+    return bias;
+}
+
+bool LightProbeGrid::save(const std::string& path, const LightmapCacheKey& key) const {
+    if (this->probes.empty())
+        return false;
+    ProbeHeader header;
+    memcpy(header.magic, PROBE_MAGIC, sizeof(PROBE_MAGIC));
+    header.version = VERSION;
+    header.sceneHash = key.scene;
+    header.settingsHash = key.settings;
+    for (int axis = 0; axis < 3; axis++) {
+        header.size[axis] = this->size[axis];
+        header.origin[axis] = this->origin[axis];
+        header.spacing[axis] = this->spacing[axis];
+    }
+    header.reserved = 0;
+
+    std::string temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "Error: could not write %s\n", temporary.c_str());
+        return false;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(this->probes.data(), sizeof(LightProbe), this->probes.size(), file) == this->probes.size();
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        fprintf(stderr, "Error: could not write %s\n", temporary.c_str());
+        std::remove(temporary.c_str());
+        return false;
+    }
+    // windows上rename不能覆盖已有的文件
+    std::remove(path.c_str());
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Error: could not write %s\n", path.c_str());
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool LightProbeGrid::load(const std::string& path, const LightmapCacheKey& key) {
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    ProbeHeader header;
+    if (file.size() < sizeof(header)) {
+        fprintf(stderr, "Warning: ignoring invalid light probe cache %s\n", path.c_str());
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    bool valid = memcmp(header.magic, PROBE_MAGIC, sizeof(PROBE_MAGIC)) == 0 && header.version == VERSION;
+    for (int axis = 0; axis < 3; axis++)
+        valid = valid && header.size[axis] >= 2 && header.size[axis] <= 1024 && header.spacing[axis] > 0.0f;
+    size_t count = valid ? (size_t)header.size[0] * header.size[1] * header.size[2] : 0;
+    if (!valid || file.size() != sizeof(header) + count * sizeof(LightProbe)) {
+        fprintf(stderr, "Warning: ignoring invalid light probe cache %s\n", path.c_str());
+        return false;
+    }
+    // 场景或者参数变化后的缓存不能使用，不算错误
+    if (header.sceneHash != key.scene || header.settingsHash != key.settings)
+        return false;
+
+    for (int axis = 0; axis < 3; axis++) {
+        this->origin[axis] = header.origin[axis];
+        this->spacing[axis] = header.spacing[axis];
+    }
+    this->size = glm::ivec3(header.size[0], header.size[1], header.size[2]);
+    // 探针只有几KB，直接复制出来，不保留映射
+    this->probes.resize(count);
+    memcpy(this->probes.data(), file.data() + sizeof(header), count * sizeof(LightProbe));
+    return true;
+}
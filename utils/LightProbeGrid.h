@@ -0,0 +1,95 @@
+#ifndef LIGHT_PROBE_GRID_H
+#define LIGHT_PROBE_GRID_H
+
+// 定义了光照探针网格，给不能使用静态光照贴图的动态物体（比如转动的地球仪）提供间接光照
+// 1. 探针均匀分布在静态几何体的包围盒中，每个探针用二阶球谐（9个RGB系数）记录入射辐射度，
+//    投影时已经和余弦核卷积并除以π，和光照贴图一样表示辐照度
+// 2. 基函数的常数因子预先乘进系数，按法线求值时基函数只剩多项式：1, y, z, x, xy, yz, 3z²-1, xz, x²-y²
+// 3. 上传为一张RGBA16F的3D纹理，z方向依次放7组系数，每组和网格大小相同；
+//    着色器在每组内夹住z坐标，三线性过滤不会跨组，7次采样加几次点积就得到辐照度
+// 4. 落在几何体内部的探针（很多光线击中三角形背面）看到的是黑暗的内部，用相邻有效探针的平均值代替，避免漏暗
+// 不调用opengl，烘焙和保存可以在任务系统上执行
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Culling.h"
+#include "LightmapCache.h"
+
+using std::vector;
+
+// 一个探针的球谐系数
+struct LightProbe {
+    // 按1, y, z, x, xy, yz, 3z²-1, xz, x²-y²的顺序，已经乘了基函数的常数和余弦卷积的系数
+    glm::vec3 sh[9];
+    // 第一次击中三角形背面的光线的比例，用于判断探针是否在几何体内部
+    float backfaceRatio;
+
+    LightProbe();
+
+    /// @brief 加入一个方向上的入射辐射度
+    /// @param direction 单位方向
+    /// @param weight 这个方向代表的立体角
+    void add(const glm::vec3& direction, const glm::vec3& radiance, float weight);
+    /// @brief 计算法线方向上的辐照度（除以π），和着色器中的相同
+    glm::vec3 evaluate(const glm::vec3& normal) const;
+};
+
+class LightProbeGrid {
+public:
+    // 9个RGB系数放进7个RGBA纹素：3组是前4个系数的R、G、B，3组是中间4个系数的R、G、B，最后一组是第9个系数
+    static const int TEXTURE_BLOCKS = 7;
+
+    /// @brief 在包围盒中放置探针，最长的轴上有resolution个探针，其他轴按相同的间距，每个轴至少2个，会清空已有的探针
+    void setup(const AABB& bounds, int resolution);
+
+    /// @brief 获取网格每个轴上的探针数
+    const glm::ivec3& getSize() const { return this->size; }
+    /// @brief 获取探针的数量
+    size_t getCount() const { return (size_t)this->size.x * this->size.y * this->size.z; }
+    bool empty() const { return this->probes.empty(); }
+    /// @brief 获取探针的世界空间位置，下标按x、y、z的顺序排列
+    glm::vec3 getPosition(size_t index) const;
+    /// @brief 获取所有探针的位置
+    vector<glm::vec3> getPositions() const;
+
+    /// @brief 设置烘焙得到的探针，数量必须和网格相同
+    bool setProbes(vector<LightProbe> probes);
+    const vector<LightProbe>& getProbes() const { return this->probes; }
+
+    /// @brief 把背面比例超过阈值的探针换成相邻有效探针的平均值，向内逐层填充
+    /// @return 被替换的探针数
+    size_t fixInvalid(float backfaceThreshold);
+
+    /// @brief 三线性插值探针后计算辐照度，和着色器的采样相同，位置在网格外时取边界上的探针
+    glm::vec3 sample(const glm::vec3& position, const glm::vec3& normal) const;
+
+    /// @brief 生成3D纹理的数据
+    /// @param out size.x x size.y x (size.z * TEXTURE_BLOCKS)个RGBA float
+    void packTexels(vector<float>& out) const;
+    /// @brief 着色器中把世界坐标变换到一组系数内的纹理坐标：uvw = position * scale + bias
+    glm::vec3 getTextureScale() const;
+    glm::vec3 getTextureBias() const;
+
+    /// @brief 用内存映射加载探针，文件不存在、损坏或者键不同时返回false
+    bool load(const std::string& path, const LightmapCacheKey& key);
+    /// @brief 保存到文件，先写到临时文件再替换
+    bool save(const std::string& path, const LightmapCacheKey& key) const;
+
+private:
+    // 文件格式的版本，格式变化时加一
+    static const uint32_t VERSION = 1;
+
+    // 第一个探针的位置
+    glm::vec3 origin = glm::vec3(0.0f);
+    // 相邻探针的间距
+    glm::vec3 spacing = glm::vec3(1.0f);
+    glm::ivec3 size = glm::ivec3(0);
+    vector<LightProbe> probes;
+
+    size_t index(int x, int y, int z) const { return ((size_t)z * this->size.y + y) * this->size.x + x; }
+};
+
+#endif // LIGHT_PROBE_GRID_H
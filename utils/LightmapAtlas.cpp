@@ -0,0 +1,542 @@
+#include "LightmapAtlas.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <numeric>
+#include <utility>
+
+namespace {
+// 位置相同的顶点映射到其中第一个顶点的下标
+vector<unsigned int> weldPositions(const vector<vertex_t>& vertices) {
+    vector<unsigned int> order(vertices.size());
+    std::iota(order.begin(), order.end(), 0u);
+    auto less = [&vertices](unsigned int a, unsigned int b) {
+        const float* pa = vertices[a].p;
+        const float* pb = vertices[b].p;
+        if (pa[0] != pb[0])
+            return pa[0] < pb[0];
+        if (pa[1] != pb[1])
+            return pa[1] < pb[1];
+        if (pa[2] != pb[2])
+            return pa[2] < pb[2];
+        return a < b;
+        };
+    std::sort(order.begin(), order.end(), less);
+    vector<unsigned int> welded(vertices.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        const float* p = vertices[order[i]].p;
+        bool same = i > 0 && p[0] == vertices[order[i - 1]].p[0] && p[1] == vertices[order[i - 1]].p[1] && p[2] == vertices[order[i - 1]].p[2];
+        welded[order[i]] = same ? welded[order[i - 1]] : order[i];
+    }
+    return welded;
+}
+
+// 二维的叉积，用于求凸包
+float cross2(const glm::vec2& o, const glm::vec2& a, const glm::vec2& b) {
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+// 单调链求凸包，points会被排序
+vector<glm::vec2> convexHull(vector<glm::vec2> points) {
+    std::sort(points.begin(), points.end(), [](const glm::vec2& a, const glm::vec2& b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+    points.erase(std::unique(points.begin(), points.end()), points.end());
+    if (points.size() < 3)
+        return points;
+    vector<glm::vec2> hull(points.size() * 2);
+    size_t k = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        while (k >= 2 && cross2(hull[k - 2], hull[k - 1], points[i]) <= 0.0f)
+            k--;
+        hull[k++] = points[i];
+    }
+    for (size_t i = points.size() - 1, lower = k + 1; i > 0; i--) {
+        while (k >= lower && cross2(hull[k - 2], hull[k - 1], points[i - 1]) <= 0.0f)
+            k--;
+        hull[k++] = points[i - 1];
+    }
+    hull.resize(k - 1);
+    return hull;
+}
+
+// 包围矩形面积最小的方向一定和凸包的某条边平行，返回这条边的方向（单位向量）
+glm::vec2 minimumAreaDirection(const vector<glm::vec2>& hull) {
+    glm::vec2 best(1.0f, 0.0f);
+    float bestArea = INFINITY;
+    for (size_t i = 0; i < hull.size(); i++) {
+        glm::vec2 edge = hull[(i + 1) % hull.size()] - hull[i];
+        float length = std::sqrt(edge.x * edge.x + edge.y * edge.y);
+        if (length == 0.0f)
+            continue;
+        glm::vec2 u = edge / length, v(-u.y, u.x);
+        float minU = INFINITY, maxU = -INFINITY, minV = INFINITY, maxV = -INFINITY;
+        for (const glm::vec2& point : hull) {
+            float pu = point.x * u.x + point.y * u.y, pv = point.x * v.x + point.y * v.y;
+            minU = std::min(minU, pu);
+            maxU = std::max(maxU, pu);
+            minV = std::min(minV, pv);
+            maxV = std::max(maxV, pv);
+        }
+        float area = (maxU - minU) * (maxV - minV);
+        if (area < bestArea) {
+            bestArea = area;
+            best = u;
+        }
+    }
+    return best;
+}
+
+// 打包时的一个矩形（纹素）：图块和四周的间隔，或者一个物体的区域
+struct PackRect {
+    // 图块所在的网格，物体的区域为空
+    LightmapMesh* mesh;
+    // 图块在网格中的下标，或者物体的下标
+    size_t chart;
+    int width;
+    int height;
+    int x = 0;
+    int y = 0;
+    // 是否旋转了90度
+    bool rotated = false;
+};
+
+// 天际线上的一段：[x, x + width)范围内已经占用到了y
+struct SkylineSegment {
+    int x;
+    int y;
+    int width;
+};
+
+// 把宽width高height的矩形的左边对齐到第index段时，矩形底部的高度，放不下时返回-1
+int skylineFit(const vector<SkylineSegment>& skyline, size_t index, int width, int height, int atlasWidth, int atlasHeight) {
+    int x = skyline[index].x;
+    if (x + width > atlasWidth)
+        return -1;
+    int y = 0;
+    for (size_t i = index; i < skyline.size() && skyline[i].x < x + width; i++)
+        y = std::max(y, skyline[i].y);
+    return y + height <= atlasHeight ? y : -1;
+}
+
+void skylineInsert(vector<SkylineSegment>& skyline, size_t index, int width, int top) {
+    int x = skyline[index].x;
+    // 被新矩形覆盖的段去掉，部分覆盖的段缩短
+    size_t end = index;
+    while (end < skyline.size() && skyline[end].x + skyline[end].width <= x + width)
+        end++;
+    if (end < skyline.size() && skyline[end].x < x + width) {
+        int shrink = x + width - skyline[end].x;
+        skyline[end].x += shrink;
+        skyline[end].width -= shrink;
+    }
+    skyline.erase(skyline.begin() + index, skyline.begin() + end);
+    skyline.insert(skyline.begin() + index, SkylineSegment{ x, top, width });
+    // 合并相邻的同高度的段
+    for (size_t i = 0; i + 1 < skyline.size();) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        }
+        else {
+            i++;
+        }
+    }
+}
+
+// 按给定的顺序放入矩形，每个矩形在所有位置（和两个方向）中选择顶部最低、其次最靠左的位置
+bool skylinePack(vector<PackRect>& rects, int atlasWidth, int atlasHeight, bool allowRotation) {
+    vector<SkylineSegment> skyline = { { 0, 0, atlasWidth } };
+    for (PackRect& rect : rects) {
+        int bestTop = INT32_MAX, bestX = INT32_MAX;
+        size_t bestIndex = 0;
+        bool bestRotated = false;
+        for (size_t i = 0; i < skyline.size(); i++) {
+            for (int r = 0; r < (allowRotation ? 2 : 1); r++) {
+                int w = r ? rect.height : rect.width, h = r ? rect.width : rect.height;
+                int y = skylineFit(skyline, i, w, h, atlasWidth, atlasHeight);
+                if (y < 0)
+                    continue;
+                if (y + h < bestTop || (y + h == bestTop && skyline[i].x < bestX)) {
+                    bestTop = y + h;
+                    bestX = skyline[i].x;
+                    bestIndex = i;
+                    bestRotated = r == 1;
+                }
+            }
+        }
+        if (bestTop == INT32_MAX)
+            return false;
+        rect.rotated = bestRotated;
+        rect.x = bestX;
+        rect.y = bestTop - (bestRotated ? rect.width : rect.height);
+        skylineInsert(skyline, bestIndex, bestRotated ? rect.height : rect.width, bestTop);
+    }
+    return true;
+}
+
+// 大的矩形先放
+void sortRects(vector<PackRect>& rects) {
+    std::stable_sort(rects.begin(), rects.end(), [](const PackRect& a, const PackRect& b) {
+        return std::max(a.width, a.height) > std::max(b.width, b.height);
+        });
+}
+
+// 按密度把一个物体的图块打包成一个区域，rects保存图块在区域中的位置，区域的宽高写入region
+bool packObject(const vector<LightmapMesh*>& meshes, float density, const LightmapAtlasSettings& settings, vector<PackRect>& rects, PackRect& region) {
+    rects.clear();
+    double area = 0.0;
+    int minWidth = 0;
+    for (LightmapMesh* mesh : meshes) {
+        for (size_t c = 0; c < mesh->charts.size(); c++) {
+            PackRect rect;
+            rect.mesh = mesh;
+            rect.chart = c;
+            rect.width = (int)std::ceil(mesh->charts[c].size.x * density) + settings.padding;
+            rect.height = (int)std::ceil(mesh->charts[c].size.y * density) + settings.padding;
+            area += (double)rect.width * rect.height;
+            // 允许旋转，区域至少要放得下每个图块较短的一边
+            minWidth = std::max(minWidth, std::min(rect.width, rect.height));
+            rects.push_back(rect);
+        }
+    }
+    region.width = region.height = 0;
+    if (rects.empty())
+        return true;
+    sortRects(rects);
+    // 先尝试接近正方形的区域，放不下时用光照贴图的整个宽度
+    int width = std::min(settings.width, std::max(minWidth, (int)std::ceil(std::sqrt(area * 1.2))));
+    if (!skylinePack(rects, width, settings.height, true) && (width == settings.width || !skylinePack(rects, settings.width, settings.height, true)))
+        return false;
+    for (const PackRect& rect : rects) {
+        region.width = std::max(region.width, rect.x + (rect.rotated ? rect.height : rect.width));
+        region.height = std::max(region.height, rect.y + (rect.rotated ? rect.width : rect.height));
+    }
+    return true;
+}
+}
+
+LightmapMesh unwrapLightmapMesh(const vector<vertex_t>& vertices, const vector<unsigned int>& indices, float maxChartAngle) {
+    LightmapMesh result;
+    // 只保留顶点下标有效的三角形
+    vector<unsigned int> triangles;
+    triangles.reserve(indices.size());
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        if (indices[i] < vertices.size() && indices[i + 1] < vertices.size() && indices[i + 2] < vertices.size())
+            triangles.insert(triangles.end(), { indices[i], indices[i + 1], indices[i + 2] });
+    }
+    const size_t triangleCount = triangles.size() / 3;
+    if (triangleCount == 0)
+        return result;
+
+    vector<glm::vec3> normals(triangleCount);
+    vector<float> areas(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        const float* a = vertices[triangles[t * 3]].p;
+        const float* b = vertices[triangles[t * 3 + 1]].p;
+        const float* c = vertices[triangles[t * 3 + 2]].p;
+        glm::vec3 n = glm::cross(glm::vec3(b[0] - a[0], b[1] - a[1], b[2] - a[2]), glm::vec3(c[0] - a[0], c[1] - a[1], c[2] - a[2]));
+        float length = glm::length(n);
+        areas[t] = length * 0.5f;
+        // 退化的三角形法线为0，可以加入任意图块
+        normals[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+    }
+
+    // 共享边的三角形互为邻居：边用焊接后的两个端点作为键，排序后键相同的三角形相邻，按压缩行存储
+    vector<unsigned int> welded = weldPositions(vertices);
+    vector<std::pair<uint64_t, uint32_t>> edges;
+    edges.reserve(triangleCount * 3);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++) {
+            uint64_t a = welded[triangles[t * 3 + k]], b = welded[triangles[t * 3 + (k + 1) % 3]];
+            if (a != b)
+                edges.emplace_back(std::min(a, b) << 32 | std::max(a, b), (uint32_t)t);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    vector<std::pair<uint32_t, uint32_t>> links;
+    for (size_t begin = 0, end = 0; begin < edges.size(); begin = end) {
+        while (end < edges.size() && edges[end].first == edges[begin].first)
+            end++;
+        for (size_t i = begin; i < end; i++)
+            for (size_t j = begin; j < end; j++)
+                if (i != j)
+                    links.emplace_back(edges[i].second, edges[j].second);
+    }
+    std::sort(links.begin(), links.end());
+    vector<uint32_t> neighbourOffsets(triangleCount + 1, 0);
+    for (const auto& link : links)
+        neighbourOffsets[link.first + 1]++;
+    for (size_t t = 0; t < triangleCount; t++)
+        neighbourOffsets[t + 1] += neighbourOffsets[t];
+
+    // 从面积最大的未分配三角形开始广度优先生长图块，只加入法线和种子法线夹角足够小的三角形
+    vector<uint32_t> seeds(triangleCount);
+    std::iota(seeds.begin(), seeds.end(), 0u);
+    std::stable_sort(seeds.begin(), seeds.end(), [&areas](uint32_t a, uint32_t b) { return areas[a] > areas[b]; });
+    const float minCos = std::cos(maxChartAngle);
+    const uint32_t UNASSIGNED = UINT32_MAX;
+    vector<uint32_t> chartOf(triangleCount, UNASSIGNED);
+    // 每个图块的三角形按加入的顺序连续存放
+    vector<uint32_t> chartTriangles;
+    vector<size_t> chartStarts;
+    vector<glm::vec3> chartNormals;
+    chartTriangles.reserve(triangleCount);
+    for (uint32_t seed : seeds) {
+        if (chartOf[seed] != UNASSIGNED)
+            continue;
+        uint32_t chart = (uint32_t)chartNormals.size();
+        glm::vec3 seedNormal = normals[seed];
+        chartNormals.push_back(seedNormal);
+        size_t start = chartTriangles.size();
+        chartStarts.push_back(start);
+        chartOf[seed] = chart;
+        chartTriangles.push_back(seed);
+        for (size_t head = start; head < chartTriangles.size(); head++) {
+            uint32_t t = chartTriangles[head];
+            for (uint32_t i = neighbourOffsets[t]; i < neighbourOffsets[t + 1]; i++) {
+                uint32_t neighbour = links[i].second;
+                if (chartOf[neighbour] != UNASSIGNED)
+                    continue;
+                bool degenerate = normals[neighbour] == glm::vec3(0.0f) || seedNormal == glm::vec3(0.0f);
+                if (!degenerate && glm::dot(normals[neighbour], seedNormal) < minCos)
+                    continue;
+                chartOf[neighbour] = chart;
+                chartTriangles.push_back(neighbour);
+            }
+        }
+    }
+    chartStarts.push_back(chartTriangles.size());
+
+    // 图块内的顶点重新编号，同一个原始顶点在不同的图块中各复制一份
+    vector<uint32_t> localIndex(vertices.size(), 0);
+    vector<uint32_t> localChart(vertices.size(), UNASSIGNED);
+    result.indices.resize(triangles.size());
+    for (uint32_t chart = 0; chart + 1 < chartStarts.size(); chart++) {
+        LightmapChart info;
+        info.firstVertex = (unsigned int)result.vertices.size();
+        for (size_t i = chartStarts[chart]; i < chartStarts[chart + 1]; i++) {
+            uint32_t t = chartTriangles[i];
+            for (int k = 0; k < 3; k++) {
+                unsigned int source = triangles[t * 3 + k];
+                if (localChart[source] != chart) {
+                    localChart[source] = chart;
+                    localIndex[source] = (uint32_t)result.vertices.size();
+                    result.vertices.push_back(vertices[source]);
+                    result.sourceVertices.push_back(source);
+                }
+                result.indices[t * 3 + k] = localIndex[source];
+            }
+        }
+        info.vertexCount = (unsigned int)result.vertices.size() - info.firstVertex;
+
+        // 投影到垂直于种子法线的平面上
+        glm::vec3 normal = chartNormals[chart] == glm::vec3(0.0f) ? glm::vec3(0.0f, 0.0f, 1.0f) : chartNormals[chart];
+        glm::vec3 tangent = glm::normalize(glm::cross(std::abs(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), normal));
+        glm::vec3 bitangent = glm::cross(normal, tangent);
+        vector<glm::vec2> projected(info.vertexCount);
+        for (unsigned int v = 0; v < info.vertexCount; v++) {
+            const float* p = result.vertices[info.firstVertex + v].p;
+            glm::vec3 position(p[0], p[1], p[2]);
+            projected[v] = glm::vec2(glm::dot(position, tangent), glm::dot(position, bitangent));
+        }
+        // 旋转到包围矩形面积最小的方向，再平移到原点
+        glm::vec2 u = minimumAreaDirection(convexHull(projected));
+        glm::vec2 minimum(INFINITY), maximum(-INFINITY);
+        for (glm::vec2& point : projected) {
+            point = glm::vec2(point.x * u.x + point.y * u.y, point.y * u.x - point.x * u.y);
+            minimum = glm::min(minimum, point);
+            maximum = glm::max(maximum, point);
+        }
+        for (unsigned int v = 0; v < info.vertexCount; v++) {
+            result.vertices[info.firstVertex + v].lm[0] = projected[v].x - minimum.x;
+            result.vertices[info.firstVertex + v].lm[1] = projected[v].y - minimum.y;
+        }
+        info.size = maximum - minimum;
+        result.charts.push_back(info);
+    }
+    return result;
+}
+
+float packLightmapAtlas(const vector<vector<LightmapMesh*>>& objects, const LightmapAtlasSettings& settings, vector<LightmapRegion>& regions) {
+    double totalArea = 0.0;
+    size_t chartCount = 0;
+    for (const vector<LightmapMesh*>& meshes : objects) {
+        for (const LightmapMesh* mesh : meshes) {
+            for (const LightmapChart& chart : mesh->charts)
+                totalArea += (double)chart.size.x * chart.size.y;
+            chartCount += mesh->charts.size();
+        }
+    }
+    regions.assign(objects.size(), LightmapRegion());
+    if (chartCount == 0)
+        return 0.0f;
+
+    // 自动选择密度时从图块恰好铺满光照贴图的密度开始，放不下时每次缩小3%
+    float density = settings.texelsPerUnit;
+    if (density <= 0.0f)
+        density = totalArea > 0.0 ? (float)std::sqrt((double)settings.width * settings.height / totalArea) : 1.0f;
+    const int MAX_ATTEMPTS = 256;
+    vector<vector<PackRect>> charts(objects.size());
+    vector<PackRect> objectRects(objects.size());
+    bool packed = false;
+    for (int attempt = 0; attempt < MAX_ATTEMPTS && !packed; attempt++) {
+        if (attempt > 0)
+            density *= 0.97f;
+        // 每个物体的图块先打包成一个区域，再把区域打包进光照贴图，区域不旋转
+        packed = true;
+        for (size_t o = 0; o < objects.size() && packed; o++) {
+            objectRects[o].mesh = nullptr;
+            objectRects[o].chart = o;
+            packed = packObject(objects[o], density, settings, charts[o], objectRects[o]);
+        }
+        if (!packed)
+            continue;
+        vector<PackRect> placed;
+        for (const PackRect& rect : objectRects) {
+            if (rect.width > 0)
+                placed.push_back(rect);
+        }
+        sortRects(placed);
+        packed = skylinePack(placed, settings.width, settings.height, false);
+        if (packed) {
+            for (const PackRect& rect : placed)
+                regions[rect.chart] = LightmapRegion{ rect.x, rect.y, rect.width, rect.height };
+        }
+    }
+    if (!packed) {
+        fprintf(stderr, "Error: could not pack %zu lightmap charts into %d x %d\n", chartCount, settings.width, settings.height);
+        regions.assign(objects.size(), LightmapRegion());
+        return 0.0f;
+    }
+    if (settings.texelsPerUnit > 0.0f && density < settings.texelsPerUnit)
+        printf("lightmap atlas: %.3f texels per unit does not fit, using %.3f\n", settings.texelsPerUnit, density);
+
+    // 图块放在矩形中央，四周各留出一半的间隔
+    const float margin = settings.padding * 0.5f;
+    for (size_t o = 0; o < objects.size(); o++) {
+        for (const PackRect& rect : charts[o]) {
+            const LightmapChart& chart = rect.mesh->charts[rect.chart];
+            float originX = regions[o].x + rect.x + margin, originY = regions[o].y + rect.y + margin;
+            for (unsigned int v = chart.firstVertex; v < chart.firstVertex + chart.vertexCount; v++) {
+                float* lm = rect.mesh->vertices[v].lm;
+                float x = lm[0] * density, y = lm[1] * density;
+                // 逆时针旋转90度，不改变三角形的环绕方向
+                if (rect.rotated) {
+                    float rotatedX = chart.size.y * density - y;
+                    y = x;
+                    x = rotatedX;
+                }
+                lm[0] = (originX + x) / settings.width;
+                lm[1] = (originY + y) / settings.height;
+            }
+        }
+    }
+    return density;
+}
+
+void appendLightmapGeometry(const LightmapMesh& mesh, vector<vertex_t>& lightVertices, vector<unsigned int>& lightIndices) {
+    unsigned int baseVertex = (unsigned int)lightVertices.size();
+    lightVertices.insert(lightVertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+    for (unsigned int index : mesh.indices)
+        lightIndices.push_back(baseVertex + index);
+}
+
+int rasterizeLightmapGuide(const vector<vertex_t>& vertices, const vector<unsigned int>& indices, const LightmapRegion& region, int chartBase, LightmapGuide& guide) {
+    // 用并查集把共享顶点的三角形合并成图块
+    vector<unsigned int> parent(vertices.size());
+    std::iota(parent.begin(), parent.end(), 0u);
+    auto find = [&parent](unsigned int v) {
+        while (parent[v] != v) {
+            parent[v] = parent[parent[v]];
+            v = parent[v];
+        }
+        return v;
+    };
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        if (a >= vertices.size() || b >= vertices.size() || c >= vertices.size())
+            continue;
+        parent[find(b)] = find(a);
+        parent[find(c)] = find(a);
+    }
+    // 按第一次出现的顺序给图块编号
+    vector<int> chartOf(vertices.size(), -1);
+    int chartCount = 0;
+
+    const int width = guide.width, height = guide.height;
+    int regionMinX = std::max(0, region.x), regionMaxX = std::min(width, region.x + region.width) - 1;
+    int regionMinY = std::max(0, region.y), regionMaxY = std::min(height, region.y + region.height) - 1;
+    if (regionMaxX < regionMinX || regionMaxY < regionMinY)
+        return 0;
+    int regionWidth = regionMaxX - regionMinX + 1;
+    // 纹素中心是否在某个三角形内，这样的纹素不会再被只有重叠的三角形覆盖
+    vector<char> centerCovered((size_t)regionWidth * (regionMaxY - regionMinY + 1), 0);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        if (a >= vertices.size() || b >= vertices.size() || c >= vertices.size())
+            continue;
+        unsigned int root = find(a);
+        if (chartOf[root] < 0)
+            chartOf[root] = chartBase + chartCount++;
+        int chart = chartOf[root];
+
+        const vertex_t* v[3] = { &vertices[a], &vertices[b], &vertices[c] };
+        glm::vec3 p[3];
+        glm::vec2 uv[3];
+        for (int k = 0; k < 3; k++) {
+            p[k] = glm::vec3(v[k]->p[0], v[k]->p[1], v[k]->p[2]);
+            uv[k] = glm::vec2(v[k]->lm[0] * width, v[k]->lm[1] * height);
+        }
+        glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        float normalLength = glm::length(normal);
+        float area = (uv[1].x - uv[0].x) * (uv[2].y - uv[0].y) - (uv[2].x - uv[0].x) * (uv[1].y - uv[0].y);
+        if (normalLength == 0.0f || area == 0.0f)
+            continue;
+        normal = normal / normalLength;
+        // 世界空间面积和纹素面积之比的平方根就是纹素的边长
+        float texelSize = std::sqrt(normalLength / std::fabs(area));
+
+        // 重心坐标对纹素坐标的偏导数，纹素和边的半平面有重叠时重心坐标最多比中心处大半个纹素的变化量
+        float inverseArea = 1.0f / area;
+        glm::vec2 gradient1((uv[2].y - uv[0].y) * inverseArea, -(uv[2].x - uv[0].x) * inverseArea);
+        glm::vec2 gradient2(-(uv[1].y - uv[0].y) * inverseArea, (uv[1].x - uv[0].x) * inverseArea);
+        glm::vec2 gradient0 = -gradient1 - gradient2;
+        float margin0 = 0.5f * (std::fabs(gradient0.x) + std::fabs(gradient0.y));
+        float margin1 = 0.5f * (std::fabs(gradient1.x) + std::fabs(gradient1.y));
+        float margin2 = 0.5f * (std::fabs(gradient2.x) + std::fabs(gradient2.y));
+
+        int minX = std::max(regionMinX, (int)std::floor(std::min(std::min(uv[0].x, uv[1].x), uv[2].x)));
+        int maxX = std::min(regionMaxX, (int)std::ceil(std::max(std::max(uv[0].x, uv[1].x), uv[2].x)));
+        int minY = std::max(regionMinY, (int)std::floor(std::min(std::min(uv[0].y, uv[1].y), uv[2].y)));
+        int maxY = std::min(regionMaxY, (int)std::ceil(std::max(std::max(uv[0].y, uv[1].y), uv[2].y)));
+        for (int y = minY; y <= maxY; y++) {
+            for (int x = minX; x <= maxX; x++) {
+                glm::vec2 center(x + 0.5f, y + 0.5f);
+                float w1 = ((center.x - uv[0].x) * (uv[2].y - uv[0].y) - (uv[2].x - uv[0].x) * (center.y - uv[0].y)) * inverseArea;
+                float w2 = ((uv[1].x - uv[0].x) * (center.y - uv[0].y) - (center.x - uv[0].x) * (uv[1].y - uv[0].y)) * inverseArea;
+                float w0 = 1.0f - w1 - w2;
+                if (w0 < -margin0 || w1 < -margin1 || w2 < -margin2)
+                    continue;
+                bool inside = w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f;
+                char& covered = centerCovered[(size_t)(y - regionMinY) * regionWidth + (x - regionMinX)];
+                if (covered && !inside)
+                    continue;
+                covered = covered || inside;
+                // 纹素中心在三角形外时把重心坐标截到三角形上
+                w0 = std::max(w0, 0.0f);
+                w1 = std::max(w1, 0.0f);
+                w2 = std::max(w2, 0.0f);
+                float sum = w0 + w1 + w2;
+                glm::vec3 position = (p[0] * w0 + p[1] * w1 + p[2] * w2) / sum;
+                size_t texel = (size_t)y * width + x;
+                for (int k = 0; k < 3; k++) {
+                    guide.positions[texel * 3 + k] = position[k];
+                    guide.normals[texel * 3 + k] = normal[k];
+                }
+                guide.texelSizes[texel] = texelSize;
+                guide.charts[texel] = chart;
+            }
+        }
+    }
+    return chartCount;
+}
@@ -0,0 +1,97 @@
+#ifndef LIGHTMAP_ATLAS_H
+#define LIGHTMAP_ATLAS_H
+
+// 定义了光照贴图坐标的自动展开和图块打包，材质的纹理坐标可能重叠或平铺，不能直接作为光照贴图坐标
+// 1. 展开：位置相同的顶点视为同一个顶点，沿共享的边把法线方向相近的三角形分割成图块，
+//    每个图块投影到种子三角形的平面上，再旋转到包围矩形面积最小的方向；图块边界上的顶点被复制
+// 2. 打包：所有网格的图块按相同的纹素密度缩放，每个物体的图块用天际线算法先放进一个矩形区域，
+//    再把各物体的区域放进同一张光照贴图，图块之间留出间隔
+// 3. 引导缓冲：把打包后的三角形光栅化到光照贴图大小的缓冲中，记录每个纹素的位置、法线和图块，用于去噪
+// 不调用opengl，导入模型和离线烘焙共用
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "LightmapImage.h"
+
+using std::vector;
+
+// 烘焙用的顶点
+typedef struct {
+    float p[3];  // 位置
+    float t[2];  // 纹理坐标
+    float lm[2]; // 光照贴图坐标
+} vertex_t;
+
+// 同一个图块中三角形法线和种子三角形法线的最大夹角（60度）
+const float LIGHTMAP_MAX_CHART_ANGLE = 1.04719755f;
+
+// 展开得到的一个图块
+struct LightmapChart {
+    // 图块的大小（模型空间的长度）
+    glm::vec2 size;
+    // 图块的顶点在LightmapMesh::vertices中的范围
+    unsigned int firstVertex;
+    unsigned int vertexCount;
+};
+
+// 一个网格展开后的烘焙几何体
+struct LightmapMesh {
+    // 展开后的顶点，按图块连续存放
+    // lm在打包之前是图块内的坐标（模型空间的长度），打包之后是光照贴图坐标
+    vector<vertex_t> vertices;
+    // 每个展开后的顶点对应的原始顶点
+    vector<unsigned int> sourceVertices;
+    // 展开后的索引
+    vector<unsigned int> indices;
+    // 图块
+    vector<LightmapChart> charts;
+};
+
+// 一个物体的所有图块在光照贴图中占用的矩形区域（纹素）
+struct LightmapRegion {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// 打包参数
+struct LightmapAtlasSettings {
+    // 光照贴图的大小
+    int width = 1024;
+    int height = 1024;
+    // 图块之间的间隔（纹素），要覆盖双线性过滤读到的相邻纹素
+    int padding = 2;
+    // 每单位长度的纹素数，0表示自动选择能放下所有图块的最大密度
+    float texelsPerUnit = 0.0f;
+};
+
+/// @brief 展开一个网格，分割图块并投影到平面上，结果的lm是图块内的坐标
+/// @param vertices 原始顶点，t是材质的纹理坐标，lm被忽略
+/// @param indices 原始索引，超出顶点范围的三角形会被跳过
+/// @param maxChartAngle 同一个图块中三角形法线和种子三角形法线的最大夹角（弧度），小于90度时投影后的三角形不会翻转
+LightmapMesh unwrapLightmapMesh(const vector<vertex_t>& vertices, const vector<unsigned int>& indices, float maxChartAngle);
+
+/// @brief 把所有物体的图块打包进一张光照贴图，把每个顶点的lm改写为光照贴图坐标
+/// 每个物体的图块先打包成一个矩形区域，再把各物体的区域打包进光照贴图，不同的物体不共享纹素，可以分别烘焙
+/// 指定的密度放不下时逐步缩小密度
+/// @param objects 每个物体展开后的网格，同一个网格只能打包一次
+/// @param regions 输出每个物体的区域，没有图块的物体区域为空
+/// @return 实际使用的纹素密度（每单位长度的纹素数），没有图块或者放不下时返回0
+float packLightmapAtlas(const vector<vector<LightmapMesh*>>& objects, const LightmapAtlasSettings& settings, vector<LightmapRegion>& regions);
+
+/// @brief 把打包后的网格追加到烘焙用的顶点和索引，索引加上已有的顶点数
+void appendLightmapGeometry(const LightmapMesh& mesh, vector<vertex_t>& lightVertices, vector<unsigned int>& lightIndices);
+
+/// @brief 把一个物体光栅化到去噪的引导缓冲，只写入它的区域内被三角形覆盖的纹素
+/// 和lightmapper一样保守光栅化：和三角形有重叠的纹素都被覆盖，中心在三角形内的优先，位置取三角形上离纹素中心最近的点
+/// 图块由共享顶点的三角形组成（展开时图块边界上的顶点被复制，不同的图块不共享顶点）
+/// @param vertices 世界空间的顶点，lm是光照贴图坐标
+/// @param indices 索引，超出顶点范围的三角形会被跳过
+/// @param region 物体在光照贴图中的区域
+/// @param chartBase 这个物体的第一个图块的编号，不同物体的图块编号不能重复
+/// @param guide 引导缓冲，必须已经分配为光照贴图的大小
+/// @return 这个物体的图块数
+int rasterizeLightmapGuide(const vector<vertex_t>& vertices, const vector<unsigned int>& indices, const LightmapRegion& region, int chartBase, LightmapGuide& guide);
+
+#endif // LIGHTMAP_ATLAS_H
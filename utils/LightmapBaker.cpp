@@ -0,0 +1,568 @@
+#include "LightmapBaker.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include "GpuResource.h"
+#include "LightmapImage.h"
+#include "Profiler.h"
+// 导入库，光照贴图库创建的纹理和帧缓冲也登记到显存账本
+#define LM_GL_TRACK(type, id, bytes) do { \
+        GpuMemoryLedger::instance().track(GpuResourceType::type, id, "lightmapper", "lightmapper"); \
+        GpuMemoryLedger::instance().setSize(GpuResourceType::type, id, bytes, GL_NONE); \
+    } while (0)
+#define LM_GL_UNTRACK(type, id) GpuMemoryLedger::instance().release(GpuResourceType::type, id)
+// 断言失败时抛出异常而不是终止程序，发布版本中也检查，烘焙停止时保留断点和部分完成的结果
+#define LM_ASSERT(condition) do { \
+        if (!(condition)) \
+            throw std::runtime_error("lightmapper assertion failed: " #condition); \
+    } while (0)
+#define LIGHTMAPPER_IMPLEMENTATION
+#define LM_DEBUG_INTERPOLATION
+#include "lightmapper.h"
+
+LightmapBaker::~LightmapBaker() {
+    // 后处理任务引用了光照贴图数据，等它结束再释放；CPU烘焙先取消，不用等所有纹素算完
+    if (this->cpuBaker)
+        this->cpuBaker->cancel();
+    if (this->postProcessJob)
+        JobSystem::instance().wait(this->postProcessJob);
+    // 采样中途退出时保存断点，下次开始烘焙时从这里继续
+    bool cpuReady = this->cpuBaker && this->sceneJob && this->sceneJob->finished;
+    if (this->state == State::Sampling && (this->ctx || cpuReady)) {
+        try {
+            this->saveCheckpoint(true);
+        }
+        catch (const std::exception& e) {
+            fprintf(stderr, "Error: %s\n", e.what());
+        }
+    }
+    if (this->checkpointJob)
+        JobSystem::instance().wait(this->checkpointJob);
+    if (this->ctx)
+        lmDestroy(this->ctx);
+}
+
+namespace {
+// 把物体的顶点变换到世界空间，光照贴图坐标不变
+void transformVertices(const LightmapBaker::Object& object, vector<vertex_t>& out) {
+    out.resize(object.vertices->size());
+    for (size_t i = 0; i < out.size(); i++) {
+        const vertex_t& vertex = (*object.vertices)[i];
+        glm::vec4 p = object.model * glm::vec4(vertex.p[0], vertex.p[1], vertex.p[2], 1.0f);
+        out[i] = vertex;
+        out[i].p[0] = p.x;
+        out[i].p[1] = p.y;
+        out[i].p[2] = p.z;
+    }
+}
+}
+
+bool LightmapBaker::start(GLuint target, int width, int height, const vector<Object>& objects) {
+    if (this->isBaking() || !this->setObjects(objects))
+        return false;
+    // lmCrate用于创建一个光照映射的上下文
+    this->ctx = lmCreate(
+        HEMISPHERE_SIZE,      // 表示渲染质量或分辨率，通常越大越精细，但也会增加计算开销
+        0.001f, 10.0f,        // 定义了渲染的近裁剪面和远裁剪面
+        1.0f, 1.0f, 1.0f,     // 定义环境光颜色
+        INTERPOLATION_PASSES, 0.0001f, // 定义了层次选择性插值的设置，用于加速计算，INTERPOLATION_PASSES代表迭代次数，0.0001f是阈值，用于决定何时进行插值
+        0.0f);                // 用于影响从摄像机到表面距离的计算，帮助光照贴图计算中权衡质量和性能
+
+    // 初始化失败
+    if (!this->ctx) {
+        fprintf(stderr, "Error: Could not initialize lightmapper.\n");
+        return false;
+    }
+
+    // lightmapper只写入还是0的纹素
+    this->allocate(target, width, height);
+    // 有断点时光照贴图换成断点中部分完成的结果，模型矩阵也换成断点中的
+    LightmapCheckpoint resumed;
+    bool resume = this->loadCheckpoint(false, resumed);
+    // 设置目标光照贴图，所有物体写入同一张光照贴图的不同区域
+    lmSetTargetLightmap(this->ctx, this->data.data(), width, height, 4);
+
+    printf("objects: %zu, triangles: %d\n", this->objects.size(), this->triangleCount);
+    this->currentObject = resume ? resumed.currentObject : 0;
+    this->finishedTriangles = resume ? resumed.finishedTriangles : 0;
+    this->uploadedPasses = 0;
+    try {
+        this->setCurrentGeometry();
+        if (resume) {
+            // 断点中的采样位置总是在两个半球之间
+            lm_position position;
+            position.pass = resumed.position.pass;
+            position.baseIndex = resumed.position.baseIndex;
+            position.x = resumed.position.x;
+            position.y = resumed.position.y;
+            position.side = resumed.position.side;
+            lmSetPosition(this->ctx, position, (unsigned int)(resumed.resultColors.size() / 4), resumed.resultLocations.data(), resumed.resultColors.data());
+            this->uploadedPasses = position.pass;
+            this->upload();
+        }
+    }
+    catch (const std::exception& e) {
+        // 断点和几何数据对不上，不能继续，删除它以免下次再失败
+        fprintf(stderr, "Error: %s\n", e.what());
+        if (resume)
+            std::remove(this->checkpointPath.c_str());
+        lmDestroy(this->ctx);
+        this->ctx = nullptr;
+        return false;
+    }
+
+    this->progress = 0.0f;
+    this->sidesRendered = 0;
+    this->lastCheckpoint = std::chrono::steady_clock::now();
+    this->state = State::Sampling;
+    return true;
+}
+
+bool LightmapBaker::startCpu(GLuint target, int width, int height, const vector<Object>& objects, std::unique_ptr<CpuLightmapBaker> baker) {
+    if (this->isBaking() || !this->setObjects(objects))
+        return false;
+    this->allocate(target, width, height);
+    LightmapCheckpoint resumed;
+    if (this->loadCheckpoint(true, resumed)) {
+        this->resumedRows.swap(resumed.finishedRows);
+        this->upload();
+    }
+    this->cpuBaker = std::move(baker);
+    this->progress = 0.0f;
+    this->lastCheckpoint = std::chrono::steady_clock::now();
+
+    // 1. 每个物体一个任务变换到世界空间
+    JobSystem& jobs = JobSystem::instance();
+    this->worldVertices.assign(this->objects.size(), vector<vertex_t>());
+    vector<JobSystem::JobHandle> transformJobs;
+    for (size_t i = 0; i < this->objects.size(); i++)
+        transformJobs.push_back(jobs.schedule([this, i]() { transformVertices(this->objects[i], this->worldVertices[i]); }));
+    // 2. 合并所有物体建立层级包围盒，阴影和间接光照的光线要和整个场景求交
+    this->sceneJob = jobs.schedule([this]() {
+        vector<vertex_t> sceneVertices;
+        vector<unsigned int> sceneIndices;
+        int rows = 0;
+        for (size_t i = 0; i < this->objects.size(); i++) {
+            unsigned int baseVertex = (unsigned int)sceneVertices.size();
+            sceneVertices.insert(sceneVertices.end(), this->worldVertices[i].begin(), this->worldVertices[i].end());
+            for (unsigned int index : *this->objects[i].indices)
+                sceneIndices.push_back(baseVertex + index);
+            rows += this->objects[i].region.height;
+        }
+        this->cpuBaker->setScene(sceneVertices, sceneIndices, rows);
+        // 从断点继续时跳过已经完成的行
+        this->cpuBaker->restoreFinishedRows(this->resumedRows);
+        this->resumedRows = vector<char>();
+        }, transformJobs);
+    // 3. 每个物体一个烘焙任务，物体的区域不重叠，任务之间没有依赖
+    vector<JobSystem::JobHandle> objectJobs;
+    size_t firstRow = 0;
+    for (size_t i = 0; i < this->objects.size(); i++) {
+        objectJobs.push_back(jobs.schedule([this, i, firstRow]() {
+            this->cpuBaker->bakeObject(this->worldVertices[i], *this->objects[i].indices, this->width, this->height, this->data.data(), this->objects[i].region, firstRow);
+            }, { this->sceneJob }));
+        firstRow += this->objects[i].region.height;
+    }
+    // 4. 所有物体烘焙完成后后处理，被取消时不保存，避免覆盖之前的结果
+    this->postProcessJob = jobs.schedule([this]() {
+        if (!this->cpuBaker->isCancelled()) {
+            this->postProcessObjects();
+            this->saveCache();
+        }
+        }, objectJobs);
+    this->state = State::Sampling;
+    return true;
+}
+
+bool LightmapBaker::setObjects(const vector<Object>& objects) {
+    this->objects.clear();
+    this->triangleCount = 0;
+    // lightmapper要求每个网格至少有一个三角形
+    for (const Object& object : objects) {
+        if (!object.vertices || !object.indices || object.vertices->empty() || object.indices->size() < 3)
+            continue;
+        this->objects.push_back(object);
+        this->triangleCount += (int)object.indices->size() / 3;
+    }
+    return !this->objects.empty();
+}
+
+void LightmapBaker::setCurrentGeometry() {
+    const Object& object = this->objects[this->currentObject];
+    // lightmapper用模型矩阵把顶点变换到世界空间，保存的是矩阵的指针
+    lmSetGeometry(this->ctx, glm::value_ptr(object.model),
+        LM_FLOAT, (const unsigned char*)(object.vertices->data()) + offsetof(vertex_t, p), sizeof(vertex_t),
+        LM_NONE, NULL, 0, // 不使用插值法线
+        LM_FLOAT, (const unsigned char*)(object.vertices->data()) + offsetof(vertex_t, lm), sizeof(vertex_t),
+        (int)(object.indices->size() / 3 * 3), LM_UNSIGNED_INT, object.indices->data());
+}
+
+void LightmapBaker::allocate(GLuint target, int width, int height) {
+    this->target = target;
+    this->width = width;
+    this->height = height;
+    // 分配内存用于存储光照贴图数据
+    this->data.assign((size_t)width * height * 4, 0.0f);
+    // 预览和最终结果都用半精度浮点保留超过1的亮度，先分配一张全黑的纹理
+    glBindTexture(GL_TEXTURE_2D, this->target);
+    // 之前加载的缓存带有mip链，预览只有第0级
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, this->data.data());
+    GpuMemoryLedger::instance().setSize(GpuResourceType::Texture, this->target, GpuMemoryLedger::textureBytes(GL_RGBA16F, width, height), GL_RGBA16F);
+}
+
+void LightmapBaker::advance(const std::function<void(const glm::mat4&, const glm::mat4&)>& renderHemisphere, double budgetMs, unsigned int maxHemispheres) {
+    if (this->state == State::Sampling && this->cpuBaker) {
+        // CPU烘焙的光照贴图在工作线程上写入，完成之前不上传预览
+        if (budgetMs <= 0.0)
+            JobSystem::instance().wait(this->postProcessJob);
+        // 已经完成的行在建立层级包围盒之后才有记录
+        if (this->isCheckpointDue() && this->sceneJob->finished)
+            this->saveCheckpoint(false);
+        this->progress = this->cpuBaker->getProgress();
+        if (this->progress >= 1.0f || this->postProcessJob->finished) {
+            this->progress = 1.0f;
+            printf("\rFinished baking %d triangles in %zu objects on the cpu.\n", this->triangleCount, this->objects.size());
+            this->state = State::PostProcessing;
+        }
+    }
+    else if (this->state == State::Sampling) {
+        PROFILE_SCOPE("lightmap hemispheres");
+        auto startTime = std::chrono::steady_clock::now();
+        unsigned int hemispheres = 0;
+        int vp[4];
+        float view[16], projection[16];
+        const int passCount = 1 + 3 * INTERPOLATION_PASSES;
+        bool sampling = true;
+        try {
+            while (true) {
+                // lightmapper只在半球的第一个面绑定自己的帧缓冲，所以只能在两个半球之间停下和保存断点
+                if (this->sidesRendered == 0 && this->isCheckpointDue())
+                    this->saveCheckpoint(false);
+                if (this->sidesRendered == 0 && budgetMs > 0.0) {
+                    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+                    if (hemispheres >= maxHemispheres || elapsed >= budgetMs)
+                        break;
+                }
+                if (!lmBegin(this->ctx, vp, view, projection)) {
+                    // 当前物体的所有采样遍数完成，上传它的结果，接着烘焙下一个物体
+                    this->finishedTriangles += (int)this->objects[this->currentObject].indices->size() / 3;
+                    this->uploadedPasses = 0;
+                    this->upload();
+                    if (++this->currentObject == this->objects.size()) {
+                        sampling = false;
+                        break;
+                    }
+                    this->setCurrentGeometry();
+                    continue;
+                }
+                // 按三角形数加权的总进度
+                int objectTriangles = (int)this->objects[this->currentObject].indices->size() / 3;
+                float objectProgress = lmProgress(this->ctx);
+                this->progress = (this->finishedTriangles + objectProgress * objectTriangles) / this->triangleCount;
+                // 渲染到光照贴图帧缓冲区
+                glViewport(vp[0], vp[1], vp[2], vp[3]);
+                renderHemisphere(glm::make_mat4(view), glm::make_mat4(projection));
+                lmEnd(this->ctx);
+                if (++this->sidesRendered == HEMISPHERE_SIDES) {
+                    this->sidesRendered = 0;
+                    hemispheres++;
+                }
+
+                // 每完成一遍采样，lightmapper会把当前物体的结果写回光照贴图，上传部分完成的结果用于预览
+                int finishedPasses = std::min(passCount - 1, (int)(objectProgress * passCount));
+                if (finishedPasses > this->uploadedPasses) {
+                    this->uploadedPasses = finishedPasses;
+                    this->upload();
+                }
+            }
+        }
+        catch (const std::exception& e) {
+            this->fail(e.what());
+            return;
+        }
+
+        if (!sampling) {
+            this->progress = 1.0f;
+            printf("\rFinished baking %d triangles in %zu objects.\n", this->triangleCount, this->objects.size());
+            // 销毁光照贴图上下文，后处理不需要opengl，交给任务系统
+            lmDestroy(this->ctx);
+            this->ctx = nullptr;
+            this->postProcessJob = JobSystem::instance().schedule([this]() {
+                this->postProcessObjects();
+                this->saveCache();
+                });
+            this->state = State::PostProcessing;
+            // 没有时间预算时等待后处理完成，和一次烘焙完的行为相同
+            if (budgetMs <= 0.0)
+                JobSystem::instance().wait(this->postProcessJob);
+        }
+    }
+
+    if (this->state == State::PostProcessing && this->postProcessJob->finished) {
+        // 后处理抛出的异常由任务系统记录，这里和采样时的异常一样处理
+        std::exception_ptr error = this->postProcessJob->error;
+        this->postProcessJob = nullptr;
+        if (error) {
+            try {
+                std::rethrow_exception(error);
+            }
+            catch (const std::exception& e) {
+                this->fail(e.what());
+            }
+            catch (...) {
+                this->fail("lightmap post-processing failed");
+            }
+            return;
+        }
+        // 烘焙已经完成，等正在写入的断点写完再删除
+        if (this->checkpointJob) {
+            JobSystem::instance().wait(this->checkpointJob);
+            this->checkpointJob = nullptr;
+        }
+        if (!this->checkpointPath.empty())
+            std::remove(this->checkpointPath.c_str());
+        PROFILE_SCOPE("lightmap upload");
+        if (this->encoded.empty()) {
+            this->upload();
+        }
+        else {
+            uploadCache(this->target, this->encoded);
+            this->encoded.clear();
+        }
+        this->data = vector<float>();
+        this->objects.clear();
+        this->worldVertices = vector<vector<vertex_t>>();
+        this->cpuBaker = nullptr;
+        this->sceneJob = nullptr;
+        this->state = State::Finished;
+    }
+}
+
+void LightmapBaker::setCache(const std::string& path, const LightmapCacheKey& key) {
+    this->cachePath = path;
+    this->cacheKey = key;
+}
+
+void LightmapBaker::saveCache() {
+    if (this->cachePath.empty())
+        return;
+    this->encoded.encode(this->data.data(), this->width, this->height);
+    if (this->encoded.save(this->cachePath, this->cacheKey))
+        printf("Saved %s\n", this->cachePath.c_str());
+}
+
+void LightmapBaker::setCheckpoint(const std::string& path, const LightmapCacheKey& key, double intervalSeconds) {
+    this->checkpointPath = path;
+    this->checkpointKey = key;
+    this->checkpointInterval = intervalSeconds;
+}
+
+bool LightmapBaker::loadCheckpoint(bool cpu, LightmapCheckpoint& out) {
+    if (this->checkpointPath.empty() || !out.load(this->checkpointPath, this->checkpointKey))
+        return false;
+    // 键包括开始烘焙时的光源、模型矩阵和几何体，键相同时场景也相同，其余的检查防止用错烘焙器或者光照贴图大小
+    if (out.cpu != cpu || out.width != this->width || out.height != this->height || out.models.size() != this->objects.size()
+        || (!cpu && out.currentObject >= this->objects.size())) {
+        fprintf(stderr, "Warning: ignoring lightmap checkpoint %s of a different bake\n", this->checkpointPath.c_str());
+        return false;
+    }
+    // 使用保存断点时的模型矩阵，已经烘焙的部分和继续烘焙的部分看到的是同一个场景
+    for (size_t i = 0; i < this->objects.size(); i++)
+        this->objects[i].model = out.models[i];
+    this->data.swap(out.lightmap);
+    printf("Resuming lightmap bake from %s\n", this->checkpointPath.c_str());
+    return true;
+}
+
+bool LightmapBaker::isCheckpointDue() const {
+    if (this->checkpointPath.empty() || this->checkpointInterval <= 0.0)
+        return false;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - this->lastCheckpoint).count() >= this->checkpointInterval;
+}
+
+void LightmapBaker::saveCheckpoint(bool wait) {
+    if (this->checkpointPath.empty())
+        return;
+    JobSystem& jobs = JobSystem::instance();
+    if (this->checkpointJob) {
+        // 上一个断点还没有写完，下一个半球之后再试
+        if (!wait && !this->checkpointJob->finished)
+            return;
+        jobs.wait(this->checkpointJob);
+        this->checkpointJob = nullptr;
+    }
+
+    LightmapCheckpoint& checkpoint = this->checkpoint;
+    checkpoint.key = this->checkpointKey;
+    checkpoint.cpu = this->cpuBaker != nullptr;
+    checkpoint.width = this->width;
+    checkpoint.height = this->height;
+    checkpoint.models.clear();
+    for (const Object& object : this->objects)
+        checkpoint.models.push_back(object.model);
+    checkpoint.resultLocations.clear();
+    checkpoint.resultColors.clear();
+    checkpoint.finishedRows.clear();
+    if (this->cpuBaker) {
+        // 工作线程还在写入光照贴图，不能整个复制；先读取完成标志，只复制标志为真的行，这些行已经写完不会再改变
+        checkpoint.finishedRows = this->cpuBaker->getFinishedRows();
+        vector<LightmapRegion> regions;
+        for (const Object& object : this->objects)
+            regions.push_back(object.region);
+        CpuLightmapBaker::copyFinishedRows(this->data.data(), this->width, this->height, regions, checkpoint.finishedRows, checkpoint.lightmap);
+    }
+    else {
+        checkpoint.currentObject = (uint32_t)this->currentObject;
+        checkpoint.finishedTriangles = this->finishedTriangles;
+        lm_position position = lmGetPosition(this->ctx);
+        checkpoint.position.pass = position.pass;
+        checkpoint.position.baseIndex = position.baseIndex;
+        checkpoint.position.x = position.x;
+        checkpoint.position.y = position.y;
+        checkpoint.position.side = position.side;
+        // 这一遍的结果要到这一遍结束时才写入光照贴图，等所有回读完成后和光照贴图一起保存
+        const int* locations;
+        const float* colors;
+        unsigned int count = lmFlushResults(this->ctx, &locations, &colors);
+        checkpoint.resultLocations.assign(locations, locations + (size_t)count * 2);
+        checkpoint.resultColors.assign(colors, colors + (size_t)count * 4);
+        // GPU烘焙只在opengl线程上写入光照贴图
+        checkpoint.lightmap = this->data;
+    }
+    this->lastCheckpoint = std::chrono::steady_clock::now();
+
+    this->checkpointJob = jobs.schedule([this]() { this->checkpoint.save(this->checkpointPath); });
+    if (wait)
+        jobs.wait(this->checkpointJob);
+}
+
+void LightmapBaker::fail(const char* message) {
+    fprintf(stderr, "\nError: %s\n", message);
+    // 异常可能发生在渲染半球的中途，恢复默认的帧缓冲和深度测试
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    // 后处理失败时上下文已经销毁了
+    if (this->ctx)
+        lmDestroy(this->ctx);
+    this->ctx = nullptr;
+    this->sidesRendered = 0;
+    // 上一个断点之后的进度不能保证一致，只保留上一个断点
+    if (this->checkpointJob) {
+        JobSystem::instance().wait(this->checkpointJob);
+        this->checkpointJob = nullptr;
+    }
+    this->upload();
+    FILE* file = this->checkpointPath.empty() ? nullptr : fopen(this->checkpointPath.c_str(), "rb");
+    if (file) {
+        fclose(file);
+        printf("Baking stopped, press space to continue from %s\n", this->checkpointPath.c_str());
+    }
+    this->data = vector<float>();
+    this->objects.clear();
+    this->state = State::Failed;
+}
+
+void LightmapBaker::upload() {
+    glBindTexture(GL_TEXTURE_2D, this->target);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, this->width, this->height, GL_RGBA, GL_FLOAT, this->data.data());
+}
+
+void LightmapBaker::postProcessObjects() {
+    if (!DENOISE) {
+        postProcess(this->data, this->width, this->height, "result.tga", nullptr);
+        return;
+    }
+    // CPU烘焙时已经变换过了
+    if (this->worldVertices.size() != this->objects.size()) {
+        this->worldVertices.assign(this->objects.size(), vector<vertex_t>());
+        JobSystem::instance().parallelFor(this->objects.size(), 1, [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                transformVertices(this->objects[i], this->worldVertices[i]);
+            });
+    }
+    vector<const vector<vertex_t>*> vertices;
+    vector<const vector<unsigned int>*> indices;
+    vector<LightmapRegion> regions;
+    for (size_t i = 0; i < this->objects.size(); i++) {
+        vertices.push_back(&this->worldVertices[i]);
+        indices.push_back(this->objects[i].indices);
+        regions.push_back(this->objects[i].region);
+    }
+    LightmapGuide guide;
+    buildGuide(vertices, indices, regions, this->width, this->height, guide);
+    postProcess(this->data, this->width, this->height, "result.tga", &guide);
+}
+
+void LightmapBaker::buildGuide(const vector<const vector<vertex_t>*>& vertices, const vector<const vector<unsigned int>*>& indices,
+    const vector<LightmapRegion>& regions, int width, int height, LightmapGuide& guide) {
+    guide.reset(width, height);
+    int charts = 0;
+    for (size_t i = 0; i < vertices.size(); i++)
+        charts += rasterizeLightmapGuide(*vertices[i], *indices[i], regions[i], charts, guide);
+}
+
+void LightmapBaker::postProcess(vector<float>& image, int width, int height, const std::string& path, const LightmapGuide* guide) {
+    if (DENOISE && guide && guide->width == width && guide->height == height) {
+        // 去噪只在图块内部滤波，之后的接缝填充把结果扩展到图块之间，双线性过滤不会读到黑色
+        LightmapDenoiseSettings settings;
+        lightmapDenoise(image.data(), *guide, settings);
+        lightmapSeamFill(image.data(), width, height, SEAM_FILL_DISTANCE);
+    }
+    else {
+        // 一遍跳跃泛洪的接缝填充代替反复扩张，平滑后有效纹素周围的一圈也被填充，不再需要最后的扩张
+        lightmapSeamFill(image.data(), width, height, SEAM_FILL_DISTANCE);
+        vector<float> smoothed(image.size());
+        lightmapSmooth(image.data(), smoothed.data(), width, height);
+        image.swap(smoothed);
+    }
+
+    // 光照贴图保持线性空间，伽马矫正统一在后处理中完成，这里只对保存的图片做伽马矫正
+    vector<float> corrected(image);
+    lightmapPower(corrected.data(), width, height, 1.0f / 2.2f);
+    // 保存结果到文件
+    if (lmImageSaveTGAf(path.c_str(), corrected.data(), width, height, 4, 1.0f))
+        printf("Saved %s\n", path.c_str());
+}
+
+void LightmapBaker::uploadCache(GLuint target, const LightmapCache& cache) {
+    const vector<LightmapCache::Level>& levels = cache.getLevels();
+    if (levels.empty())
+        return;
+    glBindTexture(GL_TEXTURE_2D, target);
+    for (size_t i = 0; i < levels.size(); i++)
+        glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGB9_E5, levels[i].width, levels[i].height, 0, GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV, levels[i].texels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    GpuMemoryLedger::instance().setSize(GpuResourceType::Texture, target, GpuMemoryLedger::textureBytes(GL_RGB9_E5, levels[0].width, levels[0].height, 1, levels.size() > 1), GL_RGB9_E5);
+}
+
+void LightmapBaker::hashSettings(LightmapHasher& hasher, const CpuLightmapBaker::Settings* cpuSettings) {
+    // 后处理的参数两种烘焙器共用
+    hasher.add((int)SEAM_FILL_DISTANCE);
+    hasher.add((bool)DENOISE);
+    if (DENOISE) {
+        LightmapDenoiseSettings denoise;
+        hasher.add(denoise.iterations);
+        hasher.add(denoise.colorSigma);
+        hasher.add(denoise.normalSigma);
+        hasher.add(denoise.planeSigma);
+    }
+    hasher.add(cpuSettings != nullptr);
+    if (cpuSettings) {
+        hasher.add(cpuSettings->samples);
+        hasher.add(cpuSettings->bounces);
+        hasher.add(cpuSettings->skyColor);
+        hasher.add(cpuSettings->albedo);
+        hasher.add(cpuSettings->seed);
+    }
+    else {
+        hasher.add((int)HEMISPHERE_SIZE);
+        hasher.add((int)INTERPOLATION_PASSES);
+    }
+}
@@ -0,0 +1,206 @@
+#ifndef LIGHTMAP_BAKER_H
+#define LIGHTMAP_BAKER_H
+
+// 定义了渐进式光照贴图烘焙
+// 每帧只渲染有限数量的半球（受数量上限和时间预算限制），其余时间照常渲染场景，窗口不会卡住
+// lightmapper每完成一遍采样就把结果写回CPU上的光照贴图，这时把部分完成的光照贴图上传到纹理用于预览
+// 采样全部完成后，去噪、接缝填充和保存图片在任务系统上执行，完成后再上传最终结果
+// 去噪用物体的世界空间位置、法线和图块作为引导，可以用更小的半球或更少的采样数烘焙
+// 也可以改用CPU路径追踪烘焙器：整个烘焙在任务系统上执行，opengl线程只显示进度和上传结果
+// 场景按物体烘焙：每个物体用自己的模型矩阵变换到世界空间，在光照贴图中占用独立的区域，
+// GPU烘焙依次烘焙各个物体，CPU烘焙在建立层级包围盒之后每个物体一个任务，互不依赖的物体同时烘焙
+// 设置了缓存路径时，后处理之后把结果编码为RGB9_E5的mip链保存，最终上传的也是编码后的结果，和下次启动时加载的相同
+// 设置了断点路径时，采样中每隔一段时间在两个半球之间保存断点（GPU烘焙）或者记录已经完成的行（CPU烘焙），
+// 开始烘焙时如果有键相同的断点就从断点继续；lightmapper的断言失败时烘焙停止，保留断点和部分完成的结果
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "CpuLightmapBaker.h"
+#include "JobSystem.h"
+#include "LightmapAtlas.h"
+#include "LightmapCache.h"
+#include "LightmapCheckpoint.h"
+
+using std::vector;
+
+typedef struct lm_context lm_context;
+
+class LightmapBaker {
+public:
+    // 烘焙的状态
+    enum class State {
+        // 没有在烘焙
+        Idle,
+        // 正在渲染半球采样
+        Sampling,
+        // 采样完成，正在后台做后处理
+        PostProcessing,
+        // 最终结果已经上传
+        Finished,
+        // lightmapper的断言失败，部分完成的结果已经上传，可以从断点重新开始
+        Failed
+    };
+
+    // 参与烘焙的一个物体
+    struct Object {
+        // 模型空间的顶点数据，lm是光照贴图坐标，烘焙结束前必须保持有效
+        const vector<vertex_t>* vertices = nullptr;
+        // 32位索引，烘焙结束前必须保持有效
+        const vector<unsigned int>* indices = nullptr;
+        // 模型矩阵
+        glm::mat4 model = glm::mat4(1.0f);
+        // 物体在光照贴图中的区域
+        LightmapRegion region;
+    };
+
+    LightmapBaker() = default;
+    ~LightmapBaker();
+
+    LightmapBaker(const LightmapBaker&) = delete;
+    LightmapBaker& operator=(const LightmapBaker&) = delete;
+
+    /// @brief 开始烘焙，目标纹理会被重新分配为width x height的RGBA16F纹理
+    /// @param target 光照贴图纹理
+    /// @param width 光照贴图宽度
+    /// @param height 光照贴图高度
+    /// @param objects 参与烘焙的物体，没有三角形的物体会被跳过，顶点和索引在烘焙结束前必须保持有效
+    /// @return 光照贴图上下文创建失败或者没有可以烘焙的物体时返回false
+    bool start(GLuint target, int width, int height, const vector<Object>& objects);
+
+    /// @brief 用CPU路径追踪烘焙器开始烘焙，烘焙和后处理都在任务系统上执行，参数和start相同
+    /// @param baker 设置好光源的烘焙器，烘焙结束前由这个对象持有
+    /// @return 正在烘焙或者没有可以烘焙的物体时返回false
+    bool startCpu(GLuint target, int width, int height, const vector<Object>& objects, std::unique_ptr<CpuLightmapBaker> baker);
+
+    /// @brief 设置烘焙结果的缓存，之后的烘焙完成时保存，在开始烘焙之前调用
+    /// @param path 缓存文件路径，为空时不保存
+    /// @param key 缓存的键
+    void setCache(const std::string& path, const LightmapCacheKey& key);
+
+    /// @brief 设置烘焙的断点，在开始烘焙之前调用
+    /// 开始烘焙时如果断点有效就从断点继续，烘焙完成时删除断点
+    /// @param path 断点文件路径，为空时不保存也不继续
+    /// @param key 这次烘焙的键，用开始烘焙时的光源和模型矩阵计算，和缓存的相同；光源移动之后旧的断点失效
+    /// @param intervalSeconds 保存断点的间隔（秒）
+    void setCheckpoint(const std::string& path, const LightmapCacheKey& key, double intervalSeconds);
+
+    /// @brief 推进烘焙，每帧在opengl线程上调用一次
+    /// 采样阶段渲染半球，直到达到数量上限或者时间预算，总是在一个半球的5个面都渲染完之后才停下；
+    /// 后处理阶段检查后台任务是否完成，完成时上传最终结果
+    /// @param renderHemisphere 从半球的一个面渲染场景，参数是视图矩阵和投影矩阵，视口已经设置好了
+    /// @param budgetMs 每帧的CPU时间预算（毫秒），小于等于0时一次完成所有采样并等待后处理
+    /// @param maxHemispheres 每帧最多渲染的半球数
+    void advance(const std::function<void(const glm::mat4&, const glm::mat4&)>& renderHemisphere, double budgetMs, unsigned int maxHemispheres);
+
+    /// @brief 获取状态
+    State getState() const { return this->state; }
+    /// @brief 是否正在烘焙（采样或后处理）
+    bool isBaking() const { return this->state == State::Sampling || this->state == State::PostProcessing; }
+    /// @brief 获取采样的进度（0到1）
+    float getProgress() const { return this->progress; }
+
+    /// @brief 去噪、接缝填充光照贴图，再保存伽马矫正后的图片，不调用opengl，可以在任意线程上执行
+    /// @param image 光照贴图，width x height x 4个float，原地修改
+    /// @param path 保存的图片路径
+    /// @param guide 去噪的引导缓冲，为空或者关闭了去噪时改用3x3平滑
+    static void postProcess(vector<float>& image, int width, int height, const std::string& path, const LightmapGuide* guide);
+
+    /// @brief 把物体光栅化到去噪的引导缓冲，各物体的图块编号不重复
+    /// @param vertices 每个物体世界空间的顶点
+    /// @param indices 每个物体的索引
+    /// @param regions 每个物体在光照贴图中的区域
+    static void buildGuide(const vector<const vector<vertex_t>*>& vertices, const vector<const vector<unsigned int>*>& indices,
+        const vector<LightmapRegion>& regions, int width, int height, LightmapGuide& guide);
+
+    /// @brief 把编码后的光照贴图的所有mip级别上传到纹理，开启三线性过滤
+    static void uploadCache(GLuint target, const LightmapCache& cache);
+
+    /// @brief 把影响烘焙结果的参数加入缓存的键
+    /// @param cpuSettings CPU烘焙器的参数，使用GPU烘焙时为空
+    static void hashSettings(LightmapHasher& hasher, const CpuLightmapBaker::Settings* cpuSettings);
+
+private:
+    // 半球的分辨率
+    static const int HEMISPHERE_SIZE = 512;
+    // 层次选择性插值的遍数，总的采样遍数是1 + 3 * INTERPOLATION_PASSES
+    static const int INTERPOLATION_PASSES = 5;
+    // 每个半球渲染的面数
+    static const int HEMISPHERE_SIDES = 5;
+    // 接缝填充的最大距离（纹素），和原来扩张32次的范围相同
+    static const int SEAM_FILL_DISTANCE = 32;
+    // 是否用引导缓冲去噪，关闭时用3x3平滑
+    static const bool DENOISE = true;
+
+    State state = State::Idle;
+    lm_context* ctx = nullptr;
+    GLuint target = 0;
+    int width = 0;
+    int height = 0;
+    // lightmapper写入的光照贴图
+    vector<float> data;
+    float progress = 0.0f;
+    // 参与烘焙的物体，lightmapper保存了模型矩阵的指针，烘焙结束前不能修改
+    vector<Object> objects;
+    // GPU烘焙正在烘焙的物体
+    size_t currentObject = 0;
+    // GPU烘焙已经烘焙完的物体的三角形数，用于计算总进度
+    int finishedTriangles = 0;
+    // 烘焙的三角形数
+    int triangleCount = 0;
+    // 当前半球已经渲染的面数
+    int sidesRendered = 0;
+    // 已经上传预览的采样遍数
+    int uploadedPasses = 0;
+    // 后处理任务，CPU烘焙时依赖所有物体的烘焙任务
+    JobSystem::JobHandle postProcessJob;
+    // CPU烘焙每个物体变换到世界空间的顶点，由烘焙任务写入
+    vector<vector<vertex_t>> worldVertices;
+    // 缓存文件路径，为空时不保存
+    std::string cachePath;
+    LightmapCacheKey cacheKey;
+    // 后处理任务编码的最终结果，上传之后释放
+    LightmapCache encoded;
+    // CPU烘焙器，烘焙和后处理在同一个任务中执行，使用GPU烘焙时为空
+    std::unique_ptr<CpuLightmapBaker> cpuBaker;
+    // CPU烘焙建立层级包围盒的任务，完成之前不能读取已经完成的行
+    JobSystem::JobHandle sceneJob;
+    // CPU烘焙从断点恢复的已经完成的行，在建立层级包围盒之后交给烘焙器
+    vector<char> resumedRows;
+    // 断点文件路径，为空时不保存
+    std::string checkpointPath;
+    LightmapCacheKey checkpointKey;
+    double checkpointInterval = 0.0;
+    std::chrono::steady_clock::time_point lastCheckpoint;
+    // 正在后台写入的断点和写入任务，上一个断点还没写完时跳过这一次
+    LightmapCheckpoint checkpoint;
+    JobSystem::JobHandle checkpointJob;
+
+    /// @brief 把光照贴图上传到目标纹理
+    void upload();
+    /// @brief 分配目标纹理和光照贴图数据
+    void allocate(GLuint target, int width, int height);
+    /// @brief 保存有三角形的物体并统计三角形数，没有可以烘焙的物体时返回false
+    bool setObjects(const vector<Object>& objects);
+    /// @brief 把当前物体的几何数据交给lightmapper
+    void setCurrentGeometry();
+    /// @brief 编码后处理的结果并保存到缓存，在后处理任务中调用
+    void saveCache();
+    /// @brief 生成引导缓冲并后处理光照贴图，在后处理任务中调用，GPU烘焙时先把物体变换到世界空间
+    void postProcessObjects();
+    /// @brief 加载和这次烘焙匹配的断点，恢复物体的模型矩阵和光照贴图
+    bool loadCheckpoint(bool cpu, LightmapCheckpoint& out);
+    /// @brief 记录当前的进度并在任务系统上保存断点，GPU烘焙只能在两个半球之间调用
+    /// @param wait 是否等待保存完成
+    void saveCheckpoint(bool wait);
+    /// @brief 距离上一次保存是否已经超过了间隔
+    bool isCheckpointDue() const;
+    /// @brief 采样或者后处理中lightmapper的断言失败时停止烘焙，上传部分完成的结果，保留之前的断点
+    void fail(const char* message);
+};
+
+#endif // LIGHTMAP_BAKER_H
@@ -0,0 +1,309 @@
+#include "LightmapCache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "JobSystem.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// 文件头，后面紧跟着从第0级开始的所有mip级别
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sceneHash;
+    uint64_t settingsHash;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t reserved;
+};
+
+const char CACHE_MAGIC[4] = { 'T', 'L', 'M', 'C' };
+// 编码和降采样时每个任务处理的行数
+const size_t CACHE_ROW_GRAIN = 16;
+
+// RGB9_E5的参数：9位尾数，指数偏移15，最大指数31
+const int RGB9E5_MANTISSA_BITS = 9;
+const int RGB9E5_EXPONENT_BIAS = 15;
+const int RGB9E5_MAX_EXPONENT = 31;
+const float RGB9E5_MAX_VALUE = 65408.0f;
+
+int levelCountFor(int width, int height) {
+    int count = 1;
+    while (width > 1 || height > 1) {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        count++;
+    }
+    return count;
+}
+
+size_t texelCountFor(int width, int height) {
+    size_t count = 0;
+    for (int i = levelCountFor(width, height); i > 0; i--) {
+        count += (size_t)width * height;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return count;
+}
+}
+
+void LightmapHasher::add(const void* data, size_t size) {
+    const uint64_t prime = 1099511628211ull;
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        this->value = (this->value ^ word) * prime;
+    }
+    for (; i < size; i++)
+        this->value = (this->value ^ bytes[i]) * prime;
+}
+
+bool MappedFile::open(const std::string& path) {
+    this->close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!view) {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    this->file = file;
+    this->mapping = mapping;
+    this->mapped = (const unsigned char*)view;
+    this->length = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // 映射建立之后文件描述符就不再需要了
+    ::close(fd);
+    if (view == MAP_FAILED)
+        return false;
+    this->mapped = (const unsigned char*)view;
+    this->length = (size_t)info.st_size;
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+    if (!this->mapped)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(this->mapped);
+    CloseHandle((HANDLE)this->mapping);
+    CloseHandle((HANDLE)this->file);
+    this->file = nullptr;
+    this->mapping = nullptr;
+#else
+    munmap((void*)this->mapped, this->length);
+#endif
+    this->mapped = nullptr;
+    this->length = 0;
+}
+
+uint32_t LightmapCache::encodeTexel(float r, float g, float b) {
+    // 和EXT_texture_shared_exponent规范中的编码相同，NaN按0处理
+    float rc = std::min(std::max(r, 0.0f), RGB9E5_MAX_VALUE);
+    float gc = std::min(std::max(g, 0.0f), RGB9E5_MAX_VALUE);
+    float bc = std::min(std::max(b, 0.0f), RGB9E5_MAX_VALUE);
+    if (!(rc == rc)) rc = 0.0f;
+    if (!(gc == gc)) gc = 0.0f;
+    if (!(bc == bc)) bc = 0.0f;
+    float maxComponent = std::max(std::max(rc, gc), bc);
+    if (maxComponent <= 0.0f)
+        return 0;
+    // frexp得到maxComponent = m * 2^e，m在[0.5, 1)之间，所以floor(log2(maxComponent)) = e - 1
+    int e;
+    std::frexp(maxComponent, &e);
+    int exponent = std::max(-RGB9E5_EXPONENT_BIAS - 1, e - 1) + 1 + RGB9E5_EXPONENT_BIAS;
+    float scale = std::ldexp(1.0f, RGB9E5_EXPONENT_BIAS + RGB9E5_MANTISSA_BITS - exponent);
+    // 舍入后最大的通道可能进位到2^9，这时指数加一
+    if ((int)std::floor(maxComponent * scale + 0.5f) == (1 << RGB9E5_MANTISSA_BITS)) {
+        exponent++;
+        scale *= 0.5f;
+    }
+    exponent = std::min(exponent, RGB9E5_MAX_EXPONENT);
+    uint32_t red = (uint32_t)std::floor(rc * scale + 0.5f);
+    uint32_t green = (uint32_t)std::floor(gc * scale + 0.5f);
+    uint32_t blue = (uint32_t)std::floor(bc * scale + 0.5f);
+    return red | (green << 9) | (blue << 18) | ((uint32_t)exponent << 27);
+}
+
+void LightmapCache::decodeTexel(uint32_t texel, float rgb[3]) {
+    float scale = std::ldexp(1.0f, (int)(texel >> 27) - RGB9E5_EXPONENT_BIAS - RGB9E5_MANTISSA_BITS);
+    rgb[0] = (float)(texel & 0x1ff) * scale;
+    rgb[1] = (float)((texel >> 9) & 0x1ff) * scale;
+    rgb[2] = (float)((texel >> 18) & 0x1ff) * scale;
+}
+
+void LightmapCache::encode(const float* image, int width, int height) {
+    this->clear();
+    if (width <= 0 || height <= 0)
+        return;
+    this->storage.resize(texelCountFor(width, height));
+    JobSystem& jobs = JobSystem::instance();
+
+    // 每一级从上一级的RGB做2x2盒式降采样，奇数大小时丢掉最后一行（列），只剩一行（列）时和自己平均
+    vector<float> level((size_t)width * height * 3), next;
+    jobs.parallelFor((size_t)height, CACHE_ROW_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; y++) {
+            for (int x = 0; x < width; x++) {
+                const float* texel = image + (y * width + x) * 4;
+                float* out = &level[(y * width + x) * 3];
+                out[0] = texel[0];
+                out[1] = texel[1];
+                out[2] = texel[2];
+            }
+        }
+        });
+
+    uint32_t* texels = this->storage.data();
+    int levelWidth = width, levelHeight = height;
+    for (int i = levelCountFor(width, height); i > 0; i--) {
+        jobs.parallelFor((size_t)levelHeight, CACHE_ROW_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; y++) {
+                for (int x = 0; x < levelWidth; x++) {
+                    const float* rgb = &level[(y * levelWidth + x) * 3];
+                    texels[y * levelWidth + x] = encodeTexel(rgb[0], rgb[1], rgb[2]);
+                }
+            }
+            });
+        texels += (size_t)levelWidth * levelHeight;
+        if (i == 1)
+            break;
+
+        int nextWidth = std::max(1, levelWidth / 2), nextHeight = std::max(1, levelHeight / 2);
+        next.resize((size_t)nextWidth * nextHeight * 3);
+        jobs.parallelFor((size_t)nextHeight, CACHE_ROW_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; y++) {
+                size_t y0 = y * 2, y1 = std::min(y0 + 1, (size_t)levelHeight - 1);
+                for (int x = 0; x < nextWidth; x++) {
+                    size_t x0 = (size_t)x * 2, x1 = std::min(x0 + 1, (size_t)levelWidth - 1);
+                    const float* a = &level[(y0 * levelWidth + x0) * 3];
+                    const float* b = &level[(y0 * levelWidth + x1) * 3];
+                    const float* c = &level[(y1 * levelWidth + x0) * 3];
+                    const float* d = &level[(y1 * levelWidth + x1) * 3];
+                    float* out = &next[(y * nextWidth + x) * 3];
+                    for (int k = 0; k < 3; k++)
+                        out[k] = (a[k] + b[k] + c[k] + d[k]) * 0.25f;
+                }
+            }
+            });
+        level.swap(next);
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+    this->layoutLevels(width, height, this->storage.data());
+}
+
+bool LightmapCache::load(const std::string& path, const LightmapCacheKey& key) {
+    this->clear();
+    if (!this->file.open(path))
+        return false;
+    CacheHeader header;
+    bool valid = this->file.size() >= sizeof(header);
+    if (valid) {
+        memcpy(&header, this->file.data(), sizeof(header));
+        valid = memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 && header.version == VERSION
+            && header.width > 0 && header.height > 0 && header.width <= 65536 && header.height <= 65536
+            && header.levelCount == (uint32_t)levelCountFor((int)header.width, (int)header.height)
+            && this->file.size() == sizeof(header) + texelCountFor((int)header.width, (int)header.height) * sizeof(uint32_t);
+    }
+    // 键不同是正常的缓存失效，不算错误
+    if (valid && (header.sceneHash != key.scene || header.settingsHash != key.settings)) {
+        this->file.close();
+        return false;
+    }
+    if (!valid) {
+        fprintf(stderr, "Warning: ignoring invalid lightmap cache %s\n", path.c_str());
+        this->file.close();
+        return false;
+    }
+    // 文件头是8字节对齐的，映射的起始地址按页对齐，纹素可以直接按uint32_t读取
+    this->layoutLevels((int)header.width, (int)header.height, (const uint32_t*)(this->file.data() + sizeof(header)));
+    return true;
+}
+
+bool LightmapCache::save(const std::string& path, const LightmapCacheKey& key) const {
+    if (this->levels.empty())
+        return false;
+    CacheHeader header;
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = VERSION;
+    header.sceneHash = key.scene;
+    header.settingsHash = key.settings;
+    header.width = (uint32_t)this->levels[0].width;
+    header.height = (uint32_t)this->levels[0].height;
+    header.levelCount = (uint32_t)this->levels.size();
+    header.reserved = 0;
+    size_t texelCount = texelCountFor(this->levels[0].width, this->levels[0].height);
+
+    std::string temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "Error: could not write %s\n", temporary.c_str());
+        return false;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(this->levels[0].texels, sizeof(uint32_t), texelCount, file) == texelCount;
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        fprintf(stderr, "Error: could not write %s\n", temporary.c_str());
+        std::remove(temporary.c_str());
+        return false;
+    }
+    // windows上rename不能覆盖已有的文件
+    std::remove(path.c_str());
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Error: could not write %s\n", path.c_str());
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+void LightmapCache::clear() {
+    this->levels.clear();
+    this->storage = vector<uint32_t>();
+    this->file.close();
+}
+
+void LightmapCache::layoutLevels(int width, int height, const uint32_t* texels) {
+    this->levels.clear();
+    for (int i = levelCountFor(width, height); i > 0; i--) {
+        this->levels.push_back({ width, height, texels });
+        texels += (size_t)width * height;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef LIGHTMAP_CACHE_H
+#define LIGHTMAP_CACHE_H
+
+// 定义了烘焙结果的持久化缓存，场景没有变化时启动直接加载，不需要重新烘焙
+// 1. 格式：文件头加上从大到小的完整mip链，每个纹素是opengl 3.3核心支持的共享指数格式RGB9_E5（4字节，
+//    三个通道各9位尾数，共用5位指数），比RGBA16F小一半，能表示到65408的亮度，可以直接上传为GL_RGB9_E5纹理
+// 2. 键：文件头记录场景内容的哈希（烘焙几何体、模型矩阵和光源）和烘焙参数的哈希，任何一个不同都视为缓存失效
+// 3. 加载：用内存映射打开文件，校验文件头后mip直接指向映射的内存，上传纹理时不需要再复制一遍
+// 不调用opengl，编码和保存可以在任务系统上执行
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::vector;
+
+// 64位FNV-1a哈希，每次处理8个字节，用于计算缓存的键
+class LightmapHasher {
+public:
+    /// @brief 加入一段数据
+    void add(const void* data, size_t size);
+    /// @brief 加入一个可以按字节比较的值（不能有填充字节）
+    template <typename T>
+    void add(const T& value) { this->add(&value, sizeof(T)); }
+    /// @brief 加入数组的长度和内容
+    template <typename T>
+    void add(const vector<T>& values) {
+        this->add((uint64_t)values.size());
+        this->add(values.data(), values.size() * sizeof(T));
+    }
+    /// @brief 获取哈希值
+    uint64_t get() const { return this->value; }
+
+private:
+    uint64_t value = 14695981039346656037ull;
+};
+
+// 缓存的键
+struct LightmapCacheKey {
+    // 场景内容的哈希：每个模型的烘焙几何体、光照贴图区域、模型矩阵，以及光源
+    uint64_t scene = 0;
+    // 烘焙参数的哈希：光照贴图大小、图块打包参数、烘焙器类型和采样设置
+    uint64_t settings = 0;
+};
+
+// 只读的内存映射文件
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { this->close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /// @brief 映射整个文件，文件不存在或者为空时返回false
+    bool open(const std::string& path);
+    /// @brief 解除映射
+    void close();
+
+    const unsigned char* data() const { return this->mapped; }
+    size_t size() const { return this->length; }
+
+private:
+    const unsigned char* mapped = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    // 文件和映射对象的句柄，避免在头文件中包含windows.h
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
+
+// 编码后的光照贴图，数据在自己的内存中（编码得到）或者在映射的文件中（加载得到）
+class LightmapCache {
+public:
+    // 一个mip级别
+    struct Level {
+        int width;
+        int height;
+        // width x height个RGB9_E5纹素，第0到8位是红色的尾数，第27到31位是指数
+        const uint32_t* texels;
+    };
+
+    /// @brief 生成完整的mip链并编码，会释放之前的数据，内部按行在任务系统上并行
+    /// @param image 光照贴图，width x height x 4个float，alpha被忽略
+    void encode(const float* image, int width, int height);
+
+    /// @brief 用内存映射加载缓存，文件不存在、损坏或者键不同时返回false
+    bool load(const std::string& path, const LightmapCacheKey& key);
+
+    /// @brief 保存到文件，先写到临时文件再替换，中途失败不会留下损坏的缓存
+    bool save(const std::string& path, const LightmapCacheKey& key) const;
+
+    /// @brief 释放数据和映射
+    void clear();
+
+    /// @brief 获取mip级别，第0级是原始大小
+    const vector<Level>& getLevels() const { return this->levels; }
+    bool empty() const { return this->levels.empty(); }
+
+    /// @brief 把一个线性空间的颜色编码为RGB9_E5，负数按0处理，超出范围的按最大值处理
+    static uint32_t encodeTexel(float r, float g, float b);
+    /// @brief 解码RGB9_E5
+    static void decodeTexel(uint32_t texel, float rgb[3]);
+
+private:
+    // 文件格式的版本，格式变化时加一，旧的缓存自动失效
+    static const uint32_t VERSION = 1;
+
+    vector<Level> levels;
+    // encode得到的所有mip级别，连续存放
+    vector<uint32_t> storage;
+    MappedFile file;
+
+    /// @brief 按大小计算每个mip级别在连续数据中的位置
+    void layoutLevels(int width, int height, const uint32_t* texels);
+};
+
+#endif // LIGHTMAP_CACHE_H
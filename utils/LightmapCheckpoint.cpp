@@ -0,0 +1,153 @@
+#include "LightmapCheckpoint.h"
+#include <cstdio>
+#include <cstring>
+
+namespace {
+// 文件头，后面依次是模型矩阵、结果的位置、结果的颜色、光照贴图和每一行的完成标志
+struct CheckpointHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sceneHash;
+    uint64_t settingsHash;
+    uint32_t width;
+    uint32_t height;
+    uint32_t cpu;
+    uint32_t objectCount;
+    uint32_t currentObject;
+    int32_t finishedTriangles;
+    int32_t pass;
+    uint32_t baseIndex;
+    int32_t x;
+    int32_t y;
+    int32_t side;
+    uint32_t resultCount;
+    uint32_t rowCount;
+    uint32_t reserved;
+};
+
+const char CHECKPOINT_MAGIC[4] = { 'T', 'L', 'M', 'K' };
+
+// 从映射的文件中按顺序读取数组
+class Reader {
+public:
+    Reader(const unsigned char* data, size_t size) : data(data), size(size) {}
+
+    template <typename T>
+    bool read(vector<T>& out, size_t count) {
+        if (count > (this->size - this->offset) / sizeof(T))
+            return false;
+        out.resize(count);
+        memcpy(out.data(), this->data + this->offset, count * sizeof(T));
+        this->offset += count * sizeof(T);
+        return true;
+    }
+
+    bool finished() const { return this->offset == this->size; }
+
+private:
+    const unsigned char* data;
+    size_t size;
+    size_t offset = sizeof(CheckpointHeader);
+};
+
+template <typename T>
+bool write(FILE* file, const vector<T>& values) {
+    return values.empty() || fwrite(values.data(), sizeof(T), values.size(), file) == values.size();
+}
+}
+
+bool LightmapCheckpoint::save(const std::string& path) const {
+    CheckpointHeader header;
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header.version = VERSION;
+    header.sceneHash = this->key.scene;
+    header.settingsHash = this->key.settings;
+    header.width = (uint32_t)this->width;
+    header.height = (uint32_t)this->height;
+    header.cpu = this->cpu ? 1 : 0;
+    header.objectCount = (uint32_t)this->models.size();
+    header.currentObject = this->currentObject;
+    header.finishedTriangles = this->finishedTriangles;
+    header.pass = this->position.pass;
+    header.baseIndex = this->position.baseIndex;
+    header.x = this->position.x;
+    header.y = this->position.y;
+    header.side = this->position.side;
+    header.resultCount = (uint32_t)(this->resultLocations.size() / 2);
+    header.rowCount = (uint32_t)this->finishedRows.size();
+    header.reserved = 0;
+    if (this->resultColors.size() != (size_t)header.resultCount * 4 || this->lightmap.size() != (size_t)this->width * this->height * 4)
+        return false;
+
+    std::string temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "Error: could not write %s\n", temporary.c_str());
+        return false;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && write(file, this->models)
+        && write(file, this->resultLocations)
+        && write(file, this->resultColors)
+        && write(file, this->lightmap)
+        && write(file, this->finishedRows);
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        fprintf(stderr, "Error: could not write %s\n", temporary.c_str());
+        std::remove(temporary.c_str());
+        return false;
+    }
+    // windows上rename不能覆盖已有的文件
+    std::remove(path.c_str());
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Error: could not write %s\n", path.c_str());
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool LightmapCheckpoint::load(const std::string& path, const LightmapCacheKey& key) {
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    CheckpointHeader header;
+    if (file.size() < sizeof(header)) {
+        fprintf(stderr, "Warning: ignoring invalid lightmap checkpoint %s\n", path.c_str());
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0 || header.version != VERSION
+        || header.width == 0 || header.height == 0 || header.width > 65536 || header.height > 65536) {
+        fprintf(stderr, "Warning: ignoring invalid lightmap checkpoint %s\n", path.c_str());
+        return false;
+    }
+    // 场景或者参数变化后的断点不能继续，不算错误
+    if (header.sceneHash != key.scene || header.settingsHash != key.settings)
+        return false;
+
+    // 映射的数据只读，而且继续烘焙时会修改光照贴图，所以复制出来
+    Reader reader(file.data(), file.size());
+    bool valid = reader.read(this->models, header.objectCount)
+        && reader.read(this->resultLocations, (size_t)header.resultCount * 2)
+        && reader.read(this->resultColors, (size_t)header.resultCount * 4)
+        && reader.read(this->lightmap, (size_t)header.width * header.height * 4)
+        && reader.read(this->finishedRows, header.rowCount)
+        && reader.finished();
+    if (!valid) {
+        fprintf(stderr, "Warning: ignoring invalid lightmap checkpoint %s\n", path.c_str());
+        return false;
+    }
+    this->key = key;
+    this->cpu = header.cpu != 0;
+    this->width = (int)header.width;
+    this->height = (int)header.height;
+    this->currentObject = header.currentObject;
+    this->finishedTriangles = header.finishedTriangles;
+    this->position.pass = header.pass;
+    this->position.baseIndex = header.baseIndex;
+    this->position.x = header.x;
+    this->position.y = header.y;
+    this->position.side = header.side;
+    return true;
+}
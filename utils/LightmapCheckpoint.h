@@ -0,0 +1,65 @@
+#ifndef LIGHTMAP_CHECKPOINT_H
+#define LIGHTMAP_CHECKPOINT_H
+
+// 定义了烘焙的断点，长时间的烘焙定期保存进度，程序退出或者烘焙失败后可以从最后一个断点继续
+// 1. GPU烘焙：正在烘焙的物体、lightmapper的采样位置（采样遍数、三角形、光栅化位置）、
+//    这一遍中还没有写入光照贴图的半球结果，以及部分完成的光照贴图
+// 2. CPU烘焙：每一行是否已经烘焙完，以及部分完成的光照贴图，继续时跳过已经完成的行
+// 3. 断点带有和缓存相同的键，还记录了各物体的模型矩阵，继续时使用保存时的矩阵，场景内容或参数变化后断点失效
+// 不调用opengl，保存可以在任务系统上执行
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "LightmapCache.h"
+
+using std::vector;
+
+struct LightmapCheckpoint {
+    // lightmapper的采样位置，和lm_position相同
+    struct Position {
+        int pass = 0;
+        // 当前三角形的第一个索引
+        unsigned int baseIndex = 0;
+        // 光栅化位置
+        int x = 0;
+        int y = 0;
+        // 0表示这个位置的半球还没有渲染，5表示已经渲染完
+        int side = 5;
+    };
+
+    LightmapCacheKey key;
+    // 是否是CPU烘焙的断点
+    bool cpu = false;
+    int width = 0;
+    int height = 0;
+    // 每个物体的模型矩阵
+    vector<glm::mat4> models;
+
+    // GPU烘焙正在烘焙的物体和已经烘焙完的物体的三角形数
+    uint32_t currentObject = 0;
+    int finishedTriangles = 0;
+    Position position;
+    // 这一遍采样中已经回读、还没有写入光照贴图的结果，每个结果2个int的位置和4个float的颜色
+    vector<int> resultLocations;
+    vector<float> resultColors;
+
+    // CPU烘焙每一行是否已经完成，按物体的顺序排列各物体区域的行
+    vector<char> finishedRows;
+
+    // 部分完成的光照贴图，width x height x 4个float
+    vector<float> lightmap;
+
+    /// @brief 保存到文件，先写到临时文件再替换，中途退出不会破坏上一个断点
+    bool save(const std::string& path) const;
+
+    /// @brief 加载断点，文件不存在、损坏或者键不同时返回false
+    bool load(const std::string& path, const LightmapCacheKey& key);
+
+private:
+    // 文件格式的版本，格式变化时加一
+    static const uint32_t VERSION = 1;
+};
+
+#endif // LIGHTMAP_CHECKPOINT_H
@@ -0,0 +1,570 @@
+#include "LightmapImage.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include "JobSystem.h"
+
+// 开启AVX2时（-mavx2或/arch:AVX2）一次处理8个float，否则使用所有x64处理器都支持的SSE2
+#if defined(__AVX2__)
+#define LIGHTMAP_IMAGE_USE_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHTMAP_IMAGE_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+using std::vector;
+
+namespace {
+// 三个核函数写成模板，按下面的指令集封装实例化；标量版本也用于SIMD版本处理不够一组的剩余元素
+struct ScalarOps {
+    using V = float;
+    using M = bool;
+    static const int WIDTH = 1;
+    static V load(const float* p) { return *p; }
+    static void store(float* p, V v) { *p = v; }
+    static V set1(float v) { return v; }
+    // x, x + 1, ...，用于计算像素的横坐标
+    static V ramp(int x) { return (float)x; }
+    static V add(V a, V b) { return a + b; }
+    static V sub(V a, V b) { return a - b; }
+    static V mul(V a, V b) { return a * b; }
+    static V div(V a, V b) { return a / b; }
+    static M less(V a, V b) { return a < b; }
+    static M greater(V a, V b) { return a > b; }
+    static M equal(V a, V b) { return a == b; }
+    static bool any(M mask) { return mask; }
+    static V select(M mask, V a, V b) { return mask ? a : b; }
+    // 第i个float是否是alpha通道
+    static M alphaMask(size_t i) { return (i & 3) == 3; }
+    static V pow(V x, float exponent) { return x > 0.0f ? std::pow(x, exponent) : 0.0f; }
+    static V exp(V x) { return std::exp(x); }
+};
+
+// Cephes的对数和指数近似（和sse_mathfun相同的系数），只用乘加和位运算，可以用任意宽度的SIMD计算
+template <typename Ops>
+typename Ops::V cephesLog(typename Ops::V x) {
+    using V = typename Ops::V;
+    const V one = Ops::set1(1.0f);
+    V e;
+    x = Ops::frexp(x, e);
+    // 尾数在[0.5, 1)，小于sqrt(0.5)时乘以2，使x - 1落在[sqrt(0.5) - 1, sqrt(2) - 1)
+    typename Ops::M small = Ops::less(x, Ops::set1(0.707106781186547524f));
+    e = Ops::sub(e, Ops::select(small, one, Ops::set1(0.0f)));
+    x = Ops::add(Ops::sub(x, one), Ops::select(small, x, Ops::set1(0.0f)));
+    V z = Ops::mul(x, x);
+    V y = Ops::set1(7.0376836292e-2f);
+    y = Ops::add(Ops::mul(y, x), Ops::set1(-1.1514610310e-1f));
+    y = Ops::add(Ops::mul(y, x), Ops::set1(1.1676998740e-1f));
+    y = Ops::add(Ops::mul(y, x), Ops::set1(-1.2420140846e-1f));
+    y = Ops::add(Ops::mul(y, x), Ops::set1(1.4249322787e-1f));
+    y = Ops::add(Ops::mul(y, x), Ops::set1(-1.6668057665e-1f));
+    y = Ops::add(Ops::mul(y, x), Ops::set1(2.0000714765e-1f));
+    y = Ops::add(Ops::mul(y, x), Ops::set1(-2.4999993993e-1f));
+    y = Ops::add(Ops::mul(y, x), Ops::set1(3.3333331174e-1f));
+    y = Ops::mul(Ops::mul(y, x), z);
+    y = Ops::add(y, Ops::mul(e, Ops::set1(-2.12194440e-4f)));
+    y = Ops::sub(y, Ops::mul(z, Ops::set1(0.5f)));
+    x = Ops::add(x, y);
+    return Ops::add(x, Ops::mul(e, Ops::set1(0.693359375f)));
+}
+
+template <typename Ops>
+typename Ops::V cephesExp(typename Ops::V x) {
+    using V = typename Ops::V;
+    x = Ops::select(Ops::greater(x, Ops::set1(88.3762626647949f)), Ops::set1(88.3762626647949f), x);
+    x = Ops::select(Ops::less(x, Ops::set1(-88.3762626647949f)), Ops::set1(-88.3762626647949f), x);
+    // exp(x) = 2^n * exp(r)，n = round(x / ln2)
+    V n = Ops::floor(Ops::add(Ops::mul(x, Ops::set1(1.44269504088896341f)), Ops::set1(0.5f)));
+    x = Ops::sub(x, Ops::mul(n, Ops::set1(0.693359375f)));
+    x = Ops::sub(x, Ops::mul(n, Ops::set1(-2.12194440e-4f)));
+    V z = Ops::mul(x, x);
+    V y = Ops::set1(1.9875691500e-4f);
+    y = Ops::add(Ops::mul(y, x), Ops::set1(1.3981999507e-3f));
+    y = Ops::add(Ops::mul(y, x), Ops::set1(8.3334519073e-3f));
+    y = Ops::add(Ops::mul(y, x), Ops::set1(4.1665795894e-2f));
+    y = Ops::add(Ops::mul(y, x), Ops::set1(1.6666665459e-1f));
+    y = Ops::add(Ops::mul(y, x), Ops::set1(5.0000001201e-1f));
+    y = Ops::add(Ops::add(Ops::mul(y, z), x), Ops::set1(1.0f));
+    return Ops::mul(y, Ops::pow2n(n));
+}
+
+#if defined(LIGHTMAP_IMAGE_USE_SSE)
+struct SseOps {
+    using V = __m128;
+    using M = __m128;
+    static const int WIDTH = 4;
+    static V load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, V v) { _mm_storeu_ps(p, v); }
+    static V set1(float v) { return _mm_set1_ps(v); }
+    static V ramp(int x) { return _mm_add_ps(_mm_set1_ps((float)x), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f)); }
+    static V add(V a, V b) { return _mm_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static V div(V a, V b) { return _mm_div_ps(a, b); }
+    static M less(V a, V b) { return _mm_cmplt_ps(a, b); }
+    static M greater(V a, V b) { return _mm_cmpgt_ps(a, b); }
+    static M equal(V a, V b) { return _mm_cmpeq_ps(a, b); }
+    static bool any(M mask) { return _mm_movemask_ps(mask) != 0; }
+    static V select(M mask, V a, V b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    // 每组从像素的边界开始，第4个float总是alpha
+    static M alphaMask(size_t) { return _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1)); }
+    // SSE2没有floor指令，截断后对负数修正
+    static V floor(V x) {
+        V truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+        return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+    }
+    // 返回[0.5, 1)范围内的尾数，e是对应的指数
+    static V frexp(V x, V& e) {
+        __m128i bits = _mm_castps_si128(x);
+        e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+        return _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32((int)0x807FFFFF)), _mm_set1_epi32(0x3F000000)));
+    }
+    // 2^n，n是整数
+    static V pow2n(V n) {
+        return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23));
+    }
+    static V pow(V x, float exponent) {
+        V positive = _mm_cmpgt_ps(x, _mm_setzero_ps());
+        // 小于等于0的值先换成1，避免对数产生无穷大和NaN
+        V safe = select(positive, x, _mm_set1_ps(1.0f));
+        return _mm_and_ps(positive, cephesExp<SseOps>(_mm_mul_ps(cephesLog<SseOps>(safe), _mm_set1_ps(exponent))));
+    }
+    static V exp(V x) { return cephesExp<SseOps>(x); }
+};
+using SimdOps = SseOps;
+#elif defined(LIGHTMAP_IMAGE_USE_AVX2)
+struct Avx2Ops {
+    using V = __m256;
+    using M = __m256;
+    static const int WIDTH = 8;
+    static V load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, V v) { _mm256_storeu_ps(p, v); }
+    static V set1(float v) { return _mm256_set1_ps(v); }
+    static V ramp(int x) { return _mm256_add_ps(_mm256_set1_ps((float)x), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f)); }
+    static V add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V div(V a, V b) { return _mm256_div_ps(a, b); }
+    static M less(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static M greater(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static M equal(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+    static bool any(M mask) { return _mm256_movemask_ps(mask) != 0; }
+    static V select(M mask, V a, V b) { return _mm256_blendv_ps(b, a, mask); }
+    // 每组是两个像素，第4个和第8个float是alpha
+    static M alphaMask(size_t) { return _mm256_castsi256_ps(_mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1)); }
+    static V floor(V x) { return _mm256_floor_ps(x); }
+    static V frexp(V x, V& e) {
+        __m256i bits = _mm256_castps_si256(x);
+        e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+        return _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32((int)0x807FFFFF)), _mm256_set1_epi32(0x3F000000)));
+    }
+    static V pow2n(V n) {
+        return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(127)), 23));
+    }
+    static V pow(V x, float exponent) {
+        V positive = _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ);
+        V safe = select(positive, x, _mm256_set1_ps(1.0f));
+        return _mm256_and_ps(positive, cephesExp<Avx2Ops>(_mm256_mul_ps(cephesLog<Avx2Ops>(safe), _mm256_set1_ps(exponent))));
+    }
+    static V exp(V x) { return cephesExp<Avx2Ops>(x); }
+};
+using SimdOps = Avx2Ops;
+#else
+using SimdOps = ScalarOps;
+#endif
+
+// 没有种子的纹素的坐标，和它的距离远大于图像中任意两点的距离
+const float NO_SEED = -1e9f;
+
+inline bool isValid(const float* texel) {
+    return texel[0] > 0.0f || texel[1] > 0.0f || texel[2] > 0.0f || texel[3] > 0.0f;
+}
+
+void forRows(int height, bool parallel, const std::function<void(size_t, size_t)>& func) {
+    if (parallel)
+        JobSystem::instance().parallelFor((size_t)height, LIGHTMAP_IMAGE_ROW_GRAIN, func);
+    else
+        func(0, (size_t)height);
+}
+
+// 用一行中[x0, x1)的像素在偏移dx处的候选种子更新最近的种子
+// seedX/seedY指向候选行的开头，outX/outY/best指向当前行的开头
+template <typename Ops>
+void jumpFloodCandidates(const float* seedX, const float* seedY, int dx, float y, int x0, int x1, float* outX, float* outY, float* best) {
+    using V = typename Ops::V;
+    int x = x0;
+    for (; x + Ops::WIDTH <= x1; x += Ops::WIDTH) {
+        V sx = Ops::load(seedX + x + dx);
+        V sy = Ops::load(seedY + x + dx);
+        V deltaX = Ops::sub(Ops::ramp(x), sx);
+        V deltaY = Ops::sub(Ops::set1(y), sy);
+        V distance = Ops::add(Ops::mul(deltaX, deltaX), Ops::mul(deltaY, deltaY));
+        V current = Ops::load(best + x);
+        typename Ops::M closer = Ops::less(distance, current);
+        Ops::store(best + x, Ops::select(closer, distance, current));
+        Ops::store(outX + x, Ops::select(closer, sx, Ops::load(outX + x)));
+        Ops::store(outY + x, Ops::select(closer, sy, Ops::load(outY + x)));
+    }
+    if (Ops::WIDTH > 1)
+        jumpFloodCandidates<ScalarOps>(seedX, seedY, dx, y, x, x1, outX, outY, best);
+}
+
+// 跳跃泛洪的一遍：每个纹素在自己和周围8个步长为step的纹素的种子中选择最近的
+template <typename Ops>
+void jumpFloodRows(const float* inX, const float* inY, float* outX, float* outY, int width, int height, int step, size_t begin, size_t end) {
+    vector<float> best(width);
+    // 先测试自己的种子，距离相同时保留原来的
+    const int offsets[3] = { 0, -step, step };
+    for (size_t y = begin; y < end; y++) {
+        std::fill(best.begin(), best.end(), FLT_MAX);
+        float* rowX = outX + y * width;
+        float* rowY = outY + y * width;
+        for (int dy : offsets) {
+            int candidateRow = (int)y + dy;
+            if (candidateRow < 0 || candidateRow >= height)
+                continue;
+            for (int dx : offsets) {
+                int x0 = std::max(0, -dx), x1 = std::min(width, width - dx);
+                jumpFloodCandidates<Ops>(inX + (size_t)candidateRow * width, inY + (size_t)candidateRow * width, dx, (float)y, x0, x1, rowX, rowY, best.data());
+            }
+        }
+    }
+}
+
+template <typename Ops>
+void seamFill(float* image, int width, int height, int maxDistance, bool parallel) {
+    size_t count = (size_t)width * height;
+    vector<float> seedX(count), seedY(count), nextX(count), nextY(count);
+    forRows(height, parallel, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; y++) {
+            for (int x = 0; x < width; x++) {
+                size_t i = y * width + x;
+                bool valid = isValid(image + i * 4);
+                seedX[i] = valid ? (float)x : NO_SEED;
+                seedY[i] = valid ? (float)y : NO_SEED;
+            }
+        }
+        });
+
+    // 步长从不小于距离一半的2的幂开始减半，能传播的距离是2 * step - 1；
+    // 最后再做一遍步长为1的跳跃（JFA+1），修正少数纹素没有找到最近种子的误差
+    int step = 1;
+    while (2 * step - 1 < maxDistance)
+        step *= 2;
+    vector<int> steps;
+    for (int s = step; s >= 1; s /= 2)
+        steps.push_back(s);
+    steps.push_back(1);
+    for (int s : steps) {
+        forRows(height, parallel, [&](size_t begin, size_t end) {
+            jumpFloodRows<Ops>(seedX.data(), seedY.data(), nextX.data(), nextY.data(), width, height, s, begin, end);
+            });
+        seedX.swap(nextX);
+        seedY.swap(nextY);
+    }
+
+    // 只写入无效纹素，读取的种子都是有效纹素，各行之间没有依赖
+    const float maxDistanceSquared = (float)maxDistance * maxDistance;
+    forRows(height, parallel, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; y++) {
+            for (int x = 0; x < width; x++) {
+                size_t i = y * width + x;
+                if (seedX[i] < 0.0f || isValid(image + i * 4))
+                    continue;
+                float dx = x - seedX[i], dy = y - seedY[i];
+                if (dx * dx + dy * dy > maxDistanceSquared)
+                    continue;
+                size_t seed = (size_t)seedY[i] * width + (size_t)seedX[i];
+                memcpy(image + i * 4, image + seed * 4, 4 * sizeof(float));
+            }
+        }
+        });
+}
+
+// out[i] = in[i - stride] + in[i] + in[i + stride]，超出行的部分不计入
+template <typename Ops>
+void horizontalSum(const float* in, float* out, int count, int stride) {
+    if (count <= stride) {
+        memcpy(out, in, count * sizeof(float));
+        return;
+    }
+    for (int i = 0; i < stride; i++) {
+        out[i] = in[i] + in[i + stride];
+        out[count - stride + i] = in[count - 2 * stride + i] + in[count - stride + i];
+    }
+    int i = stride;
+    for (; i + Ops::WIDTH <= count - stride; i += Ops::WIDTH)
+        Ops::store(out + i, Ops::add(Ops::add(Ops::load(in + i - stride), Ops::load(in + i)), Ops::load(in + i + stride)));
+    for (; i < count - stride; i++)
+        out[i] = in[i - stride] + in[i] + in[i + stride];
+}
+
+// 三行的和除以三行的有效纹素数，没有有效纹素时为0
+template <typename Ops>
+void verticalAverage(const float* sumAbove, const float* sum, const float* sumBelow, const float* countAbove, const float* count, const float* countBelow, float* out, int length) {
+    using V = typename Ops::V;
+    int i = 0;
+    for (; i + Ops::WIDTH <= length; i += Ops::WIDTH) {
+        V total = Ops::add(Ops::add(Ops::load(sumAbove + i), Ops::load(sum + i)), Ops::load(sumBelow + i));
+        V n = Ops::add(Ops::add(Ops::load(countAbove + i), Ops::load(count + i)), Ops::load(countBelow + i));
+        V zero = Ops::set1(0.0f);
+        // 没有有效纹素的位置除以0，结果被丢弃
+        Ops::store(out + i, Ops::select(Ops::greater(n, zero), Ops::div(total, Ops::select(Ops::greater(n, zero), n, Ops::set1(1.0f))), zero));
+    }
+    if (Ops::WIDTH > 1 && i < length)
+        verticalAverage<ScalarOps>(sumAbove + i, sum + i, sumBelow + i, countAbove + i, count + i, countBelow + i, out + i, length - i);
+}
+
+template <typename Ops>
+void smoothRows(const float* image, float* out, int width, int height, size_t begin, size_t end) {
+    const int rowLength = width * 4;
+    // 这一段的上下各多算一行水平和
+    int first = std::max(0, (int)begin - 1);
+    int last = std::min(height - 1, (int)end);
+    int rowCount = last - first + 1;
+    vector<float> sums((size_t)rowCount * rowLength), counts((size_t)rowCount * rowLength);
+    vector<float> masked(rowLength), valid(rowLength), zero(rowLength, 0.0f);
+    for (int y = first; y <= last; y++) {
+        // 无效纹素的颜色按0计入，有效纹素数按通道展开，和颜色一起按float计算
+        const float* row = image + (size_t)y * rowLength;
+        for (int x = 0; x < width; x++) {
+            bool texelValid = isValid(row + x * 4);
+            for (int c = 0; c < 4; c++) {
+                masked[x * 4 + c] = texelValid ? row[x * 4 + c] : 0.0f;
+                valid[x * 4 + c] = texelValid ? 1.0f : 0.0f;
+            }
+        }
+        horizontalSum<Ops>(masked.data(), sums.data() + (size_t)(y - first) * rowLength, rowLength, 4);
+        horizontalSum<Ops>(valid.data(), counts.data() + (size_t)(y - first) * rowLength, rowLength, 4);
+    }
+    for (size_t y = begin; y < end; y++) {
+        size_t local = y - first;
+        const float* sumAbove = y > 0 ? sums.data() + (local - 1) * rowLength : zero.data();
+        const float* countAbove = y > 0 ? counts.data() + (local - 1) * rowLength : zero.data();
+        const float* sumBelow = (int)y + 1 < height ? sums.data() + (local + 1) * rowLength : zero.data();
+        const float* countBelow = (int)y + 1 < height ? counts.data() + (local + 1) * rowLength : zero.data();
+        verticalAverage<Ops>(sumAbove, sums.data() + local * rowLength, sumBelow, countAbove, counts.data() + local * rowLength, countBelow, out + y * rowLength, rowLength);
+    }
+}
+
+template <typename Ops>
+void powerRange(float* data, size_t count, float exponent) {
+    size_t i = 0;
+    for (; i + Ops::WIDTH <= count; i += Ops::WIDTH) {
+        typename Ops::V value = Ops::load(data + i);
+        Ops::store(data + i, Ops::select(Ops::alphaMask(i), value, Ops::pow(value, exponent)));
+    }
+    for (; i < count; i++) {
+        if (!ScalarOps::alphaMask(i))
+            data[i] = ScalarOps::pow(data[i], exponent);
+    }
+}
+
+// 去噪用的数组结构数据，每行左右各留出pad个纹素，最大间隔的采样和SIMD一组超出行尾的部分都落在留白中，不用单独处理边界
+// 留白和无效纹素的图块是-1，和任何有效纹素的图块都不同，权重为0
+struct DenoisePlanes {
+    int width;
+    int height;
+    int pad;
+    int stride;
+    vector<float> px, py, pz, nx, ny, nz, size, chart;
+
+    DenoisePlanes(int width, int height, int pad) : width(width), height(height), pad(pad), stride(width + 2 * pad) {
+        size_t count = (size_t)this->stride * height;
+        for (vector<float>* plane : { &px, &py, &pz, &nx, &ny, &nz, &size })
+            plane->assign(count, 0.0f);
+        this->chart.assign(count, -1.0f);
+    }
+    // 第y行第0个纹素的下标
+    size_t row(int y) const { return (size_t)y * this->stride + this->pad; }
+};
+
+// à-trous的一次迭代：5x5的B3样条核，采样间隔是step个纹素
+template <typename Ops>
+void atrousRows(const DenoisePlanes& planes, const float* const in[3], float* const out[3], int step,
+    float colorFactor, float normalFactor, float planeFactor, size_t begin, size_t end) {
+    using V = typename Ops::V;
+    using M = typename Ops::M;
+    static const float KERNEL[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+    const V zero = Ops::set1(0.0f);
+    const V one = Ops::set1(1.0f);
+    for (size_t y = begin; y < end; y++) {
+        size_t row = planes.row((int)y);
+        // 一组超出行尾的纹素落在留白中，它们的结果不会被使用
+        for (int x = 0; x < planes.width; x += Ops::WIDTH) {
+            size_t c = row + x;
+            V chart = Ops::load(&planes.chart[c]);
+            V r = Ops::load(in[0] + c), g = Ops::load(in[1] + c), b = Ops::load(in[2] + c);
+            // 图块之间的间隔占了光照贴图的很大一部分，整组都是无效纹素时直接复制
+            if (!Ops::any(Ops::less(Ops::set1(-0.5f), chart))) {
+                Ops::store(out[0] + c, r);
+                Ops::store(out[1] + c, g);
+                Ops::store(out[2] + c, b);
+                continue;
+            }
+            V px = Ops::load(&planes.px[c]), py = Ops::load(&planes.py[c]), pz = Ops::load(&planes.pz[c]);
+            V nx = Ops::load(&planes.nx[c]), ny = Ops::load(&planes.ny[c]), nz = Ops::load(&planes.nz[c]);
+            // 颜色差按中心纹素的亮度归一化，暗处和亮处的噪声同样被平滑
+            V luminance = Ops::add(Ops::add(Ops::mul(r, Ops::set1(0.2126f)), Ops::mul(g, Ops::set1(0.7152f))), Ops::mul(b, Ops::set1(0.0722f)));
+            V colorScale = Ops::div(Ops::set1(colorFactor), Ops::add(Ops::mul(luminance, luminance), Ops::set1(1e-4f)));
+            V size = Ops::load(&planes.size[c]);
+            V planeScale = Ops::div(Ops::set1(planeFactor), Ops::add(Ops::mul(size, size), Ops::set1(1e-12f)));
+            V sumR = zero, sumG = zero, sumB = zero, sumWeight = zero;
+            for (int ky = 0; ky < 5; ky++) {
+                int sampleY = (int)y + (ky - 2) * step;
+                if (sampleY < 0 || sampleY >= planes.height)
+                    continue;
+                size_t sampleRow = planes.row(sampleY) + x;
+                for (int kx = 0; kx < 5; kx++) {
+                    size_t q = sampleRow + (kx - 2) * step;
+                    V qr = Ops::load(in[0] + q), qg = Ops::load(in[1] + q), qb = Ops::load(in[2] + q);
+                    V dr = Ops::sub(qr, r), dg = Ops::sub(qg, g), db = Ops::sub(qb, b);
+                    V colorDistance = Ops::add(Ops::add(Ops::mul(dr, dr), Ops::mul(dg, dg)), Ops::mul(db, db));
+                    // 采样点到中心纹素切平面的距离，区分折角两侧和平行的面
+                    V plane = Ops::add(Ops::add(Ops::mul(nx, Ops::sub(Ops::load(&planes.px[q]), px)),
+                        Ops::mul(ny, Ops::sub(Ops::load(&planes.py[q]), py))), Ops::mul(nz, Ops::sub(Ops::load(&planes.pz[q]), pz)));
+                    V normalDot = Ops::add(Ops::add(Ops::mul(nx, Ops::load(&planes.nx[q])), Ops::mul(ny, Ops::load(&planes.ny[q]))), Ops::mul(nz, Ops::load(&planes.nz[q])));
+                    V exponent = Ops::add(Ops::add(Ops::mul(colorDistance, colorScale), Ops::mul(Ops::mul(plane, plane), planeScale)),
+                        Ops::mul(Ops::sub(one, normalDot), Ops::set1(normalFactor)));
+                    M sameChart = Ops::equal(Ops::load(&planes.chart[q]), chart);
+                    V weight = Ops::select(sameChart, Ops::mul(Ops::set1(KERNEL[ky] * KERNEL[kx]), Ops::exp(Ops::sub(zero, exponent))), zero);
+                    sumR = Ops::add(sumR, Ops::mul(qr, weight));
+                    sumG = Ops::add(sumG, Ops::mul(qg, weight));
+                    sumB = Ops::add(sumB, Ops::mul(qb, weight));
+                    sumWeight = Ops::add(sumWeight, weight);
+                }
+            }
+            // 有效纹素至少有自己的权重；无效纹素保持原来的颜色
+            M valid = Ops::greater(sumWeight, zero);
+            V inverse = Ops::div(one, Ops::select(valid, sumWeight, one));
+            Ops::store(out[0] + c, Ops::select(valid, Ops::mul(sumR, inverse), r));
+            Ops::store(out[1] + c, Ops::select(valid, Ops::mul(sumG, inverse), g));
+            Ops::store(out[2] + c, Ops::select(valid, Ops::mul(sumB, inverse), b));
+        }
+    }
+}
+
+template <typename Ops>
+void denoise(float* image, const LightmapGuide& guide, const LightmapDenoiseSettings& settings, bool parallel) {
+    const int width = guide.width, height = guide.height;
+    if (settings.iterations <= 0 || width <= 0 || height <= 0)
+        return;
+    int maxStep = 1 << (settings.iterations - 1);
+    // 留白要放下最大间隔的采样，再加上最后一组超出行尾的纹素
+    DenoisePlanes planes(width, height, 2 * maxStep + 8);
+    size_t count = (size_t)planes.stride * height;
+    vector<float> colors[2][3];
+    for (auto& group : colors)
+        for (vector<float>& plane : group)
+            plane.assign(count, 0.0f);
+
+    // 转换成数组结构，被覆盖但没有烘焙结果的纹素也当作无效纹素
+    forRows(height, parallel, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; y++) {
+            for (int x = 0; x < width; x++) {
+                size_t i = y * width + x, p = planes.row((int)y) + x;
+                const float* texel = image + i * 4;
+                if (guide.charts[i] < 0 || !isValid(texel))
+                    continue;
+                colors[0][0][p] = texel[0];
+                colors[0][1][p] = texel[1];
+                colors[0][2][p] = texel[2];
+                planes.px[p] = guide.positions[i * 3 + 0];
+                planes.py[p] = guide.positions[i * 3 + 1];
+                planes.pz[p] = guide.positions[i * 3 + 2];
+                planes.nx[p] = guide.normals[i * 3 + 0];
+                planes.ny[p] = guide.normals[i * 3 + 1];
+                planes.nz[p] = guide.normals[i * 3 + 2];
+                planes.size[p] = guide.texelSizes[i];
+                planes.chart[p] = (float)guide.charts[i];
+            }
+        }
+        });
+
+    int current = 0;
+    for (int iteration = 0; iteration < settings.iterations; iteration++) {
+        int step = 1 << iteration;
+        float colorSigma = settings.colorSigma / (float)step;
+        float planeSigma = settings.planeSigma * (float)step;
+        const float* in[3] = { colors[current][0].data(), colors[current][1].data(), colors[current][2].data() };
+        float* out[3] = { colors[1 - current][0].data(), colors[1 - current][1].data(), colors[1 - current][2].data() };
+        forRows(height, parallel, [&](size_t begin, size_t end) {
+            atrousRows<Ops>(planes, in, out, step, 1.0f / (colorSigma * colorSigma), 1.0f / settings.normalSigma, 1.0f / (planeSigma * planeSigma), begin, end);
+            });
+        current = 1 - current;
+    }
+
+    forRows(height, parallel, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; y++) {
+            for (int x = 0; x < width; x++) {
+                size_t p = planes.row((int)y) + x;
+                if (planes.chart[p] < 0.0f)
+                    continue;
+                float* texel = image + (y * width + x) * 4;
+                texel[0] = colors[current][0][p];
+                texel[1] = colors[current][1][p];
+                texel[2] = colors[current][2][p];
+            }
+        }
+        });
+}
+}
+
+void lightmapSeamFill(float* image, int width, int height, int maxDistance) {
+    seamFill<SimdOps>(image, width, height, maxDistance, true);
+}
+
+void lightmapSeamFillScalar(float* image, int width, int height, int maxDistance) {
+    seamFill<ScalarOps>(image, width, height, maxDistance, false);
+}
+
+void lightmapSmooth(const float* image, float* out, int width, int height) {
+    forRows(height, true, [&](size_t begin, size_t end) { smoothRows<SimdOps>(image, out, width, height, begin, end); });
+}
+
+void lightmapSmoothScalar(const float* image, float* out, int width, int height) {
+    smoothRows<ScalarOps>(image, out, width, height, 0, (size_t)height);
+}
+
+void lightmapPower(float* image, int width, int height, float exponent) {
+    // 每行从像素的边界开始，SIMD的每组里alpha的位置固定
+    forRows(height, true, [&](size_t begin, size_t end) {
+        powerRange<SimdOps>(image + begin * width * 4, (end - begin) * width * 4, exponent);
+        });
+}
+
+void lightmapPowerScalar(float* image, int width, int height, float exponent) {
+    powerRange<ScalarOps>(image, (size_t)width * height * 4, exponent);
+}
+
+void LightmapGuide::reset(int width, int height) {
+    this->width = width;
+    this->height = height;
+    size_t count = (size_t)width * height;
+    this->positions.assign(count * 3, 0.0f);
+    this->normals.assign(count * 3, 0.0f);
+    this->texelSizes.assign(count, 0.0f);
+    this->charts.assign(count, -1);
+}
+
+void lightmapDenoise(float* image, const LightmapGuide& guide, const LightmapDenoiseSettings& settings) {
+    denoise<SimdOps>(image, guide, settings, true);
+}
+
+void lightmapDenoiseScalar(float* image, const LightmapGuide& guide, const LightmapDenoiseSettings& settings) {
+    denoise<ScalarOps>(image, guide, settings, false);
+}
+
+const char* lightmapImageInstructionSet() {
+#if defined(LIGHTMAP_IMAGE_USE_AVX2)
+    return "AVX2";
+#elif defined(LIGHTMAP_IMAGE_USE_SSE)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,84 @@
+#ifndef LIGHTMAP_IMAGE_H
+#define LIGHTMAP_IMAGE_H
+
+// 定义了光照贴图烘焙结果的后处理：去噪、接缝填充、平滑和求幂
+// 图像是width x height x 4个float（RGBA交错存放），和lightmapper的约定相同：任一通道大于0的纹素是有效的
+// 每个函数按行分到任务系统上并行，行内用AVX2的8个或SSE的4个float一组计算，
+// 编译器没有开启对应的指令集时退回标量实现；带Scalar后缀的版本是单线程的标量实现，用于对比
+
+#include <cstddef>
+#include <vector>
+
+// 分到任务系统上时每个任务处理的行数
+const size_t LIGHTMAP_IMAGE_ROW_GRAIN = 16;
+
+/// @brief 接缝填充：无效纹素取欧氏距离最近的有效纹素的颜色，距离超过maxDistance的保持为0
+/// 代替反复扩张一个纹素的lmImageDilate，用跳跃泛洪（jump flood）在log2(maxDistance) + 2遍内完成
+/// @param image 光照贴图，原地修改
+/// @param width 宽度
+/// @param height 高度
+/// @param maxDistance 最大的填充距离（纹素）
+void lightmapSeamFill(float* image, int width, int height, int maxDistance);
+
+/// @brief lightmapSeamFill的单线程标量实现
+void lightmapSeamFillScalar(float* image, int width, int height, int maxDistance);
+
+/// @brief 3x3盒式滤波，只平均有效的纹素，结果和lmImageSmooth相同（有效纹素周围一圈的无效纹素也会被填充）
+/// 分成水平和竖直两遍，每行只做加法
+/// @param image 输入的光照贴图
+/// @param out 输出的光照贴图，不能和image相同
+void lightmapSmooth(const float* image, float* out, int width, int height);
+
+/// @brief lightmapSmooth的单线程标量实现
+void lightmapSmoothScalar(const float* image, float* out, int width, int height);
+
+/// @brief 颜色通道（RGB）求幂，alpha不变，小于等于0的值变成0
+/// SIMD实现用多项式近似的对数和指数，相对误差在1e-6量级
+/// @param image 光照贴图，原地修改
+void lightmapPower(float* image, int width, int height, float exponent);
+
+/// @brief lightmapPower的单线程标量实现，使用std::pow
+void lightmapPowerScalar(float* image, int width, int height, float exponent);
+
+// 去噪的引导缓冲，和光照贴图大小相同，由rasterizeLightmapGuide生成
+struct LightmapGuide {
+    int width = 0;
+    int height = 0;
+    // 每个纹素的世界空间位置和几何法线，xyz连续存放
+    std::vector<float> positions;
+    std::vector<float> normals;
+    // 每个纹素在世界空间中的边长，用于把位置的差换算成纹素
+    std::vector<float> texelSizes;
+    // 每个纹素所属的图块，-1表示没有被三角形覆盖
+    std::vector<int> charts;
+
+    /// @brief 分配width x height个纹素，所有纹素都没有被覆盖
+    void reset(int width, int height);
+};
+
+// 去噪参数
+struct LightmapDenoiseSettings {
+    // 迭代次数，第i次的采样间隔是2^i个纹素，滤波半径是2 * (2^iterations - 1)个纹素
+    int iterations = 4;
+    // 颜色的权重：和中心纹素的颜色差相对于中心纹素亮度的比例，每次迭代减半，逐步只平滑更小的差异
+    float colorSigma = 1.0f;
+    // 法线的权重：1减去法线的点积
+    float normalSigma = 0.05f;
+    // 位置的权重：到中心纹素切平面的距离（按中心纹素的边长和采样间隔换算）
+    float planeSigma = 0.5f;
+};
+
+/// @brief 边缘保持的à-trous小波去噪，5x5的B3样条核逐次加大采样间隔，每个采样按颜色、法线和到切平面的距离加权
+/// 只在同一个图块内的有效纹素之间滤波，图块边界两侧的纹素互不影响；无效纹素保持不变
+/// 引导数据按数组结构存放，行内相邻的纹素一组用SIMD计算
+/// @param image 光照贴图，原地修改，大小和引导缓冲相同
+/// @param guide 引导缓冲
+void lightmapDenoise(float* image, const LightmapGuide& guide, const LightmapDenoiseSettings& settings);
+
+/// @brief lightmapDenoise的单线程标量实现
+void lightmapDenoiseScalar(float* image, const LightmapGuide& guide, const LightmapDenoiseSettings& settings);
+
+/// @brief 编译时选择的指令集，用于基准测试的输出
+const char* lightmapImageInstructionSet();
+
+#endif // LIGHTMAP_IMAGE_H
@@ -6,6 +6,8 @@
 #include <string>
 #include <vector>
 #include "shader.h"
+#include "RenderStats.h"
+#include "GpuResource.h"
 
 using std::string;
 using std::vector;
@@ -22,6 +24,8 @@ struct Vertex {
     glm::vec3 Tangent;
     // 副切线
     glm::vec3 Bitangent;
+    // 光照贴图坐标（第二套纹理坐标），由模型导入时的展开和场景的图块打包生成
+    glm::vec2 LightmapTexCoords;
 };
 
 // 纹理
@@ -53,18 +57,18 @@ public:
     // 纹理数据
     vector<Texture> textures;
 
-    // 构造函数
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures) {
+    // 构造函数，owner是显存账本中记录的拥有者（模型文件路径）
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, const string& owner) {
         // 设置数据
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
 
-        setupMesh();
+        setupMesh(owner);
     }
 
     // 绘制函数
-    void draw(Shader& shader, vector<unsigned int> directionLightDepthMaps, bool isActiveTexture, vector<unsigned int> d_d2_filter_maps, bool is_d_d2, bool isLightMap, unsigned int lightMap) {
+    void draw(Shader& shader, const vector<GLTexture>& directionLightDepthMaps, bool isActiveTexture, const vector<GLTexture>& d_d2_filter_maps, bool is_d_d2, bool isLightMap, unsigned int lightMap) {
         // 是否激活纹理
         if (isActiveTexture) {
             unsigned int diffuseNr = 0;
@@ -76,6 +80,7 @@ public:
                 glActiveTexture(GL_TEXTURE0 + i);
                 // 绑定纹理单元
                 glBindTexture(GL_TEXTURE_2D, textures[i].id);
+                STATS_COUNT(textureBinds, 1);
 
                 /// 将纹理传递给着色器
                 // 获取纹理序号
@@ -118,6 +123,7 @@ public:
                 for (; j < directionLightDepthMaps.size(); j++) {
                     glActiveTexture(GL_TEXTURE0 + i + j);
                     glBindTexture(GL_TEXTURE_2D, directionLightDepthMaps[j]);
+                    STATS_COUNT(textureBinds, 1);
                     shader.setInt("directionalLights[" + std::to_string(j) + "].shadowMap", i + j);
                 }
             }
@@ -126,6 +132,7 @@ public:
                 for (; j * 2 + 1 < d_d2_filter_maps.size(); j++) {
                     glActiveTexture(GL_TEXTURE0 + i + j);
                     glBindTexture(GL_TEXTURE_2D, d_d2_filter_maps[j * 2 + 1]);
+                    STATS_COUNT(textureBinds, 1);
                     shader.setInt("directionalLights[" + std::to_string(j) + "].d_d2_filter", i + j);
                 }
             }
@@ -134,6 +141,7 @@ public:
                 // 设置光照贴图
                 glActiveTexture(GL_TEXTURE0 + i + j);
                 glBindTexture(GL_TEXTURE_2D, lightMap);
+                STATS_COUNT(textureBinds, 1);
                 shader.setInt("lightMap", i + j);
             }
         }
@@ -141,6 +149,9 @@ public:
         // 绘制网格
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        STATS_COUNT(vaoBinds, 1);
+        STATS_COUNT(drawCalls, 1);
+        STATS_COUNT(triangles, indices.size() / 3);
 
         // 恢复默认纹理单元
         glActiveTexture(GL_TEXTURE0);
@@ -148,16 +159,24 @@ public:
         glBindVertexArray(0);
     }
 
+    // 重新上传顶点数据，用于导入之后才确定的光照贴图坐标
+    void updateVertices() {
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(Vertex), vertices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
 private:
-    // 渲染数据
-    unsigned int VAO, VBO, EBO;
+    // 渲染数据，网格析构时自动释放
+    GLVertexArray VAO;
+    GLBuffer VBO, EBO;
 
     // 初始化渲染数据
-    void setupMesh() {
+    void setupMesh(const string& owner) {
         // 生成VAO，VBO，EBO
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        VAO.create("mesh", owner);
+        VBO.create("mesh", owner);
+        EBO.create("mesh", owner);
 
         // 绑定VAO
         glBindVertexArray(VAO);
@@ -165,11 +184,13 @@ private:
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // 将顶点数据复制到VBO
         glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        VBO.setSize(vertices.size() * sizeof(Vertex));
 
         // 绑定EBO
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         // 将索引数据复制到EBO
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        EBO.setSize(indices.size() * sizeof(unsigned int));
 
         // 顶点位置
         glEnableVertexAttribArray(0);
@@ -186,6 +207,9 @@ private:
         // 副切线
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        // 光照贴图坐标
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, LightmapTexCoords));
 
         // 解绑VAO
         glBindVertexArray(0);
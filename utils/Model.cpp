@@ -1,15 +1,19 @@
 #include "Model.h"
 // #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
+#include "JobSystem.h"
 
-void Model::draw(Shader& shader, vector<unsigned int> directionLightDepthMaps, bool isActiveTexture, vector<unsigned int> d_d2_filter_maps, bool is_d_d2, bool isLightMap, unsigned int lightMap) {
+// 材质中需要加载的纹理类型
+static const aiTextureType TEXTURE_TYPES[] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT };
+
+void Model::draw(Shader& shader, const vector<GLTexture>& directionLightDepthMaps, bool isActiveTexture, const vector<GLTexture>& d_d2_filter_maps, bool is_d_d2, bool isLightMap, unsigned int lightMap) {
     // 遍历所有网格，并调用它们各自的draw函数
     for (unsigned int i = 0; i < meshes.size(); i++) {
         meshes[i].draw(shader, directionLightDepthMaps, isActiveTexture, d_d2_filter_maps, is_d_d2, isLightMap, lightMap);
     }
 }
 
-void Model::loadModel(string path, vector<vertex_t>& lightVertices, vector<unsigned int>& lightIndices) {
+void Model::loadModel(string path) {
     // 读取文件，将模型数据存储在scene中
     Assimp::Importer importer;
     // 预处理参数
@@ -27,26 +31,120 @@ void Model::loadModel(string path, vector<vertex_t>& lightVertices, vector<unsig
     // 获取模型文件所在的目录
     this->directory = path.substr(0, path.find_last_of('/'));
 
+    // 解码图像是加载中最慢的部分，先并行解码所有纹理，处理网格时只在当前线程上传
+    this->decodeTextures(scene);
+    // 光照贴图坐标的展开和材质纹理无关，也在上传之前并行完成
+    vector<LightmapMesh> unwrapped = unwrapMeshes(scene);
+
     // 递归处理场景中的每个节点
     // 每个节点包含了一系列的网格索引
     // 每个索引指向场景对象中的那个特定网格
-    this->processNode(scene->mRootNode, scene, lightVertices, lightIndices);
+    this->processNode(scene->mRootNode, scene, unwrapped);
+
+    for (auto& entry : this->decodedImages)
+        stbi_image_free(entry.second.data);
+    this->decodedImages.clear();
+}
+
+bool Model::loadGeometry(const string& path, vector<LightmapMesh>& lightmapMeshes) {
+    // 和loadModel使用相同的预处理参数，得到的顶点和索引完全相同
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        cout << "ERROR::ASSIMP::" << importer.GetErrorString() << endl;
+        return false;
+    }
+    vector<LightmapMesh> unwrapped = unwrapMeshes(scene);
+    // 按processNode的顺序遍历节点
+    std::function<void(const aiNode*)> visit = [&](const aiNode* node) {
+        for (unsigned int i = 0; i < node->mNumMeshes; i++)
+            lightmapMeshes.push_back(unwrapped[node->mMeshes[i]]);
+        for (unsigned int i = 0; i < node->mNumChildren; i++)
+            visit(node->mChildren[i]);
+    };
+    visit(scene->mRootNode);
+    return true;
+}
+
+vector<LightmapMesh> Model::unwrapMeshes(const aiScene* scene) {
+    vector<LightmapMesh> unwrapped(scene->mNumMeshes);
+    JobSystem::instance().parallelFor(scene->mNumMeshes, 1, [&](size_t begin, size_t end) {
+        for (size_t m = begin; m < end; m++) {
+            const aiMesh* mesh = scene->mMeshes[m];
+            vector<vertex_t> vertices(mesh->mNumVertices);
+            for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+                vertices[i].p[0] = mesh->mVertices[i].x;
+                vertices[i].p[1] = mesh->mVertices[i].y;
+                vertices[i].p[2] = mesh->mVertices[i].z;
+                vertices[i].t[0] = mesh->mTextureCoords[0] ? mesh->mTextureCoords[0][i].x : 0.0f;
+                vertices[i].t[1] = mesh->mTextureCoords[0] ? mesh->mTextureCoords[0][i].y : 0.0f;
+            }
+            // 三角化之后仍然可能有点和线段，只保留三角形
+            vector<unsigned int> indices;
+            for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+                if (mesh->mFaces[i].mNumIndices == 3)
+                    indices.insert(indices.end(), mesh->mFaces[i].mIndices, mesh->mFaces[i].mIndices + 3);
+            }
+            unwrapped[m] = unwrapLightmapMesh(vertices, indices, LIGHTMAP_MAX_CHART_ANGLE);
+        }
+        });
+    return unwrapped;
+}
+
+void Model::applyLightmapAtlas(vector<vertex_t>& lightVertices, vector<unsigned int>& lightIndices) {
+    for (size_t m = 0; m < this->meshes.size(); m++) {
+        const LightmapMesh& lightmapMesh = this->lightmapMeshes[m];
+        Mesh& mesh = this->meshes[m];
+        for (size_t i = 0; i < mesh.vertices.size(); i++)
+            mesh.vertices[i].LightmapTexCoords = glm::vec2(lightmapMesh.vertices[i].lm[0], lightmapMesh.vertices[i].lm[1]);
+        mesh.updateVertices();
+        appendLightmapGeometry(lightmapMesh, lightVertices, lightIndices);
+    }
+}
+
+void Model::decodeTextures(const aiScene* scene) {
+    // 收集不重复的纹理路径，多个材质引用同一个纹理时只解码一次
+    vector<string> paths;
+    for (unsigned int m = 0; m < scene->mNumMaterials; m++) {
+        aiMaterial* material = scene->mMaterials[m];
+        for (aiTextureType type : TEXTURE_TYPES) {
+            for (unsigned int i = 0; i < material->GetTextureCount(type); i++) {
+                aiString str;
+                material->GetTexture(type, i, &str);
+                if (this->decodedImages.emplace(str.C_Str(), DecodedImage()).second)
+                    paths.push_back(str.C_Str());
+            }
+        }
+    }
+
+    // 每个任务解码一张图像，结果写到各自的位置上，不需要加锁
+    vector<DecodedImage> images(paths.size());
+    JobSystem::instance().parallelFor(paths.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            string fullPath = (std::filesystem::path(this->directory) / std::filesystem::path(paths[i])).string();
+            images[i].data = stbi_load(fullPath.c_str(), &images[i].width, &images[i].height, &images[i].components, 0);
+        }
+        });
+    for (size_t i = 0; i < paths.size(); i++)
+        this->decodedImages[paths[i]] = images[i];
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene, vector<vertex_t>& lightVertices, vector<unsigned int>& lightIndices) {
+void Model::processNode(aiNode* node, const aiScene* scene, const vector<LightmapMesh>& unwrapped) {
     // 处理节点的所有网格(如果有的话)
     for (unsigned int i = 0; i < node->mNumMeshes; i++) {
         aiMesh* meshes = scene->mMeshes[node->mMeshes[i]];
-        this->meshes.push_back(this->processMesh(meshes, scene, lightVertices, lightIndices));
+        this->meshes.push_back(this->processMesh(meshes, scene, unwrapped[node->mMeshes[i]]));
+        // 被多个节点引用的网格每次都复制一份，在光照贴图中各占一块
+        this->lightmapMeshes.push_back(unwrapped[node->mMeshes[i]]);
     }
 
     // 对它的子节点重复这一过程
     for (unsigned int i = 0; i < node->mNumChildren; i++) {
-        this->processNode(node->mChildren[i], scene, lightVertices, lightIndices);
+        this->processNode(node->mChildren[i], scene, unwrapped);
     }
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene, vector<vertex_t>& lightVertices, vector<unsigned int>& lightIndices) {
+Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene, const LightmapMesh& unwrapped) {
     // 顶点数据
     vector<Vertex> vertices;
     // 索引数据
@@ -54,20 +152,18 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene, vector<vertex_t>& li
     // 纹理数据
     vector<Texture> textures;
 
-    // 遍历网格的所有顶点，取出位置、法线、纹理坐标
-    for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+    // 遍历展开后的顶点，从对应的原始顶点取出位置、法线、纹理坐标
+    // 光照贴图坐标在所有模型的图块打包之后才确定
+    for (unsigned int i : unwrapped.sourceVertices) {
         // 处理网格的顶点
         Vertex vertex;
         glm::vec3 vector;
-        vertex_t lightVertex;
         // 顶点位置
         vector.x = mesh->mVertices[i].x;
         vector.y = mesh->mVertices[i].y;
         vector.z = mesh->mVertices[i].z;
         vertex.Position = vector;
-        lightVertex.p[0] = vector.x;
-        lightVertex.p[1] = vector.y;
-        lightVertex.p[2] = vector.z;
+        this->bounds.expand(vector);
         // 顶点法线
         if (mesh->HasNormals()) {
             vector.x = mesh->mNormals[i].x;
@@ -81,13 +177,9 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene, vector<vertex_t>& li
             vec.x = mesh->mTextureCoords[0][i].x;
             vec.y = mesh->mTextureCoords[0][i].y;
             vertex.TexCoords = vec;
-            lightVertex.t[0] = vec.x;
-            lightVertex.t[1] = vec.y;
         }
         else {
             vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-            lightVertex.t[0] = 0.0f;
-            lightVertex.t[1] = 0.0f;
         }
         // 切线
         vector.x = mesh->mTangents[i].x;
@@ -103,19 +195,14 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene, vector<vertex_t>& li
         // DEBUG
         // cout << "bitangent: " << vector.x << " " << vector.y << " " << vector.z << endl;
         vertex.Bitangent = vector;
+        vertex.LightmapTexCoords = glm::vec2(0.0f, 0.0f);
 
         vertices.push_back(vertex);
-        lightVertices.push_back(lightVertex);
     }
 
     // 处理网格的索引(服了，一开始把这步操作写在处理顶点的循环里面了，怪不得导入某些模型内存oom了)
-    for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-        aiFace face = mesh->mFaces[i];
-        for (unsigned int j = 0; j < face.mNumIndices; j++) {
-            indices.push_back(face.mIndices[j]);
-            lightIndices.push_back(face.mIndices[j]);
-        }
-    }
+    // 展开时已经复制了图块边界上的顶点，索引指向展开后的顶点
+    indices = unwrapped.indices;
 
     // 处理网格的材质
     if (mesh->mMaterialIndex >= 0) {
@@ -131,45 +218,51 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene, vector<vertex_t>& li
         std::vector<Texture> normalMaps = this->loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
         textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
     }
-    return Mesh(vertices, indices, textures);
+    return Mesh(vertices, indices, textures, this->path);
 }
 
 
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma) {
+GLTexture TextureFromImage(const DecodedImage& image, const char* path, const string& directory, bool gamma = false);
+GLTexture TextureFromImage(const DecodedImage& image, const char* path, const string& directory, bool gamma) {
     std::filesystem::path dirPath(directory);
     std::filesystem::path filePath(path);
 
     string fullPath = (dirPath / filePath).string();
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+    GLTexture textureID;
+    textureID.create("material texture", fullPath);
 
-    int width, height, nrComponents;
+    int width = image.width, height = image.height, nrComponents = image.components;
     std::cout << fullPath << std::endl;
-    unsigned char* data = stbi_load(fullPath.c_str(), &width, &height, &nrComponents, 0);
+    unsigned char* data = image.data;
     if (data) {
         GLenum format;
-        if (nrComponents == 4)
+        GLenum internalFormat;
+        if (nrComponents == 4) {
             format = GL_RGBA;
-        else if (nrComponents == 3)
+            internalFormat = gamma ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+        }
+        else if (nrComponents == 3) {
             format = GL_RGB;
-        else
+            internalFormat = gamma ? GL_SRGB8 : GL_RGB8;
+        }
+        else {
             format = GL_RED;
+            internalFormat = GL_R8;
+        }
 
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        // 颜色纹理保存的是sRGB空间的值，用sRGB格式让采样结果自动转换到线性空间
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
+        textureID.setSize(GpuMemoryLedger::textureBytes(internalFormat, width, height, 1, true), internalFormat);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
     }
     else {
         std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
     }
 
     return textureID;
@@ -212,8 +305,10 @@ vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type,
             // 自定义高光系数Ns
             texture.shininess = 108.0f;
 
-            // 从aiMaterial中获取纹理
-            texture.id = TextureFromFile(str.C_Str(), this->directory);
+            // 从aiMaterial中获取纹理，只有漫反射纹理是颜色，法线和镜面反射纹理是线性的数据
+            GLTexture handle = TextureFromImage(this->decodedImages[str.C_Str()], str.C_Str(), this->directory, typeName == "texture_diffuse");
+            texture.id = handle;
+            this->textureHandles.push_back(std::move(handle));
             texture.type = typeName;
             texture.path = str.C_Str();
             textures.push_back(texture);
@@ -3,6 +3,8 @@
 
 #include "shader.h"
 #include "Mesh.h"
+#include "Culling.h"
+#include "LightmapAtlas.h"
 #include <vector>
 #include <string>
 #include <assimp/Importer.hpp>
@@ -12,16 +14,19 @@
 #include <filesystem>
 #include <fstream>
 #include <sstream>
+#include <unordered_map>
 
 using std::vector;
 using std::string;
 using std::cout;
 using std::endl;
-// 定义顶点结构体，包含位置和纹理坐标
-typedef struct {
-    float p[3]; // 位置
-    float t[2]; // 纹理坐标
-} vertex_t;
+// 解码后还没有上传的纹理图像
+struct DecodedImage {
+    unsigned char* data = nullptr;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+};
 
 class Model {
 public:
@@ -31,23 +36,46 @@ public:
     vector<Mesh> meshes;
     // 目录
     string directory;
+    // 模型文件路径，作为显存账本中的拥有者
+    string path;
+    // 模型空间的包围盒，用于视锥体剔除和遮挡剔除
+    AABB bounds;
+
+    // 展开后的烘焙几何体，和meshes一一对应，打包之前lm是图块内的坐标
+    vector<LightmapMesh> lightmapMeshes;
 
     // 构造函数
-    Model(string const& path, vector<vertex_t>& lightVertices, vector<unsigned int>& lightIndices) {
-        loadModel(path, lightVertices, lightIndices);
+    Model(string const& path) : path(path) {
+        loadModel(path);
     }
 
+    /// @brief 只读取展开后的烘焙几何体，不创建网格和纹理，不需要opengl上下文
+    /// 得到的数据和构造函数得到的lightmapMeshes相同
+    /// @return 导入失败时返回false
+    static bool loadGeometry(const string& path, vector<LightmapMesh>& lightmapMeshes);
+
+    /// @brief 图块打包之后，把光照贴图坐标写入网格的顶点缓冲，并把烘焙几何体追加到场景的顶点和索引
+    void applyLightmapAtlas(vector<vertex_t>& lightVertices, vector<unsigned int>& lightIndices);
+
     // 绘制函数
-    void draw(Shader& shader, vector<unsigned int> directionLightDepthMaps, bool isActiveTexture, vector<unsigned int> d_d2_filter_maps, bool is_d_d2, bool isLightMap, unsigned int lightMap);
+    void draw(Shader& shader, const vector<GLTexture>& directionLightDepthMaps, bool isActiveTexture, const vector<GLTexture>& d_d2_filter_maps, bool is_d_d2, bool isLightMap, unsigned int lightMap);
 
 private:
+    // 加载的纹理对象，模型析构时自动释放（textures_loaded中的id由网格共享）
+    vector<GLTexture> textureHandles;
+    // 加载过程中预先解码的纹理，键是材质中的纹理路径，加载完成后释放
+    std::unordered_map<string, DecodedImage> decodedImages;
 
     // 加载模型
-    void loadModel(string path, vector<vertex_t>& lightVertices, vector<unsigned int>& lightIndices);
-    // 处理节点
-    void processNode(aiNode* node, const aiScene* scene, vector<vertex_t>& lightVertices, vector<unsigned int>& lightIndices);
-    // 处理网格
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene, vector<vertex_t>& lightVertices, vector<unsigned int>& lightIndices);
+    void loadModel(string path);
+    // 处理节点，unwrapped是场景中每个网格展开的结果
+    void processNode(aiNode* node, const aiScene* scene, const vector<LightmapMesh>& unwrapped);
+    // 处理网格，顶点按展开的结果复制
+    Mesh processMesh(aiMesh* mesh, const aiScene* scene, const LightmapMesh& unwrapped);
+    // 在任务系统上并行展开场景中的所有网格，被多个节点引用的网格只展开一次
+    static vector<LightmapMesh> unwrapMeshes(const aiScene* scene);
+    // 在任务系统上并行解码所有材质引用的纹理
+    void decodeTextures(const aiScene* scene);
     // 加载材质纹理
     vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName);
 };
@@ -0,0 +1,94 @@
+#include "PostProcess.h"
+#include "RenderStats.h"
+
+void PostProcess::setup(unsigned int width, unsigned int height) {
+    this->bloomShader = Shader("shaders/bloomShader.vs", "shaders/bloomShader.fs");
+    this->postShader = Shader("shaders/postShader.vs", "shaders/postShader.fs");
+    this->sceneSize = glm::ivec2(width, height);
+
+    // 泛光mip链，只需要RGB，用R11G11B10F把带宽减半
+    this->bloomMap.create("post process", "PostProcess");
+    glBindTexture(GL_TEXTURE_2D, this->bloomMap);
+    glm::ivec2 size = this->sceneSize;
+    for (unsigned int level = 0; level < BLOOM_LEVELS; level++) {
+        size = glm::max(size / 2, glm::ivec2(1));
+        this->bloomSizes[level] = size;
+        glTexImage2D(GL_TEXTURE_2D, level, GL_R11F_G11F_B10F, size.x, size.y, 0, GL_RGB, GL_FLOAT, NULL);
+    }
+    // 只有BLOOM_LEVELS级，按完整mip链估计略多一点
+    this->bloomMap.setSize(GpuMemoryLedger::textureBytes(GL_R11F_G11F_B10F, this->bloomSizes[0].x, this->bloomSizes[0].y, 1, true), GL_R11F_G11F_B10F);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, BLOOM_LEVELS - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    this->bloomFBO.create("post process", "PostProcess");
+}
+
+void PostProcess::apply(unsigned int sceneColorMap, bool bloom, unsigned int targetFBO, const std::function<void()>& renderQuad) {
+    // 全屏绘制不需要深度测试
+    glDisable(GL_DEPTH_TEST);
+
+    if (bloom) {
+        downsampleBloom(sceneColorMap, renderQuad);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+    STATS_COUNT(framebufferBinds, 1);
+    glViewport(0, 0, this->sceneSize.x, this->sceneSize.y);
+    this->postShader.use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, sceneColorMap);
+    STATS_COUNT(textureBinds, 1);
+    this->postShader.setInt("sceneColor", 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, this->bloomMap);
+    STATS_COUNT(textureBinds, 1);
+    this->postShader.setInt("bloomMap", 1);
+    this->postShader.setBool("bloom", bloom);
+    this->postShader.setInt("bloomLevels", BLOOM_LEVELS);
+    this->postShader.setFloat("bloomIntensity", BLOOM_INTENSITY);
+    this->postShader.setFloat("exposure", EXPOSURE);
+    renderQuad();
+
+    glActiveTexture(GL_TEXTURE0);
+    glEnable(GL_DEPTH_TEST);
+}
+
+void PostProcess::downsampleBloom(unsigned int sceneColorMap, const std::function<void()>& renderQuad) {
+    glBindFramebuffer(GL_FRAMEBUFFER, this->bloomFBO);
+    STATS_COUNT(framebufferBinds, 1);
+    this->bloomShader.use();
+    this->bloomShader.setInt("source", 0);
+    this->bloomShader.setFloat("threshold", BLOOM_THRESHOLD);
+    this->bloomShader.setFloat("knee", BLOOM_KNEE);
+    glActiveTexture(GL_TEXTURE0);
+
+    // 第0级：从场景颜色降采样，同时提取高亮部分
+    glBindTexture(GL_TEXTURE_2D, sceneColorMap);
+    STATS_COUNT(textureBinds, 1);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->bloomMap, 0);
+    glViewport(0, 0, this->bloomSizes[0].x, this->bloomSizes[0].y);
+    this->bloomShader.setBool("prefilter", true);
+    this->bloomShader.setVec2("texelSize", 1.0f / glm::vec2(this->sceneSize));
+    renderQuad();
+
+    // 之后每一级从上一级降采样，通过限制BASE/MAX_LEVEL避免读写同一层级
+    this->bloomShader.setBool("prefilter", false);
+    glBindTexture(GL_TEXTURE_2D, this->bloomMap);
+    STATS_COUNT(textureBinds, 1);
+    for (unsigned int level = 1; level < BLOOM_LEVELS; level++) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->bloomMap, level);
+        glViewport(0, 0, this->bloomSizes[level].x, this->bloomSizes[level].y);
+        this->bloomShader.setVec2("texelSize", 1.0f / glm::vec2(this->bloomSizes[level - 1]));
+        renderQuad();
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, BLOOM_LEVELS - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,59 @@
+#ifndef POST_PROCESS_H
+#define POST_PROCESS_H
+
+// 定义了PostProcess类，把HDR场景颜色输出到屏幕
+// 泛光先把高亮部分逐级降采样成一条mip链，之后的曝光、泛光合成、色调映射和sRGB转换
+// 全部合并在一次全屏绘制中完成，全分辨率的数据只读一次、写一次
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <functional>
+#include "shader.h"
+#include "GpuResource.h"
+
+class PostProcess {
+public:
+    // 泛光降采样的级数，第0级是场景分辨率的一半
+    static const unsigned int BLOOM_LEVELS = 5;
+    // 亮度超过这个阈值的部分才产生泛光
+    static constexpr float BLOOM_THRESHOLD = 1.0f;
+    // 阈值附近的过渡宽度，避免泛光突然出现
+    static constexpr float BLOOM_KNEE = 0.5f;
+    // 泛光强度
+    static constexpr float BLOOM_INTENSITY = 0.08f;
+    // 曝光
+    static constexpr float EXPOSURE = 1.0f;
+
+    PostProcess() {}
+
+    /// @brief 创建泛光纹理和着色器，需要在opengl上下文初始化之后调用
+    /// @param width 场景的宽度
+    /// @param height 场景的高度
+    void setup(unsigned int width, unsigned int height);
+
+    /// @brief 把HDR场景颜色输出到目标帧缓冲
+    /// @param sceneColorMap HDR场景颜色贴图
+    /// @param bloom 是否开启泛光
+    /// @param targetFBO 目标帧缓冲，0表示屏幕
+    /// @param renderQuad 绘制全屏四边形的函数
+    void apply(unsigned int sceneColorMap, bool bloom, unsigned int targetFBO, const std::function<void()>& renderQuad);
+
+private:
+    // 降采样着色器
+    Shader bloomShader;
+    // 合并的后处理着色器：曝光、泛光、色调映射、sRGB转换
+    Shader postShader;
+    // 泛光mip链（R11G11B10F，每一级是上一级的一半）
+    GLTexture bloomMap;
+    // 渲染泛光mip链的帧缓冲
+    GLFramebuffer bloomFBO;
+    // 场景的尺寸
+    glm::ivec2 sceneSize = glm::ivec2(0);
+    // 泛光每一级的尺寸
+    glm::ivec2 bloomSizes[BLOOM_LEVELS];
+
+    /// @brief 生成泛光mip链
+    void downsampleBloom(unsigned int sceneColorMap, const std::function<void()>& renderQuad);
+};
+
+#endif // POST_PROCESS_H
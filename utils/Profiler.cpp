@@ -0,0 +1,195 @@
+#include "Profiler.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+Profiler& Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler() {
+    this->startTime = std::chrono::steady_clock::now();
+}
+
+long long Profiler::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->startTime).count();
+}
+
+void Profiler::beginFrame() {
+    this->frameActive = this->enabled;
+    if (!this->frameActive)
+        return;
+
+    if (!this->gpuCalibrated) {
+        // 同时读取GPU和CPU的时间，把GPU时间戳对齐到CPU时间轴上
+        GLint64 gpuTime = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+        this->gpuOffset = now() - gpuTime;
+        this->gpuCalibrated = true;
+    }
+
+    FrameSlot& slot = this->slots[this->frameIndex % FRAME_LATENCY];
+    // 这一帧的数据是FRAME_LATENCY帧之前的，一般已经完成了
+    if (slot.pending)
+        resolve(slot, false);
+    slot.scopes.clear();
+    slot.pending = true;
+    this->openScopes.clear();
+    this->droppedDepth = 0;
+}
+
+void Profiler::endFrame() {
+    if (!this->frameActive)
+        return;
+    this->frameActive = false;
+    this->frameIndex++;
+}
+
+void Profiler::beginScope(const std::string& name) {
+    if (!this->frameActive)
+        return;
+    FrameSlot& slot = this->slots[this->frameIndex % FRAME_LATENCY];
+    if (this->droppedDepth > 0 || slot.scopes.size() >= MAX_SCOPES_PER_FRAME) {
+        this->droppedDepth++;
+        if (!this->droppedWarning) {
+            std::cout << "profiler: more than " << MAX_SCOPES_PER_FRAME << " scopes in one frame, the rest are dropped" << std::endl;
+            this->droppedWarning = true;
+        }
+        return;
+    }
+
+    unsigned int index = (unsigned int)slot.scopes.size();
+    // 查询对象只在需要时创建，之后一直复用
+    if (slot.queries.size() < (index + 1) * 2) {
+        size_t oldSize = slot.queries.size();
+        slot.queries.resize((index + 1) * 2);
+        glGenQueries((GLsizei)(slot.queries.size() - oldSize), slot.queries.data() + oldSize);
+    }
+
+    Scope scope;
+    scope.name = name;
+    scope.depth = (int)this->openScopes.size();
+    scope.cpuBegin = now();
+    scope.cpuEnd = scope.cpuBegin;
+    slot.scopes.push_back(scope);
+    this->openScopes.push_back(index);
+    glQueryCounter(slot.queries[index * 2], GL_TIMESTAMP);
+}
+
+void Profiler::endScope() {
+    if (!this->frameActive)
+        return;
+    if (this->droppedDepth > 0) {
+        this->droppedDepth--;
+        return;
+    }
+    if (this->openScopes.empty())
+        return;
+    FrameSlot& slot = this->slots[this->frameIndex % FRAME_LATENCY];
+    unsigned int index = this->openScopes.back();
+    this->openScopes.pop_back();
+    glQueryCounter(slot.queries[index * 2 + 1], GL_TIMESTAMP);
+    slot.scopes[index].cpuEnd = now();
+}
+
+void Profiler::resolve(FrameSlot& slot, bool wait) {
+    slot.pending = false;
+    if (slot.scopes.empty())
+        return;
+
+    // 时间戳查询按提交顺序完成，最后一个结束查询可用时所有查询都可用
+    bool gpuAvailable = true;
+    if (!wait) {
+        GLint available = 0;
+        glGetQueryObjectiv(slot.queries[slot.scopes.size() * 2 - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        gpuAvailable = available != 0;
+    }
+
+    for (size_t i = 0; i < slot.scopes.size(); i++) {
+        const Scope& scope = slot.scopes[i];
+        long long cpuDuration = scope.cpuEnd - scope.cpuBegin;
+        GLuint64 gpuBegin = 0, gpuEnd = 0;
+        if (gpuAvailable) {
+            glGetQueryObjectui64v(slot.queries[i * 2], GL_QUERY_RESULT, &gpuBegin);
+            glGetQueryObjectui64v(slot.queries[i * 2 + 1], GL_QUERY_RESULT, &gpuEnd);
+        }
+
+        // 累计统计结果
+        auto found = this->summaryIndex.find(scope.name);
+        if (found == this->summaryIndex.end()) {
+            found = this->summaryIndex.emplace(scope.name, this->summaries.size()).first;
+            Summary summary;
+            summary.name = scope.name;
+            summary.depth = scope.depth;
+            this->summaries.push_back(summary);
+        }
+        Summary& summary = this->summaries[found->second];
+        summary.cpuMs += cpuDuration / 1.0e6;
+        summary.count++;
+        if (gpuAvailable) {
+            summary.gpuMs += (gpuEnd - gpuBegin) / 1.0e6;
+            summary.gpuCount++;
+        }
+
+        // 记录trace事件
+        if (!this->tracePath.empty() && this->traceEvents.size() + 2 <= MAX_TRACE_EVENTS) {
+            this->traceEvents.push_back({ scope.name, 0, scope.cpuBegin, cpuDuration });
+            if (gpuAvailable)
+                this->traceEvents.push_back({ scope.name, 1, (long long)gpuBegin + this->gpuOffset, (long long)(gpuEnd - gpuBegin) });
+        }
+    }
+
+    if (++this->summaryFrames >= SUMMARY_INTERVAL)
+        printSummary();
+}
+
+void Profiler::printSummary() {
+    std::cout << "---- profiler (average per frame over " << this->summaryFrames << " frames) ----" << std::endl;
+    for (Summary& summary : this->summaries) {
+        if (summary.count > 0) {
+            char line[256];
+            std::string name = std::string(summary.depth * 2, ' ') + summary.name;
+            if (summary.gpuCount > 0)
+                snprintf(line, sizeof(line), "%-32s cpu %8.3f ms  gpu %8.3f ms", name.c_str(),
+                    summary.cpuMs / this->summaryFrames, summary.gpuMs / summary.gpuCount * summary.count / this->summaryFrames);
+            else
+                snprintf(line, sizeof(line), "%-32s cpu %8.3f ms  gpu        - ms", name.c_str(), summary.cpuMs / this->summaryFrames);
+            std::cout << line << std::endl;
+        }
+        summary.cpuMs = 0.0;
+        summary.gpuMs = 0.0;
+        summary.gpuCount = 0;
+        summary.count = 0;
+    }
+    this->summaryFrames = 0;
+}
+
+void Profiler::writeTrace() {
+    // 程序结束时可以等待剩下的查询，从最早的一帧开始
+    for (unsigned int i = 0; i < FRAME_LATENCY; i++) {
+        FrameSlot& slot = this->slots[(this->frameIndex + i) % FRAME_LATENCY];
+        if (slot.pending)
+            resolve(slot, true);
+    }
+    if (this->tracePath.empty())
+        return;
+
+    std::ofstream file(this->tracePath);
+    if (!file) {
+        std::cerr << "Error: Unable to write " << this->tracePath << std::endl;
+        return;
+    }
+    // Chrome trace格式：X表示有持续时间的事件，时间单位是微秒
+    file << "{\"traceEvents\":[\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+    char line[512];
+    for (const TraceEvent& event : this->traceEvents) {
+        snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+            event.name.c_str(), event.track == 0 ? "cpu" : "gpu", event.track + 1, event.begin / 1000.0, event.duration / 1000.0);
+        file << line;
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    std::cout << "Saved trace " << this->tracePath << " (" << this->traceEvents.size() << " events)" << std::endl;
+}
@@ -0,0 +1,136 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// 定义了Profiler类，按渲染阶段统计CPU和GPU耗时
+// GPU时间用GL_TIMESTAMP查询，查询结果在FRAME_LATENCY帧之后才读取，结果还没准备好就丢弃，不会让CPU等待GPU
+// 时间戳查询可以任意嵌套，也不会和基准测试的GL_TIME_ELAPSED查询冲突
+// 统计结果定期输出到控制台，也可以导出为Chrome trace格式（chrome://tracing 或 Perfetto 打开）
+
+#include <glad/glad.h>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using std::vector;
+
+class Profiler {
+public:
+    /// @brief 获取全局的性能分析器
+    static Profiler& instance();
+
+    /// @brief 开启/关闭性能分析，关闭时所有统计函数都直接返回，只在帧开始时生效
+    void setEnabled(bool enabled) { this->enabled = enabled; }
+
+    /// @brief 导出Chrome trace的文件路径，设置后会记录所有的统计事件
+    void setTraceOutput(const std::string& path) { this->tracePath = path; }
+
+    /// @brief 一帧开始时调用，读取之前帧的查询结果
+    void beginFrame();
+    /// @brief 一帧结束时调用
+    void endFrame();
+
+    /// @brief 开始一个统计区间，必须和endScope成对调用
+    /// @param name 区间的名字，同名区间的耗时会被合并统计
+    void beginScope(const std::string& name);
+    /// @brief 结束最近开始的统计区间
+    void endScope();
+
+    /// @brief 读取所有剩余的查询结果，写出Chrome trace文件（设置了输出路径时）
+    void writeTrace();
+
+private:
+    // 查询结果延迟读取的帧数
+    static const unsigned int FRAME_LATENCY = 3;
+    // 每帧最多记录的区间数，超过的部分会被丢弃（光照贴图烘焙会在一帧内执行上千次渲染）
+    static const unsigned int MAX_SCOPES_PER_FRAME = 512;
+    // 每隔多少帧输出一次统计结果
+    static const unsigned int SUMMARY_INTERVAL = 120;
+    // trace最多记录的事件数，防止长时间运行时占用过多内存
+    static const size_t MAX_TRACE_EVENTS = 1000000;
+
+    // 一个统计区间
+    struct Scope {
+        std::string name;
+        // 嵌套深度
+        int depth;
+        // CPU开始和结束的时间（纳秒，相对于分析器创建的时间）
+        long long cpuBegin;
+        long long cpuEnd;
+    };
+    // 一帧的统计数据，查询对象按帧循环使用
+    struct FrameSlot {
+        vector<Scope> scopes;
+        // 每个区间的开始和结束各使用一个时间戳查询
+        vector<GLuint> queries;
+        // 这一帧的数据还没有读取
+        bool pending = false;
+    };
+    // 累计的统计结果，用于定期输出
+    struct Summary {
+        std::string name;
+        int depth;
+        double cpuMs = 0.0;
+        double gpuMs = 0.0;
+        unsigned int gpuCount = 0;
+        unsigned int count = 0;
+    };
+    // Chrome trace中的一个事件
+    struct TraceEvent {
+        std::string name;
+        // 0: CPU, 1: GPU
+        int track;
+        // 开始时间和持续时间（纳秒）
+        long long begin;
+        long long duration;
+    };
+
+    Profiler();
+
+    bool enabled = false;
+    // 当前帧是否在统计
+    bool frameActive = false;
+    FrameSlot slots[FRAME_LATENCY];
+    unsigned int frameIndex = 0;
+    // 当前打开的区间在scopes中的下标
+    vector<unsigned int> openScopes;
+    // 区间数超过上限时被丢弃的嵌套层数
+    unsigned int droppedDepth = 0;
+    bool droppedWarning = false;
+
+    std::chrono::steady_clock::time_point startTime;
+    // GPU时间戳加上这个偏移就是CPU时间轴上的时间（纳秒）
+    long long gpuOffset = 0;
+    bool gpuCalibrated = false;
+
+    // 按第一次出现的顺序保存的统计结果
+    vector<Summary> summaries;
+    std::unordered_map<std::string, size_t> summaryIndex;
+    unsigned int summaryFrames = 0;
+
+    std::string tracePath;
+    vector<TraceEvent> traceEvents;
+
+    /// @brief 获取当前CPU时间（纳秒）
+    long long now() const;
+    /// @brief 读取一帧的查询结果
+    /// @param slot 帧数据
+    /// @param wait 是否等待结果，为false时结果没准备好就只统计CPU时间
+    void resolve(FrameSlot& slot, bool wait);
+    /// @brief 输出统计结果并清零
+    void printSummary();
+};
+
+// 统计一个作用域的耗时
+class ProfileScope {
+public:
+    ProfileScope(const std::string& name) { Profiler::instance().beginScope(name); }
+    ~ProfileScope() { Profiler::instance().endScope(); }
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// 统计当前作用域的耗时
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+#endif // PROFILER_H
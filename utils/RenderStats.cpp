@@ -0,0 +1,76 @@
+#include "RenderStats.h"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+FrameStats RenderStats::current;
+FrameStats RenderStats::last;
+FrameStats RenderStats::sum;
+unsigned int RenderStats::sumFrames = 0;
+std::atomic<uint64_t> RenderStats::allocations(0);
+std::atomic<uint64_t> RenderStats::allocatedBytes(0);
+uint64_t RenderStats::frameAllocations = 0;
+uint64_t RenderStats::frameAllocatedBytes = 0;
+
+bool RenderStats::isEnabled() {
+#ifdef TELLURION_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void RenderStats::beginFrame() {
+#ifdef TELLURION_STATS
+    current = FrameStats();
+    frameAllocations = allocations.load(std::memory_order_relaxed);
+    frameAllocatedBytes = allocatedBytes.load(std::memory_order_relaxed);
+#endif
+}
+
+void RenderStats::endFrame() {
+#ifdef TELLURION_STATS
+    current.allocations = allocations.load(std::memory_order_relaxed) - frameAllocations;
+    current.allocatedBytes = allocatedBytes.load(std::memory_order_relaxed) - frameAllocatedBytes;
+    last = current;
+
+    sum.drawCalls += current.drawCalls;
+    sum.triangles += current.triangles;
+    sum.uniformCalls += current.uniformCalls;
+    sum.textureBinds += current.textureBinds;
+    sum.vaoBinds += current.vaoBinds;
+    sum.framebufferBinds += current.framebufferBinds;
+    sum.allocations += current.allocations;
+    sum.allocatedBytes += current.allocatedBytes;
+    if (++sumFrames >= LOG_INTERVAL) {
+        // 输出的是每帧的平均值
+        double n = (double)sumFrames;
+        printf("stats: draws %.0f, triangles %.0f, uniforms %.0f, texture binds %.0f, vao binds %.0f, fbo binds %.0f, allocations %.0f (%.1f KB)\n",
+            sum.drawCalls / n, sum.triangles / n, sum.uniformCalls / n, sum.textureBinds / n,
+            sum.vaoBinds / n, sum.framebufferBinds / n, sum.allocations / n, sum.allocatedBytes / n / 1024.0);
+        fflush(stdout);
+        sum = FrameStats();
+        sumFrames = 0;
+    }
+#endif
+}
+
+#ifdef TELLURION_STATS
+// 替换全局的operator new统计堆内存分配，其他形式的new（数组、nothrow）默认都会转发到这两个函数
+void* operator new(std::size_t size) {
+    RenderStats::allocations.fetch_add(1, std::memory_order_relaxed);
+    RenderStats::allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    void* p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+#endif
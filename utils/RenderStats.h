@@ -0,0 +1,69 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+// 定义了RenderStats类，统计每帧提交给驱动的工作量：绘制调用、三角形、uniform设置、纹理和VAO绑定、帧缓冲切换以及堆内存分配
+// 统计在TELLURION_STATS选项开启时才编译，关闭时STATS_COUNT展开为空，没有任何开销
+
+#include <atomic>
+#include <cstdint>
+
+// 一帧的统计结果
+struct FrameStats {
+    // 绘制调用次数
+    uint64_t drawCalls = 0;
+    // 三角形数
+    uint64_t triangles = 0;
+    // glUniform*调用次数
+    uint64_t uniformCalls = 0;
+    // 纹理绑定次数
+    uint64_t textureBinds = 0;
+    // VAO绑定次数
+    uint64_t vaoBinds = 0;
+    // 帧缓冲切换次数
+    uint64_t framebufferBinds = 0;
+    // 堆内存分配次数和字节数
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+};
+
+class RenderStats {
+public:
+    /// @brief 一帧开始时调用，清零当前帧的计数
+    static void beginFrame();
+
+    /// @brief 一帧结束时调用，保存当前帧的计数，每隔LOG_INTERVAL帧输出一次平均值
+    static void endFrame();
+
+    /// @brief 获取上一帧的统计结果，没有开启统计时总是0
+    static const FrameStats& lastFrame() { return last; }
+
+    /// @brief 是否编译了统计代码
+    static bool isEnabled();
+
+    // 当前帧的计数，渲染线程之外不会访问
+    static FrameStats current;
+    // 堆内存分配可能发生在任何线程，单独用原子变量计数
+    static std::atomic<uint64_t> allocations;
+    static std::atomic<uint64_t> allocatedBytes;
+
+private:
+    // 每隔多少帧输出一次统计结果
+    static const unsigned int LOG_INTERVAL = 300;
+
+    static FrameStats last;
+    // 累计的统计结果，用于输出平均值
+    static FrameStats sum;
+    static unsigned int sumFrames;
+    // 帧开始时的分配计数
+    static uint64_t frameAllocations;
+    static uint64_t frameAllocatedBytes;
+};
+
+#ifdef TELLURION_STATS
+// 增加当前帧的计数
+#define STATS_COUNT(counter, n) (RenderStats::current.counter += (uint64_t)(n))
+#else
+#define STATS_COUNT(counter, n) ((void)0)
+#endif
+
+#endif // RENDER_STATS_H
@@ -1,22 +1,28 @@
 
 #include "Scene.h"
 #include <iostream>
+#include <algorithm>
+#include <random>
+#include <cstring>
+#include <thread>
 #include "yaml-cpp/yaml.h"
+#include "Profiler.h"
+#include "RenderStats.h"
+#include "JobSystem.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
-// 导入库
-#define LIGHTMAPPER_IMPLEMENTATION
-#define LM_DEBUG_INTERPOLATION
-#include "lightmapper.h"
 
-Scene::Scene(GLFWWindowFactory* window) :window(window) {
+Scene::Scene(WindowFactory* window) :SCR_WIDTH(window->getWidth()), SCR_HEIGHT(window->getHeight()), window(window) {
     // 加载定向光配置
     this->directionalLights = loadDirectionalLights("config/directionalLights.yaml");
     this->numDirectionalLights = this->directionalLights.size();
     // 加载点光源配置
     pointLights = loadPointLights("config/pointLights.yaml");
+    // 初始化分簇光照并上传点光源
+    this->lightCluster.setup();
+    uploadPointLights();
     // 加载场景配置
-    this->modelInfos = loadScene("config/scene.yaml");
+    this->modelInfos = loadScene("config/scene.yaml", this->transforms);
 
     /// 阴影深度贴图处理
     // 给directionLightDepthMapFBOs分配大小
@@ -30,15 +36,21 @@ Scene::Scene(GLFWWindowFactory* window) :window(window) {
     // 加载深度贴图
     loadDirectionLightDepthMap();
 
-    /// 光照贴图处理
-    // 加载光照贴图
-    loadLightMap();
+    /// 场景离屏帧缓冲和G-buffer
+    loadSceneFramebuffer();
 
     // 为每个模型信息加载模型
     for (auto& modelInfo : modelInfos) {
 
-        modelInfo.model = new Model(modelInfo.path, vertices, indices);
+        modelInfo.model.reset(new Model(modelInfo.path));
+        this->localBounds.push_back(modelInfo.model->bounds);
     }
+    // 所有模型共用一张光照贴图，加载完所有模型之后才能打包
+    buildLightMapAtlas();
+
+    /// 光照贴图处理
+    // 加载光照贴图，缓存的键包括烘焙用的几何体，所以在打包之后加载
+    loadLightMap();
 
     // 初始化着色器
     this->shader = Shader("shaders/sceneShader.vs", "shaders/sceneShader.fs");
@@ -48,29 +60,116 @@ Scene::Scene(GLFWWindowFactory* window) :window(window) {
     this->d_d2_filter_shader = Shader("shaders/vsmShader.vs", "shaders/vsmShader.fs");
     // 初始化光照贴图着色器
     this->lightMapShader = Shader("shaders/lightMapShader.vs", "shaders/lightMapShader.fs");
+    // 初始化延迟渲染着色器，几何阶段和前向渲染使用同一个顶点着色器
+    this->gBufferShader = Shader("shaders/sceneShader.vs", "shaders/gbufferShader.fs");
+    this->deferredShader = Shader("shaders/deferredShader.vs", "shaders/deferredShader.fs");
+
+    // 片段计数查询
+    glGenQueries(QUERY_COUNT, this->samplesPassedQueries);
+    // 层级深度遮挡剔除
+    this->hiZBuffer.setup(SCR_WIDTH, SCR_HEIGHT);
+    // 后处理
+    this->postProcess.setup(SCR_WIDTH, SCR_HEIGHT);
 }
 
 Scene::~Scene() {
+    // 纹理、帧缓冲、缓冲和模型都由RAII对象持有，这里只需要删除查询对象
+    glDeleteQueries(QUERY_COUNT, this->samplesPassedQueries);
+    // 探针烘焙任务引用了模型的烘焙几何体，取消后等它结束
+    if (this->lightProbeJob) {
+        this->lightProbeBaker->cancel();
+        JobSystem::instance().wait(this->lightProbeJob);
+    }
+}
+
+void Scene::update(FramePacket& packet) {
+    // 按固定步长推进地球仪的转动，转动速度和帧率无关
+    for (unsigned int i = 0; i < packet.simulationSteps; i++) {
+        this->previousSpinAngle = this->spinAngle;
+        this->spinAngle += SPIN_SPEED * (float)SimulationClock::STEP;
+    }
+    // 转满一圈后两个角度一起回绕，插值时不会跨过0度
+    if (this->previousSpinAngle >= 360.0f) {
+        this->previousSpinAngle -= 360.0f;
+        this->spinAngle -= 360.0f;
+    }
+    float spinAngle = glm::mix(this->previousSpinAngle, this->spinAngle, packet.simulationAlpha);
+
+    updateTransforms(spinAngle);
+    // 剔除对摄像机不可见的模型
+    updateVisibility(packet);
+    // 按到摄像机的距离从近到远排序，减少被覆盖的片段执行昂贵的光照计算
+    sortModelsFrontToBack(packet);
 }
 
-void Scene::draw() {
+void Scene::draw(const FramePacket& packet) {
+    this->frame = &packet;
     // 处理输入
     processInputMoveDirLight();
+
+    // 遮挡剔除
+    {
+        PROFILE_SCOPE("occlusion culling");
+        cullOccluded();
+    }
+
     if (BAKE) {
         static int baking = 0; // 添加一个标志
-        if (glfwGetKey(this->window->window, GLFW_KEY_SPACE) == GLFW_PRESS && !baking) {
+        if (window->isKeyPressed(GLFW_KEY_SPACE) && !baking) {
             baking = 1; // 设置标志
-            cout << "baking" << endl;
-            bakeLightMap();
+            // 烘焙过程中再按空格不会重新开始
+            // 每个模型用这一帧的模型矩阵烘焙到自己的区域
+            vector<LightmapBaker::Object> objects = lightMapBakeObjects();
+            // 光源可能已经用方向键移动过，用现在的光源和模型矩阵重新计算键，结果不会保存到旧的键下
+            // 断点使用同一个键，光源移动之后不会从旧光源的断点继续
+            if (!this->lightmapBaker.isBaking()) {
+                LightmapCacheKey key = lightMapCacheKey(this->modelInfos, this->frame->modelMatrices, this->directionalLights, this->pointLights, CPU_BAKE);
+                this->lightmapBaker.setCache(LIGHT_MAP_CACHE, key);
+                this->lightmapBaker.setCheckpoint(LIGHT_MAP_CHECKPOINT, key, LIGHT_MAP_CHECKPOINT_INTERVAL);
+            }
+            bool started = CPU_BAKE
+                ? this->lightmapBaker.startCpu(this->lightMap, LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT, objects, createCpuBaker(this->directionalLights, this->pointLights))
+                : this->lightmapBaker.start(this->lightMap, LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT, objects);
+            if (started)
+                cout << "baking" << endl;
+            // 光照探针很快，和光照贴图一起用这一帧的模型矩阵重新烘焙
+            startLightProbeBake(this->frame->modelMatrices);
         }
-        if (glfwGetKey(this->window->window, GLFW_KEY_SPACE) == GLFW_RELEASE) {
+        if (!window->isKeyPressed(GLFW_KEY_SPACE)) {
             baking = 0; // 重置标志
         }
+        // 渐进式烘焙每帧只渲染一部分半球，场景照常渲染，光照贴图逐步填满
+        advanceLightMapBake();
+        advanceLightProbeBake();
     }
 
     // 渲染深度贴图
     renderSceneToDepthMap();
 
+    // 渲染到场景离屏帧缓冲
+    glBindFramebuffer(GL_FRAMEBUFFER, this->sceneFBO);
+    STATS_COUNT(framebufferBinds, 1);
+    glViewport(0, 0, this->SCR_WIDTH, this->SCR_HEIGHT);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // 光照贴图只在前向渲染中使用，烘焙时总是走前向渲染
+    this->hiZBuilt = false;
+    if (window->deferred && !BAKE) {
+        renderDeferred();
+    }
+    else {
+        renderForward();
+    }
+
+    // 没有深度预渲染时，场景深度在主渲染阶段之后才完整
+    if (window->occlusionCulling && !this->hiZBuilt) {
+        buildHiZ();
+    }
+}
+
+void Scene::renderForward() {
+    PROFILE_SCOPE("forward");
     this->shader.use();
     if (BAKE) {
         // 使用光照贴图
@@ -82,41 +181,268 @@ void Scene::draw() {
     }
 
     // 设置场景着色器uniform变量
-    setupSceneUniform();
+    setupSceneUniform(this->shader);
+    // 光照探针的3D纹理使用单独的纹理单元，不设置时会和材质的2D纹理共用0号单元
+    this->shader.setInt("lightProbes", LIGHT_PROBE_TEXTURE_UNIT);
+    if (BAKE && !this->lightProbes.empty()) {
+        glActiveTexture(GL_TEXTURE0 + LIGHT_PROBE_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_3D, this->lightProbeTexture);
+        STATS_COUNT(textureBinds, 1);
+        glActiveTexture(GL_TEXTURE0);
+        this->shader.setVec3("lightProbeScale", this->lightProbes.getTextureScale());
+        this->shader.setVec3("lightProbeBias", this->lightProbes.getTextureBias());
+        this->shader.setFloat("lightProbeDepth", (float)this->lightProbes.getSize().z);
+    }
 
-    // 切换回默认视口
-    glViewport(0, 0, this->SCR_WIDTH, this->SCR_HEIGHT);
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (window->depthPrepass) {
+        PROFILE_SCOPE("depth prepass");
+        // 深度预渲染：复用只输出位置的阴影着色器，只写深度不写颜色
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        this->directionLightShadowShader.use();
+        this->directionLightShadowShader.setMat4("lightSpaceMatrix", window->getProjectionMatrix() * window->getViewMatrix());
+        renderScene(this->directionLightShadowShader, false, true);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        // 深度预渲染之后场景深度已经完整了，这时就生成层级深度
+        if (window->occlusionCulling) {
+            buildHiZ();
+        }
+        // 主渲染阶段只有最靠前的片段能通过深度测试，深度已经写好了，不需要再写
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
 
+    // 统计主渲染阶段执行光照计算的片段数
+    beginSamplesPassedQuery();
     // 渲染场景
-    renderScene(this->shader, true);
+    {
+        PROFILE_SCOPE("forward shading");
+        renderScene(this->shader, true, true);
+    }
+    endSamplesPassedQuery();
+
+    if (window->depthPrepass) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
 }
 
+void Scene::beginSamplesPassedQuery() {
+    // 读取QUERY_COUNT-1帧之前的结果，这时GPU一般已经完成了，不会阻塞
+    unsigned int oldest = (this->queryFrame + 1) % QUERY_COUNT;
+    if (this->queryIssued[oldest]) {
+        GLint available = 0;
+        glGetQueryObjectiv(this->samplesPassedQueries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            glGetQueryObjectui64v(this->samplesPassedQueries[oldest], GL_QUERY_RESULT, &this->shadedFragments);
+            this->queryIssued[oldest] = false;
+        }
+    }
+
+    unsigned int current = this->queryFrame % QUERY_COUNT;
+    // 上一轮的结果还没有读到就直接覆盖，宁可丢掉一个结果也不等待GPU
+    glBeginQuery(GL_SAMPLES_PASSED, this->samplesPassedQueries[current]);
+}
+
+void Scene::endSamplesPassedQuery() {
+    glEndQuery(GL_SAMPLES_PASSED);
+    this->queryIssued[this->queryFrame % QUERY_COUNT] = true;
+    this->queryFrame++;
+
+    // 开启性能分析时定期输出片段数，用来对比开启/关闭深度预渲染时的过度绘制
+    if (window->profiler && this->queryFrame % 120 == 0) {
+        cout << "shaded fragments: " << this->shadedFragments
+            << " (depth prepass " << (window->depthPrepass ? "on" : "off") << ")" << endl;
+    }
+}
 
-std::vector<Scene::ModelInfo> Scene::loadScene(const std::string& fileName) {
+void Scene::sortModelsFrontToBack(FramePacket& packet) const {
+    // 数据包是循环使用的，上一次的顺序作为初始顺序，模型之间的远近变化不大，排序很快
+    if (packet.drawOrder.size() != this->modelInfos.size()) {
+        packet.drawOrder.resize(this->modelInfos.size());
+        for (size_t i = 0; i < packet.drawOrder.size(); i++)
+            packet.drawOrder[i] = i;
+    }
+    // 用包围盒中心而不是模型原点排序，模型原点不一定在几何中心
+    const vector<AABB>& worldBounds = packet.worldBounds;
+    glm::vec3 cameraPosition = packet.cameraPosition;
+    std::sort(packet.drawOrder.begin(), packet.drawOrder.end(), [&](size_t a, size_t b) {
+        glm::vec3 da = (worldBounds[a].min + worldBounds[a].max) * 0.5f - cameraPosition;
+        glm::vec3 db = (worldBounds[b].min + worldBounds[b].max) * 0.5f - cameraPosition;
+        return glm::dot(da, da) < glm::dot(db, db);
+        });
+}
+
+void Scene::updateTransforms(float spinAngle) {
+    // 只有自转的模型每帧修改旋转，烘焙时地球仪不转动
+    if (!BAKE) {
+        for (const ModelInfo& modelInfo : this->modelInfos) {
+            if (modelInfo.spinning)
+                this->transforms.setRotation(modelInfo.transform, modelInfo.restRotation * glm::angleAxis(glm::radians(spinAngle), glm::vec3(0.0f, 1.0f, 0.0f)));
+        }
+    }
+    this->transforms.update();
+
+    // 静态模型的世界包围盒一直沿用第一帧的结果，变化了的模型按连续的一段批量变换
+    // 模型和变换节点按相同的顺序添加，下标相同
+    this->worldBoundsCache.resize(this->modelInfos.size());
+    const glm::mat4* worldMatrices = this->transforms.getWorldMatrices();
+    this->transforms.forEachChangedRun([&](size_t begin, size_t end) {
+        transformBoundsParallel(worldMatrices + begin, &this->localBounds[begin], &this->worldBoundsCache[begin], end - begin);
+        for (size_t i = begin; i < end; i++) {
+            if (!this->localBounds[i].valid()) {
+                // 没有顶点的模型没有包围盒，只记录位置用于排序
+                this->worldBoundsCache[i] = AABB();
+                this->worldBoundsCache[i].expand(glm::vec3(worldMatrices[i][3]));
+            }
+        }
+        });
+}
+
+void Scene::updateVisibility(FramePacket& packet) const {
+    packet.modelMatrices.resize(this->modelInfos.size());
+    packet.worldBounds.resize(this->modelInfos.size());
+    packet.frustumVisible.resize(this->modelInfos.size());
+
+    Frustum frustum = Frustum::fromMatrix(packet.viewProjection);
+    // 每个模型只写自己的位置，模型很多时分到任务系统上并行测试
+    JobSystem::instance().parallelFor(this->modelInfos.size(), CULL_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const ModelInfo& modelInfo = this->modelInfos[i];
+            // 数据包要交给opengl线程，变换层级之后还会被更新线程修改，所以复制一份
+            packet.modelMatrices[i] = this->transforms.getWorldMatrix(modelInfo.transform);
+            packet.worldBounds[i] = this->worldBoundsCache[i];
+            packet.frustumVisible[i] = !modelInfo.model->bounds.valid() || frustum.intersects(packet.worldBounds[i]);
+        }
+        });
+    packet.frustumCulled = (int)std::count(packet.frustumVisible.begin(), packet.frustumVisible.end(), 0);
+}
+
+void Scene::cullOccluded() {
+    this->modelVisible.assign(this->frame->frustumVisible.begin(), this->frame->frustumVisible.end());
+    int culledCount = this->frame->frustumCulled;
+    if (window->occlusionCulling) {
+        for (size_t i = 0; i < this->modelVisible.size(); i++) {
+            // 遮挡剔除使用的是上一帧的层级深度，摄像机快速移动时刚露出来的模型可能会晚一帧出现
+            if (this->modelVisible[i] && this->modelInfos[i].model->bounds.valid() && this->hiZBuffer.isOccluded(this->frame->worldBounds[i])) {
+                this->modelVisible[i] = false;
+                culledCount++;
+            }
+        }
+    }
+
+    // 开启性能分析时，剔除的模型数变化了才输出
+    if (window->profiler && culledCount != this->lastCulledCount)
+        cout << "culled models: " << culledCount << "/" << this->modelInfos.size() << endl;
+    this->lastCulledCount = culledCount;
+}
+
+void Scene::buildHiZ() {
+    PROFILE_SCOPE("hi-z");
+    this->hiZBuffer.build(this->sceneDepthMap, window->getProjectionMatrix() * window->getViewMatrix(), [this]() { renderQuad(); });
+    this->hiZBuilt = true;
+    // 恢复场景帧缓冲
+    glBindFramebuffer(GL_FRAMEBUFFER, this->sceneFBO);
+    STATS_COUNT(framebufferBinds, 1);
+    glViewport(0, 0, this->SCR_WIDTH, this->SCR_HEIGHT);
+}
+
+void Scene::renderDeferred() {
+    PROFILE_SCOPE("deferred");
+    // 几何阶段：把表面属性写入G-buffer，深度直接写入和场景帧缓冲共用的深度贴图
+    {
+        PROFILE_SCOPE("gbuffer");
+        glBindFramebuffer(GL_FRAMEBUFFER, this->gBufferFBO);
+        STATS_COUNT(framebufferBinds, 1);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        this->gBufferShader.use();
+        this->gBufferShader.setMat4("viewProjection", window->getProjectionMatrix() * window->getViewMatrix());
+        // 漫反射颜色是线性的，写入sRGB格式时先编码，读取时自动解码，暗部不会出现色带
+        glEnable(GL_FRAMEBUFFER_SRGB);
+        renderScene(this->gBufferShader, true, true);
+        glDisable(GL_FRAMEBUFFER_SRGB);
+    }
+
+    // 光照阶段：对每个像素只计算一次光照
+    PROFILE_SCOPE("deferred lighting");
+    glBindFramebuffer(GL_FRAMEBUFFER, this->sceneFBO);
+    STATS_COUNT(framebufferBinds, 1);
+    // 全屏四边形不需要深度测试，也不能覆盖G-buffer写入的深度
+    glDisable(GL_DEPTH_TEST);
+    this->deferredShader.use();
+    setupSceneUniform(this->deferredShader);
+    this->deferredShader.setMat4("inverseViewProjection", glm::inverse(window->getProjectionMatrix() * window->getViewMatrix()));
+    // 绑定G-buffer
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, this->gAlbedoSpecMap);
+    STATS_COUNT(textureBinds, 1);
+    this->deferredShader.setInt("gAlbedoSpec", 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, this->gNormalShininessMap);
+    STATS_COUNT(textureBinds, 1);
+    this->deferredShader.setInt("gNormalShininess", 1);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, this->sceneDepthMap);
+    STATS_COUNT(textureBinds, 1);
+    this->deferredShader.setInt("gDepth", 2);
+    // 绑定阴影贴图
+    bindShadowMaps(this->deferredShader, 3);
+    renderQuad();
+    glEnable(GL_DEPTH_TEST);
+}
+
+void Scene::present() {
+    PROFILE_SCOPE("post process");
+    // 泛光、曝光、色调映射和sRGB转换，直接输出到默认帧缓冲
+    this->postProcess.apply(this->sceneColorMap, window->bloom, window->getOutputFramebuffer(), [this]() { renderQuad(); });
+}
+
+
+std::vector<Scene::ModelInfo> Scene::loadScene(const std::string& fileName, TransformStore& transforms) {
     std::vector<ModelInfo> models;
     try {
         YAML::Node scene = YAML::LoadFile(fileName);
         if (scene["models"]) {
             for (size_t i = 0; i < scene["models"].size(); ++i) {
                 ModelInfo info;
+                glm::vec3 position, rotation, scale;
                 info.path = scene["models"][i]["path"].as<std::string>();
-                info.position.x = scene["models"][i]["position"]["x"].as<float>();
-                info.position.y = scene["models"][i]["position"]["y"].as<float>();
-                info.position.z = scene["models"][i]["position"]["z"].as<float>();
-                info.rotation.x = scene["models"][i]["rotation"]["x"].as<float>();
-                info.rotation.y = scene["models"][i]["rotation"]["y"].as<float>();
-                info.rotation.z = scene["models"][i]["rotation"]["z"].as<float>();
-                info.scale.x = scene["models"][i]["scale"]["x"].as<float>();
-                info.scale.y = scene["models"][i]["scale"]["y"].as<float>();
-                info.scale.z = scene["models"][i]["scale"]["z"].as<float>();
-                models.push_back(info);
+                position.x = scene["models"][i]["position"]["x"].as<float>();
+                position.y = scene["models"][i]["position"]["y"].as<float>();
+                position.z = scene["models"][i]["position"]["z"].as<float>();
+                rotation.x = scene["models"][i]["rotation"]["x"].as<float>();
+                rotation.y = scene["models"][i]["rotation"]["y"].as<float>();
+                rotation.z = scene["models"][i]["rotation"]["z"].as<float>();
+                scale.x = scene["models"][i]["scale"]["x"].as<float>();
+                scale.y = scene["models"][i]["scale"]["y"].as<float>();
+                scale.z = scene["models"][i]["scale"]["z"].as<float>();
                 // 打印模型信息
                 std::cout << info.path << std::endl;
-                std::cout << info.position.x << " " << info.position.y << " " << info.position.z << std::endl;
-                std::cout << info.rotation.x << " " << info.rotation.y << " " << info.rotation.z << std::endl;
-                std::cout << info.scale.x << " " << info.scale.y << " " << info.scale.z << std::endl;
+                std::cout << position.x << " " << position.y << " " << position.z << std::endl;
+                std::cout << rotation.x << " " << rotation.y << " " << rotation.z << std::endl;
+                std::cout << scale.x << " " << scale.y << " " << scale.z << std::endl;
+
+                // 静态旋转依次绕x、y、z轴
+                info.restRotation = glm::angleAxis(glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f))
+                    * glm::angleAxis(glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f))
+                    * glm::angleAxis(glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+                // 自转的模型：先把自转轴倾斜tilt度（绕z轴），再绕倾斜后的y轴转动
+                if (YAML::Node spin = scene["models"][i]["spin"]) {
+                    info.spinning = true;
+                    float tilt = spin["tilt"] ? spin["tilt"].as<float>() : 0.0f;
+                    info.restRotation = info.restRotation * glm::angleAxis(glm::radians(tilt), glm::vec3(0.0f, 0.0f, 1.0f));
+                }
+                // 父模型是配置中排在前面的模型的下标，变换相对于父模型
+                int parent = TransformStore::NO_PARENT;
+                if (scene["models"][i]["parent"]) {
+                    parent = scene["models"][i]["parent"].as<int>();
+                    if (parent < 0 || parent >= (int)models.size()) {
+                        std::cerr << "Warning: parent " << parent << " of " << info.path << " must be an earlier model, ignored" << std::endl;
+                        parent = TransformStore::NO_PARENT;
+                    }
+                }
+                info.transform = transforms.add(parent, position, info.restRotation, scale);
+                models.push_back(std::move(info));
             }
         }
     } catch (const YAML::BadFile& e) {
@@ -188,23 +514,224 @@ std::vector<Scene::PointLight> Scene::loadPointLights(const std::string& fileNam
                 pointLights.push_back(light);
             }
         }
+        // 基准测试：额外生成指定数量的随机点光源
+        if (scene["benchmark"] && scene["benchmark"]["count"]) {
+            int count = scene["benchmark"]["count"].as<int>();
+            unsigned int seed = scene["benchmark"]["seed"] ? scene["benchmark"]["seed"].as<unsigned int>() : 1;
+            if (count > 0) {
+                vector<PointLight> generated = generateBenchmarkPointLights(count, seed);
+                pointLights.insert(pointLights.end(), generated.begin(), generated.end());
+                std::cout << "benchmark: generated " << count << " point lights" << std::endl;
+            }
+        }
     } catch (const YAML::Exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
     }
     return pointLights;
 }
 
+std::vector<Scene::PointLight> Scene::generateBenchmarkPointLights(int count, unsigned int seed) {
+    std::vector<PointLight> pointLights;
+    std::mt19937 rng(seed);
+    // 在桌面上方、地球仪周围的范围内随机分布
+    std::uniform_real_distribution<float> horizontal(-40.0f, 40.0f);
+    std::uniform_real_distribution<float> vertical(-25.0f, 20.0f);
+    std::uniform_real_distribution<float> color(0.2f, 1.0f);
+    for (int i = 0; i < count; ++i) {
+        PointLight light;
+        light.position = glm::vec3(horizontal(rng), vertical(rng), horizontal(rng));
+        // 影响半径大约为15个单位
+        light.constant = 1.0f;
+        light.linear = 0.35f;
+        light.quadratic = 0.44f;
+        light.ambient = glm::vec3(0.0f);
+        light.diffuse = glm::vec3(0.8f);
+        light.specular = glm::vec3(1.0f);
+        light.lightColor = glm::vec3(color(rng), color(rng), color(rng));
+        pointLights.push_back(light);
+    }
+    return pointLights;
+}
+
+CpuLightmapBaker::Settings Scene::cpuBakerSettings() {
+    // 使用默认参数，修改参数时旧的缓存因为键不同而失效
+    return CpuLightmapBaker::Settings();
+}
+
+std::unique_ptr<CpuLightmapBaker> Scene::createCpuBaker(const vector<DirectionalLight>& directionalLights, const vector<PointLight>& pointLights) {
+    vector<CpuLightmapBaker::DirectionalLight> bakeDirectionalLights;
+    for (const auto& light : directionalLights)
+        bakeDirectionalLights.push_back({ light.direction, light.diffuse * light.lightColor });
+    vector<CpuLightmapBaker::PointLight> bakePointLights;
+    for (const auto& light : pointLights)
+        bakePointLights.push_back({ light.position, light.diffuse * light.lightColor, light.constant, light.linear, light.quadratic });
+    std::unique_ptr<CpuLightmapBaker> baker(new CpuLightmapBaker(cpuBakerSettings()));
+    baker->setLights(bakeDirectionalLights, bakePointLights);
+    return baker;
+}
+
+bool Scene::bakeLightMapOffline(const std::string& output) {
+    // 和场景构造函数读取相同的配置文件，模型只导入几何体，变换层级只用来计算模型矩阵
+    TransformStore transforms;
+    vector<ModelInfo> modelInfos = loadScene("config/scene.yaml", transforms);
+    transforms.update();
+    vector<vector<LightmapMesh>> meshes(modelInfos.size());
+    vector<vector<LightmapMesh*>> objectMeshes(modelInfos.size());
+    for (size_t i = 0; i < modelInfos.size(); i++) {
+        Model::loadGeometry(modelInfos[i].path, meshes[i]);
+        for (LightmapMesh& mesh : meshes[i])
+            objectMeshes[i].push_back(&mesh);
+    }
+    vector<LightmapRegion> regions;
+    packLightmapAtlas(objectMeshes, lightMapAtlasSettings(), regions);
+    // 和场景中的模型生成相同的烘焙几何体，缓存的键才能和窗口程序的相同
+    for (size_t i = 0; i < modelInfos.size(); i++) {
+        for (const LightmapMesh& mesh : meshes[i])
+            appendLightmapGeometry(mesh, modelInfos[i].lightVertices, modelInfos[i].lightIndices);
+        if (i < regions.size())
+            modelInfos[i].lightMapRegion = regions[i];
+    }
+    vector<DirectionalLight> directionalLights = loadDirectionalLights("config/directionalLights.yaml");
+    vector<PointLight> pointLights = loadPointLights("config/pointLights.yaml");
+    vector<glm::mat4> restModels;
+    for (const ModelInfo& modelInfo : modelInfos)
+        restModels.push_back(transforms.getWorldMatrix(modelInfo.transform));
+    LightmapCacheKey key = lightMapCacheKey(modelInfos, restModels, directionalLights, pointLights, true);
+
+    // 每个模型变换到世界空间，合并后建立层级包围盒，再分别烘焙自己的区域
+    vector<vector<vertex_t>> vertices(modelInfos.size());
+    vector<vertex_t> sceneVertices;
+    vector<unsigned int> sceneIndices;
+    int rows = 0;
+    for (size_t i = 0; i < modelInfos.size(); i++) {
+        const vector<unsigned int>& indices = modelInfos[i].lightIndices;
+        const glm::mat4& model = transforms.getWorldMatrix(modelInfos[i].transform);
+        vertices[i] = modelInfos[i].lightVertices;
+        for (vertex_t& vertex : vertices[i]) {
+            glm::vec4 p = model * glm::vec4(vertex.p[0], vertex.p[1], vertex.p[2], 1.0f);
+            vertex.p[0] = p.x;
+            vertex.p[1] = p.y;
+            vertex.p[2] = p.z;
+        }
+        unsigned int baseVertex = (unsigned int)sceneVertices.size();
+        sceneVertices.insert(sceneVertices.end(), vertices[i].begin(), vertices[i].end());
+        for (unsigned int index : indices)
+            sceneIndices.push_back(baseVertex + index);
+        rows += modelInfos[i].lightMapRegion.height;
+    }
+    if (sceneIndices.empty()) {
+        std::cerr << "Error: nothing to bake" << std::endl;
+        return false;
+    }
+
+    std::unique_ptr<CpuLightmapBaker> baker = createCpuBaker(directionalLights, pointLights);
+    // 断点和窗口程序的CPU烘焙通用，模型矩阵只记录参与烘焙的模型的
+    LightmapCheckpoint checkpoint;
+    checkpoint.key = key;
+    checkpoint.cpu = true;
+    checkpoint.width = LIGHT_MAP_WIDTH;
+    checkpoint.height = LIGHT_MAP_HEIGHT;
+    for (size_t i = 0; i < modelInfos.size(); i++) {
+        if (!modelInfos[i].lightVertices.empty() && modelInfos[i].lightIndices.size() >= 3)
+            checkpoint.models.push_back(transforms.getWorldMatrix(modelInfos[i].transform));
+    }
+    vector<float> data((size_t)LIGHT_MAP_WIDTH * LIGHT_MAP_HEIGHT * 4, 0.0f);
+    vector<char> resumedRows;
+    LightmapCheckpoint resumed;
+    if (resumed.load(LIGHT_MAP_CHECKPOINT, key) && resumed.cpu && resumed.width == (int)LIGHT_MAP_WIDTH
+        && resumed.height == (int)LIGHT_MAP_HEIGHT && resumed.models.size() == checkpoint.models.size()) {
+        printf("Resuming lightmap bake from %s\n", LIGHT_MAP_CHECKPOINT);
+        data.swap(resumed.lightmap);
+        resumedRows.swap(resumed.finishedRows);
+    }
+    auto start = std::chrono::steady_clock::now();
+    // 烘焙在任务系统上执行，每个模型一个任务，当前线程每秒输出一次进度
+    JobSystem& jobs = JobSystem::instance();
+    JobSystem::JobHandle sceneJob = jobs.schedule([&]() {
+        baker->setScene(sceneVertices, sceneIndices, rows);
+        baker->restoreFinishedRows(resumedRows);
+        });
+    vector<JobSystem::JobHandle> objectJobs;
+    vector<LightmapRegion> objectRegions;
+    size_t firstRow = 0;
+    for (size_t i = 0; i < modelInfos.size(); i++) {
+        objectRegions.push_back(modelInfos[i].lightMapRegion);
+        objectJobs.push_back(jobs.schedule([&, i, firstRow]() {
+            baker->bakeObject(vertices[i], modelInfos[i].lightIndices, LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT, data.data(), modelInfos[i].lightMapRegion, firstRow);
+            }, { sceneJob }));
+        firstRow += modelInfos[i].lightMapRegion.height;
+    }
+    JobSystem::JobHandle job = jobs.schedule([]() {}, objectJobs);
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+    while (!job->finished) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        printf("\rbaking %6.2f%%", baker->getProgress() * 100.0f);
+        fflush(stdout);
+        // 定期保存断点，中途退出后再次运行时跳过已经完成的行
+        if (sceneJob->finished && std::chrono::duration<double>(std::chrono::steady_clock::now() - lastCheckpoint).count() >= LIGHT_MAP_CHECKPOINT_INTERVAL) {
+            lastCheckpoint = std::chrono::steady_clock::now();
+            // 烘焙任务还在写入光照贴图，只复制已经完成的行
+            checkpoint.finishedRows = baker->getFinishedRows();
+            CpuLightmapBaker::copyFinishedRows(data.data(), LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT, objectRegions, checkpoint.finishedRows, checkpoint.lightmap);
+            checkpoint.save(LIGHT_MAP_CHECKPOINT);
+        }
+    }
+    jobs.wait(job);
+    std::remove(LIGHT_MAP_CHECKPOINT);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("\rFinished baking %zu triangles in %zu objects on the cpu in %.1f s.\n", sceneIndices.size() / 3, modelInfos.size(), seconds);
+    // 用世界空间的位置、法线和图块引导去噪
+    vector<const vector<vertex_t>*> guideVertices;
+    vector<const vector<unsigned int>*> guideIndices;
+    vector<LightmapRegion> guideRegions;
+    for (size_t i = 0; i < modelInfos.size(); i++) {
+        guideVertices.push_back(&vertices[i]);
+        guideIndices.push_back(&modelInfos[i].lightIndices);
+        guideRegions.push_back(modelInfos[i].lightMapRegion);
+    }
+    LightmapGuide guide;
+    LightmapBaker::buildGuide(guideVertices, guideIndices, guideRegions, LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT, guide);
+    LightmapBaker::postProcess(data, LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT, output, &guide);
+    // 同时写入缓存，窗口程序使用CPU烘焙时可以直接加载
+    LightmapCache cache;
+    cache.encode(data.data(), LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT);
+    if (cache.save(LIGHT_MAP_CACHE, key))
+        printf("Saved %s\n", LIGHT_MAP_CACHE);
+    // 光照探针用同一个烘焙器烘焙，窗口程序开启光线烘焙时可以直接加载
+    LightProbeGrid probes;
+    if (bakeLightProbes(modelInfos, restModels, *baker, probes) && probes.save(LIGHT_PROBE_CACHE, lightProbeCacheKey(key)))
+        printf("Saved %s\n", LIGHT_PROBE_CACHE);
+    return true;
+}
+
+void Scene::uploadPointLights() {
+    vector<LightCluster::GpuPointLight> lights;
+    for (const auto& light : this->pointLights) {
+        LightCluster::GpuPointLight gpuLight;
+        glm::vec3 diffuse = light.diffuse * light.lightColor;
+        float maxIntensity = std::max(std::max(diffuse.r, diffuse.g), diffuse.b);
+        float radius = LightCluster::computeRadius(light.constant, light.linear, light.quadratic, maxIntensity);
+        gpuLight.positionRadius = glm::vec4(light.position, radius);
+        gpuLight.ambientConstant = glm::vec4(light.ambient * light.lightColor, light.constant);
+        gpuLight.diffuseLinear = glm::vec4(diffuse, light.linear);
+        gpuLight.specularQuadratic = glm::vec4(light.specular * light.lightColor, light.quadratic);
+        lights.push_back(gpuLight);
+    }
+    this->lightCluster.setLights(lights);
+}
+
 void Scene::loadDirectionLightDepthMap() {
     for (int i = 0; i < this->numDirectionalLights; ++i) {
         // 创建帧缓冲对象
-        glGenFramebuffers(1, &this->directionLightDepthMapFBOs[i]);
+        this->directionLightDepthMapFBOs[i].create("shadow map", "Scene");
         // 深度贴图
         // 创建深度贴图
-        glGenTextures(1, &this->directionLightDepthMaps[i]);
+        this->directionLightDepthMaps[i].create("shadow map", "Scene");
         // 绑定深度纹理
         glBindTexture(GL_TEXTURE_2D, this->directionLightDepthMaps[i]);
         // 只关注深度值，设置为GL_DEPTH_COMPONENT
         glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        this->directionLightDepthMaps[i].setSize(GpuMemoryLedger::textureBytes(GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT), GL_DEPTH_COMPONENT);
         // 设置纹理过滤方式
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -221,10 +748,11 @@ void Scene::loadDirectionLightDepthMap() {
         if (SHADOW_ALGORITHM == 3) {
             // 深度的均值和方差贴图
             // 创建深度贴图
-            glGenTextures(1, &this->directionLightDepthMeanVarMaps[i]);
+            this->directionLightDepthMeanVarMaps[i].create("shadow map", "Scene");
             // 绑定深度纹理
             glBindTexture(GL_TEXTURE_2D, this->directionLightDepthMeanVarMaps[i]);
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_RG, GL_FLOAT, NULL);
+            this->directionLightDepthMeanVarMaps[i].setSize(GpuMemoryLedger::textureBytes(GL_RG32F, SHADOW_WIDTH, SHADOW_HEIGHT), GL_RG32F);
             // 设置纹理过滤方式
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -253,10 +781,11 @@ void Scene::loadDirectionLightDepthMap() {
 
     if (SHADOW_ALGORITHM == 3) {
         for (int i = 0; i < this->numDirectionalLights; ++i) {
-            glGenFramebuffers(1, &this->d_d2_filter_FBO[i * 2]);
-            glGenTextures(1, &this->d_d2_filter_maps[i * 2]);
+            this->d_d2_filter_FBO[i * 2].create("shadow map", "Scene");
+            this->d_d2_filter_maps[i * 2].create("shadow map", "Scene");
             glBindTexture(GL_TEXTURE_2D, this->d_d2_filter_maps[i * 2]);
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_RG, GL_FLOAT, NULL);
+            this->d_d2_filter_maps[i * 2].setSize(GpuMemoryLedger::textureBytes(GL_RG32F, SHADOW_WIDTH, SHADOW_HEIGHT), GL_RG32F);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -267,10 +796,11 @@ void Scene::loadDirectionLightDepthMap() {
                 std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
             }
 
-            glGenFramebuffers(1, &this->d_d2_filter_FBO[i * 2 + 1]);
-            glGenTextures(1, &this->d_d2_filter_maps[i * 2 + 1]);
+            this->d_d2_filter_FBO[i * 2 + 1].create("shadow map", "Scene");
+            this->d_d2_filter_maps[i * 2 + 1].create("shadow map", "Scene");
             glBindTexture(GL_TEXTURE_2D, this->d_d2_filter_maps[i * 2 + 1]);
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_RG, GL_FLOAT, NULL);
+            this->d_d2_filter_maps[i * 2 + 1].setSize(GpuMemoryLedger::textureBytes(GL_RG32F, SHADOW_WIDTH, SHADOW_HEIGHT), GL_RG32F);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -285,7 +815,67 @@ void Scene::loadDirectionLightDepthMap() {
     }
 }
 
+void Scene::loadSceneFramebuffer() {
+    // 场景颜色贴图，保存线性空间的HDR颜色，后处理时再做色调映射和sRGB转换
+    this->sceneColorMap.create("render target", "Scene");
+    glBindTexture(GL_TEXTURE_2D, this->sceneColorMap);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
+    this->sceneColorMap.setSize(GpuMemoryLedger::textureBytes(GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT), GL_RGBA16F);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // 场景深度贴图
+    this->sceneDepthMap.create("render target", "Scene");
+    glBindTexture(GL_TEXTURE_2D, this->sceneDepthMap);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, SCR_WIDTH, SCR_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    this->sceneDepthMap.setSize(GpuMemoryLedger::textureBytes(GL_DEPTH_COMPONENT24, SCR_WIDTH, SCR_HEIGHT), GL_DEPTH_COMPONENT24);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    this->sceneFBO.create("render target", "Scene");
+    glBindFramebuffer(GL_FRAMEBUFFER, this->sceneFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->sceneColorMap, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->sceneDepthMap, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR::FRAMEBUFFER:: Scene framebuffer is not complete!" << std::endl;
+    }
+
+    // G-buffer：漫反射颜色和镜面反射强度
+    // 漫反射颜色和漫反射贴图一样用sRGB编码保存，8位也有足够的暗部精度；镜面反射强度在alpha中，不受影响
+    this->gAlbedoSpecMap.create("render target", "Scene");
+    glBindTexture(GL_TEXTURE_2D, this->gAlbedoSpecMap);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    this->gAlbedoSpecMap.setSize(GpuMemoryLedger::textureBytes(GL_SRGB8_ALPHA8, SCR_WIDTH, SCR_HEIGHT), GL_SRGB8_ALPHA8);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    // G-buffer：八面体编码的法线（每个分量10位）、反射光泽度
+    this->gNormalShininessMap.create("render target", "Scene");
+    glBindTexture(GL_TEXTURE_2D, this->gNormalShininessMap);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, NULL);
+    this->gNormalShininessMap.setSize(GpuMemoryLedger::textureBytes(GL_RGB10_A2, SCR_WIDTH, SCR_HEIGHT), GL_RGB10_A2);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    this->gBufferFBO.create("render target", "Scene");
+    glBindFramebuffer(GL_FRAMEBUFFER, this->gBufferFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->gAlbedoSpecMap, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, this->gNormalShininessMap, 0);
+    // 深度和场景帧缓冲共用，延迟渲染之后天空盒可以直接做深度测试
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->sceneDepthMap, 0);
+    GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR::FRAMEBUFFER:: G-buffer is not complete!" << std::endl;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
 void Scene::renderSceneToDepthMap() {
+    PROFILE_SCOPE("shadow maps");
     // 解决悬浮(pater panning)的阴影失真问题
     // 告诉opengl剔除正面
     glCullFace(GL_FRONT);
@@ -299,6 +889,7 @@ void Scene::renderSceneToDepthMap() {
     glm::mat4 lightView;
     // 计算阴影矩阵
     for (int i = 0; i < this->numDirectionalLights; ++i) {
+        PROFILE_SCOPE("shadow light " + std::to_string(i));
         lightView = glm::lookAt(-directionalLights[i].direction * 1.0f, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
         this->directionalLights[i].lightSpaceMatrix = lightProjection * lightView;
         // DEBUG
@@ -317,6 +908,7 @@ void Scene::renderSceneToDepthMap() {
 
         // 绑定帧缓冲
         glBindFramebuffer(GL_FRAMEBUFFER, this->directionLightDepthMapFBOs[i]);
+        STATS_COUNT(framebufferBinds, 1);
 
         if (SHADOW_ALGORITHM == 3) {
             glClearColor(1.0f, 1.0f, 0.0f, 1.0f); // 注意这里的初始化, 1.0f 深度最大值
@@ -330,8 +922,10 @@ void Scene::renderSceneToDepthMap() {
         renderScene(this->directionLightShadowShader, false);
 
         if (SHADOW_ALGORITHM == 3) {
+            PROFILE_SCOPE("vsm blur");
             // 绑定均值和方差帧缓冲对象 pass2
             glBindFramebuffer(GL_FRAMEBUFFER, this->d_d2_filter_FBO[i * 2]);
+            STATS_COUNT(framebufferBinds, 1);
             glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
             // 使用均值和方差计算着色器
@@ -341,10 +935,12 @@ void Scene::renderSceneToDepthMap() {
             // 激活深度贴图
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_2D, this->directionLightDepthMeanVarMaps[i]);
+            STATS_COUNT(textureBinds, 1);
             renderQuad();
 
             // 绑定均值和方差帧缓冲对象 pass3
             glBindFramebuffer(GL_FRAMEBUFFER, this->d_d2_filter_FBO[i * 2 + 1]);
+            STATS_COUNT(framebufferBinds, 1);
             glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
             // 使用均值和方差计算着色器
@@ -354,50 +950,48 @@ void Scene::renderSceneToDepthMap() {
             // 激活深度贴图
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_2D, this->d_d2_filter_maps[i * 2]);
+            STATS_COUNT(textureBinds, 1);
             renderQuad();
         }
     }
 
     // 解绑帧缓冲对象
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    STATS_COUNT(framebufferBinds, 1);
     // 恢复剔除背面
     glCullFace(GL_BACK);
 }
 
-void Scene::renderScene(Shader& shader, bool isActiveTexture) {
+void Scene::renderScene(Shader& shader, bool isActiveTexture, bool cameraCulling) {
     shader.use();
-    // 绘制每个模型
-    for (const auto& modelInfo : modelInfos) {
-        // 获取当前时间（s）
-        float currentTime = glfwGetTime();
-        // 根据时间计算旋转角度，10.0f是速度因子
-        float angle = currentTime * 10.0f;
-
-        // 初始化模型矩阵
-        glm::mat4 model = glm::mat4(1.0f);
-        // 平移模型
-        model = glm::translate(model, modelInfo.position);
-        // 静态旋转
-        model = glm::rotate(model, glm::radians(modelInfo.rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(modelInfo.rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(modelInfo.rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-        if (modelInfo.path.find("sphere.obj") != std::string::npos) {
-            // 添加倾斜23°26'，因为支架的模型本来就是倾斜的，所以不用再倾斜，只需要调整球体即可
-            float tiltAngle = 23.433f;
-            model = glm::rotate(model, glm::radians(tiltAngle), glm::vec3(0.0f, 0.0f, 1.0f));
-
-            // 动态旋转（绕y轴旋转
-            if (!BAKE)
-                model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-        }
-        // 缩放模型
-        model = glm::scale(model, modelInfo.scale);
+    // 动态物体（自转的模型）不能使用静态的光照贴图，有光照探针时改用探针，只在切换时设置uniform
+    bool probes = false;
+    // 按从近到远的顺序绘制每个模型
+    for (size_t index : this->frame->drawOrder) {
+        // 对摄像机不可见的模型不参与摄像机视角的渲染，但仍然可能投射阴影
+        if (cameraCulling && !this->modelVisible[index])
+            continue;
+        const ModelInfo& modelInfo = this->modelInfos[index];
+
         // 传递模型矩阵给着色器
-        shader.setMat4("model", model);
+        shader.setMat4("model", this->frame->modelMatrices[index]);
+        if (BAKE && isActiveTexture) {
+            bool useProbes = modelInfo.spinning && !this->lightProbes.empty();
+            if (useProbes != probes) {
+                shader.setBool("useLightMap", !useProbes);
+                shader.setBool("useLightProbes", useProbes);
+                probes = useProbes;
+            }
+        }
 
         // 绘制模型
         modelInfo.model->draw(shader, this->directionLightDepthMaps, isActiveTexture, this->d_d2_filter_maps, SHADOW_ALGORITHM == 3, BAKE, lightMap);
     }
+    // 恢复，烘焙时渲染半球也使用这个着色器，所有模型都使用光照贴图
+    if (probes) {
+        shader.setBool("useLightMap", true);
+        shader.setBool("useLightProbes", false);
+    }
 }
 
 void Scene::processInputMoveDirLight() {
@@ -405,16 +999,16 @@ void Scene::processInputMoveDirLight() {
     float step = 0.01f;
 
     // 监听按键事件
-    if (glfwGetKey(this->window->window, GLFW_KEY_UP) == GLFW_PRESS) {
+    if (window->isKeyPressed(GLFW_KEY_UP)) {
         directionalLights[0].direction.y -= step;
     }
-    if (glfwGetKey(this->window->window, GLFW_KEY_DOWN) == GLFW_PRESS) {
+    if (window->isKeyPressed(GLFW_KEY_DOWN)) {
         directionalLights[0].direction.y += step;
     }
-    if (glfwGetKey(this->window->window, GLFW_KEY_LEFT) == GLFW_PRESS) {
+    if (window->isKeyPressed(GLFW_KEY_LEFT)) {
         directionalLights[0].direction.z -= step;
     }
-    if (glfwGetKey(this->window->window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
+    if (window->isKeyPressed(GLFW_KEY_RIGHT)) {
         directionalLights[0].direction.z += step;
     }
 
@@ -471,15 +1065,16 @@ void Scene::renderQuad() {
              1.0f,  1.0f, 0.0f,  1.0f, 1.0f, // 右上角
         };
         // 生成VAO
-        glGenVertexArrays(1, &this->quadVAO);
+        this->quadVAO.create("mesh", "Scene");
         // 生成VBO
-        glGenBuffers(1, &this->quadVBO);
+        this->quadVBO.create("mesh", "Scene");
         // 将VAO绑定到当前上下文
         glBindVertexArray(this->quadVAO);
         // 将VBO绑定到GL_ARRAY_BUFFER
         glBindBuffer(GL_ARRAY_BUFFER, this->quadVBO);
         // 将顶点数据复制到VBO
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+        this->quadVBO.setSize(sizeof(quadVertices));
         // 设置顶点属性指针
         // 位置属性
         glEnableVertexAttribArray(0);
@@ -495,67 +1090,78 @@ void Scene::renderQuad() {
 
     // 绘制四边形
     glBindVertexArray(this->quadVAO);
+    STATS_COUNT(vaoBinds, 1);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    STATS_COUNT(drawCalls, 1);
+    STATS_COUNT(triangles, 2);
     glBindVertexArray(0);
 }
 
-void Scene::setupSceneUniform() {
+void Scene::bindShadowMaps(Shader& shader, unsigned int firstUnit) {
+    for (int i = 0; i < this->numDirectionalLights; i++) {
+        std::string number = std::to_string(i);
+        glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+        if (SHADOW_ALGORITHM == 3) {
+            // VSM使用模糊后的均值和方差贴图
+            glBindTexture(GL_TEXTURE_2D, this->d_d2_filter_maps[i * 2 + 1]);
+            STATS_COUNT(textureBinds, 1);
+            shader.setInt("directionalLights[" + number + "].d_d2_filter", firstUnit + i);
+        }
+        else {
+            glBindTexture(GL_TEXTURE_2D, this->directionLightDepthMaps[i]);
+            STATS_COUNT(textureBinds, 1);
+            shader.setInt("directionalLights[" + number + "].shadowMap", firstUnit + i);
+        }
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void Scene::setupSceneUniform(Shader& shader) {
     // -- 场景着色器配置 -- 
-    this->shader.use();
+    shader.use();
     // 传递方向光数量给着色器
-    this->shader.setInt("numDirectionalLights", this->numDirectionalLights);
+    shader.setInt("numDirectionalLights", this->numDirectionalLights);
     // 传递每个方向光的属性给着色器
     for (auto i = 0; i < this->numDirectionalLights; i++) {
         std::string number = std::to_string(i);
-        this->shader.setVec3("directionalLights[" + number + "].direction", this->directionalLights[i].direction);
-        this->shader.setVec3("directionalLights[" + number + "].ambient", this->directionalLights[i].ambient);
-        this->shader.setVec3("directionalLights[" + number + "].diffuse", this->directionalLights[i].diffuse);
-        this->shader.setVec3("directionalLights[" + number + "].specular", this->directionalLights[i].specular);
-        this->shader.setVec3("directionalLights[" + number + "].lightColor", this->directionalLights[i].lightColor);
+        shader.setVec3("directionalLights[" + number + "].direction", this->directionalLights[i].direction);
+        shader.setVec3("directionalLights[" + number + "].ambient", this->directionalLights[i].ambient);
+        shader.setVec3("directionalLights[" + number + "].diffuse", this->directionalLights[i].diffuse);
+        shader.setVec3("directionalLights[" + number + "].specular", this->directionalLights[i].specular);
+        shader.setVec3("directionalLights[" + number + "].lightColor", this->directionalLights[i].lightColor);
         // 将阴影矩阵传递给着色器
-        this->shader.setMat4("directionalLights[" + number + "].lightSpaceMatrix", this->directionalLights[i].lightSpaceMatrix);
-    }
-    // 传递点光源数量给着色器
-    this->shader.setInt("numPointLights", pointLights.size());
-    // 传递每个点光源的属性给着色器
-    for (auto i = 0; i < pointLights.size(); i++) {
-        std::string number = std::to_string(i);
-        this->shader.setVec3("pointLights[" + number + "].position", pointLights[i].position);
-        this->shader.setVec3("pointLights[" + number + "].ambient", pointLights[i].ambient);
-        this->shader.setVec3("pointLights[" + number + "].diffuse", pointLights[i].diffuse);
-        this->shader.setVec3("pointLights[" + number + "].specular", pointLights[i].specular);
-        this->shader.setFloat("pointLights[" + number + "].constant", pointLights[i].constant);
-        this->shader.setFloat("pointLights[" + number + "].linear", pointLights[i].linear);
-        this->shader.setFloat("pointLights[" + number + "].quadratic", pointLights[i].quadratic);
-        this->shader.setVec3("pointLights[" + number + "].lightColor", pointLights[i].lightColor);
+        shader.setMat4("directionalLights[" + number + "].lightSpaceMatrix", this->directionalLights[i].lightSpaceMatrix);
     }
+    // 按当前摄像机对点光源做分簇剔除，并绑定簇数据
+    PROFILE_SCOPE("light clusters");
+    this->lightCluster.update(window->getViewMatrix(), window->getProjectionMatrix(), this->SCR_WIDTH, this->SCR_HEIGHT);
+    this->lightCluster.bind(shader);
     // 当按下键1时，切换Blinn-Phong着色模式(将blinn传递给着色器)
     if (window->blinn) {
-        this->shader.setInt("blinn", 1);
+        shader.setInt("blinn", 1);
     }
     else {
-        this->shader.setInt("blinn", 0);
+        shader.setInt("blinn", 0);
     }
-    // 传递投影矩阵和视图矩阵给着色器
-    this->shader.setMat4("projection", window->getProjectionMatrix());
-    this->shader.setMat4("view", window->getViewMatrix());
-    auto camera = window->camera;
+    // 传递视图投影矩阵和视图矩阵给着色器
+    shader.setMat4("viewProjection", window->getProjectionMatrix() * window->getViewMatrix());
+    shader.setMat4("view", window->getViewMatrix());
     // 传递摄像机位置给着色器
-    this->shader.setVec3("viewPos", camera.Position);
+    shader.setVec3("viewPos", this->frame->cameraPosition);
     // 传递光源宽度给着色器
-    this->shader.setFloat("lightWidth", this->lightWidth);
+    shader.setFloat("lightWidth", this->lightWidth);
     // 将PCF采样半径传递给着色器
-    this->shader.setFloat("PCFSampleRadius", this->PCFSampleRadius);
+    shader.setFloat("PCFSampleRadius", this->PCFSampleRadius);
     // 设置阴影映射算法类型
-    this->shader.setInt("shadowMapType", SHADOW_ALGORITHM);
+    shader.setInt("shadowMapType", SHADOW_ALGORITHM);
     // 将近平面和远平面传递给着色器
-    this->shader.setFloat("near_plane", NEAR_PLANE);
-    this->shader.setFloat("far_plane", FAR_PLANE);
+    shader.setFloat("near_plane", NEAR_PLANE);
+    shader.setFloat("far_plane", FAR_PLANE);
 }
 
 void Scene::loadLightMap() {
     // 生成光照贴图
-    glGenTextures(1, &this->lightMap);
+    this->lightMap.create("lightmap", "Scene");
     // 绑定光照贴图
     glBindTexture(GL_TEXTURE_2D, this->lightMap);
     // 设置光照贴图环绕和过滤方式
@@ -566,91 +1172,263 @@ void Scene::loadLightMap() {
 
     unsigned char emissive[] = { 0, 0, 0, 255 };
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, emissive);
-}
+    this->lightMap.setSize(GpuMemoryLedger::textureBytes(GL_RGBA8, 1, 1), GL_RGBA8);
+    if (!BAKE)
+        return;
 
-int Scene::bakeLightMap() {
-    // lmCrate用于创建一个光照映射的上下文
-    lm_context* ctx = lmCreate(
-        512,               // 表示渲染质量或分辨率，通常越大越精细，但也会增加计算开销
-        0.001f, 10.0f,   // 定义了渲染的近裁剪面和远裁剪面
-        1.0f, 1.0f, 1.0f, // 定义环境光颜色
-        5, 0.0001f,         // 定义了层次选择性插值的设置，用于加速计算，2代表迭代次数，0.01f是阈值，用于决定何时进行插值
-        0.0f);            // 用于影响从摄像机到表面距离的计算，帮助光照贴图计算中权衡质量和性能
-
-    // 初始化失败
-    if (!ctx) {
-        fprintf(stderr, "Error: Could not initialize lightmapper.\n");
-        return 0;
-    }
-
-    // 分配内存用于存储光照贴图数据
-    float* data = (float*)calloc(LIGHT_MAP_WIDTH * LIGHT_MAP_HEIGHT * 4, sizeof(float));
-    // 设置目标光照贴图
-    lmSetTargetLightmap(ctx, data, LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT, 4);
-
-    // 设置几何数据
-    // 输出scene->vertices大小
-    printf("verticeCount: %d\n", this->vertices.size());
-    // 输出scene->indexCount大小
-    printf("indexCount: %d\n", this->indices.size());
-    lmSetGeometry(ctx, NULL,                                                                 // no transformation in this example
-        LM_FLOAT, (unsigned char*)(vertices.data()) + offsetof(vertex_t, p), sizeof(vertex_t),
-        LM_NONE, NULL, 0, // 不使用插值法线
-        LM_FLOAT, (unsigned char*)(vertices.data()) + offsetof(vertex_t, t), sizeof(vertex_t),
-        indices.size(), LM_UNSIGNED_SHORT, indices.data());
-
-    int vp[4];
-    float view[16], projection[16];
-    double lastUpdateTime = 0.0;
-    while (lmBegin(ctx, vp, view, projection)) {
-        // 渲染到光照贴图帧缓冲区
-        glViewport(vp[0], vp[1], vp[2], vp[3]);
+    // 在副本上计算世界矩阵，不影响更新线程记录的变化
+    TransformStore rest = this->transforms;
+    rest.update();
+    vector<glm::mat4> models;
+    for (const ModelInfo& modelInfo : this->modelInfos)
+        models.push_back(rest.getWorldMatrix(modelInfo.transform));
 
-        // 将视图矩阵传递给着色器
-        this->shader.use();
-        this->shader.setMat4("view", glm::make_mat4(view));
-        // 将投影矩阵传递给着色器
-        this->shader.setMat4("projection", glm::make_mat4(projection));
+    // 场景和烘焙参数没有变化时直接使用上一次的烘焙结果，按空格烘焙时再用当时的光源重新计算键
+    LightmapCacheKey key = lightMapCacheKey(this->modelInfos, models, this->directionalLights, this->pointLights, CPU_BAKE);
+    this->lightmapBaker.setCache(LIGHT_MAP_CACHE, key);
+    LightmapCache cache;
+    if (cache.load(LIGHT_MAP_CACHE, key)) {
+        LightmapBaker::uploadCache(this->lightMap, cache);
+        printf("Loaded %s, press space to bake again\n", LIGHT_MAP_CACHE);
+    }
 
-        // 渲染场景
-        renderScene(this->shader, false);
+    // 光照探针总是用CPU烘焙器烘焙，键和CPU烘焙的光照贴图相同，再加上探针的参数
+    LightmapCacheKey probeKey = lightProbeCacheKey(lightMapCacheKey(this->modelInfos, models, this->directionalLights, this->pointLights, true));
+    if (this->lightProbes.load(LIGHT_PROBE_CACHE, probeKey)) {
+        uploadLightProbes();
+        printf("Loaded %s\n", LIGHT_PROBE_CACHE);
+        return;
+    }
+    // 没有有效的缓存时不用等按空格，直接用静止时的模型矩阵在后台烘焙，完成之前动态物体按原来的环境光着色
+    startLightProbeBake(models);
+}
+
+LightmapCacheKey Scene::lightProbeCacheKey(const LightmapCacheKey& lightMapKey) {
+    LightmapHasher settings;
+    settings.add(lightMapKey.settings);
+    settings.add((int)LIGHT_PROBE_RESOLUTION);
+    settings.add((unsigned int)LIGHT_PROBE_SAMPLES);
+    settings.add((float)LIGHT_PROBE_BACKFACE_THRESHOLD);
+    LightmapCacheKey key;
+    key.scene = lightMapKey.scene;
+    key.settings = settings.get();
+    return key;
+}
 
-        // 每秒显示进度
-        double time = glfwGetTime();
-        if (time - lastUpdateTime > 1.0) {
-            lastUpdateTime = time;
-            printf("\r%6.2f%%", lmProgress(ctx) * 100.0f);
-            fflush(stdout);
+bool Scene::bakeLightProbes(const vector<ModelInfo>& modelInfos, const vector<glm::mat4>& models, CpuLightmapBaker& baker, LightProbeGrid& grid) {
+    // 动态物体不参与：它的位置每帧都在变化，探针也不应该落在它的内部
+    vector<vertex_t> vertices;
+    vector<unsigned int> indices;
+    AABB bounds;
+    for (size_t i = 0; i < modelInfos.size() && i < models.size(); i++) {
+        if (modelInfos[i].spinning)
+            continue;
+        unsigned int baseVertex = (unsigned int)vertices.size();
+        for (vertex_t vertex : modelInfos[i].lightVertices) {
+            glm::vec4 p = models[i] * glm::vec4(vertex.p[0], vertex.p[1], vertex.p[2], 1.0f);
+            vertex.p[0] = p.x;
+            vertex.p[1] = p.y;
+            vertex.p[2] = p.z;
+            bounds.expand(glm::vec3(p));
+            vertices.push_back(vertex);
         }
+        for (unsigned int index : modelInfos[i].lightIndices)
+            indices.push_back(baseVertex + index);
+    }
+    if (indices.empty())
+        return false;
+
+    auto start = std::chrono::steady_clock::now();
+    baker.setScene(vertices, indices, 0);
+    grid.setup(bounds, LIGHT_PROBE_RESOLUTION);
+    vector<LightProbe> probes;
+    if (!baker.bakeProbes(grid.getPositions(), LIGHT_PROBE_SAMPLES, probes) || !grid.setProbes(std::move(probes)))
+        return false;
+    size_t inside = grid.fixInvalid(LIGHT_PROBE_BACKFACE_THRESHOLD);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Baked %zu light probes (%d x %d x %d, %zu inside geometry) in %.2f s\n", grid.getCount(),
+        grid.getSize().x, grid.getSize().y, grid.getSize().z, inside, seconds);
+    return true;
+}
 
-        lmEnd(ctx);
+void Scene::startLightProbeBake(const vector<glm::mat4>& models) {
+    // 正在进行的烘焙用的是旧的光源，取消后等它结束，不能同时使用bakingProbes
+    if (this->lightProbeJob) {
+        this->lightProbeBaker->cancel();
+        this->lightProbeRebakePending = true;
+        this->pendingProbeModels = models;
+        return;
     }
-    printf("\rFinished baking %d triangles.\n", indices.size() / 3);
+    this->lightProbeBaker = createCpuBaker(this->directionalLights, this->pointLights);
+    this->bakingProbes.reset(new LightProbeGrid());
+    // 光照探针总是用CPU烘焙器烘焙，键和CPU烘焙的光照贴图相同，再加上探针的参数
+    LightmapCacheKey key = lightProbeCacheKey(lightMapCacheKey(this->modelInfos, models, this->directionalLights, this->pointLights, true));
+    // 任务只读取模型的烘焙几何体（打包之后不再修改），模型矩阵复制一份
+    this->lightProbeJob = JobSystem::instance().schedule([this, models, key]() {
+        if (bakeLightProbes(this->modelInfos, models, *this->lightProbeBaker, *this->bakingProbes)
+            && this->bakingProbes->save(LIGHT_PROBE_CACHE, key))
+            printf("Saved %s\n", LIGHT_PROBE_CACHE);
+        });
+}
+
+void Scene::advanceLightProbeBake() {
+    if (!this->lightProbeJob || !this->lightProbeJob->finished)
+        return;
+    JobSystem::instance().wait(this->lightProbeJob);
+    this->lightProbeJob.reset();
+    if (this->lightProbeRebakePending) {
+        // 取消之前可能刚好烘焙完，结果属于旧的光源，不上传
+        this->lightProbeRebakePending = false;
+        this->bakingProbes.reset();
+        startLightProbeBake(this->pendingProbeModels);
+        this->pendingProbeModels.clear();
+        return;
+    }
+    if (!this->bakingProbes->empty()) {
+        std::swap(this->lightProbes, *this->bakingProbes);
+        uploadLightProbes();
+    }
+    this->bakingProbes.reset();
+}
+
+void Scene::uploadLightProbes() {
+    vector<float> texels;
+    this->lightProbes.packTexels(texels);
+    glm::ivec3 size = this->lightProbes.getSize();
+    int depth = size.z * LightProbeGrid::TEXTURE_BLOCKS;
+    if (this->lightProbeTexture.id() == 0)
+        this->lightProbeTexture.create("light probes", "Scene");
+    glBindTexture(GL_TEXTURE_3D, this->lightProbeTexture);
+    // 探针之间三线性插值，网格外的片段取边界上的探针
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, size.x, size.y, depth, 0, GL_RGBA, GL_FLOAT, texels.data());
+    glBindTexture(GL_TEXTURE_3D, 0);
+    this->lightProbeTexture.setSize(GpuMemoryLedger::textureBytes(GL_RGBA16F, size.x, size.y, depth), GL_RGBA16F);
+}
 
-    // 销毁光照贴图上下文
-    lmDestroy(ctx);
+LightmapCacheKey Scene::lightMapCacheKey(const vector<ModelInfo>& modelInfos, const vector<glm::mat4>& models,
+    const vector<DirectionalLight>& directionalLights, const vector<PointLight>& pointLights, bool cpu) {
+    LightmapHasher scene;
+    for (size_t i = 0; i < modelInfos.size(); i++) {
+        const ModelInfo& modelInfo = modelInfos[i];
+        scene.add(i < models.size() ? models[i] : glm::mat4(1.0f));
+        scene.add(modelInfo.lightVertices);
+        scene.add(modelInfo.lightIndices);
+        scene.add(modelInfo.lightMapRegion);
+    }
+    for (const DirectionalLight& light : directionalLights) {
+        scene.add(light.direction);
+        scene.add(light.ambient);
+        scene.add(light.diffuse);
+        scene.add(light.lightColor);
+    }
+    for (const PointLight& light : pointLights) {
+        scene.add(light.position);
+        scene.add(light.ambient);
+        scene.add(light.diffuse);
+        scene.add(light.lightColor);
+        scene.add(light.constant);
+        scene.add(light.linear);
+        scene.add(light.quadratic);
+    }
 
-    // 后处理纹理
-    float* temp = (float*)calloc(LIGHT_MAP_WIDTH * LIGHT_MAP_HEIGHT * 4, sizeof(float));
-    for (int i = 0; i < 16; i++) {
-        lmImageDilate(data, temp, LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT, 4);
-        lmImageDilate(temp, data, LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT, 4);
+    LightmapHasher settings;
+    settings.add((unsigned int)LIGHT_MAP_WIDTH);
+    settings.add((unsigned int)LIGHT_MAP_HEIGHT);
+    LightmapAtlasSettings atlas = lightMapAtlasSettings();
+    settings.add(atlas.padding);
+    settings.add(atlas.texelsPerUnit);
+    if (cpu) {
+        CpuLightmapBaker::Settings cpuSettings = cpuBakerSettings();
+        LightmapBaker::hashSettings(settings, &cpuSettings);
+    }
+    else {
+        LightmapBaker::hashSettings(settings, nullptr);
     }
-    lmImageSmooth(data, temp, LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT, 4);
-    lmImageSmooth(data, temp, LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT, 4);
 
-    lmImageDilate(temp, data, LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT, 4);
-    lmImagePower(data, LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT, 4, 1.0f / 2.2f, 0x7); // 伽马矫正颜色通道
-    free(temp);
+    LightmapCacheKey key;
+    key.scene = scene.get();
+    key.settings = settings.get();
+    return key;
+}
+
+LightmapAtlasSettings Scene::lightMapAtlasSettings() {
+    LightmapAtlasSettings settings;
+    settings.width = LIGHT_MAP_WIDTH;
+    settings.height = LIGHT_MAP_HEIGHT;
+    settings.padding = LIGHT_MAP_PADDING;
+    settings.texelsPerUnit = LIGHT_MAP_TEXELS_PER_UNIT;
+    return settings;
+}
+
+void Scene::buildLightMapAtlas() {
+    vector<vector<LightmapMesh*>> objects(this->modelInfos.size());
+    size_t chartCount = 0;
+    for (size_t i = 0; i < this->modelInfos.size(); i++) {
+        for (LightmapMesh& mesh : this->modelInfos[i].model->lightmapMeshes) {
+            objects[i].push_back(&mesh);
+            chartCount += mesh.charts.size();
+        }
+    }
+    vector<LightmapRegion> regions;
+    float density = packLightmapAtlas(objects, lightMapAtlasSettings(), regions);
+    printf("lightmap atlas: %zu charts, %.3f texels per unit\n", chartCount, density);
+    for (size_t i = 0; i < this->modelInfos.size(); i++) {
+        ModelInfo& modelInfo = this->modelInfos[i];
+        modelInfo.model->applyLightmapAtlas(modelInfo.lightVertices, modelInfo.lightIndices);
+        if (i < regions.size())
+            modelInfo.lightMapRegion = regions[i];
+        // 烘焙只使用每个模型合并后的几何体
+        modelInfo.model->lightmapMeshes.clear();
+    }
+}
 
-    // 保存结果到文件
-    if (lmImageSaveTGAf("result.tga", data, LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT, 4, 1.0f))
-        printf("Saved result.tga\n");
+vector<LightmapBaker::Object> Scene::lightMapBakeObjects() const {
+    vector<LightmapBaker::Object> objects;
+    for (size_t i = 0; i < this->modelInfos.size(); i++) {
+        LightmapBaker::Object object;
+        object.vertices = &this->modelInfos[i].lightVertices;
+        object.indices = &this->modelInfos[i].lightIndices;
+        object.model = this->frame->modelMatrices[i];
+        object.region = this->modelInfos[i].lightMapRegion;
+        objects.push_back(object);
+    }
+    return objects;
+}
 
-    // 上传结果到opengl纹理
-    glBindTexture(GL_TEXTURE_2D, lightMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, LIGHT_MAP_WIDTH, LIGHT_MAP_HEIGHT, 0, GL_RGBA, GL_FLOAT, data);
-    free(data);
+void Scene::advanceLightMapBake() {
+    if (!this->lightmapBaker.isBaking())
+        return;
+    PROFILE_SCOPE("lightmap bake");
+    this->lightmapBaker.advance([this](const glm::mat4& view, const glm::mat4& projection) {
+        // 将视图矩阵传递给着色器
+        this->shader.use();
+        this->shader.setMat4("view", view);
+        // 将视图投影矩阵传递给着色器
+        this->shader.setMat4("viewProjection", projection * view);
+        // 渲染场景
+        renderScene(this->shader, false);
+        }, PROGRESSIVE_BAKE ? BAKE_BUDGET_MS : 0.0, BAKE_MAX_HEMISPHERES_PER_FRAME);
 
-    return 1;
-}
\ No newline at end of file
+    // 每秒在控制台和窗口标题上显示进度
+    double time = window->getTime();
+    LightmapBaker::State state = this->lightmapBaker.getState();
+    if (state == LightmapBaker::State::Finished || state == LightmapBaker::State::Failed) {
+        window->setStatusText("");
+    }
+    else if (time - this->lastBakeReportTime > 1.0) {
+        this->lastBakeReportTime = time;
+        char status[64];
+        if (state == LightmapBaker::State::Sampling)
+            snprintf(status, sizeof(status), "baking %6.2f%%", this->lightmapBaker.getProgress() * 100.0f);
+        else
+            snprintf(status, sizeof(status), "baking: post processing");
+        printf("\r%s", status);
+        fflush(stdout);
+        window->setStatusText(status);
+    }
+}
@@ -12,9 +12,18 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <stdlib.h>
+#include <memory>
 
 #include "windowFactory.h"
-#include "model.h"
+#include "Model.h"
+#include "LightCluster.h"
+#include "HiZBuffer.h"
+#include "PostProcess.h"
+#include "GpuResource.h"
+#include "FramePipeline.h"
+#include "TransformStore.h"
+#include "LightmapBaker.h"
+#include "LightProbeGrid.h"
 
 
 using std::vector;
@@ -59,30 +68,60 @@ class Scene {
         float quadratic;
     };
     struct ModelInfo {
-        glm::vec3 position;
-        glm::vec3 rotation;
-        glm::vec3 scale;
         std::string path;
-        Model* model = nullptr;
+        // 模型的变换在transforms中的节点下标
+        size_t transform = 0;
+        // 是否绕自转轴转动（地球仪的球体），在场景配置中用spin显式标记
+        bool spinning = false;
+        // 不包括自转的局部旋转，自转的模型每帧在它的基础上叠加自转角度
+        glm::quat restRotation;
+        // 模型由场景持有，场景析构时释放网格和纹理
+        std::unique_ptr<Model> model;
         Material material;
+        // 烘焙用的顶点数据（模型空间），模型的网格按光照贴图图块展开后连续存放
+        vector<vertex_t> lightVertices;
+        // 烘焙用的32位索引，已经加上了每个网格的起始顶点
+        vector<unsigned int> lightIndices;
+        // 模型在光照贴图中的区域，每个模型单独烘焙
+        LightmapRegion lightMapRegion;
     };
 public:
     // 定向光数组
     vector<DirectionalLight> directionalLights;
 
     /// @brief 构造函数，初始化窗口和加载配置文件
-    /// @param window  opengl窗口
-    Scene(GLFWWindowFactory* window);
+    /// @param window  opengl窗口，场景的渲染尺寸和窗口相同
+    Scene(WindowFactory* window);
+
+    /// @brief 更新函数，在更新线程上按固定步长推进动画，为一帧计算模型矩阵、包围盒、视锥体剔除和绘制顺序，不调用opengl
+    /// @param packet 帧数据包，摄像机、矩阵和模拟步数已经由窗口填好
+    void update(FramePacket& packet);
 
     /// @brief 绘制函数，用于渲染场景
-    void draw();
+    /// 场景被渲染到离屏帧缓冲中，返回时该帧缓冲仍然处于绑定状态，之后绘制的天空盒等也会写入其中
+    /// @param packet 这一帧的数据包
+    void draw(const FramePacket& packet);
+
+    /// @brief 把离屏帧缓冲中的HDR场景经过后处理输出到屏幕，在一帧的所有绘制完成后调用
+    void present();
+
+    /// @brief 获取最近一次统计到的主渲染阶段执行光照计算的片段数
+    /// opengl 3.3核心模式没有片段着色器调用次数的统计查询，这里用GL_SAMPLES_PASSED代替：
+    /// 开启提前深度测试时，通过深度测试的片段数就是执行了片段着色器的片段数
+    GLuint64 getShadedFragmentCount() const { return this->shadedFragments; }
+
+    /// @brief 不创建窗口和opengl上下文，读取场景和光源配置，用CPU路径追踪烘焙器烘焙光照贴图并保存，同时保存光照探针的缓存
+    /// 用于没有显卡的构建机器
+    /// @param output 保存的图片路径
+    /// @return 没有可以烘焙的几何体时返回false
+    static bool bakeLightMapOffline(const std::string& output);
 
     ~Scene();
 private:
-    // 屏幕的宽度和
-    static const unsigned int SCR_WIDTH = 800;
+    // 屏幕的宽度
+    unsigned int SCR_WIDTH;
     // 屏幕的高度
-    static const unsigned int SCR_HEIGHT = 600;
+    unsigned int SCR_HEIGHT;
     // 阴影贴图的宽度
     static const unsigned int SHADOW_WIDTH = 1024;
     // 阴影贴图的高度
@@ -102,11 +141,43 @@ private:
     // 3: VSM
     static const unsigned int SHADOW_ALGORITHM = 1;
     // 光照贴图的宽度
-    unsigned int LIGHT_MAP_WIDTH = 1024;
+    static const unsigned int LIGHT_MAP_WIDTH = 1024;
     // 光照贴图的高度
-    unsigned int LIGHT_MAP_HEIGHT = 1024;
+    static const unsigned int LIGHT_MAP_HEIGHT = 1024;
+    // 光照贴图中图块之间的间隔（纹素）
+    static const int LIGHT_MAP_PADDING = 2;
+    // 光照贴图每单位长度的纹素数，0表示自动选择能放下所有图块的最大密度
+    static constexpr float LIGHT_MAP_TEXELS_PER_UNIT = 0.0f;
+    // 烘焙结果的缓存文件，场景内容和烘焙参数都没有变化时启动直接加载
+    static constexpr const char* LIGHT_MAP_CACHE = "lightmap.cache";
+    // 烘焙的断点文件，烘焙中途退出或者失败后从这里继续，烘焙完成时删除
+    static constexpr const char* LIGHT_MAP_CHECKPOINT = "lightmap.checkpoint";
+    // 保存断点的间隔（秒）
+    static constexpr double LIGHT_MAP_CHECKPOINT_INTERVAL = 60.0;
+    // 光照探针的缓存文件，和光照贴图缓存使用相同的场景哈希
+    static constexpr const char* LIGHT_PROBE_CACHE = "lightprobes.cache";
+    // 光照探针网格最长的轴上的探针数
+    static const int LIGHT_PROBE_RESOLUTION = 8;
+    // 每个探针的光线数
+    static const unsigned int LIGHT_PROBE_SAMPLES = 256;
+    // 第一次就击中背面的光线超过这个比例的探针视为在几何体内部
+    static constexpr float LIGHT_PROBE_BACKFACE_THRESHOLD = 0.25f;
+    // 光照探针3D纹理使用的纹理单元，和网格的材质、阴影贴图和光照贴图使用的单元错开
+    static const int LIGHT_PROBE_TEXTURE_UNIT = 15;
     // 是否使用光线烘焙
     const bool BAKE = false;
+    // 烘焙时是否用CPU路径追踪烘焙器代替lightmapper的半球渲染
+    const bool CPU_BAKE = false;
+    // 是否渐进式烘焙：为true时烘焙分散到多帧中，窗口照常渲染；为false时在一帧内烘焙完
+    const bool PROGRESSIVE_BAKE = true;
+    // 渐进式烘焙每帧的CPU时间预算（毫秒）
+    static constexpr double BAKE_BUDGET_MS = 8.0;
+    // 渐进式烘焙每帧最多渲染的半球数
+    static const unsigned int BAKE_MAX_HEMISPHERES_PER_FRAME = 64;
+    // 地球仪自转的角速度（度/秒）
+    static constexpr float SPIN_SPEED = 10.0f;
+    // 视锥体剔除时每个任务测试的模型数，模型不超过这个数量时直接在更新线程上测试
+    static const size_t CULL_GRAIN = 1024;
 
 
     // 场景渲染着色器
@@ -117,64 +188,201 @@ private:
     Shader d_d2_filter_shader;
     // 光照贴图着色器
     Shader lightMapShader;
+    // 延迟渲染几何阶段着色器，输出G-buffer
+    Shader gBufferShader;
+    // 延迟渲染光照阶段着色器
+    Shader deferredShader;
 
-    GLFWWindowFactory* window;
+    WindowFactory* window;
     // 定向光帧缓冲对象
-    vector<unsigned int> directionLightDepthMapFBOs;
+    vector<GLFramebuffer> directionLightDepthMapFBOs;
     // 定向光深度贴图
-    vector<unsigned int> directionLightDepthMaps;
+    vector<GLTexture> directionLightDepthMaps;
     // 定向光深度的方差和均值贴图
-    vector<unsigned int> directionLightDepthMeanVarMaps;
-    vector<unsigned int> d_d2_filter_FBO;
-    vector<unsigned int> d_d2_filter_maps;
+    vector<GLTexture> directionLightDepthMeanVarMaps;
+    vector<GLFramebuffer> d_d2_filter_FBO;
+    vector<GLTexture> d_d2_filter_maps;
 
     // 模型信息
     vector<ModelInfo> modelInfos;
+    // 模型的变换层级，只在更新线程上修改
+    TransformStore transforms;
+    // 每个模型在模型空间的包围盒，连续存放用于批量变换
+    vector<AABB> localBounds;
+    // 每个模型在世界空间的包围盒，只在模型的世界矩阵变化时重新计算，只在更新线程上访问
+    vector<AABB> worldBoundsCache;
     // 定向光数量
     int numDirectionalLights;
     // 点光源数组
     vector<PointLight> pointLights;
+    // 点光源分簇剔除
+    LightCluster lightCluster;
+
+    // 场景离屏帧缓冲对象，前向和延迟渲染的结果都先写到这里
+    GLFramebuffer sceneFBO;
+    // 场景颜色贴图（RGBA16F，线性空间的HDR颜色）
+    GLTexture sceneColorMap;
+    // 场景深度贴图，和G-buffer共用
+    GLTexture sceneDepthMap;
+    // G-buffer帧缓冲对象
+    GLFramebuffer gBufferFBO;
+    // G-buffer：漫反射颜色和镜面反射强度（RGBA8）
+    GLTexture gAlbedoSpecMap;
+    // G-buffer：八面体编码的法线、反射光泽度和镜面反射颜色标志（RGB10_A2）
+    GLTexture gNormalShininessMap;
+
+    // 正在绘制的帧的数据包，只在draw期间有效
+    const FramePacket* frame = nullptr;
+    // 本帧每个模型对摄像机是否可见（没有被视锥体剔除或遮挡剔除），阴影渲染不受影响
+    vector<char> modelVisible;
+    // 上一次输出的被剔除模型数，变化时才输出
+    int lastCulledCount = -1;
+    // 层级深度遮挡剔除
+    HiZBuffer hiZBuffer;
+    // 后处理：泛光、色调映射和sRGB转换
+    PostProcess postProcess;
+    // 本帧是否已经生成了层级深度
+    bool hiZBuilt = false;
+    // 地球仪的自转角度（度），只在更新线程上按固定步长推进
+    float spinAngle = 0.0f;
+    // 上一个模拟步的自转角度，用于插值
+    float previousSpinAngle = 0.0f;
+
+    // 片段计数查询的环形缓冲大小
+    static const unsigned int QUERY_COUNT = 3;
+    // GL_SAMPLES_PASSED查询对象，统计主渲染阶段通过深度测试（也就是执行了光照计算）的片段数
+    unsigned int samplesPassedQueries[QUERY_COUNT];
+    // 对应的查询是否已经提交但还没有读取结果
+    bool queryIssued[QUERY_COUNT] = {};
+    // 已经提交的查询次数
+    unsigned int queryFrame = 0;
+    // 最近一次读到的片段数
+    GLuint64 shadedFragments = 0;
 
     // 屏幕的渲染数据
-    GLuint quadVAO = 0;
-    GLuint quadVBO = 0;
+    GLVertexArray quadVAO;
+    GLBuffer quadVBO;
 
     // 光照贴图
-    unsigned int lightMap;
-    // 顶点数据
-    vector<vertex_t> vertices;
-    // 索引数据
-    vector<unsigned int> indices;
+    GLTexture lightMap;
+    // 渐进式光照贴图烘焙
+    LightmapBaker lightmapBaker;
+    // 上一次显示烘焙进度的时间
+    double lastBakeReportTime = 0.0;
+    // 动态物体使用的光照探针，上传之后才不为空
+    LightProbeGrid lightProbes;
+    // 光照探针的3D纹理
+    GLTexture lightProbeTexture;
+    // 在后台烘焙光照探针的任务，结果写入bakingProbes，完成后在opengl线程上上传
+    JobSystem::JobHandle lightProbeJob;
+    std::unique_ptr<LightProbeGrid> bakingProbes;
+    // 烘焙光照探针的CPU烘焙器，场景析构时取消
+    std::unique_ptr<CpuLightmapBaker> lightProbeBaker;
+    // 正在烘焙时又要求重新烘焙（比如移动光源后按空格），取消的任务结束后用这些模型矩阵重新开始
+    bool lightProbeRebakePending = false;
+    vector<glm::mat4> pendingProbeModels;
 
-    /// @brief 加载场景配置文件 
+    /// @brief 加载场景配置文件，同时把每个模型的变换添加到变换层级中
     /// @param fileName 文件名
+    /// @param transforms 变换层级
     /// @return 模型信息
-    vector<ModelInfo> loadScene(const std::string& fileName);
+    static vector<ModelInfo> loadScene(const std::string& fileName, TransformStore& transforms);
     /// @brief 加载方向光配置文件
     /// @param fileName 文件名
     /// @return 返回方向光信息
-    vector<DirectionalLight> loadDirectionalLights(const std::string& fileName);
+    static vector<DirectionalLight> loadDirectionalLights(const std::string& fileName);
     /// @brief 加载点光源配置文件
     /// @param fileName 文件名
     /// @return 返回点光源信息
-    vector<PointLight> loadPointLights(const std::string& fileName);
+    static vector<PointLight> loadPointLights(const std::string& fileName);
+    /// @brief 生成基准测试用的随机点光源，用于观察光源数量增加时的性能变化
+    /// @param count 点光源数量
+    /// @param seed 随机数种子，保证每次生成的场景相同
+    /// @return 返回点光源信息
+    static vector<PointLight> generateBenchmarkPointLights(int count, unsigned int seed);
+    /// @brief CPU烘焙器的参数，创建烘焙器和计算缓存的键都使用这里的参数
+    static CpuLightmapBaker::Settings cpuBakerSettings();
+    /// @brief 创建使用场景光源的CPU烘焙器，光源的环境光项由间接光照代替
+    static std::unique_ptr<CpuLightmapBaker> createCpuBaker(const vector<DirectionalLight>& directionalLights, const vector<PointLight>& pointLights);
+    /// @brief 把点光源数据上传到分簇光照的缓冲纹理
+    void uploadPointLights();
     /// @brief 加载定向光深度贴图
     void loadDirectionLightDepthMap();
-    /// @brief 加载光照贴图
+    /// @brief 加载光照贴图，开启光线烘焙时先尝试加载缓存，没有有效的缓存时是1x1的黑色纹理
+    /// 同时加载光照探针的缓存，没有有效的缓存时在后台烘焙探针
+    /// 需要在生成烘焙用的几何体之后调用
     void loadLightMap();
+    /// @brief 计算光照贴图缓存的键，光源移动或者模型矩阵变化后键也不同
+    /// @param modelInfos 已经生成了烘焙用几何体的模型
+    /// @param models 每个模型的模型矩阵（开启光线烘焙时地球仪不转动，启动时和按空格时的矩阵相同）
+    /// @param cpu 是否使用CPU烘焙器
+    static LightmapCacheKey lightMapCacheKey(const vector<ModelInfo>& modelInfos, const vector<glm::mat4>& models,
+        const vector<DirectionalLight>& directionalLights, const vector<PointLight>& pointLights, bool cpu);
+    /// @brief 在光照贴图缓存的键上加入光照探针的参数
+    static LightmapCacheKey lightProbeCacheKey(const LightmapCacheKey& lightMapKey);
+    /// @brief 用静态模型（不自转的模型）的世界空间几何体放置并烘焙光照探针，阻塞直到完成，不调用opengl
+    /// @param models 每个模型的模型矩阵
+    /// @param baker 设置好光源的烘焙器，会用静态模型重新设置场景
+    /// @return 被取消或者没有静态几何体时返回false
+    static bool bakeLightProbes(const vector<ModelInfo>& modelInfos, const vector<glm::mat4>& models, CpuLightmapBaker& baker, LightProbeGrid& grid);
+    /// @brief 在任务系统上烘焙光照探针，完成后保存缓存
+    /// 正在烘焙时取消正在进行的烘焙，它结束后由advanceLightProbeBake用models重新开始
+    /// 缓存的键用开始时的光源和models计算，光源移动之后不会保存到旧的键下
+    /// @param models 每个模型的模型矩阵
+    void startLightProbeBake(const vector<glm::mat4>& models);
+    /// @brief 光照探针烘焙完成时上传，有等待的重新烘焙时丢弃结果并重新开始，每帧在opengl线程上调用
+    void advanceLightProbeBake();
+    /// @brief 把光照探针上传到3D纹理，并设置场景着色器中把世界坐标变换到纹理坐标的参数
+    void uploadLightProbes();
+    /// @brief 把所有模型展开的图块打包进同一张光照贴图，每个模型占用一个区域，更新网格的光照贴图坐标并生成每个模型烘焙用的几何体
+    void buildLightMapAtlas();
+    /// @brief 用这一帧的模型矩阵生成参与烘焙的物体
+    vector<LightmapBaker::Object> lightMapBakeObjects() const;
+    /// @brief 光照贴图图块的打包参数
+    static LightmapAtlasSettings lightMapAtlasSettings();
+    /// @brief 加载场景离屏帧缓冲和G-buffer
+    void loadSceneFramebuffer();
     void renderSceneToDepthMap();
-    /// @brief 设置场景的统一变量
-    void setupSceneUniform();
+    /// @brief 设置场景光照相关的统一变量，前向渲染和延迟渲染光照阶段共用
+    /// @param shader 使用的着色器
+    void setupSceneUniform(Shader& shader);
+    /// @brief 把定向光的阴影贴图绑定到连续的纹理单元上
+    /// @param shader 使用的着色器
+    /// @param firstUnit 第一个纹理单元
+    void bindShadowMaps(Shader& shader, unsigned int firstUnit);
+    /// @brief 前向渲染：每个片段直接计算所有光照
+    void renderForward();
+    /// @brief 延迟渲染：先写G-buffer，再用全屏四边形计算光照
+    void renderDeferred();
+    /// @brief 按模型到摄像机的距离从近到远排序绘制顺序
+    /// @param packet 帧数据包
+    void sortModelsFrontToBack(FramePacket& packet) const;
+    /// @brief 更新自转模型的旋转，重新计算变化了的世界矩阵和世界包围盒
+    /// 模型矩阵每帧只计算一次，阴影、深度预渲染和主渲染阶段共用，看到的地球仪角度相同
+    /// @param spinAngle 插值后的地球仪自转角度（度）
+    void updateTransforms(float spinAngle);
+    /// @brief 把模型矩阵和世界包围盒写入数据包，并做视锥体剔除
+    /// @param packet 帧数据包
+    void updateVisibility(FramePacket& packet) const;
+    /// @brief 在视锥体剔除的结果上用上一帧的层级深度做遮挡剔除，层级深度只在opengl线程上可用
+    void cullOccluded();
+    /// @brief 从场景深度生成层级深度，供之后的帧做遮挡剔除，完成后重新绑定场景帧缓冲
+    void buildHiZ();
+    /// @brief 开始统计通过深度测试的片段数，同时非阻塞地读取之前帧的结果
+    void beginSamplesPassedQuery();
+    /// @brief 结束统计通过深度测试的片段数
+    void endSamplesPassedQuery();
     /// @brief 渲染场景
     /// @param shader 使用的着色器
     /// @param isActiveTexture 是否激活纹理，一般是开启的，在渲染深度贴图时不开启（也就是从光源的视角渲染场景时
-    void renderScene(Shader& shader, bool isActiveTexture);
+    /// @param cameraCulling 是否跳过对摄像机不可见的模型，只用于从摄像机视角渲染的阶段
+    void renderScene(Shader& shader, bool isActiveTexture, bool cameraCulling = false);
     /// @brief 处理输入，移动定向光
     void processInputMoveDirLight();
     /// @brief 渲染整个屏幕，一般用于图像后期处理
     void renderQuad();
-    /// @brief 光照贴图烘培函数
-    int bakeLightMap();
+    /// @brief 推进正在进行的光照贴图烘焙，每帧在渲染场景之前调用
+    void advanceLightMapBake();
 };
 
 #endif // SCENE_H
\ No newline at end of file
@@ -0,0 +1,23 @@
+#include "SimulationClock.h"
+#include <algorithm>
+#include <cmath>
+
+unsigned int SimulationClock::advance(double time) {
+    if (!this->started) {
+        this->started = true;
+        this->startTime = time;
+    }
+    double elapsed = time - this->startTime - this->droppedTime;
+    // 加上一个很小的量，避免固定帧间隔（例如1/60秒）除以步长时因为舍入误差少算一步
+    unsigned long long target = (unsigned long long)std::max(0.0, std::floor(elapsed / STEP + 1e-6));
+    unsigned long long steps = target > this->step ? target - this->step : 0;
+    if (steps > MAX_STEPS_PER_FRAME) {
+        // 丢弃追不上的时间，模拟从这一帧开始重新跟上
+        this->droppedTime += (steps - MAX_STEPS_PER_FRAME) * STEP;
+        elapsed -= (steps - MAX_STEPS_PER_FRAME) * STEP;
+        steps = MAX_STEPS_PER_FRAME;
+    }
+    this->step += steps;
+    this->alpha = (float)std::min(std::max((elapsed - this->step * STEP) / STEP, 0.0), 0.999999);
+    return (unsigned int)steps;
+}
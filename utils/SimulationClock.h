@@ -0,0 +1,38 @@
+#ifndef SIMULATION_CLOCK_H
+#define SIMULATION_CLOCK_H
+
+// 定义了固定步长的模拟时钟
+// 摄像机移动和地球仪转动都按固定的步长STEP推进，和帧率无关；渲染时用插值系数在最近两个模拟状态之间插值
+// 模拟的步数只由时间决定，固定时间步长模式下每次运行的模拟结果完全相同
+
+class SimulationClock {
+public:
+    // 模拟步长（秒）
+    static constexpr double STEP = 1.0 / 120.0;
+    // 一帧最多执行的模拟步数，帧时间过长（例如加载、烘焙或者调试断点）时丢弃多出来的时间，避免越追越慢
+    static const unsigned int MAX_STEPS_PER_FRAME = 8;
+
+    /// @brief 推进到新的一帧
+    /// @param time 这一帧的时间（秒），第一次调用时作为模拟的起点
+    /// @return 这一帧需要执行的模拟步数
+    unsigned int advance(double time);
+
+    /// @brief 获取插值系数：渲染的时刻在上一个模拟状态和当前模拟状态之间的位置，范围[0, 1)
+    float getAlpha() const { return this->alpha; }
+
+    /// @brief 获取已经模拟的时间（秒）
+    double getSimulationTime() const { return this->step * STEP; }
+
+private:
+    // 是否已经确定了起点
+    bool started = false;
+    // 模拟的起点
+    double startTime = 0.0;
+    // 已经执行的模拟步数
+    unsigned long long step = 0;
+    // 被丢弃的时间（秒），之后的帧时间减去这部分再计算步数
+    double droppedTime = 0.0;
+    float alpha = 0.0f;
+};
+
+#endif // SIMULATION_CLOCK_H
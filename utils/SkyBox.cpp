@@ -1,11 +1,13 @@
 #include "SkyBox.h"
 #include "stb_image.h"
+#include "Profiler.h"
+#include "RenderStats.h"
 
 // public
 
 /// @brief 构造函数
 /// @param face_paths 纹理路径 
-SkyBox::SkyBox(GLFWWindowFactory* window) : window(window) {
+SkyBox::SkyBox(WindowFactory* window) : window(window) {
     vector<string> face_paths{
         "assets/skybox/right.jpg",
         "assets/skybox/left.jpg",
@@ -25,6 +27,7 @@ SkyBox::SkyBox(GLFWWindowFactory* window) : window(window) {
 /// @brief 绘制天空盒
 /// @param shader 天空盒着色器
 void SkyBox::draw() {
+    PROFILE_SCOPE("skybox");
     // 设置深度测试的比较函数
     // Gl_LEQUAL表示深度值小于或等于深度缓冲区值的像素能够通过深度测试
     glDepthFunc(GL_LEQUAL);
@@ -45,15 +48,19 @@ void SkyBox::draw() {
 
     // 在上下文中绑定VAO
     glBindVertexArray(this->VAO);
+    STATS_COUNT(vaoBinds, 1);
     // 激活纹理
     glActiveTexture(GL_TEXTURE0);
     // 绑定纹理
     glBindTexture(GL_TEXTURE_CUBE_MAP, this->textureID);
+    STATS_COUNT(textureBinds, 1);
     // 设置uniform变量
     this->shader.setInt("skybox", 0);
 
     // 绘制
     glDrawArrays(GL_TRIANGLES, 0, 36);
+    STATS_COUNT(drawCalls, 1);
+    STATS_COUNT(triangles, 12);
     // 解绑VAO
     glBindVertexArray(0);
     // 将深度测试的比较函数设置回默认值
@@ -66,7 +73,7 @@ void SkyBox::draw() {
 /// @param faces 纹理路径
 void SkyBox::loadTexture(vector<string> faces) {
     // 生成一个纹理
-    glGenTextures(1, &this->textureID);
+    this->textureID.create("skybox", "SkyBox");
     // 在上下文中绑定该纹理
     glBindTexture(GL_TEXTURE_CUBE_MAP, this->textureID);
 
@@ -74,7 +81,9 @@ void SkyBox::loadTexture(vector<string> faces) {
     for (unsigned int i = 0; i < faces.size(); i++) {
         unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
         if (data) {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+            // 天空盒图片是sRGB空间的，采样时转换到线性空间和场景一起做色调映射
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_SRGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+            this->textureID.setSize(GpuMemoryLedger::textureBytes(GL_SRGB8, width, height, i + 1), GL_SRGB8);
             stbi_image_free(data);
         }
         else {
@@ -136,15 +145,16 @@ void SkyBox::setupVertices() {
     };
 
     // 生成VAO
-    glGenVertexArrays(1, &this->VAO);
+    this->VAO.create("mesh", "SkyBox");
     // 生成VBO
-    glGenBuffers(1, &this->VBO);
+    this->VBO.create("mesh", "SkyBox");
     // 将VAO绑定到当前上下文
     glBindVertexArray(this->VAO);
     // 将VBO绑定到GL_ARRAY_BUFFER
     glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
     // 将顶点数据复制到VBO
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
+    this->VBO.setSize(sizeof(skyboxVertices));
 
     // 设置顶点属性指针
     // 位置属性
@@ -3,7 +3,8 @@
 
 #include <glad/glad.h>
 #include "shader.h"
-#include "WindowFactory.h"
+#include "windowFactory.h"
+#include "GpuResource.h"
 
 #include <vector>
 #include <string>
@@ -17,18 +18,19 @@ using std::endl;
 class SkyBox {
 public:
     // 构造函数
-    SkyBox(GLFWWindowFactory* window);
+    SkyBox(WindowFactory* window);
 
     // 绘制天空盒
     void draw();
 
 private:
     // 渲染数据
-    unsigned int VAO, VBO;
+    GLVertexArray VAO;
+    GLBuffer VBO;
     // 纹理ID
-    unsigned int textureID;
+    GLTexture textureID;
     // 窗口指针
-    GLFWWindowFactory* window;
+    WindowFactory* window;
     // 着色器
     Shader shader;
 
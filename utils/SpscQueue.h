@@ -0,0 +1,45 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+// 定义了单生产者单消费者的无锁环形队列
+// 只能有一个线程调用push，一个线程调用pop，两个线程之间不需要加锁
+// 生产者用release写入尾部位置，消费者用acquire读取，保证消费者看到位置更新时元素已经写完
+
+#include <atomic>
+#include <cstddef>
+
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+public:
+    /// @brief 生产者线程：写入一个元素
+    /// @return 队列已满时返回false
+    bool push(const T& value) {
+        size_t head = this->head.load(std::memory_order_relaxed);
+        if (head - this->tail.load(std::memory_order_acquire) == Capacity)
+            return false;
+        this->items[head & (Capacity - 1)] = value;
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// @brief 消费者线程：取出最早写入的元素
+    /// @return 队列为空时返回false
+    bool pop(T& value) {
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        if (tail == this->head.load(std::memory_order_acquire))
+            return false;
+        value = this->items[tail & (Capacity - 1)];
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // 下一个写入的位置，只有生产者修改；和tail放在不同的缓存行，避免两个线程互相使对方的缓存行失效
+    alignas(64) std::atomic<size_t> head{ 0 };
+    // 下一个读取的位置，只有消费者修改
+    alignas(64) std::atomic<size_t> tail{ 0 };
+    T items[Capacity];
+};
+
+#endif // SPSC_QUEUE_H
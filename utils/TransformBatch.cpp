@@ -0,0 +1,238 @@
+#include "TransformBatch.h"
+#include <algorithm>
+#include <cmath>
+#include "JobSystem.h"
+
+// 开启了AVX2时一次处理8个实例，否则x64下SSE2总是可用的，一次处理4个实例，其他平台退回标量实现
+#if defined(__AVX2__)
+#define TRANSFORM_BATCH_USE_AVX2 1
+#define TRANSFORM_BATCH_USE_SSE 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_BATCH_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+void TransformSoA::push_back(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+    this->positionX.push_back(position.x);
+    this->positionY.push_back(position.y);
+    this->positionZ.push_back(position.z);
+    this->rotationX.push_back(rotation.x);
+    this->rotationY.push_back(rotation.y);
+    this->rotationZ.push_back(rotation.z);
+    this->rotationW.push_back(rotation.w);
+    this->scaleX.push_back(scale.x);
+    this->scaleY.push_back(scale.y);
+    this->scaleZ.push_back(scale.z);
+}
+
+void TransformSoA::setPosition(size_t i, const glm::vec3& position) {
+    this->positionX[i] = position.x;
+    this->positionY[i] = position.y;
+    this->positionZ[i] = position.z;
+}
+
+void TransformSoA::setRotation(size_t i, const glm::quat& rotation) {
+    this->rotationX[i] = rotation.x;
+    this->rotationY[i] = rotation.y;
+    this->rotationZ[i] = rotation.z;
+    this->rotationW[i] = rotation.w;
+}
+
+void TransformSoA::setScale(size_t i, const glm::vec3& scale) {
+    this->scaleX[i] = scale.x;
+    this->scaleY[i] = scale.y;
+    this->scaleZ[i] = scale.z;
+}
+
+void composeTRSScalar(const TransformSoA& transforms, size_t begin, size_t end, glm::mat4* out) {
+    for (size_t i = begin; i < end; i++) {
+        float x = transforms.rotationX[i], y = transforms.rotationY[i], z = transforms.rotationZ[i], w = transforms.rotationW[i];
+        float sx = transforms.scaleX[i], sy = transforms.scaleY[i], sz = transforms.scaleZ[i];
+        // 单位四元数转换为旋转矩阵，和glm::mat4_cast相同
+        float* m = reinterpret_cast<float*>(&out[i - begin]);
+        m[0] = (1.0f - 2.0f * (y * y + z * z)) * sx;
+        m[1] = 2.0f * (x * y + w * z) * sx;
+        m[2] = 2.0f * (x * z - w * y) * sx;
+        m[3] = 0.0f;
+        m[4] = 2.0f * (x * y - w * z) * sy;
+        m[5] = (1.0f - 2.0f * (x * x + z * z)) * sy;
+        m[6] = 2.0f * (y * z + w * x) * sy;
+        m[7] = 0.0f;
+        m[8] = 2.0f * (x * z + w * y) * sz;
+        m[9] = 2.0f * (y * z - w * x) * sz;
+        m[10] = (1.0f - 2.0f * (x * x + y * y)) * sz;
+        m[11] = 0.0f;
+        m[12] = transforms.positionX[i];
+        m[13] = transforms.positionY[i];
+        m[14] = transforms.positionZ[i];
+        m[15] = 1.0f;
+    }
+}
+
+#ifdef TRANSFORM_BATCH_USE_SSE
+// 把4个实例的同一列（每个分量一个寄存器）转置后写到4个矩阵中
+static inline void storeColumn4(__m128 cx, __m128 cy, __m128 cz, __m128 cw, float* out, int column) {
+    _MM_TRANSPOSE4_PS(cx, cy, cz, cw);
+    _mm_storeu_ps(out + column * 4, cx);
+    _mm_storeu_ps(out + 16 + column * 4, cy);
+    _mm_storeu_ps(out + 32 + column * 4, cz);
+    _mm_storeu_ps(out + 48 + column * 4, cw);
+}
+
+// 一次组合4个实例
+static inline void composeTRS4(const TransformSoA& t, size_t i, float* out) {
+    const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+    __m128 x = _mm_loadu_ps(&t.rotationX[i]), y = _mm_loadu_ps(&t.rotationY[i]);
+    __m128 z = _mm_loadu_ps(&t.rotationZ[i]), w = _mm_loadu_ps(&t.rotationW[i]);
+    __m128 sx = _mm_loadu_ps(&t.scaleX[i]), sy = _mm_loadu_ps(&t.scaleY[i]), sz = _mm_loadu_ps(&t.scaleZ[i]);
+    __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+    __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+    __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+    storeColumn4(
+        _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx),
+        _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx),
+        _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx),
+        zero, out, 0);
+    storeColumn4(
+        _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy),
+        _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy),
+        _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy),
+        zero, out, 1);
+    storeColumn4(
+        _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz),
+        _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz),
+        _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz),
+        zero, out, 2);
+    storeColumn4(_mm_loadu_ps(&t.positionX[i]), _mm_loadu_ps(&t.positionY[i]), _mm_loadu_ps(&t.positionZ[i]), one, out, 3);
+}
+#endif
+
+#ifdef TRANSFORM_BATCH_USE_AVX2
+// 把8个实例的同一列拆成两组4个实例写出
+static inline void storeColumn8(__m256 cx, __m256 cy, __m256 cz, __m256 cw, float* out, int column) {
+    storeColumn4(_mm256_castps256_ps128(cx), _mm256_castps256_ps128(cy), _mm256_castps256_ps128(cz), _mm256_castps256_ps128(cw), out, column);
+    storeColumn4(_mm256_extractf128_ps(cx, 1), _mm256_extractf128_ps(cy, 1), _mm256_extractf128_ps(cz, 1), _mm256_extractf128_ps(cw, 1), out + 64, column);
+}
+
+// 一次组合8个实例
+static inline void composeTRS8(const TransformSoA& t, size_t i, float* out) {
+    const __m256 one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f), zero = _mm256_setzero_ps();
+    __m256 x = _mm256_loadu_ps(&t.rotationX[i]), y = _mm256_loadu_ps(&t.rotationY[i]);
+    __m256 z = _mm256_loadu_ps(&t.rotationZ[i]), w = _mm256_loadu_ps(&t.rotationW[i]);
+    __m256 sx = _mm256_loadu_ps(&t.scaleX[i]), sy = _mm256_loadu_ps(&t.scaleY[i]), sz = _mm256_loadu_ps(&t.scaleZ[i]);
+    __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+    __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+    __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+    storeColumn8(
+        _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx),
+        _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx),
+        _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx),
+        zero, out, 0);
+    storeColumn8(
+        _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy),
+        _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy),
+        _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy),
+        zero, out, 1);
+    storeColumn8(
+        _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz),
+        _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz),
+        _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz),
+        zero, out, 2);
+    storeColumn8(_mm256_loadu_ps(&t.positionX[i]), _mm256_loadu_ps(&t.positionY[i]), _mm256_loadu_ps(&t.positionZ[i]), one, out, 3);
+}
+#endif
+
+void composeTRSBatch(const TransformSoA& transforms, size_t begin, size_t end, glm::mat4* out) {
+    size_t i = begin;
+    float* data = reinterpret_cast<float*>(out);
+#ifdef TRANSFORM_BATCH_USE_AVX2
+    for (; i + 8 <= end; i += 8)
+        composeTRS8(transforms, i, data + (i - begin) * 16);
+#endif
+#ifdef TRANSFORM_BATCH_USE_SSE
+    for (; i + 4 <= end; i += 4)
+        composeTRS4(transforms, i, data + (i - begin) * 16);
+#endif
+    // 剩余不够一组的实例
+    composeTRSScalar(transforms, i, end, out + (i - begin));
+}
+
+void transformBoundsScalar(const glm::mat4* matrices, const AABB* localBounds, AABB* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const float* m = reinterpret_cast<const float*>(&matrices[i]);
+        glm::vec3 center = (localBounds[i].min + localBounds[i].max) * 0.5f;
+        glm::vec3 extent = (localBounds[i].max - localBounds[i].min) * 0.5f;
+        float newCenter[3], newExtent[3];
+        for (int k = 0; k < 3; k++) {
+            newCenter[k] = m[k] * center.x + m[4 + k] * center.y + m[8 + k] * center.z + m[12 + k];
+            newExtent[k] = std::abs(m[k]) * extent.x + std::abs(m[4 + k]) * extent.y + std::abs(m[8 + k]) * extent.z;
+        }
+        out[i].min = glm::vec3(newCenter[0] - newExtent[0], newCenter[1] - newExtent[1], newCenter[2] - newExtent[2]);
+        out[i].max = glm::vec3(newCenter[0] + newExtent[0], newCenter[1] + newExtent[1], newCenter[2] + newExtent[2]);
+    }
+}
+
+void transformBoundsBatch(const glm::mat4* matrices, const AABB* localBounds, AABB* out, size_t count) {
+#ifdef TRANSFORM_BATCH_USE_SSE
+    // 每次处理一个包围盒，x/y/z三个分量并行计算，矩阵的列可以直接加载，不需要转置
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (size_t i = 0; i < count; i++) {
+        const float* m = reinterpret_cast<const float*>(&matrices[i]);
+        __m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+        const AABB& local = localBounds[i];
+        __m128 localMin = _mm_set_ps(0.0f, local.min.z, local.min.y, local.min.x);
+        __m128 localMax = _mm_set_ps(0.0f, local.max.z, local.max.y, local.max.x);
+        __m128 center = _mm_mul_ps(_mm_add_ps(localMin, localMax), half);
+        __m128 extent = _mm_mul_ps(_mm_sub_ps(localMax, localMin), half);
+
+        __m128 newCenter = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(c0, _mm_shuffle_ps(center, center, _MM_SHUFFLE(0, 0, 0, 0))),
+                _mm_mul_ps(c1, _mm_shuffle_ps(center, center, _MM_SHUFFLE(1, 1, 1, 1)))),
+            _mm_add_ps(_mm_mul_ps(c2, _mm_shuffle_ps(center, center, _MM_SHUFFLE(2, 2, 2, 2))), c3));
+        __m128 newExtent = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_and_ps(c0, absMask), _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(0, 0, 0, 0))),
+                _mm_mul_ps(_mm_and_ps(c1, absMask), _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(1, 1, 1, 1)))),
+            _mm_mul_ps(_mm_and_ps(c2, absMask), _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(2, 2, 2, 2))));
+
+        float newMin[4], newMax[4];
+        _mm_storeu_ps(newMin, _mm_sub_ps(newCenter, newExtent));
+        _mm_storeu_ps(newMax, _mm_add_ps(newCenter, newExtent));
+        out[i].min = glm::vec3(newMin[0], newMin[1], newMin[2]);
+        out[i].max = glm::vec3(newMax[0], newMax[1], newMax[2]);
+    }
+#else
+    transformBoundsScalar(matrices, localBounds, out, count);
+#endif
+}
+
+// 把[0, count)分成几段交给任务系统执行，每段的长度是8的倍数，都能完整地使用AVX2
+template <typename Func>
+static void parallelFor(size_t count, Func func) {
+    JobSystem::instance().parallelFor(count, TRANSFORM_PARALLEL_GRAIN, func);
+}
+
+void composeTRSParallel(const TransformSoA& transforms, size_t begin, size_t end, glm::mat4* out) {
+    parallelFor(end - begin, [&](size_t first, size_t last) {
+        composeTRSBatch(transforms, begin + first, begin + last, out + first);
+        });
+}
+
+void transformBoundsParallel(const glm::mat4* matrices, const AABB* localBounds, AABB* out, size_t count) {
+    parallelFor(count, [&](size_t first, size_t last) {
+        transformBoundsBatch(matrices + first, localBounds + first, out + first, last - first);
+        });
+}
+
+const char* transformBatchInstructionSet() {
+#if defined(TRANSFORM_BATCH_USE_AVX2)
+    return "avx2";
+#elif defined(TRANSFORM_BATCH_USE_SSE)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
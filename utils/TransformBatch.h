@@ -0,0 +1,66 @@
+#ifndef TRANSFORM_BATCH_H
+#define TRANSFORM_BATCH_H
+
+// 定义了批量组合变换矩阵和变换包围盒的函数
+// 位置、旋转和缩放按分量分别存放（SoA），一次处理AVX2的8个或SSE的4个实例；
+// 编译器没有开启对应的指令集时退回标量实现，数量很多时再分到任务系统上并行计算
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstddef>
+#include <vector>
+#include "Culling.h"
+
+using std::vector;
+
+// 变换的数组结构：每个分量一个数组，下标相同的元素属于同一个实例
+struct TransformSoA {
+    vector<float> positionX, positionY, positionZ;
+    vector<float> rotationX, rotationY, rotationZ, rotationW;
+    vector<float> scaleX, scaleY, scaleZ;
+
+    size_t size() const { return this->positionX.size(); }
+
+    /// @brief 添加一个实例
+    void push_back(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+    /// @brief 修改一个实例的位置
+    void setPosition(size_t i, const glm::vec3& position);
+    /// @brief 修改一个实例的旋转
+    void setRotation(size_t i, const glm::quat& rotation);
+    /// @brief 修改一个实例的缩放
+    void setScale(size_t i, const glm::vec3& scale);
+};
+
+// 分到任务系统上时每个任务处理的实例数，数量不超过它时直接在当前线程上计算
+// 必须是8的倍数；一段的计算量要远大于调度一个任务的开销
+const size_t TRANSFORM_PARALLEL_GRAIN = 4096;
+
+/// @brief 组合[begin, end)范围内实例的变换矩阵（先缩放，再旋转，最后平移）
+/// @param transforms 变换
+/// @param out 输出的矩阵，out[0]对应第begin个实例
+void composeTRSBatch(const TransformSoA& transforms, size_t begin, size_t end, glm::mat4* out);
+
+/// @brief composeTRSBatch的标量实现，也用于处理不够一组的剩余实例
+void composeTRSScalar(const TransformSoA& transforms, size_t begin, size_t end, glm::mat4* out);
+
+/// @brief 计算变换后的轴对齐包围盒，结果和AABB::transformed相同
+/// 用中心和半长计算：新的中心是变换后的中心，新的半长是半长乘以矩阵左上3x3的绝对值
+/// @param matrices 变换矩阵
+/// @param localBounds 变换前的包围盒，必须是有效的
+/// @param out 变换后的包围盒
+/// @param count 数量
+void transformBoundsBatch(const glm::mat4* matrices, const AABB* localBounds, AABB* out, size_t count);
+
+/// @brief transformBoundsBatch的标量实现
+void transformBoundsScalar(const glm::mat4* matrices, const AABB* localBounds, AABB* out, size_t count);
+
+/// @brief 和composeTRSBatch相同，数量超过TRANSFORM_PARALLEL_GRAIN时分到任务系统上
+void composeTRSParallel(const TransformSoA& transforms, size_t begin, size_t end, glm::mat4* out);
+
+/// @brief 和transformBoundsBatch相同，数量超过TRANSFORM_PARALLEL_GRAIN时分到任务系统上
+void transformBoundsParallel(const glm::mat4* matrices, const AABB* localBounds, AABB* out, size_t count);
+
+/// @brief 获取编译时选择的指令集："avx2"、"sse2"或"scalar"
+const char* transformBatchInstructionSet();
+
+#endif // TRANSFORM_BATCH_H
@@ -0,0 +1,57 @@
+#include "TransformStore.h"
+#include <cassert>
+
+size_t TransformStore::add(int parent, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+    assert(parent < (int)this->parents.size());
+    this->parents.push_back(parent);
+    this->locals.push_back(position, rotation, scale);
+    this->worldMatrices.push_back(glm::mat4(1.0f));
+    this->dirty.push_back(1);
+    this->changed.push_back(0);
+    return this->parents.size() - 1;
+}
+
+void TransformStore::setPosition(size_t node, const glm::vec3& position) {
+    this->locals.setPosition(node, position);
+    this->dirty[node] = 1;
+}
+
+void TransformStore::setRotation(size_t node, const glm::quat& rotation) {
+    this->locals.setRotation(node, rotation);
+    this->dirty[node] = 1;
+}
+
+void TransformStore::setScale(size_t node, const glm::vec3& scale) {
+    this->locals.setScale(node, scale);
+    this->dirty[node] = 1;
+}
+
+size_t TransformStore::update() {
+    // 先确定需要重新计算的节点：自己被修改过，或者父节点变化了（父节点在前面，已经确定了）
+    size_t updated = 0;
+    for (size_t i = 0; i < this->parents.size(); i++) {
+        int parent = this->parents[i];
+        this->changed[i] = this->dirty[i] || (parent != NO_PARENT && this->changed[parent]);
+        this->dirty[i] = 0;
+        updated += this->changed[i];
+    }
+    // 批量组合局部矩阵，直接写到世界矩阵的位置上
+    forEachChangedRun([this](size_t begin, size_t end) {
+        composeTRSParallel(this->locals, begin, end, &this->worldMatrices[begin]);
+        });
+    // 从根到叶乘上父节点的世界矩阵
+    for (size_t i = 0; i < this->parents.size(); i++) {
+        if (this->changed[i] && this->parents[i] != NO_PARENT)
+            this->worldMatrices[i] = this->worldMatrices[this->parents[i]] * this->worldMatrices[i];
+    }
+    return updated;
+}
+
+glm::mat4 TransformStore::compose(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+    glm::mat4 matrix = glm::mat4_cast(rotation);
+    matrix[0] *= scale.x;
+    matrix[1] *= scale.y;
+    matrix[2] *= scale.z;
+    matrix[3] = glm::vec4(position, 1.0f);
+    return matrix;
+}
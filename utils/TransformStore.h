@@ -0,0 +1,83 @@
+#ifndef TRANSFORM_STORE_H
+#define TRANSFORM_STORE_H
+
+// 定义了场景图的变换存储
+// 所有节点的局部变换（位置、旋转、缩放）和世界矩阵按数组结构（SoA）存放，节点用下标表示
+// 父节点总是比子节点先添加，所以按下标顺序遍历一次就能从根到叶更新世界矩阵
+// 只有局部变换被修改过的节点和它们的子孙节点才会重新计算，静态的模型只在第一帧计算一次
+// 连续的一段需要重新计算的节点用SIMD批量组合局部矩阵，再从根到叶乘上父节点的世界矩阵
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstddef>
+#include <vector>
+#include "TransformBatch.h"
+
+using std::vector;
+
+class TransformStore {
+public:
+    // 没有父节点
+    static const int NO_PARENT = -1;
+
+    /// @brief 添加一个节点
+    /// @param parent 父节点的下标，必须是已经添加的节点，没有父节点时传NO_PARENT
+    /// @param position 相对于父节点的位置
+    /// @param rotation 相对于父节点的旋转
+    /// @param scale 相对于父节点的缩放
+    /// @return 新节点的下标
+    size_t add(int parent, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+
+    /// @brief 修改节点的局部位置，节点会在下一次update时重新计算
+    void setPosition(size_t node, const glm::vec3& position);
+    /// @brief 修改节点的局部旋转
+    void setRotation(size_t node, const glm::quat& rotation);
+    /// @brief 修改节点的局部缩放
+    void setScale(size_t node, const glm::vec3& scale);
+
+    /// @brief 重新计算所有被修改过的节点和它们的子孙节点的世界矩阵
+    /// @return 重新计算的节点数
+    size_t update();
+
+    /// @brief 获取节点的世界矩阵，在update之后有效
+    const glm::mat4& getWorldMatrix(size_t node) const { return this->worldMatrices[node]; }
+    /// @brief 获取所有节点的世界矩阵，下标和节点相同
+    const glm::mat4* getWorldMatrices() const { return this->worldMatrices.data(); }
+    /// @brief 节点的世界矩阵在最近一次update中是否变化了，变化的节点需要重新计算世界包围盒
+    bool isChanged(size_t node) const { return this->changed[node] != 0; }
+    /// @brief 获取父节点的下标
+    int getParent(size_t node) const { return this->parents[node]; }
+    /// @brief 获取节点数
+    size_t size() const { return this->parents.size(); }
+
+    /// @brief 对每一段连续的、在最近一次update中变化了的节点调用func(begin, end)
+    template <typename Func>
+    void forEachChangedRun(Func&& func) const {
+        size_t i = 0;
+        while (i < this->changed.size()) {
+            if (!this->changed[i]) {
+                i++;
+                continue;
+            }
+            size_t begin = i;
+            while (i < this->changed.size() && this->changed[i])
+                i++;
+            func(begin, i);
+        }
+    }
+
+    /// @brief 用位置、旋转和缩放组合变换矩阵（先缩放，再旋转，最后平移），逐个计算时使用
+    static glm::mat4 compose(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+
+private:
+    vector<int> parents;
+    // 局部变换
+    TransformSoA locals;
+    vector<glm::mat4> worldMatrices;
+    // 局部变换被修改过，还没有重新计算
+    vector<char> dirty;
+    // 世界矩阵在最近一次update中变化了
+    vector<char> changed;
+};
+
+#endif // TRANSFORM_STORE_H
@@ -0,0 +1,165 @@
+#include "headlessWindowFactory.h"
+
+#ifdef TELLURION_HEADLESS
+
+#include <EGL/eglext.h>
+#include <chrono>
+#include <cstring>
+#include <vector>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+HeadlessWindowFactory::HeadlessWindowFactory(unsigned int width, unsigned int height, unsigned int frameCount, const std::string& outputPath)
+    : WindowFactory(width, height), outputPath(outputPath) {
+    // 没有窗口可以关闭，总是按固定的帧数和帧间隔渲染
+    setFixedTimestep(FRAME_INTERVAL, frameCount);
+    createContext();
+
+    // 加载所有opengl函数指针
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        cout << "Failed to initialize GLAD" << endl;
+        exit(-1);
+    }
+
+    // 离屏帧缓冲代替窗口的默认帧缓冲
+    this->outputColor.create("render target", "HeadlessWindowFactory");
+    glBindTexture(GL_TEXTURE_2D, this->outputColor);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    this->outputColor.setSize(GpuMemoryLedger::textureBytes(GL_RGBA8, width, height), GL_RGBA8);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    this->outputDepth.create("render target", "HeadlessWindowFactory");
+    glBindRenderbuffer(GL_RENDERBUFFER, this->outputDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    this->outputDepth.setSize(GpuMemoryLedger::textureBytes(GL_DEPTH_COMPONENT24, width, height), GL_DEPTH_COMPONENT24);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    this->outputFBO.create("render target", "HeadlessWindowFactory");
+    glBindFramebuffer(GL_FRAMEBUFFER, this->outputFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->outputColor, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->outputDepth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        cout << "ERROR::FRAMEBUFFER:: Headless output framebuffer is not complete!" << endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    cout << "headless renderer: " << glGetString(GL_RENDERER) << ", " << width << "x" << height << endl;
+}
+
+HeadlessWindowFactory::~HeadlessWindowFactory() {
+    // 上下文销毁之前释放离屏帧缓冲
+    this->outputFBO.destroy();
+    this->outputColor.destroy();
+    this->outputDepth.destroy();
+    if (this->display != EGL_NO_DISPLAY) {
+        eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (this->context != EGL_NO_CONTEXT)
+            eglDestroyContext(this->display, this->context);
+        eglTerminate(this->display);
+    }
+}
+
+void HeadlessWindowFactory::createContext() {
+    // 优先使用Mesa的surfaceless平台，不需要X或者Wayland
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay) {
+        this->display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (this->display == EGL_NO_DISPLAY) {
+        this->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major, minor;
+    if (this->display == EGL_NO_DISPLAY || !eglInitialize(this->display, &major, &minor)) {
+        cout << "Failed to initialize EGL display" << endl;
+        exit(-1);
+    }
+
+    // 不需要任何surface，只要求支持桌面opengl
+    const EGLint configAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(this->display, configAttributes, &config, 1, &configCount) || configCount == 0) {
+        cout << "Failed to choose EGL config" << endl;
+        exit(-1);
+    }
+
+    eglBindAPI(EGL_OPENGL_API);
+    // 和窗口模式一样使用opengl 3.3核心模式
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    this->context = eglCreateContext(this->display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (this->context == EGL_NO_CONTEXT) {
+        cout << "Failed to create EGL context" << endl;
+        exit(-1);
+    }
+    // 不绑定surface，需要EGL_KHR_surfaceless_context
+    if (!eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, this->context)) {
+        cout << "Failed to make EGL context current" << endl;
+        exit(-1);
+    }
+}
+
+void HeadlessWindowFactory::run(std::function<void(FramePacket&)> updateFunc, std::function<void(const FramePacket&)> renderFunc) {
+    // 启用深度测试，和窗口模式保持一致
+    glEnable(GL_DEPTH_TEST);
+
+    FramePipeline pipeline([&](FramePacket& packet) { updateFrame(packet, updateFunc); }, this->pipelined);
+    if (this->frameLimit > 0)
+        pipeline.submit(captureInput(0));
+
+    auto start = std::chrono::steady_clock::now();
+    // 时间由帧序号和固定的帧间隔决定，和实际耗时无关
+    for (this->frameIndex = 0; this->frameIndex < this->frameLimit; this->frameIndex++) {
+        const FramePacket& packet = pipeline.acquire();
+        // 提交这一帧之前先把下一帧交给更新线程
+        if (this->frameIndex + 1 < this->frameLimit)
+            pipeline.submit(captureInput(this->frameIndex + 1));
+
+        glBindFramebuffer(GL_FRAMEBUFFER, this->outputFBO);
+        glViewport(0, 0, this->width, this->height);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // 按数据包提交这一帧
+        beginFrame(packet);
+        renderFunc(packet);
+    }
+    // 等待GPU完成，统计的时间才包含所有帧的渲染
+    glFinish();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (this->frameLimit > 0) {
+        cout << "rendered " << this->frameLimit << " frames in " << elapsed.count() << " s, frame time: "
+            << elapsed.count() * 1000.0 / this->frameLimit << " ms" << endl;
+    }
+
+    if (!this->outputPath.empty()) {
+        saveOutput();
+    }
+}
+
+void HeadlessWindowFactory::saveOutput() {
+    std::vector<unsigned char> pixels(this->width * this->height * 4);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->outputFBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, this->width, this->height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // opengl的原点在左下角，图片的原点在左上角
+    stbi_flip_vertically_on_write(1);
+    if (stbi_write_png(this->outputPath.c_str(), this->width, this->height, 4, pixels.data(), this->width * 4))
+        cout << "Saved " << this->outputPath << endl;
+    else
+        cout << "Failed to save " << this->outputPath << endl;
+}
+
+#endif // TELLURION_HEADLESS
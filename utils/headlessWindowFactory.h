@@ -0,0 +1,65 @@
+#ifndef HEADLESS_WINDOW_FACTORY_H
+#define HEADLESS_WINDOW_FACTORY_H
+
+// 定义了HeadlessWindowFactory类，不创建窗口，用EGL surfaceless上下文渲染到任意尺寸的离屏帧缓冲
+// 用于没有显示器（也可以没有GPU，配合Mesa llvmpipe）的Linux服务器和CI上跑基准测试和批量渲染
+// 只有开启CMake选项TELLURION_HEADLESS时才会编译
+
+#ifdef TELLURION_HEADLESS
+
+#include "windowFactory.h"
+#include "GpuResource.h"
+#include <EGL/egl.h>
+#include <string>
+
+class HeadlessWindowFactory : public WindowFactory {
+public:
+    /// @brief 构造函数，初始化EGL上下文和离屏帧缓冲
+    /// @param width 渲染的宽度
+    /// @param height 渲染的高度
+    /// @param frameCount 渲染的帧数
+    /// @param outputPath 最后一帧保存的png路径，为空时不保存
+    HeadlessWindowFactory(unsigned int width, unsigned int height, unsigned int frameCount, const std::string& outputPath);
+    ~HeadlessWindowFactory();
+
+    /// @brief 渲染固定的帧数，时间按固定的帧间隔推进，保证每次运行的结果相同
+    void run(std::function<void(FramePacket&)> updateFunc, std::function<void(const FramePacket&)> renderFunc) override;
+
+    // 没有键盘输入
+    bool isKeyPressed(int key) const override { return false; }
+
+    // 获取模拟的时间
+    float getTime() const override { return this->frameIndex * this->fixedTimestep; }
+
+    // 画面输出到离屏帧缓冲
+    unsigned int getOutputFramebuffer() const override { return this->outputFBO; }
+
+private:
+    // 固定的帧间隔（秒）
+    static constexpr float FRAME_INTERVAL = 1.0f / 60.0f;
+
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    // 离屏帧缓冲和它的颜色、深度附件
+    GLFramebuffer outputFBO;
+    GLTexture outputColor;
+    GLRenderbuffer outputDepth;
+    // 最后一帧保存的路径
+    std::string outputPath;
+
+    /// @brief 创建EGL上下文，优先使用不需要显示器的surfaceless平台
+    void createContext();
+    /// @brief 生成一帧的输入，没有键盘鼠标，只有按帧序号计算的时间
+    FrameInput captureInput(unsigned int frameIndex) const {
+        FrameInput input;
+        input.frameIndex = frameIndex;
+        input.time = frameIndex * this->fixedTimestep;
+        return input;
+    }
+    /// @brief 把离屏帧缓冲保存为png
+    void saveOutput();
+};
+
+#endif // TELLURION_HEADLESS
+
+#endif // HEADLESS_WINDOW_FACTORY_H
@@ -28,6 +28,27 @@
 #define LM_FREE(ptr) free(ptr)
 #endif
 
+// hooks for gpu memory accounting: type is one of Texture, Buffer, Framebuffer, Renderbuffer, VertexArray
+#ifndef LM_GL_TRACK
+#define LM_GL_TRACK(type, id, bytes) ((void)0)
+#endif
+
+#ifndef LM_GL_UNTRACK
+#define LM_GL_UNTRACK(type, id) ((void)0)
+#endif
+
+// called with the failed condition. the default aborts in debug builds like assert,
+// a host can throw instead to fail a bake without losing its state.
+#ifndef LM_ASSERT
+#define LM_ASSERT(condition) assert(condition)
+#endif
+
+// number of pixel pack buffers used to read back hemisphere batches asynchronously.
+// a batch is only waited for when all buffers are in flight.
+#ifndef LM_READBACK_RING_SIZE
+#define LM_READBACK_RING_SIZE 4
+#endif
+
 typedef int lm_bool;
 #define LM_FALSE 0
 #define LM_TRUE  1
@@ -85,6 +106,27 @@ float lmProgress(lm_context *ctx);
 
 void lmEnd(lm_context *ctx);
 
+// checkpointing: the sampler position inside the current mesh.
+// positions can only be taken and restored between hemispheres (not between lmBegin and lmEnd).
+typedef struct lm_position
+{
+	int pass;
+	unsigned int baseIndex; // first index of the current triangle
+	int x, y;               // rasterizer position on the lightmap
+	int side;               // 0: the hemisphere at x, y is still to be rendered, 5: it is done
+} lm_position;
+
+lm_position lmGetPosition(lm_context *ctx);
+
+// integrates the pending hemisphere batch and waits for all readbacks. returns the number of results of the
+// current pass that are not in the lightmap yet (they are written at the end of the pass).
+// the returned arrays (x, y per result and r, g, b, a per result) stay valid until the next lmBegin.
+unsigned int lmFlushResults(lm_context *ctx, const int **outLocationsXY, const float **outColorsRGBA);
+
+// continues from a checkpoint. call after lmSetGeometry with the same geometry and the lightmap contents
+// of the checkpoint in the target lightmap. results are the ones returned by lmFlushResults.
+void lmSetPosition(lm_context *ctx, lm_position position, unsigned int resultCount, const int *locationsXY, const float *colorsRGBA);
+
 // destroys the lightmapper instance. should be called to free resources.
 void lmDestroy(lm_context *ctx);
 
@@ -112,6 +154,7 @@ lm_bool lmImageSaveTGAf(const char *filename, const float *image, int w, int h,
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <float.h>
 #include <assert.h>
@@ -354,10 +397,21 @@ struct lm_context
 		} downsamplePass; // 下采样渲染相关设置
 		struct
 		{
-			GLuint texture; // 存储光照贴图的纹理对象
-			lm_ivec2 writePosition; // 当前写入光照贴图的位置
-			lm_ivec2 *toLightmapLocation; // 指向光照贴图位置的指针
-		} storage; // 存储相关设置
+			GLuint pbo[LM_READBACK_RING_SIZE]; // 半球批次的像素打包缓冲，循环使用
+			GLsync fence[LM_READBACK_RING_SIZE]; // 每个缓冲的回读完成的栅栏
+			lm_ivec2 *toLightmapLocation; // 每个缓冲中半球对应的光照贴图位置，每个缓冲fbHemiCountX * fbHemiCountY个
+			unsigned int hemiCount[LM_READBACK_RING_SIZE]; // 每个缓冲中有效的半球数
+			unsigned int first; // 最早提交的缓冲
+			unsigned int count; // 正在回读的缓冲数
+		} readback; // 异步回读相关设置
+
+		struct
+		{
+			lm_ivec2 *location; // 结果对应的光照贴图位置
+			float *color; // 按有效采样数归一化的颜色（每个结果4个分量）
+			unsigned int count; // 结果数
+			unsigned int capacity; // 最多能保存的结果数
+		} results; // 这一遍采样中已经回读、还没有写入光照贴图的结果
 	} hemisphere; // 半球结构体，用于管理光照贴图生成过程中的各类资源和状态
 
 	float interpolationThreshold;
@@ -374,7 +428,7 @@ static unsigned int lm_passStepSize(lm_context *ctx)
 {
 	unsigned int shift = ctx->meshPosition.passCount / 3 - (ctx->meshPosition.pass - 1) / 3;
 	unsigned int step = (1 << shift);
-	assert(step > 0);
+	LM_ASSERT(step > 0);
 	return step;
 }
 
@@ -416,13 +470,13 @@ static void lm_moveToNextPotentialConservativeTriangleRasterizerPosition(lm_cont
 
 static float *lm_getLightmapPixel(lm_context *ctx, int x, int y)
 {
-	assert(x >= 0 && x < ctx->lightmap.width && y >= 0 && y < ctx->lightmap.height);
+	LM_ASSERT(x >= 0 && x < ctx->lightmap.width && y >= 0 && y < ctx->lightmap.height);
 	return ctx->lightmap.data + (y * ctx->lightmap.width + x) * ctx->lightmap.channels;
 }
 
 static void lm_setLightmapPixel(lm_context *ctx, int x, int y, float *in)
 {
-	assert(x >= 0 && x < ctx->lightmap.width && y >= 0 && y < ctx->lightmap.height);
+	LM_ASSERT(x >= 0 && x < ctx->lightmap.width && y >= 0 && y < ctx->lightmap.height);
 	float *p = ctx->lightmap.data + (y * ctx->lightmap.width + x) * ctx->lightmap.channels;
 	for (int j = 0; j < ctx->lightmap.channels; j++)
 		*p++ = *in++;
@@ -616,6 +670,56 @@ static lm_bool lm_findNextConservativeTriangleRasterizerPosition(lm_context *ctx
 	return lm_findFirstConservativeTriangleRasterizerPosition(ctx);
 }
 
+// moves finished hemisphere batch readbacks (oldest first) into the pending results.
+// if wait is true, it blocks until the oldest batch is available and collects it.
+static void lm_collectReadbacks(lm_context *ctx, lm_bool wait)
+{
+	unsigned int batchSize = ctx->hemisphere.fbHemiCountX * ctx->hemisphere.fbHemiCountY;
+	while (ctx->hemisphere.readback.count)
+	{
+		unsigned int slot = ctx->hemisphere.readback.first;
+		GLsync fence = ctx->hemisphere.readback.fence[slot];
+		if (wait)
+		{
+			while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+				;
+			wait = LM_FALSE; // only the oldest one has to be waited for
+		}
+		else if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			break; // the gpu is still busy with this batch
+		glDeleteSync(fence);
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, ctx->hemisphere.readback.pbo[slot]);
+		const float *hemi = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, batchSize * 4 * sizeof(float), GL_MAP_READ_BIT);
+		const lm_ivec2 *locations = ctx->hemisphere.readback.toLightmapLocation + slot * batchSize;
+		if (hemi)
+		{
+			for (unsigned int i = 0; i < ctx->hemisphere.readback.hemiCount[slot]; i++)
+			{
+				const float *c = hemi + i * 4;
+				float validity = c[3];
+				if (validity > 0.9)
+				{
+					LM_ASSERT(ctx->hemisphere.results.count < ctx->hemisphere.results.capacity);
+					float scale = 1.0f / validity;
+					unsigned int r = ctx->hemisphere.results.count++;
+					float *color = ctx->hemisphere.results.color + r * 4;
+					ctx->hemisphere.results.location[r] = locations[i];
+					color[0] = c[0] * scale;
+					color[1] = c[1] * scale;
+					color[2] = c[2] * scale;
+					color[3] = 1.0f;
+				}
+			}
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		ctx->hemisphere.readback.first = (slot + 1) % LM_READBACK_RING_SIZE;
+		ctx->hemisphere.readback.count--;
+	}
+}
+
 static void lm_integrateHemisphereBatch(lm_context *ctx)
 {
 	if (!ctx->hemisphere.fbHemiIndex)
@@ -669,101 +773,83 @@ static void lm_integrateHemisphereBatch(lm_context *ctx)
 		//glBindTexture(GL_TEXTURE_2D, 0);
 	}
 
-	// copy results to storage texture
-	glBindTexture(GL_TEXTURE_2D, ctx->hemisphere.storage.texture);
-	glCopyTexSubImage2D(GL_TEXTURE_2D, 0,
-		ctx->hemisphere.storage.writePosition.x, ctx->hemisphere.storage.writePosition.y,
-		0, 0, ctx->hemisphere.fbHemiCountX, ctx->hemisphere.fbHemiCountY);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	// read the downsampled batch back asynchronously. the results only land in the lightmap
+	// at the end of the pass (sampling decisions depend on the lightmap contents), so they
+	// are collected from the pixel pack buffers while the gpu renders the following batches.
+	if (ctx->hemisphere.readback.count == LM_READBACK_RING_SIZE)
+		lm_collectReadbacks(ctx, LM_TRUE); // all buffers are in flight: wait for the oldest one
+	unsigned int slot = (ctx->hemisphere.readback.first + ctx->hemisphere.readback.count) % LM_READBACK_RING_SIZE;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, ctx->hemisphere.fb[fbWrite]);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, ctx->hemisphere.readback.pbo[slot]);
+	glReadPixels(0, 0, ctx->hemisphere.fbHemiCountX, ctx->hemisphere.fbHemiCountY, GL_RGBA, GL_FLOAT, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	ctx->hemisphere.readback.fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glBindVertexArray(0);
 	glEnable(GL_DEPTH_TEST);
 
-	// copy position mapping to storage
-	for (unsigned int y = 0; y < ctx->hemisphere.fbHemiCountY; y++)
-	{
-		int sy = ctx->hemisphere.storage.writePosition.y + y;
-		for (unsigned int x = 0; x < ctx->hemisphere.fbHemiCountX; x++)
-		{
-			int sx = ctx->hemisphere.storage.writePosition.x + x;
-			unsigned int hemiIndex = y * ctx->hemisphere.fbHemiCountX + x;
-			if (hemiIndex >= ctx->hemisphere.fbHemiIndex)
-				ctx->hemisphere.storage.toLightmapLocation[sy * ctx->lightmap.width + sx] = lm_i2(-1, -1);
-			else
-				ctx->hemisphere.storage.toLightmapLocation[sy * ctx->lightmap.width + sx] = ctx->hemisphere.fbHemiToLightmapLocation[hemiIndex];
-		}
-	}
+	// remember where the hemispheres of this batch belong in the lightmap
+	unsigned int batchSize = ctx->hemisphere.fbHemiCountX * ctx->hemisphere.fbHemiCountY;
+	memcpy(ctx->hemisphere.readback.toLightmapLocation + slot * batchSize,
+		ctx->hemisphere.fbHemiToLightmapLocation, ctx->hemisphere.fbHemiIndex * sizeof(lm_ivec2));
+	ctx->hemisphere.readback.hemiCount[slot] = ctx->hemisphere.fbHemiIndex;
+	ctx->hemisphere.readback.count++;
 
-	// advance storage texture write position
-	ctx->hemisphere.storage.writePosition.x += ctx->hemisphere.fbHemiCountX;
-	if (ctx->hemisphere.storage.writePosition.x + (int)ctx->hemisphere.fbHemiCountX > ctx->lightmap.width)
-	{
-		ctx->hemisphere.storage.writePosition.x = 0;
-		ctx->hemisphere.storage.writePosition.y += ctx->hemisphere.fbHemiCountY;
-		assert(ctx->hemisphere.storage.writePosition.y + (int)ctx->hemisphere.fbHemiCountY < ctx->lightmap.height);
-	}
+	// pick up older batches that are already done without waiting
+	lm_collectReadbacks(ctx, LM_FALSE);
 
 	ctx->hemisphere.fbHemiIndex = 0;
 }
 
 static void lm_writeResultsToLightmap(lm_context *ctx)
 {
-	// do the GPU->CPU transfer of downsampled hemispheres
-	float *hemi = (float*)LM_CALLOC(ctx->lightmap.width * ctx->lightmap.height, 4 * sizeof(float));
-	glBindTexture(GL_TEXTURE_2D, ctx->hemisphere.storage.texture);
-	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, hemi);
+	// collect the batches that are still in flight
+	while (ctx->hemisphere.readback.count)
+		lm_collectReadbacks(ctx, LM_TRUE);
 
-	// write results to lightmap texture
-	for (int y = 0; y < ctx->hemisphere.storage.writePosition.y + (int)ctx->hemisphere.fbHemiCountY; y++)
+	// write results to lightmap texture in the order they were sampled.
+	// the first result for a texel wins (a texel can be sampled by multiple triangles in one pass).
+	for (unsigned int r = 0; r < ctx->hemisphere.results.count; r++)
 	{
-		for (int x = 0; x < ctx->lightmap.width; x++)
+		lm_ivec2 lmUV = ctx->hemisphere.results.location[r];
+		const float *c = ctx->hemisphere.results.color + r * 4;
+		float *lm = ctx->lightmap.data + (lmUV.y * ctx->lightmap.width + lmUV.x) * ctx->lightmap.channels;
+		if (!lm[0])
 		{
-			lm_ivec2 lmUV = ctx->hemisphere.storage.toLightmapLocation[y * ctx->lightmap.width + x];
-			if (lmUV.x >= 0)
+			switch (ctx->lightmap.channels)
 			{
-				float *c = hemi + (y * ctx->lightmap.width + x) * 4;
-				float validity = c[3];
-				float *lm = ctx->lightmap.data + (lmUV.y * ctx->lightmap.width + lmUV.x) * ctx->lightmap.channels;
-				if (!lm[0] && validity > 0.9)
-				{
-					float scale = 1.0f / validity;
-					switch (ctx->lightmap.channels)
-					{
-					case 1:
-						lm[0] = lm_maxf((c[0] + c[1] + c[2]) * scale / 3.0f, FLT_MIN);
-						break;
-					case 2:
-						lm[0] = lm_maxf((c[0] + c[1] + c[2]) * scale / 3.0f, FLT_MIN);
-						lm[1] = 1.0f; // do we want to support this format?
-						break;
-					case 3:
-						lm[0] = lm_maxf(c[0] * scale, FLT_MIN);
-						lm[1] = lm_maxf(c[1] * scale, FLT_MIN);
-						lm[2] = lm_maxf(c[2] * scale, FLT_MIN);
-						break;
-					case 4:
-						lm[0] = lm_maxf(c[0] * scale, FLT_MIN);
-						lm[1] = lm_maxf(c[1] * scale, FLT_MIN);
-						lm[2] = lm_maxf(c[2] * scale, FLT_MIN);
-						lm[3] = 1.0f;
-						break;
-					default:
-						assert(LM_FALSE);
-						break;
-					}
+			case 1:
+				lm[0] = lm_maxf((c[0] + c[1] + c[2]) / 3.0f, FLT_MIN);
+				break;
+			case 2:
+				lm[0] = lm_maxf((c[0] + c[1] + c[2]) / 3.0f, FLT_MIN);
+				lm[1] = 1.0f; // do we want to support this format?
+				break;
+			case 3:
+				lm[0] = lm_maxf(c[0], FLT_MIN);
+				lm[1] = lm_maxf(c[1], FLT_MIN);
+				lm[2] = lm_maxf(c[2], FLT_MIN);
+				break;
+			case 4:
+				lm[0] = lm_maxf(c[0], FLT_MIN);
+				lm[1] = lm_maxf(c[1], FLT_MIN);
+				lm[2] = lm_maxf(c[2], FLT_MIN);
+				lm[3] = 1.0f;
+				break;
+			default:
+				LM_ASSERT(LM_FALSE);
+				break;
+			}
 
 #ifdef LM_DEBUG_INTERPOLATION
-					// set sampled pixel to red in debug output
-					ctx->lightmap.debug[(lmUV.y * ctx->lightmap.width + lmUV.x) * 3 + 0] = 255;
+			// set sampled pixel to red in debug output
+			ctx->lightmap.debug[(lmUV.y * ctx->lightmap.width + lmUV.x) * 3 + 0] = 255;
 #endif
-				}
-			}
-			ctx->hemisphere.storage.toLightmapLocation[y * ctx->lightmap.width + x].x = -1; // reset
 		}
 	}
 
-	LM_FREE(hemi);
-	ctx->hemisphere.storage.writePosition = lm_i2(0, 0);
+	ctx->hemisphere.results.count = 0;
 }
 
 static void lm_setView(
@@ -863,7 +949,7 @@ static lm_bool lm_beginSampleHemisphere(lm_context *ctx, int* viewport, float* v
 				   proj,     -zNear, zNear, -zNear, 0.0f, zNear, zFar);
 		break;
 	default:
-		assert(LM_FALSE);
+		LM_ASSERT(LM_FALSE);
 		break;
 	}
 
@@ -898,7 +984,7 @@ static void lm_inverseTranspose(const float *m44, float *n33)
 					  - m44[ 1] * (m44[ 4] * m44[10] - m44[ 6] * m44[ 8])
 					  + m44[ 2] * (m44[ 4] * m44[ 9] - m44[ 5] * m44[ 8]);
 
-	assert(fabs(determinant) > FLT_EPSILON);
+	LM_ASSERT(fabs(determinant) > FLT_EPSILON);
 	float rcpDeterminant = 1.0f / determinant;
 
 	n33[0] =  (m44[ 5] * m44[10] - m44[ 9] * m44[ 6]) * rcpDeterminant;
@@ -930,7 +1016,7 @@ static lm_vec3 lm_transformPosition(const float *m, lm_vec3 v)
 	r.y =     m[1] * v.x + m[5] * v.y + m[ 9] * v.z + m[13];
 	r.z =     m[2] * v.x + m[6] * v.y + m[10] * v.z + m[14];
 	float d = m[3] * v.x + m[7] * v.y + m[11] * v.z + m[15];
-	assert(lm_absf(d - 1.0f) < 0.00001f); // could divide by d, but this shouldn't be a projection transform!
+	LM_ASSERT(lm_absf(d - 1.0f) < 0.00001f); // could divide by d, but this shouldn't be a projection transform!
 	return r;
 }
 
@@ -962,7 +1048,7 @@ static void lm_setMeshPosition(lm_context *ctx, unsigned int indicesTriangleBase
 			vIndex = ((const unsigned int*)ctx->mesh.indices + ctx->meshPosition.triangle.baseIndex)[i];
 			break;
 		default:
-			assert(LM_FALSE);
+			LM_ASSERT(LM_FALSE);
 			break;
 		}
 		vIndices[i] = vIndex;
@@ -989,7 +1075,7 @@ static void lm_setMeshPosition(lm_context *ctx, unsigned int indicesTriangleBase
 			p = *(const lm_vec3*)pPtr;
 		} break;
 		default: {
-			assert(LM_FALSE);
+			LM_ASSERT(LM_FALSE);
 		} break;
 		}
 		ctx->meshPosition.triangle.p[i] = lm_transformPosition(ctx->mesh.modelMatrix, p);
@@ -1015,7 +1101,7 @@ static void lm_setMeshPosition(lm_context *ctx, unsigned int indicesTriangleBase
 			uv = *(const lm_vec2*)uvPtr;
 		} break;
 		default: {
-			assert(LM_FALSE);
+			LM_ASSERT(LM_FALSE);
 		} break;
 		}
 
@@ -1045,7 +1131,7 @@ static void lm_setMeshPosition(lm_context *ctx, unsigned int indicesTriangleBase
 			n = flatNormal;
 		} break;
 		default: {
-			assert(LM_FALSE);
+			LM_ASSERT(LM_FALSE);
 		} break;
 		}
 		ctx->meshPosition.triangle.n[i] = lm_normalize3(lm_transformNormal(ctx->mesh.normalMatrix, n));
@@ -1058,7 +1144,7 @@ static void lm_setMeshPosition(lm_context *ctx, unsigned int indicesTriangleBase
 	ctx->meshPosition.rasterizer.miny = lm_maxi((int)bbMin.y - 1, 0);
 	ctx->meshPosition.rasterizer.maxx = lm_mini((int)bbMax.x + 1, ctx->lightmap.width - 1);
 	ctx->meshPosition.rasterizer.maxy = lm_mini((int)bbMax.y + 1, ctx->lightmap.height - 1);
-	assert(ctx->meshPosition.rasterizer.minx <= ctx->meshPosition.rasterizer.maxx &&
+	LM_ASSERT(ctx->meshPosition.rasterizer.minx <= ctx->meshPosition.rasterizer.maxx &&
 		   ctx->meshPosition.rasterizer.miny <= ctx->meshPosition.rasterizer.maxy);
 	ctx->meshPosition.rasterizer.x = ctx->meshPosition.rasterizer.minx + lm_passOffsetX(ctx);
 	ctx->meshPosition.rasterizer.y = ctx->meshPosition.rasterizer.miny + lm_passOffsetY(ctx);
@@ -1147,12 +1233,12 @@ lm_context *lmCreate(int hemisphereSize, float zNear, float zFar,
 	int interpolationPasses, float interpolationThreshold,
 	float cameraToSurfaceDistanceModifier)
 {
-	assert(hemisphereSize == 512 || hemisphereSize == 256 || hemisphereSize == 128 ||
+	LM_ASSERT(hemisphereSize == 512 || hemisphereSize == 256 || hemisphereSize == 128 ||
 		   hemisphereSize ==  64 || hemisphereSize ==  32 || hemisphereSize ==  16);
-	assert(zNear < zFar && zNear > 0.0f);
-	assert(cameraToSurfaceDistanceModifier >= -1.0f);
-	assert(interpolationPasses >= 0 && interpolationPasses <= 8);
-	assert(interpolationThreshold >= 0.0f);
+	LM_ASSERT(zNear < zFar && zNear > 0.0f);
+	LM_ASSERT(cameraToSurfaceDistanceModifier >= -1.0f);
+	LM_ASSERT(interpolationPasses >= 0 && interpolationPasses <= 8);
+	LM_ASSERT(interpolationThreshold >= 0.0f);
 
 	lm_context *ctx = (lm_context*)LM_CALLOC(1, sizeof(lm_context));
 
@@ -1324,6 +1410,28 @@ lm_context *lmCreate(int hemisphereSize, float zNear, float zFar,
 	// allocate batchPosition-to-lightmapPosition map
 	ctx->hemisphere.fbHemiToLightmapLocation = (lm_ivec2*)LM_CALLOC(ctx->hemisphere.fbHemiCountX * ctx->hemisphere.fbHemiCountY, sizeof(lm_ivec2));
 
+	// pixel pack buffers for asynchronous batch readback, allocated once and reused
+	unsigned int batchBytes = ctx->hemisphere.fbHemiCountX * ctx->hemisphere.fbHemiCountY * 4 * sizeof(float);
+	glGenBuffers(LM_READBACK_RING_SIZE, ctx->hemisphere.readback.pbo);
+	for (int i = 0; i < LM_READBACK_RING_SIZE; i++)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, ctx->hemisphere.readback.pbo[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, batchBytes, 0, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	ctx->hemisphere.readback.toLightmapLocation = (lm_ivec2*)LM_CALLOC(LM_READBACK_RING_SIZE * ctx->hemisphere.fbHemiCountX * ctx->hemisphere.fbHemiCountY, sizeof(lm_ivec2));
+
+	// report gpu allocations only once everything succeeded
+	LM_GL_TRACK(Texture, ctx->hemisphere.fbTexture[0], (size_t)w[0] * h[0] * 4 * sizeof(float));
+	LM_GL_TRACK(Texture, ctx->hemisphere.fbTexture[1], (size_t)w[1] * h[1] * 4 * sizeof(float));
+	LM_GL_TRACK(Framebuffer, ctx->hemisphere.fb[0], 0);
+	LM_GL_TRACK(Framebuffer, ctx->hemisphere.fb[1], 0);
+	LM_GL_TRACK(Renderbuffer, ctx->hemisphere.fbDepth, (size_t)w[0] * h[0] * 4);
+	LM_GL_TRACK(VertexArray, ctx->hemisphere.vao, 0);
+	for (int i = 0; i < LM_READBACK_RING_SIZE; i++)
+		LM_GL_TRACK(Buffer, ctx->hemisphere.readback.pbo[i], batchBytes);
+	LM_GL_TRACK(Texture, ctx->hemisphere.firstPass.weightsTexture, (size_t)3 * ctx->hemisphere.size * ctx->hemisphere.size * 2 * sizeof(float));
+
 	return ctx;
 }
 
@@ -1339,18 +1447,31 @@ void lmDestroy(lm_context *ctx)
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 
 	// delete gl objects
+	LM_GL_UNTRACK(Texture, ctx->hemisphere.firstPass.weightsTexture);
+	for (int i = 0; i < LM_READBACK_RING_SIZE; i++)
+		LM_GL_UNTRACK(Buffer, ctx->hemisphere.readback.pbo[i]);
+	LM_GL_UNTRACK(VertexArray, ctx->hemisphere.vao);
+	LM_GL_UNTRACK(Renderbuffer, ctx->hemisphere.fbDepth);
+	LM_GL_UNTRACK(Framebuffer, ctx->hemisphere.fb[0]);
+	LM_GL_UNTRACK(Framebuffer, ctx->hemisphere.fb[1]);
+	LM_GL_UNTRACK(Texture, ctx->hemisphere.fbTexture[0]);
+	LM_GL_UNTRACK(Texture, ctx->hemisphere.fbTexture[1]);
 	glDeleteTextures(1, &ctx->hemisphere.firstPass.weightsTexture);
-	glDeleteTextures(1, &ctx->hemisphere.storage.texture);
+	// readbacks still in flight (destroyed before finishing) are dropped
+	for (unsigned int i = 0; i < ctx->hemisphere.readback.count; i++)
+		glDeleteSync(ctx->hemisphere.readback.fence[(ctx->hemisphere.readback.first + i) % LM_READBACK_RING_SIZE]);
+	glDeleteBuffers(LM_READBACK_RING_SIZE, ctx->hemisphere.readback.pbo);
 	glDeleteProgram(ctx->hemisphere.downsamplePass.programID);
 	glDeleteProgram(ctx->hemisphere.firstPass.programID);
 	glDeleteVertexArrays(1, &ctx->hemisphere.vao);
 	glDeleteRenderbuffers(1, &ctx->hemisphere.fbDepth);
 	glDeleteFramebuffers(2, ctx->hemisphere.fb);
 	glDeleteTextures(2, ctx->hemisphere.fbTexture);
-	glDeleteTextures(1, &ctx->hemisphere.storage.texture);
 
 	// free memory
-	LM_FREE(ctx->hemisphere.storage.toLightmapLocation);
+	LM_FREE(ctx->hemisphere.readback.toLightmapLocation);
+	LM_FREE(ctx->hemisphere.results.location);
+	LM_FREE(ctx->hemisphere.results.color);
 	LM_FREE(ctx->hemisphere.fbHemiToLightmapLocation);
 #ifdef LM_DEBUG_INTERPOLATION
 	LM_FREE(ctx->lightmap.debug);
@@ -1412,23 +1533,16 @@ void lmSetTargetLightmap(lm_context *ctx, float *outLightmap, int w, int h, int
 	ctx->lightmap.height = h;
 	ctx->lightmap.channels = c;
 
-	// allocate storage texture
-	if (!ctx->hemisphere.storage.texture)
-		glGenTextures(1, &ctx->hemisphere.storage.texture);
-	glBindTexture(GL_TEXTURE_2D, ctx->hemisphere.storage.texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, 0);
-
-	// allocate storage position to lightmap position map
-	if (ctx->hemisphere.storage.toLightmapLocation)
-		LM_FREE(ctx->hemisphere.storage.toLightmapLocation);
-	ctx->hemisphere.storage.toLightmapLocation = (lm_ivec2*)LM_CALLOC(w * h, sizeof(lm_ivec2));
-	// invalidate all positions
-	for (int i = 0; i < w * h; i++)
-		ctx->hemisphere.storage.toLightmapLocation[i].x = -1;
+	// allocate the pending results of one pass. like the storage texture this replaces,
+	// a pass can hold at most one hemisphere per lightmap texel.
+	if (ctx->hemisphere.results.location)
+		LM_FREE(ctx->hemisphere.results.location);
+	if (ctx->hemisphere.results.color)
+		LM_FREE(ctx->hemisphere.results.color);
+	ctx->hemisphere.results.capacity = w * h;
+	ctx->hemisphere.results.location = (lm_ivec2*)LM_CALLOC(w * h, sizeof(lm_ivec2));
+	ctx->hemisphere.results.color = (float*)LM_CALLOC(w * h, 4 * sizeof(float));
+	ctx->hemisphere.results.count = 0;
 
 #ifdef LM_DEBUG_INTERPOLATION
 	if (ctx->lightmap.debug)
@@ -1466,7 +1580,7 @@ void lmSetGeometry(lm_context *ctx,
 
 lm_bool lmBegin(lm_context *ctx, int* outViewport4, float* outView4x4, float* outProjection4x4)
 {
-	assert(ctx->meshPosition.triangle.baseIndex < ctx->mesh.count);
+	LM_ASSERT(ctx->meshPosition.triangle.baseIndex < ctx->mesh.count);
 	while (!lm_beginSampleHemisphere(ctx, outViewport4, outView4x4, outProjection4x4))
 	{ // as long as there are no hemisphere sides to render...
 		// try moving to the next rasterizer position
@@ -1483,7 +1597,7 @@ lm_bool lmBegin(lm_context *ctx, int* outViewport4, float* outView4x4, float* ou
 			else
 			{ // ...and there are no triangles left: finish
 				lm_integrateHemisphereBatch(ctx); // integrate and store last batch
-				lm_writeResultsToLightmap(ctx); // read storage data from gpu memory and write it to the lightmap
+				lm_writeResultsToLightmap(ctx); // wait for the remaining readbacks and write the results of this pass to the lightmap
 
 				if (++ctx->meshPosition.pass == ctx->meshPosition.passCount)
 				{
@@ -1538,10 +1652,55 @@ void lmEnd(lm_context *ctx)
 	lm_endSampleHemisphere(ctx);
 }
 
+lm_position lmGetPosition(lm_context *ctx)
+{
+	LM_ASSERT(ctx->meshPosition.hemisphere.side == 0 || ctx->meshPosition.hemisphere.side == 5);
+	lm_position position;
+	position.pass = ctx->meshPosition.pass;
+	position.baseIndex = ctx->meshPosition.triangle.baseIndex;
+	position.x = ctx->meshPosition.rasterizer.x;
+	position.y = ctx->meshPosition.rasterizer.y;
+	position.side = ctx->meshPosition.hemisphere.side;
+	return position;
+}
+
+unsigned int lmFlushResults(lm_context *ctx, const int **outLocationsXY, const float **outColorsRGBA)
+{
+	LM_ASSERT(ctx->meshPosition.hemisphere.side == 0 || ctx->meshPosition.hemisphere.side == 5);
+	lm_integrateHemisphereBatch(ctx);
+	while (ctx->hemisphere.readback.count)
+		lm_collectReadbacks(ctx, LM_TRUE);
+	*outLocationsXY = (const int*)ctx->hemisphere.results.location;
+	*outColorsRGBA = ctx->hemisphere.results.color;
+	return ctx->hemisphere.results.count;
+}
+
+void lmSetPosition(lm_context *ctx, lm_position position, unsigned int resultCount, const int *locationsXY, const float *colorsRGBA)
+{
+	LM_ASSERT(position.pass >= 0 && position.pass < ctx->meshPosition.passCount);
+	LM_ASSERT(position.baseIndex + 2 < ctx->mesh.count);
+	LM_ASSERT(position.side == 0 || position.side == 5);
+	LM_ASSERT(resultCount <= ctx->hemisphere.results.capacity);
+
+	// reload the triangle, then move the rasterizer to the stored position
+	ctx->meshPosition.pass = position.pass;
+	lm_setMeshPosition(ctx, position.baseIndex);
+	ctx->meshPosition.rasterizer.x = position.x;
+	ctx->meshPosition.rasterizer.y = position.y;
+	ctx->meshPosition.hemisphere.side = 5;
+	// the sample orientation is not stored: sample the position again (it has not been written to the lightmap yet)
+	if (position.side == 0 && lm_trySamplingConservativeTriangleRasterizerPosition(ctx))
+		ctx->meshPosition.hemisphere.side = 0;
+
+	memcpy(ctx->hemisphere.results.location, locationsXY, resultCount * sizeof(lm_ivec2));
+	memcpy(ctx->hemisphere.results.color, colorsRGBA, resultCount * 4 * sizeof(float));
+	ctx->hemisphere.results.count = resultCount;
+}
+
 // these are not performance tuned since their impact on the whole lightmapping duration is insignificant
 float lmImageMin(const float *image, int w, int h, int c, int m)
 {
-	assert(c > 0 && m);
+	LM_ASSERT(c > 0 && m);
 	float minValue = FLT_MAX;
 	for (int i = 0; i < w * h; i++)
 		for (int j = 0; j < c; j++)
@@ -1552,7 +1711,7 @@ float lmImageMin(const float *image, int w, int h, int c, int m)
 
 float lmImageMax(const float *image, int w, int h, int c, int m)
 {
-	assert(c > 0 && m);
+	LM_ASSERT(c > 0 && m);
 	float maxValue = 0.0f;
 	for (int i = 0; i < w * h; i++)
 		for (int j = 0; j < c; j++)
@@ -1563,7 +1722,7 @@ float lmImageMax(const float *image, int w, int h, int c, int m)
 
 void lmImageAdd(float *image, int w, int h, int c, float value, int m)
 {
-	assert(c > 0 && m);
+	LM_ASSERT(c > 0 && m);
 	for (int i = 0; i < w * h; i++)
 		for (int j = 0; j < c; j++)
 			if (m & (1 << j))
@@ -1572,7 +1731,7 @@ void lmImageAdd(float *image, int w, int h, int c, float value, int m)
 
 void lmImageScale(float *image, int w, int h, int c, float factor, int m)
 {
-	assert(c > 0 && m);
+	LM_ASSERT(c > 0 && m);
 	for (int i = 0; i < w * h; i++)
 		for (int j = 0; j < c; j++)
 			if (m & (1 << j))
@@ -1581,7 +1740,7 @@ void lmImageScale(float *image, int w, int h, int c, float factor, int m)
 
 void lmImagePower(float *image, int w, int h, int c, float exponent, int m)
 {
-	assert(c > 0 && m);
+	LM_ASSERT(c > 0 && m);
 	for (int i = 0; i < w * h; i++)
 		for (int j = 0; j < c; j++)
 			if (m & (1 << j))
@@ -1590,7 +1749,7 @@ void lmImagePower(float *image, int w, int h, int c, float exponent, int m)
 
 void lmImageDilate(const float *image, float *outImage, int w, int h, int c)
 {
-	assert(c > 0 && c <= 4);
+	LM_ASSERT(c > 0 && c <= 4);
 	for (int y = 0; y < h; y++)
 	{
 		for (int x = 0; x < w; x++)
@@ -1643,7 +1802,7 @@ void lmImageDilate(const float *image, float *outImage, int w, int h, int c)
 
 void lmImageSmooth(const float *image, float *outImage, int w, int h, int c)
 {
-	assert(c > 0 && c <= 4);
+	LM_ASSERT(c > 0 && c <= 4);
 	for (int y = 0; y < h; y++)
 	{
 		for (int x = 0; x < w; x++)
@@ -1678,7 +1837,7 @@ void lmImageSmooth(const float *image, float *outImage, int w, int h, int c)
 
 void lmImageDownsample(const float *image, float *outImage, int w, int h, int c)
 {
-	assert(c > 0 && c <= 4);
+	LM_ASSERT(c > 0 && c <= 4);
 	for (int y = 0; y < h / 2; y++)
 	{
 		for (int x = 0; x < w / 2; x++)
@@ -1705,7 +1864,7 @@ void lmImageDownsample(const float *image, float *outImage, int w, int h, int c)
 
 void lmImageFtoUB(const float *image, unsigned char *outImage, int w, int h, int c, float max)
 {
-	assert(c > 0);
+	LM_ASSERT(c > 0);
 	float scale = 255.0f / (max != 0.0f ? max : lmImageMax(image, w, h, c, LM_ALL_CHANNELS));
 	for (int i = 0; i < w * h * c; i++)
 		outImage[i] = (unsigned char)lm_minf(lm_maxf(image[i] * scale, 0.0f), 255.0f);
@@ -1714,14 +1873,14 @@ void lmImageFtoUB(const float *image, unsigned char *outImage, int w, int h, int
 // TGA output helpers
 static void lm_swapRandBub(unsigned char *image, int w, int h, int c)
 {
-	assert(c >= 3);
+	LM_ASSERT(c >= 3);
 	for (int i = 0; i < w * h * c; i += c)
 		LM_SWAP(unsigned char, image[i], image[i + 2]);
 }
 
 lm_bool lmImageSaveTGAub(const char *filename, const unsigned char *image, int w, int h, int c)
 {
-	assert(c == 1 || c == 3 || c == 4);
+	LM_ASSERT(c == 1 || c == 3 || c == 4);
 	lm_bool isGreyscale = c == 1;
 	lm_bool hasAlpha = c == 4;
 	unsigned char header[18] = {
@@ -8,6 +8,7 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include "RenderStats.h"
 
 using std::string;
 using std::ifstream;
@@ -43,9 +44,9 @@ public:
             // 关闭文件处理器
             vShaderFile.close();
             fShaderFile.close();
-            // 将stream转换为字符串
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            // 将stream转换为字符串，并展开#include引用的公共代码
+            vertexCode = resolveIncludes(vShaderStream.str(), vertexPath);
+            fragmentCode = resolveIncludes(fShaderStream.str(), fragmentPath);
         } catch (ifstream::failure& e) {
             cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << endl;
         }
@@ -84,61 +85,112 @@ public:
     // 设置一个布尔类型的uniform变量
     void setBool(const std::string& name, bool value) const {
         glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        STATS_COUNT(uniformCalls, 1);
     }
 
     // 设置一个整型的uniform变量
     void setInt(const std::string& name, int value) const {
         glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        STATS_COUNT(uniformCalls, 1);
     }
 
     // 设置一个浮点类型的uniform变量
     void setFloat(const std::string& name, float value) const {
         glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        STATS_COUNT(uniformCalls, 1);
+    }
+
+    // 设置一个ivec2类型的uniform变量
+    void setIVec2(const std::string& name, const glm::ivec2& value) const {
+        glUniform2iv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        STATS_COUNT(uniformCalls, 1);
     }
 
     // 设置一个vec2类型的uniform变量
     void setVec2(const std::string& name, const glm::vec2& value) const {
         glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        STATS_COUNT(uniformCalls, 1);
     }
     // 设置一个vec2类型的uniform变量
     void setVec2(const std::string& name, float x, float y) const {
         glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        STATS_COUNT(uniformCalls, 1);
     }
 
     // 设置一个vec3类型的uniform变量
     void setVec3(const std::string& name, const glm::vec3& value) const {
         glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        STATS_COUNT(uniformCalls, 1);
     }
     // 设置一个vec3类型的uniform变量
     void setVec3(const std::string& name, float x, float y, float z) const {
         glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        STATS_COUNT(uniformCalls, 1);
     }
 
     // 设置一个vec4类型的uniform变量
     void setVec4(const std::string& name, const glm::vec4& value) const {
         glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        STATS_COUNT(uniformCalls, 1);
     }
     // 设置一个vec4类型的uniform变量
     void setVec4(const std::string& name, float x, float y, float z, float w) {
         glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        STATS_COUNT(uniformCalls, 1);
     }
 
     // 设置一个mat2类型的uniform变量
     void setMat2(const std::string& name, const glm::mat2& mat) const {
         glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        STATS_COUNT(uniformCalls, 1);
     }
 
     //  设置一个mat3类型的uniform变量
     void setMat3(const std::string& name, const glm::mat3& mat) const {
         glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        STATS_COUNT(uniformCalls, 1);
     }
 
     // 设置一个mat4类型的uniform变量
     void setMat4(const std::string& name, const glm::mat4& mat) const {
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        STATS_COUNT(uniformCalls, 1);
     }
 
 private:
+    // 展开着色器源码中的 #include "文件名"，文件路径相对于当前着色器文件所在的目录
+    static string resolveIncludes(const string& code, const string& path) {
+        string directory = path.substr(0, path.find_last_of("/\\") + 1);
+        stringstream input(code);
+        stringstream output;
+        string line;
+        while (std::getline(input, line)) {
+            size_t pos = line.find("#include");
+            if (pos != string::npos && line.find_first_not_of(" \t") == pos) {
+                size_t begin = line.find('"', pos);
+                size_t end = line.find('"', begin + 1);
+                if (begin == string::npos || end == string::npos) {
+                    cout << "ERROR::SHADER::INVALID_INCLUDE: " << line << endl;
+                    continue;
+                }
+                string includePath = directory + line.substr(begin + 1, end - begin - 1);
+                ifstream includeFile(includePath);
+                if (!includeFile) {
+                    cout << "ERROR::SHADER::INCLUDE_NOT_FOUND: " << includePath << endl;
+                    continue;
+                }
+                stringstream includeStream;
+                includeStream << includeFile.rdbuf();
+                // 被引用的文件里也可以继续引用其他文件
+                output << resolveIncludes(includeStream.str(), includePath) << "\n";
+            }
+            else {
+                output << line << "\n";
+            }
+        }
+        return output.str();
+    }
+
     // 检查着色器编译/链接错误
     void checkCompileErrors(GLuint shader, string type) {
         GLint success;
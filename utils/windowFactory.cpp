@@ -1,6 +1,6 @@
-#include "WindowFactory.h"
+#include "windowFactory.h"
 
-Camera GLFWWindowFactory::camera = Camera(glm::vec3(0.0f, 0.0f, 25.0f));
+Camera WindowFactory::camera = Camera(glm::vec3(0.0f, 0.0f, 25.0f));
 
 // 初始化鼠标的最后X位置为屏幕宽度的一半
 float GLFWWindowFactory::lastX = GLFWWindowFactory::SCR_WIDTH / 2.0f;
@@ -8,9 +8,19 @@ float GLFWWindowFactory::lastX = GLFWWindowFactory::SCR_WIDTH / 2.0f;
 float GLFWWindowFactory::lastY = GLFWWindowFactory::SCR_HEIGHT / 2.0f;
 // 标记是否为第一次鼠标输入
 bool GLFWWindowFactory::firstMouse = true;
-// 初始化帧间隔时间
-float GLFWWindowFactory::deltaTime = 0.0f;
-// 初始化上一帧的时间
-float GLFWWindowFactory::lastFrame = 0.0f;
-bool GLFWWindowFactory::blinn = false;
-bool GLFWWindowFactory::blinnKeyPressed = false;
\ No newline at end of file
+bool WindowFactory::blinn = false;
+bool WindowFactory::blinnKeyPressed = false;
+bool WindowFactory::deferred = false;
+bool WindowFactory::deferredKeyPressed = false;
+bool WindowFactory::depthPrepass = false;
+bool WindowFactory::depthPrepassKeyPressed = false;
+bool WindowFactory::occlusionCulling = false;
+bool WindowFactory::occlusionCullingKeyPressed = false;
+bool WindowFactory::bloom = true;
+bool WindowFactory::bloomKeyPressed = false;
+bool WindowFactory::profiler = false;
+bool WindowFactory::profilerKeyPressed = false;
+bool WindowFactory::memoryReportKeyPressed = false;
+// 累计的鼠标移动和滚轮滚动
+glm::vec2 GLFWWindowFactory::mouseOffset = glm::vec2(0.0f);
+float GLFWWindowFactory::scrollOffset = 0.0f;
\ No newline at end of file
@@ -4,19 +4,162 @@
 #include <GLFW/glfw3.h>
 #include <functional>
 #include <iostream>
-#include "QuaternionCamera.h"
+#include <string>
+#include "quaternionCamera.h"
+#include "FramePipeline.h"
+#include "SimulationClock.h"
+#include "GpuResource.h"
 
 using std::cout;
 using std::endl;
 
-class GLFWWindowFactory {
+// 窗口的抽象：提供opengl上下文、渲染循环、输入、时间和摄像机矩阵
+// Scene和SkyBox只依赖这个接口，既可以渲染到GLFW窗口，也可以在没有显示器的机器上离屏渲染
+class WindowFactory {
 public:
     static bool blinn;
     static bool blinnKeyPressed; // 添加一个标志位
+    static bool deferred; // 是否使用延迟渲染
+    static bool deferredKeyPressed;
+    static bool depthPrepass; // 是否开启深度预渲染
+    static bool depthPrepassKeyPressed;
+    static bool occlusionCulling; // 是否开启层级深度遮挡剔除
+    static bool occlusionCullingKeyPressed;
+    static bool bloom; // 是否开启泛光
+    static bool bloomKeyPressed;
+    static bool profiler; // 是否开启性能分析
+    static bool profilerKeyPressed;
+    static bool memoryReportKeyPressed;
+    // 摄像机，渲染循环运行时只由更新线程修改，opengl线程从帧数据包中读取
+    static Camera camera;
+    // 投影矩阵
+    glm::mat4 projection;
+    // 视图矩阵
+    glm::mat4 view;
+
+    WindowFactory(unsigned int width, unsigned int height) : width(width), height(height), previousCameraPosition(camera.Position) {}
+    virtual ~WindowFactory() {}
+
+    // 运行渲染循环
+    // updateFunc在更新线程上执行，为一帧生成数据包，不能调用opengl；renderFunc在opengl线程上按数据包提交这一帧
+    virtual void run(std::function<void(FramePacket&)> updateFunc, std::function<void(const FramePacket&)> renderFunc) = 0;
+
+    // 查询按键是否处于按下状态（GLFW_KEY_*），没有键盘的实现总是返回false
+    virtual bool isKeyPressed(int key) const = 0;
+
+    // 获取从启动开始经过的时间（秒）
+    virtual float getTime() const = 0;
+
+    // 最终画面输出到的帧缓冲，0表示窗口的默认帧缓冲
+    virtual unsigned int getOutputFramebuffer() const { return 0; }
+
+    // 在窗口标题上显示状态（例如烘焙进度），传入空字符串恢复原来的标题；没有窗口的实现忽略
+    virtual void setStatusText(const std::string& text) {}
+
+    // 开启固定时间步长模式：时间按帧数推进，和实际耗时无关，忽略键盘鼠标输入，渲染frameLimit帧后退出（0表示不限制）
+    // 用于基准测试和离屏渲染，保证每次运行看到的画面完全相同
+    void setFixedTimestep(float timestep, unsigned int frameLimit) {
+        this->fixedTimestep = timestep;
+        this->frameLimit = frameLimit;
+    }
+    // 是否是固定时间步长模式
+    bool isFixedTimestep() const { return this->fixedTimestep > 0.0f; }
+    // 获取opengl线程正在提交的帧的序号
+    unsigned int getFrameIndex() const { return this->frameIndex; }
+
+    // 开启/关闭帧流水线：开启时更新在单独的线程上和opengl提交并行执行，关闭时串行执行，在run之前设置
+    void setPipelined(bool pipelined) { this->pipelined = pipelined; }
+
+    // 设置摄像机控制器：每帧在更新线程上按这一帧的时间设置摄像机，代替键盘鼠标输入，用于回放摄像机路径
+    void setCameraController(std::function<void(float)> controller) { this->cameraController = std::move(controller); }
+
+    // 获取渲染的宽度
+    unsigned int getWidth() const { return this->width; }
+    // 获取渲染的高度
+    unsigned int getHeight() const { return this->height; }
+
+    // 获取投影矩阵
+    const glm::mat4 getProjectionMatrix() {
+        return this->projection;
+    }
+
+    // 获取视图矩阵
+    glm::mat4 getViewMatrix() {
+        return this->view;
+    }
+
+protected:
+    // 渲染的宽度
+    unsigned int width;
+    // 渲染的高度
+    unsigned int height;
+    // 固定时间步长（秒），0表示使用实际时间
+    float fixedTimestep = 0.0f;
+    // 渲染的帧数上限，0表示不限制
+    unsigned int frameLimit = 0;
+    // 当前帧的序号
+    unsigned int frameIndex = 0;
+    // 是否使用单独的更新线程
+    bool pipelined = true;
+    // 摄像机控制器，为空时摄像机由输入控制
+    std::function<void(float)> cameraController;
+    // 模拟时钟，只在更新线程上使用
+    SimulationClock clock;
+    // 上一个模拟步的摄像机位置，用于插值
+    glm::vec3 previousCameraPosition;
+
+    // 更新线程：按固定步长推进模拟，根据输入或摄像机控制器更新摄像机，把插值后的摄像机和矩阵写入数据包，再执行更新函数
+    void updateFrame(FramePacket& packet, const std::function<void(FramePacket&)>& updateFunc) {
+        packet.simulationSteps = this->clock.advance(packet.input.time);
+        packet.simulationAlpha = this->clock.getAlpha();
+        if (this->cameraController) {
+            // 路径本身就是时间的函数，不需要插值
+            this->cameraController(packet.input.time);
+            this->previousCameraPosition = camera.Position;
+        }
+        else {
+            applyCameraInput(packet.input, packet.simulationSteps);
+        }
+        // 位置在最近两个模拟步之间插值，朝向直接使用最新的值
+        packet.cameraPosition = glm::mix(this->previousCameraPosition, camera.Position, packet.simulationAlpha);
+        packet.cameraFront = camera.Front;
+        packet.projection =
+            glm::perspective(glm::radians(camera.Zoom),
+                (float)this->width / (float)this->height, 0.1f, 1000.0f);
+        packet.view = glm::lookAt(packet.cameraPosition, packet.cameraPosition + camera.Front, camera.Up);
+        packet.viewProjection = packet.projection * packet.view;
+        updateFunc(packet);
+    }
+
+    // opengl线程：开始提交一帧，之后getProjectionMatrix和getViewMatrix返回这一帧的矩阵
+    void beginFrame(const FramePacket& packet) {
+        this->projection = packet.projection;
+        this->view = packet.view;
+    }
+
+    // 把一帧的键盘鼠标输入应用到摄像机
+    // 鼠标和滚轮每帧直接应用，保证视角转动的响应；按键移动按固定步长积分，移动速度和帧率无关
+    void applyCameraInput(const FrameInput& input, unsigned int steps) {
+        if (input.mouseOffset.x != 0.0f || input.mouseOffset.y != 0.0f)
+            camera.ProcessMouseMovement(input.mouseOffset.x, input.mouseOffset.y);
+        if (input.scrollOffset != 0.0f)
+            camera.ProcessMouseScroll(input.scrollOffset);
+        for (unsigned int step = 0; step < steps; step++) {
+            this->previousCameraPosition = camera.Position;
+            for (int movement = FORWARD; movement <= YAW_RIGHT; movement++) {
+                if (input.movement & (1u << movement))
+                    camera.ProcessKeyboard((Camera_Movement)movement, (float)SimulationClock::STEP);
+            }
+        }
+    }
+};
+
+class GLFWWindowFactory : public WindowFactory {
+public:
     // 默认构造函数
-    GLFWWindowFactory() {}
+    GLFWWindowFactory() : WindowFactory(SCR_WIDTH, SCR_HEIGHT) {}
     // 构造函数，初始化窗口
-    GLFWWindowFactory(int width, int height, const char* title) {
+    GLFWWindowFactory(int width, int height, const char* title) : WindowFactory(width, height) {
         // 初始化glfw
         glfwInit();
         // 设置opengl版本
@@ -26,6 +169,7 @@ public:
         glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
         // 创建glfw窗口
+        this->title = title;
         this->window = glfwCreateWindow(width, height, title, NULL, NULL);
         if (this->window == NULL) {
             cout << "Failed to create GLFW window" << endl;
@@ -55,51 +199,92 @@ public:
 
     }
 
+    // 在窗口标题后面显示状态
+    void setStatusText(const std::string& text) override {
+        glfwSetWindowTitle(this->window, text.empty() ? this->title.c_str() : (this->title + " - " + text).c_str());
+    }
+
     // 获取窗口对象
     GLFWwindow* getWindow() {
         return this->window;
     }
 
-    // 运行窗口，传入一个自定义的更新函数
-    void run(std::function<void()> updateFunc) {
+    // 运行窗口
+    // 第N帧在opengl线程上提交时，更新线程已经在用第N+1帧的输入生成数据包
+    void run(std::function<void(FramePacket&)> updateFunc, std::function<void(const FramePacket&)> renderFunc) override {
         // 启用深度测试，opengl将在绘制每个像素之前比较其深度值，以确定该像素是否应该被绘制
         glEnable(GL_DEPTH_TEST);
 
+        // 固定时间步长模式下关闭垂直同步，测到的是渲染本身的耗时
+        if (isFixedTimestep())
+            glfwSwapInterval(0);
+
+        FramePipeline pipeline([&](FramePacket& packet) { updateFrame(packet, updateFunc); }, this->pipelined);
+        // 第一帧的输入
+        pipeline.submit(captureInput(0));
+
         // 循环渲染
-        while (!glfwWindowShouldClose(this->window)) { // 检查是否应该关闭窗口
+        while (!glfwWindowShouldClose(this->window) // 检查是否应该关闭窗口
+            && (this->frameLimit == 0 || this->frameIndex < this->frameLimit)) {
+            // 取出这一帧的数据包
+            const FramePacket& packet = pipeline.acquire();
+            // 提交这一帧之前先把下一帧的输入交给更新线程，两者并行执行
+            if (this->frameLimit == 0 || this->frameIndex + 1 < this->frameLimit)
+                pipeline.submit(captureInput(this->frameIndex + 1));
+
             // 清空屏幕所用的颜色
             glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
             // 清空颜色缓冲，主要目的是为每一帧的渲染准备一个干净的画布
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
             float currentFrame = glfwGetTime();
-            this->deltaTime = currentFrame - this->lastFrame;
+            this->timeElapsed += currentFrame - this->lastFrame;
             this->lastFrame = currentFrame;
-            this->timeElapsed += this->deltaTime;
+            this->updateTimeElapsed += packet.updateMs;
             this->frameCount++;
+            // 开启性能分析时每秒输出一次帧率、平均帧时间和更新线程的平均耗时，用于观察性能变化
+            if (this->timeElapsed >= 1.0f) {
+                if (profiler)
+                    cout << "fps: " << this->frameCount / this->timeElapsed
+                        << ", frame time: " << this->timeElapsed * 1000.0f / this->frameCount << " ms"
+                        << ", update: " << this->updateTimeElapsed / this->frameCount << " ms" << endl;
+                this->timeElapsed = 0.0f;
+                this->updateTimeElapsed = 0.0;
+                this->frameCount = 0;
+            }
 
-            // 处理输入
-            GLFWWindowFactory::process_input(this->window);
-
-            // 初始化投影矩阵和视图矩阵
-            this->projection =
-                glm::perspective(glm::radians(camera.Zoom),
-                    (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
-            this->view = this->camera.GetViewMatrix();
-
-            // 执行更新函数
-            updateFunc();
+            // 按数据包提交这一帧
+            beginFrame(packet);
+            renderFunc(packet);
+            this->frameIndex++;
 
             // 交换缓冲区
             glfwSwapBuffers(this->window);
             // 处理所有待处理事件，去poll所有事件，看看哪个没处理的
             glfwPollEvents();
         }
+    }
 
-        // 终止GLFW，清理GLFW分配的资源
+    // 终止GLFW，清理GLFW分配的资源
+    // 放在析构函数里，run返回后仍然可以读取基准测试和性能分析的查询结果
+    ~GLFWWindowFactory() override {
         glfwTerminate();
     }
 
+    // 查询按键是否处于按下状态
+    bool isKeyPressed(int key) const override {
+        if (isFixedTimestep())
+            return false;
+        return glfwGetKey(this->window, key) == GLFW_PRESS;
+    }
+
+    // 获取从glfw初始化开始经过的时间，固定时间步长模式下按帧数计算
+    float getTime() const override {
+        if (isFixedTimestep())
+            return this->frameIndex * this->fixedTimestep;
+        return (float)glfwGetTime();
+    }
+
     // 窗口大小改变的回调函数
     static void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
         // 确保视口与新窗口尺寸匹配，注意在视网膜显示器上，宽度和高度会显著大于指定值
@@ -124,12 +309,13 @@ public:
         lastX = xpos;
         lastY = ypos;
 
-        camera.ProcessMouseMovement(xoffset, yoffset);
+        // 摄像机由更新线程修改，这里只累计鼠标移动，下一帧采集输入时交给更新线程
+        mouseOffset += glm::vec2(xoffset, yoffset);
     }
 
     // 鼠标滚轮的回调函数
     static void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
-        camera.ProcessMouseScroll(static_cast<float>(yoffset));
+        scrollOffset += static_cast<float>(yoffset);
     }
 
     // 鼠标按钮的回调函数
@@ -145,37 +331,60 @@ public:
         }
     }
 
-    // 处理输入
-    static void process_input(GLFWwindow* window) {
+    // 采集一帧的输入，在opengl线程上调用
+    FrameInput captureInput(unsigned int frameIndex) {
+        FrameInput input;
+        input.frameIndex = frameIndex;
+        if (isFixedTimestep()) {
+            // 固定时间步长模式下摄像机由外部控制，只响应ESC
+            input.time = frameIndex * this->fixedTimestep;
+            if (glfwGetKey(this->window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+                glfwSetWindowShouldClose(this->window, true);
+            mouseOffset = glm::vec2(0.0f);
+            scrollOffset = 0.0f;
+            return input;
+        }
+        input.time = (float)glfwGetTime();
+        input.movement = GLFWWindowFactory::process_input(this->window);
+        input.mouseOffset = mouseOffset;
+        input.scrollOffset = scrollOffset;
+        mouseOffset = glm::vec2(0.0f);
+        scrollOffset = 0.0f;
+        return input;
+    }
+
+    // 处理输入，切换渲染选项，返回按下的摄像机移动键（第i位对应Camera_Movement中的第i个值）
+    static unsigned int process_input(GLFWwindow* window) {
         // 按下ESC键时进入if块
         if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
             // 关闭窗口
             glfwSetWindowShouldClose(window, true);
 
+        unsigned int movement = 0;
         if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-            camera.ProcessKeyboard(FORWARD, deltaTime);
+            movement |= 1u << FORWARD;
         if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-            camera.ProcessKeyboard(BACKWARD, deltaTime);
+            movement |= 1u << BACKWARD;
         if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-            camera.ProcessKeyboard(LEFT, deltaTime);
+            movement |= 1u << LEFT;
         if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-            camera.ProcessKeyboard(RIGHT, deltaTime);
+            movement |= 1u << RIGHT;
         if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-            camera.ProcessKeyboard(UP, deltaTime);
+            movement |= 1u << UP;
         if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-            camera.ProcessKeyboard(DOWN, deltaTime);
+            movement |= 1u << DOWN;
         if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS)
-            camera.ProcessKeyboard(PITCH_UP, deltaTime);
+            movement |= 1u << PITCH_UP;
         if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS)
-            camera.ProcessKeyboard(PITCH_DOWN, deltaTime);
+            movement |= 1u << PITCH_DOWN;
         if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS)
-            camera.ProcessKeyboard(YAW_LEFT, deltaTime);
+            movement |= 1u << YAW_LEFT;
         if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
-            camera.ProcessKeyboard(YAW_RIGHT, deltaTime);
+            movement |= 1u << YAW_RIGHT;
         if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS)
-            camera.ProcessKeyboard(ROLL_LEFT, deltaTime);
+            movement |= 1u << ROLL_LEFT;
         if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
-            camera.ProcessKeyboard(ROLL_RIGHT, deltaTime);
+            movement |= 1u << ROLL_RIGHT;
 
         // 当按下键1时，切换Blinn-Phong着色模式
         if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS) {
@@ -187,37 +396,99 @@ public:
         else {
             blinnKeyPressed = false;
         }
-    }
 
-    // 获取投影矩阵
-    const glm::mat4 getProjectionMatrix() {
-        return this->projection;
-    }
+        // 当按下键2时，切换前向渲染/延迟渲染
+        if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS) {
+            if (!deferredKeyPressed) {
+                deferred = !deferred;
+                deferredKeyPressed = true;
+                cout << (deferred ? "deferred shading" : "forward shading") << endl;
+            }
+        }
+        else {
+            deferredKeyPressed = false;
+        }
 
-    // 获取视图矩阵
-    glm::mat4 getViewMatrix() {
-        return this->view;
+        // 当按下键3时，开启/关闭深度预渲染
+        if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS) {
+            if (!depthPrepassKeyPressed) {
+                depthPrepass = !depthPrepass;
+                depthPrepassKeyPressed = true;
+                cout << "depth prepass " << (depthPrepass ? "on" : "off") << endl;
+            }
+        }
+        else {
+            depthPrepassKeyPressed = false;
+        }
+
+        // 当按下键4时，开启/关闭遮挡剔除
+        if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS) {
+            if (!occlusionCullingKeyPressed) {
+                occlusionCulling = !occlusionCulling;
+                occlusionCullingKeyPressed = true;
+                cout << "occlusion culling " << (occlusionCulling ? "on" : "off") << endl;
+            }
+        }
+        else {
+            occlusionCullingKeyPressed = false;
+        }
+
+        // 当按下键5时，开启/关闭泛光
+        if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS) {
+            if (!bloomKeyPressed) {
+                bloom = !bloom;
+                bloomKeyPressed = true;
+                cout << "bloom " << (bloom ? "on" : "off") << endl;
+            }
+        }
+        else {
+            bloomKeyPressed = false;
+        }
+
+        // 当按下键6时，开启/关闭性能分析
+        if (glfwGetKey(window, GLFW_KEY_6) == GLFW_PRESS) {
+            if (!profilerKeyPressed) {
+                profiler = !profiler;
+                profilerKeyPressed = true;
+                cout << "profiler " << (profiler ? "on" : "off") << endl;
+            }
+        }
+        else {
+            profilerKeyPressed = false;
+        }
+
+        // 当按下键7时，输出按类别统计的常驻显存
+        if (glfwGetKey(window, GLFW_KEY_7) == GLFW_PRESS) {
+            if (!memoryReportKeyPressed) {
+                memoryReportKeyPressed = true;
+                GpuMemoryLedger::instance().printReport();
+            }
+        }
+        else {
+            memoryReportKeyPressed = false;
+        }
+        return movement;
     }
 
 public:
-    // 投影矩阵
-    glm::mat4 projection;
-    // 视图矩阵
-    glm::mat4 view;
-    // 摄像机
-    static Camera camera;
-    // 屏幕宽度
+    // 默认的屏幕宽度
     static const unsigned int SCR_WIDTH = 800;
-    // 屏幕高度
+    // 默认的屏幕高度
     static const unsigned int SCR_HEIGHT = 600;
     // 窗口对象
     GLFWwindow* window;
 private:
+    // 窗口原来的标题
+    std::string title;
 
     // 经过的时间
-    float timeElapsed;
+    float timeElapsed = 0.0f;
+    // 经过的这段时间内更新线程的总耗时（毫秒）
+    double updateTimeElapsed = 0.0;
+    // 上一帧开始的时间，只用于统计帧率，模拟由模拟时钟推进
+    float lastFrame = 0.0f;
     // 帧计数
-    int frameCount;
+    int frameCount = 0;
 
     // 上一次鼠标的X坐标
     static float lastX;
@@ -225,11 +496,10 @@ private:
     static float lastY;
     // 是否第一次鼠标移动
     static bool firstMouse;
-
-    // 时间间隔
-    static float deltaTime;
-    // 上一帧的时间
-    static float lastFrame;
+    // 上一次采集输入以来累计的鼠标移动
+    static glm::vec2 mouseOffset;
+    // 上一次采集输入以来累计的滚轮滚动
+    static float scrollOffset;
 };
 
 #endif
\ No newline at end of file